@@ -0,0 +1,192 @@
+/*
+bench_fakechip.c
+Public Domain
+
+Toggle rate, read rate and alert latency of lgpio on the fake gpiochip
+from wiringPi/test, so it runs on any Linux box. GPIO 19 is wired to
+GPIO 26 on the fake chip. The numbers include the emulator's own cost,
+compare them with each other and with wiringPi's bench, not with a Pi.
+It also counts how often lgpio's alert thread wakes while the alerts
+sit idle, with and without a watchdog armed.
+
+gcc -Wall -o bench_fakechip bench_fakechip.c -llgpio -lpthread
+
+make -C ../../../wiringPi/test libfakegpiochip.so
+
+FAKE_GPIOCHIP_LOOPBACK=19:26 \
+   LD_PRELOAD=../../../wiringPi/test/libfakegpiochip.so ./bench_fakechip
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <dirent.h>
+#include <sched.h>
+#include <time.h>
+
+#include <lgpio.h>
+
+#define OUT 19
+#define IN 26
+#define LOOPS 100000
+#define EDGES 2000
+
+static volatile int edges;
+static volatile int64_t edgeAt;
+
+static int64_t nanos(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+
+   return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int cmp64(const void *a, const void *b)
+{
+   int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+
+   return (x > y) - (x < y);
+}
+
+static void report(const char *name, int count, int64_t ns)
+{
+   printf("%-32s %8d in %8.1f ms -> %10.0f /s, %7.0f ns each\n",
+      name, count, ns / 1e6, count * 1e9 / ns, (double)ns / count);
+}
+
+static long wakeups(void)
+{
+   /* context switches of lgpio's alert thread */
+
+   DIR *dir;
+   struct dirent *d;
+   FILE *f;
+   char path[300], line[128];
+   long n, total = 0;
+
+   dir = opendir("/proc/self/task");
+   if (dir == NULL) return -1;
+
+   while ((d = readdir(dir)) != NULL)
+   {
+      if (d->d_name[0] == '.') continue;
+
+      snprintf(path, sizeof(path), "/proc/self/task/%s/status", d->d_name);
+
+      if ((f = fopen(path, "r")) == NULL) continue;
+
+      if (fgets(line, sizeof(line), f) && strstr(line, "lgAlert"))
+      {
+         while (fgets(line, sizeof(line), f))
+         {
+            if (sscanf(line, "voluntary_ctxt_switches: %ld", &n) == 1)
+               total += n;
+         }
+      }
+
+      fclose(f);
+   }
+
+   closedir(dir);
+
+   return total;
+}
+
+static void idle(const char *name)
+{
+   long before = wakeups();
+
+   sleep(1);
+
+   printf("%-32s %8ld wakeups in 1 s\n", name, wakeups() - before);
+}
+
+static void alerts(int e, lgGpioAlert_p evt, void *data)
+{
+   int64_t now = nanos();
+   int i;
+
+   for (i=0; i<e; i++)
+   {
+      if (evt[i].report.flags == 0)
+      {
+         edgeAt = now;
+         __atomic_add_fetch(&edges, 1, __ATOMIC_RELEASE);
+      }
+   }
+}
+
+int main(int argc, char *argv[])
+{
+   static int64_t latency[EDGES];
+   int h, i, value = 0;
+   int64_t start, t0;
+
+   h = lgGpiochipOpen(0);
+
+   if (h < 0)
+   {
+      printf("can't open gpiochip 0 (%s)\n", lguErrorText(h));
+      return 1;
+   }
+
+   if ((lgGpioClaimOutput(h, 0, OUT, 0) != LG_OKAY) ||
+       (lgGpioClaimInput(h, 0, IN) != LG_OKAY))
+   {
+      printf("can't claim GPIO %d and %d\n", OUT, IN);
+      return 1;
+   }
+
+   start = nanos();
+   for (i=0; i<LOOPS; i++) lgGpioWrite(h, OUT, i & 1);
+   report("lgGpioWrite toggle", LOOPS, nanos() - start);
+
+   start = nanos();
+   for (i=0; i<LOOPS; i++) value += lgGpioRead(h, IN);
+   report("lgGpioRead", LOOPS, nanos() - start);
+
+   /* alert latency: from the write that makes the edge to the callback */
+
+   lgGpioWrite(h, OUT, 0);
+   lgGpioFree(h, IN);
+   lgGpioSetAlertsFunc(h, IN, alerts, NULL);
+
+   if (lgGpioClaimAlert(h, 0, LG_BOTH_EDGES, IN, -1) != LG_OKAY)
+   {
+      printf("can't claim GPIO %d for alerts\n", IN);
+      return 1;
+   }
+
+   start = nanos();
+   for (i=0; i<EDGES; i++)
+   {
+      t0 = nanos();
+      lgGpioWrite(h, OUT, (i & 1) ? 0 : 1);
+      while ((__atomic_load_n(&edges, __ATOMIC_ACQUIRE) <= i) &&
+             (nanos() - t0 < 1000000000)) sched_yield();
+      latency[i] = edgeAt - t0;
+   }
+   report("edge -> alert round trip", EDGES, nanos() - start);
+
+   qsort(latency, EDGES, sizeof(latency[0]), cmp64);
+
+   printf("alert latency [us]: min %.1f, median %.1f, p90 %.1f, "
+      "p99 %.1f, max %.1f (%d edges seen)\n",
+      latency[0] / 1000.0, latency[EDGES / 2] / 1000.0,
+      latency[(EDGES * 9) / 10] / 1000.0, latency[(EDGES * 99) / 100] / 1000.0,
+      latency[EDGES - 1] / 1000.0, edges);
+
+   idle("idle alert thread");
+
+   lgGpioSetWatchdog(h, IN, 100000);
+   lgGpioWrite(h, OUT, 1);
+   idle("idle with 100 ms watchdog");
+   lgGpioSetWatchdog(h, IN, 0);
+
+   lgGpiochipClose(h);
+
+   return value < 0;
+}
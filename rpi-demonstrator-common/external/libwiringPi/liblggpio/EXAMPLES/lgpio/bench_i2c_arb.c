@@ -0,0 +1,457 @@
+/*
+bench_i2c_arb.c
+Public Domain
+
+Throughput and behaviour of lgpio's I2C bus arbiter on a fake adapter,
+so it runs on any Linux box. open() and ioctl() are replaced below:
+/dev/i2c-N is /dev/null and the adapter has register file devices at
+0x48 and 0x49, while 0x4A never answers. Reads of more than 2 bytes
+fail part way through the transfer. Every I2C_RDWR transfer takes
+100 us of "bus time".
+
+Four threads read words from the same device, first directly and then
+through the arbiter, which merges their reads into shared transfers.
+Then it checks that writes are never merged after a write or replayed,
+that a failing device only fails its own requests, that higher priority
+requests go first, and that stopping the arbiter completes the queue.
+
+gcc -Wall -o bench_i2c_arb bench_i2c_arb.c -llgpio -lpthread
+
+./bench_i2c_arb
+*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+
+#include <lgpio.h>
+
+#define BUS 1
+#define DEV0 0x48
+#define DEV1 0x49
+#define DEAD 0x4A
+#define THREADS 4
+#define READS 500
+#define BUS_US 100
+
+static uint8_t regs[2][256];
+static uint8_t ptr[2];
+static int slave[1024];
+
+static pthread_mutex_t busMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t busCond = PTHREAD_COND_INITIALIZER;
+static int held;
+
+static int transfers, smbus, writes;
+static int failures;
+
+/* the fake adapter */
+
+int open(const char *path, int flags, ...)
+{
+   va_list ap;
+   int mode;
+
+   va_start(ap, flags);
+   mode = (flags & O_CREAT) ? va_arg(ap, int) : 0;
+   va_end(ap);
+
+   if (strncmp(path, "/dev/i2c-", 9) == 0) path = "/dev/null";
+
+   return syscall(SYS_openat, AT_FDCWD, path, flags, mode);
+}
+
+static int fakeRdwr(struct i2c_rdwr_ioctl_data *rdwr)
+{
+   struct i2c_msg *msg;
+   unsigned i;
+   int d, k;
+
+   pthread_mutex_lock(&busMutex);
+
+   while (held) pthread_cond_wait(&busCond, &busMutex);
+
+   transfers++;
+
+   for (i=0; i<rdwr->nmsgs; i++)
+   {
+      msg = &rdwr->msgs[i];
+      d = msg->addr - DEV0;
+
+      if ((d < 0) || (d > 1) || ((msg->flags & I2C_M_RD) && (msg->len > 2)))
+      {
+         pthread_mutex_unlock(&busMutex);
+         errno = ENXIO;
+         return -1;
+      }
+
+      if (msg->flags & I2C_M_RD)
+      {
+         for (k=0; k<msg->len; k++) msg->buf[k] = regs[d][ptr[d]++];
+      }
+      else if (msg->len)
+      {
+         ptr[d] = msg->buf[0];
+         for (k=1; k<msg->len; k++) regs[d][ptr[d]++] = msg->buf[k];
+         if (msg->len > 1) writes++;
+      }
+   }
+
+   usleep(BUS_US);
+
+   pthread_mutex_unlock(&busMutex);
+
+   return rdwr->nmsgs;
+}
+
+static int fakeSmbus(int fd, struct i2c_smbus_ioctl_data *sm)
+{
+   int d = slave[fd] - DEV0;
+   uint8_t c = sm->command;
+
+   if ((d < 0) || (d > 1))
+   {
+      errno = ENXIO;
+      return -1;
+   }
+
+   pthread_mutex_lock(&busMutex);
+
+   smbus++;
+
+   if (sm->size == I2C_SMBUS_BYTE_DATA)
+   {
+      if (sm->read_write == I2C_SMBUS_READ) sm->data->byte = regs[d][c];
+      else regs[d][c] = sm->data->byte;
+   }
+   else if (sm->size == I2C_SMBUS_WORD_DATA)
+   {
+      if (sm->read_write == I2C_SMBUS_READ)
+         sm->data->word = regs[d][c] | (regs[d][(uint8_t)(c + 1)] << 8);
+      else
+      {
+         regs[d][c] = sm->data->word & 0xFF;
+         regs[d][(uint8_t)(c + 1)] = sm->data->word >> 8;
+      }
+   }
+
+   usleep(BUS_US);
+
+   pthread_mutex_unlock(&busMutex);
+
+   return 0;
+}
+
+int ioctl(int fd, unsigned long request, ...)
+{
+   va_list ap;
+   void *arg;
+
+   va_start(ap, request);
+   arg = va_arg(ap, void *);
+   va_end(ap);
+
+   switch (request)
+   {
+      case I2C_SLAVE:
+         if ((unsigned)fd < 1024) slave[fd] = (long)arg;
+         return 0;
+
+      case I2C_FUNCS:
+         *(unsigned long *)arg = I2C_FUNC_I2C | I2C_FUNC_SMBUS_EMUL;
+         return 0;
+
+      case I2C_RDWR:
+         return fakeRdwr(arg);
+
+      case I2C_SMBUS:
+         return fakeSmbus(fd, arg);
+   }
+
+   return syscall(SYS_ioctl, fd, request, arg);
+}
+
+static void holdBus(int hold)
+{
+   pthread_mutex_lock(&busMutex);
+   held = hold;
+   pthread_cond_broadcast(&busCond);
+   pthread_mutex_unlock(&busMutex);
+}
+
+/* the bench */
+
+static void check(const char *what, int ok)
+{
+   printf("   %-50s %s\n", what, ok ? "ok" : "FAILED");
+
+   if (!ok) failures++;
+}
+
+static int h[THREADS];
+static int readErrors;
+
+static void *reader(void *x)
+{
+   int t = (long)x;
+   int i;
+
+   for (i=0; i<READS; i++)
+   {
+      if (lgI2cReadWordData(h[t], 2 * t) != (t * 0x0101))
+         __atomic_add_fetch(&readErrors, 1, __ATOMIC_RELAXED);
+   }
+
+   return NULL;
+}
+
+static double readers(void)
+{
+   pthread_t pth[THREADS];
+   struct timespec t0, t1;
+   long t;
+
+   clock_gettime(CLOCK_MONOTONIC, &t0);
+
+   for (t=0; t<THREADS; t++) pthread_create(&pth[t], NULL, reader, (void *)t);
+   for (t=0; t<THREADS; t++) pthread_join(pth[t], NULL);
+
+   clock_gettime(CLOCK_MONOTONIC, &t1);
+
+   return (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1E9;
+}
+
+#define ASYNC 64
+
+static int order[ASYNC], completed, statuses[ASYNC];
+
+static void done(int status, void *userdata)
+{
+   int id = (long)userdata;
+
+   statuses[id] = status;
+   order[__atomic_fetch_add(&completed, 1, __ATOMIC_RELAXED)] = id;
+}
+
+static void *releaser(void *x)
+{
+   (void)x;
+
+   usleep(50000);
+   holdBus(0);
+
+   return NULL;
+}
+
+int main(void)
+{
+   lgI2cArbStats_t st;
+   lgI2cMsg_t segs[ASYNC][2];
+   uint8_t ptrs[ASYNC], bufs[ASYNC][2];
+   pthread_t pth;
+   double secs;
+   int hDead, i, t, ok;
+
+   for (t=0; t<THREADS; t++)
+   {
+      regs[0][2 * t] = t;
+      regs[0][2 * t + 1] = t;
+      h[t] = lgI2cOpen(BUS, DEV0, 0);
+   }
+
+   hDead = lgI2cOpen(BUS, DEAD, 0);
+
+   /* merging */
+
+   printf("%d threads reading words from one device:\n", THREADS);
+
+   transfers = smbus = readErrors = 0;
+   secs = readers();
+   printf("   direct    %5d SMBus calls %5d transfers  %7.0f reads/s\n",
+      smbus, transfers, THREADS * READS / secs);
+   check("direct reads correct", readErrors == 0);
+
+   lgI2cArbiterStart(BUS, LG_I2C_DEFAULT_MERGE);
+
+   transfers = smbus = readErrors = 0;
+   secs = readers();
+   printf("   arbiter   %5d SMBus calls %5d transfers  %7.0f reads/s\n",
+      smbus, transfers, THREADS * READS / secs);
+   check("arbitrated reads correct", readErrors == 0);
+   check("reads merged into fewer transfers", transfers < THREADS * READS);
+
+   lgI2cArbiterStats(BUS, &st);
+   printf("   %.1f requests per transfer, %.0f us mean wait, %.0f%% busy\n",
+      (double)st.requests / st.transfers, st.wait_ns / 1E3 / st.requests,
+      st.busy_ns * 100.0 / st.elapsed_ns);
+
+   /* writes to one device queued together, then reads of the same */
+
+   printf("\nqueued writes and reads to one device:\n");
+
+   holdBus(1);
+   transfers = writes = completed = 0;
+
+   for (i=0; i<16; i++)
+   {
+      ptrs[i] = 0x80 + i;
+      bufs[i][0] = 0x80 + i;
+      bufs[i][1] = i;
+
+      if (i < 8)
+      {
+         segs[i][0] = (lgI2cMsg_t){DEV1, 0, 2, bufs[i]};
+         lgI2cSubmit(h[0], segs[i], 1, done, (void *)(long)i);
+      }
+      else
+      {
+         segs[i][0] = (lgI2cMsg_t){DEV1, 0, 1, &ptrs[i - 8]};
+         segs[i][1] = (lgI2cMsg_t){DEV1, I2C_M_RD, 1, &bufs[i][1]};
+         lgI2cSubmit(h[0], segs[i], 2, done, (void *)(long)i);
+      }
+   }
+
+   holdBus(0);
+
+   while (__atomic_load_n(&completed, __ATOMIC_RELAXED) < 16) usleep(1000);
+
+   printf("   16 requests in %d transfers\n", transfers);
+   check("each write ends its transfer", transfers >= 8);
+   check("reads after the last write merged", transfers <= 9);
+   for (ok=1, i=8; i<16; i++) ok &= (bufs[i][1] == i - 8);
+   check("reads see the writes", ok);
+
+   /* failure isolation */
+
+   printf("\na device which doesn't answer:\n");
+
+   holdBus(1);
+   transfers = completed = 0;
+
+   for (i=0; i<12; i++)
+   {
+      /* reads of 0x48 around reads of 0x4A */
+
+      ptrs[i] = 0;
+      segs[i][0] = (lgI2cMsg_t){((i >= 4) && (i < 8)) ? DEAD : DEV0, 0, 1, &ptrs[i]};
+      segs[i][1] = (lgI2cMsg_t){segs[i][0].addr, I2C_M_RD, 2, bufs[i]};
+      lgI2cSubmit((segs[i][0].addr == DEAD) ? hDead : h[1], segs[i], 2, done,
+         (void *)(long)i);
+   }
+
+   holdBus(0);
+
+   while (__atomic_load_n(&completed, __ATOMIC_RELAXED) < 12) usleep(1000);
+
+   for (ok=1, i=0; i<12; i++)
+      ok &= ((segs[i][0].addr == DEAD) ? (statuses[i] < 0) : (statuses[i] == 2));
+   check("only the dead device's reads failed", ok);
+   check("requests to different devices not merged", transfers >= 3);
+
+   printf("\na merged transfer failing after a write:\n");
+
+   holdBus(1);
+   writes = completed = 0;
+
+   /* a read to keep the arbiter busy, then a read and a write + read */
+
+   lgI2cSubmit(h[1], segs[0], 2, done, (void *)0L);
+   usleep(10000);
+
+   lgI2cSubmit(h[1], segs[1], 2, done, (void *)1L);
+
+   bufs[2][0] = 0x10;
+   bufs[2][1] = 0x55;
+   segs[2][0] = (lgI2cMsg_t){DEV0, 0, 2, bufs[2]};
+   segs[2][1] = (lgI2cMsg_t){DEV0, I2C_M_RD, 3, bufs[3]};
+   lgI2cSubmit(h[1], segs[2], 2, done, (void *)2L);
+
+   holdBus(0);
+
+   while (__atomic_load_n(&completed, __ATOMIC_RELAXED) < 3) usleep(1000);
+
+   check("the whole merged transfer failed", (statuses[1] < 0) && (statuses[2] < 0));
+   check("its write was not replayed", writes == 1);
+
+   /* priority */
+
+   printf("\npriorities:\n");
+
+   lgI2cSetPriority(h[2], 0);
+   lgI2cSetPriority(h[3], 3);
+
+   holdBus(1);
+   completed = 0;
+
+   for (i=0; i<ASYNC; i++)
+   {
+      ptrs[i] = 0;
+      segs[i][0] = (lgI2cMsg_t){DEV0, 0, 1, &ptrs[i]};
+      segs[i][1] = (lgI2cMsg_t){DEV0, I2C_M_RD, 2, bufs[i]};
+   }
+
+   /* the first is taken by the arbiter and waits for the bus */
+
+   lgI2cSubmit(h[2], segs[0], 2, done, (void *)0L);
+   usleep(10000);
+
+   for (i=1; i<ASYNC; i++)
+      lgI2cSubmit(h[(i & 1) ? 2 : 3], segs[i], 2, done, (void *)(long)i);
+
+   holdBus(0);
+
+   while (__atomic_load_n(&completed, __ATOMIC_RELAXED) < ASYNC) usleep(1000);
+
+   for (ok=1, i=1; i<=ASYNC/2 - 1; i++) ok &= ((order[i] & 1) == 0);
+   check("priority 3 requests before priority 0", ok);
+   for (ok=1, i=2; i<ASYNC; i++)
+   {
+      if (((order[i] & 1) == (order[i-1] & 1)) && (order[i] < order[i-1]))
+         ok = 0;
+   }
+   check("in order within a priority", ok);
+
+   lgI2cSetPriority(h[3], 0);
+
+   /* stop */
+
+   printf("\nstopping with requests queued:\n");
+
+   holdBus(1);
+   completed = 0;
+
+   for (i=0; i<ASYNC; i++)
+   {
+      statuses[i] = 0;
+      lgI2cSubmit(h[i & 3], segs[i], 2, done, (void *)(long)i);
+   }
+
+   pthread_create(&pth, NULL, releaser, NULL);
+
+   check("lgI2cArbiterStop", lgI2cArbiterStop(BUS) == 0);
+   check("all queued requests completed", completed == ASYNC);
+   for (ok=1, i=0; i<ASYNC; i++) ok &= (statuses[i] == 2);
+   check("all succeeded", ok);
+   check("submit without an arbiter refused",
+      lgI2cSubmit(h[0], segs[0], 2, done, NULL) == LG_NO_I2C_ARBITER);
+
+   pthread_join(pth, NULL);
+
+   for (t=0; t<THREADS; t++) lgI2cClose(h[t]);
+   lgI2cClose(hDead);
+
+   printf("\n%s\n", failures ? "FAILED" : "all ok");
+
+   return failures ? 1 : 0;
+}
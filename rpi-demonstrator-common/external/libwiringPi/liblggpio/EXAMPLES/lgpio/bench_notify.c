@@ -0,0 +1,210 @@
+/*
+bench_notify.c
+Public Domain
+
+Delivery of alerts through a pipe notification and through a shared
+memory notification, on the fake gpiochip from wiringPi/test. GPIO 19
+is wired to GPIO 26 and toggled in short bursts while a reader thread
+takes the reports off the notification. It shows how many reports
+arrive, how many the reader knows it lost, how many vanished without
+a trace, how many arrive per wakeup of the reader, and the reader's
+CPU time per report. The slow runs make the reader sleep after each
+wakeup with a small pipe or ring, so that reports are lost.
+
+gcc -Wall -o bench_notify bench_notify.c -llgpio -lpthread
+
+make -C ../../../wiringPi/test libfakegpiochip.so
+
+FAKE_GPIOCHIP_LOOPBACK=19:26 \
+   LD_PRELOAD=../../../wiringPi/test/libfakegpiochip.so ./bench_notify
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <lgpio.h>
+
+#define OUT 19
+#define IN 26
+#define EDGES 100000
+#define BURST 16
+#define BATCH 256
+
+static volatile int done;
+static int slow;
+
+static uint64_t delivered, lost, wakeups;
+static int64_t readerNanos;
+
+static int h, nfy, pipeFd, memFd, evFd;
+static lgNotifyRing_p ring;
+
+static int64_t threadNanos(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+
+   return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void *pipeReader(void *arg)
+{
+   lgGpioReport_t rep[BATCH];
+   struct pollfd pfd;
+   int n;
+
+   pfd.fd = pipeFd;
+   pfd.events = POLLIN;
+
+   while (1)
+   {
+      if (poll(&pfd, 1, 100) <= 0)
+      {
+         if (done) break;
+         continue;
+      }
+
+      n = read(pipeFd, rep, sizeof(rep));
+
+      if (n > 0)
+      {
+         delivered += n / sizeof(lgGpioReport_t);
+         wakeups++;
+         if (slow) usleep(slow);
+      }
+   }
+
+   readerNanos = threadNanos();
+
+   return NULL;
+}
+
+static void *ringReader(void *arg)
+{
+   lgGpioReport_t rep[BATCH];
+   uint64_t seq = 0;
+   int n;
+
+   while (1)
+   {
+      if (lgNotifyRingWait(ring, evFd, seq, 100) <= 0)
+      {
+         if (done) break;
+         continue;
+      }
+
+      wakeups++;
+
+      while ((n = lgNotifyRingRead(ring, &seq, rep, BATCH, &lost)) > 0)
+         delivered += n;
+
+      if (slow) usleep(slow);
+   }
+
+   readerNanos = threadNanos();
+
+   return NULL;
+}
+
+static void run(const char *name, void *(*reader)(void *))
+{
+   pthread_t t;
+   lgAlertStats_t st;
+   int i;
+
+   delivered = lost = wakeups = 0;
+   done = 0;
+
+   lgGpioClaimAlert(h, 0, LG_BOTH_EDGES, IN, nfy);
+   lgGpioSetAlertDepth(h, IN, LG_MAX_ALERT_DEPTH);
+
+   pthread_create(&t, NULL, reader, NULL);
+
+   for (i=0; i<EDGES; i++)
+   {
+      lgGpioWrite(h, OUT, i & 1);
+
+      /* let the alert thread keep up with the fake chip's event queue */
+      if ((i % BURST) == (BURST - 1)) usleep(50);
+   }
+
+   usleep(300000); /* let the alert thread catch up */
+
+   lgGpioGetAlertStats(h, IN, &st);
+
+   done = 1;
+   pthread_join(t, NULL);
+
+   lgGpioFree(h, IN);
+
+   printf("%-10s %7llu edges, %7llu delivered, %6llu known lost, "
+      "%6llu vanished, %6.1f per wakeup, %6.1f ns reader cpu each\n",
+      name, (unsigned long long)st.events, (unsigned long long)delivered,
+      (unsigned long long)lost,
+      (unsigned long long)(st.events - st.dropped - delivered - lost),
+      wakeups ? (double)delivered / wakeups : 0.0,
+      delivered ? (double)readerNanos / delivered : 0.0);
+}
+
+int main(int argc, char *argv[])
+{
+   char name[512];
+
+   h = lgGpiochipOpen(0);
+
+   if (h < 0)
+   {
+      printf("can't open gpiochip 0 (%s)\n", lguErrorText(h));
+      return 1;
+   }
+
+   lgGpioClaimOutput(h, 0, OUT, 0);
+
+   for (slow=0; slow<=2000; slow+=2000)
+   {
+      /* pipe notification, a single page for the slow reader */
+
+      nfy = lgNotifyOpenWithSize(slow ? 4096 : 0);
+
+      if (nfy < 0)
+      {
+         printf("can't open a pipe notification (%s)\n", lguErrorText(nfy));
+         return 1;
+      }
+
+      snprintf(name, sizeof(name), "%s/.lgd-nfy%d", lguGetWorkDir(), nfy);
+
+      pipeFd = open(name, O_RDONLY | O_NONBLOCK);
+
+      run(slow ? "pipe slow" : "pipe", pipeReader);
+
+      close(pipeFd);
+      lgNotifyClose(nfy);
+
+      /* shared memory notification, as many slots as the page holds */
+
+      nfy = lgNotifyOpenRing(slow ? 4096 / sizeof(lgGpioReport_t) : 0);
+
+      if ((nfy < 0) || (lgNotifyRingFds(nfy, &memFd, &evFd) < 0) ||
+          ((ring = lgNotifyRingMap(memFd)) == NULL))
+      {
+         printf("can't open a ring notification\n");
+         return 1;
+      }
+
+      run(slow ? "ring slow" : "ring", ringReader);
+
+      lgNotifyRingUnmap(ring);
+      lgNotifyClose(nfy);
+   }
+
+   lgGpiochipClose(h);
+
+   return 0;
+}
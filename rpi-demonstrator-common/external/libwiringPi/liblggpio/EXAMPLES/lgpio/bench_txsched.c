@@ -0,0 +1,255 @@
+/*
+bench_txsched.c
+Public Domain
+
+Cost and edge jitter of lgpio's software timed PWM as the number of
+busy GPIO grows from 1 to 50, on the fake gpiochip from wiringPi/test.
+GPIO 19 is one of the pulsed GPIO and is wired to GPIO 26, whose alerts
+timestamp every rising edge. Jitter is how far each period strays from
+the nominal one. Cost is the CPU time used by lgpio's tx thread and by
+the whole process per second of PWM. The lines are claimed one by one
+(one line request each) and then as a single group, where edges that
+fall due together can go out in one write.
+
+gcc -Wall -o bench_txsched bench_txsched.c -llgpio -lpthread
+
+make -C ../../../wiringPi/test libfakegpiochip.so
+
+FAKE_GPIOCHIP_LOOPBACK=19:26 \
+   LD_PRELOAD=../../../wiringPi/test/libfakegpiochip.so ./bench_txsched
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <dirent.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include <lgpio.h>
+
+#define PROBE 19
+#define IN 26
+#define MAX_GPIO 50
+#define MAX_EDGES 4096
+
+#define PWM_HZ 500
+#define SERVO_HZ 50
+#define SERVO_US 1500
+
+static volatile int rises;
+static uint64_t riseAt[MAX_EDGES];
+
+static int gpios[MAX_GPIO];
+
+static int cmpDbl(const void *a, const void *b)
+{
+   double x = *(const double *)a, y = *(const double *)b;
+
+   return (x > y) - (x < y);
+}
+
+static int64_t cpuNanos(void)
+{
+   struct rusage ru;
+
+   getrusage(RUSAGE_SELF, &ru);
+
+   return ((int64_t)ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000000 +
+      ((int64_t)ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1000;
+}
+
+static int64_t txNanos(void)
+{
+   /* CPU time of lgpio's tx thread */
+
+   DIR *dir;
+   struct dirent *d;
+   FILE *f;
+   char path[300], line[128];
+   long long ns;
+   int64_t total = -1;
+
+   dir = opendir("/proc/self/task");
+   if (dir == NULL) return -1;
+
+   while ((d = readdir(dir)) != NULL)
+   {
+      if (d->d_name[0] == '.') continue;
+
+      snprintf(path, sizeof(path), "/proc/self/task/%s/comm", d->d_name);
+
+      if ((f = fopen(path, "r")) == NULL) continue;
+
+      if (fgets(line, sizeof(line), f) && (strncmp(line, "lgTx", 4) == 0))
+      {
+         fclose(f);
+
+         snprintf(path, sizeof(path),
+            "/proc/self/task/%s/schedstat", d->d_name);
+
+         if ((f = fopen(path, "r")) == NULL) continue;
+
+         if (fscanf(f, "%lld", &ns) == 1) total = ns;
+      }
+
+      fclose(f);
+   }
+
+   closedir(dir);
+
+   return total;
+}
+
+static void alerts(int e, lgGpioAlert_p evt, void *data)
+{
+   int i;
+
+   for (i=0; i<e; i++)
+   {
+      if ((evt[i].report.flags == 0) && (evt[i].report.level == 1) &&
+          (rises < MAX_EDGES))
+      {
+         riseAt[rises] = evt[i].report.timestamp;
+         __atomic_add_fetch(&rises, 1, __ATOMIC_RELEASE);
+      }
+   }
+}
+
+static int start(int h, int n, int servo)
+{
+   int i, s;
+
+   for (i=0; i<n; i++)
+   {
+      if (servo) s = lgTxServo(h, gpios[i], SERVO_US, SERVO_HZ, 0, 0);
+      else s = lgTxPwm(h, gpios[i], PWM_HZ, 25, 0, 0);
+
+      if (s < 0) return s;
+   }
+
+   return LG_OKAY;
+}
+
+static void stop(int h, int n, int servo)
+{
+   int i;
+
+   for (i=0; i<n; i++)
+   {
+      if (servo) lgTxServo(h, gpios[i], 0, SERVO_HZ, 0, 0);
+      else lgTxPwm(h, gpios[i], 0, 0, 0, 0);
+   }
+}
+
+static void measure(int h, int n, int servo, const char *lines)
+{
+   static double dev[MAX_EDGES];
+   double period, seconds, sum = 0;
+   int64_t cpu, tx;
+   int i, count;
+
+   period = servo ? 1e9 / SERVO_HZ : 1e9 / PWM_HZ;
+   seconds = servo ? 2.0 : 1.0;
+
+   if (start(h, n, servo) != LG_OKAY)
+   {
+      printf("can't start %d GPIO\n", n);
+      return;
+   }
+
+   usleep(200000); /* let it settle */
+
+   cpu = cpuNanos();
+   tx = txNanos();
+   rises = 0;
+
+   usleep(seconds * 1000000);
+
+   count = __atomic_load_n(&rises, __ATOMIC_ACQUIRE);
+   cpu = cpuNanos() - cpu;
+   if (tx >= 0) tx = txNanos() - tx;
+
+   stop(h, n, servo);
+
+   for (i=1; i<count; i++)
+   {
+      dev[i-1] = abs((int)((int64_t)(riseAt[i] - riseAt[i-1]) - period));
+      sum += dev[i-1];
+   }
+
+   count--;
+
+   if (count < 2)
+   {
+      printf("%-6s %-8s %3d GPIO: no edges seen\n",
+         servo ? "servo" : "pwm", lines, n);
+      return;
+   }
+
+   qsort(dev, count, sizeof(dev[0]), cmpDbl);
+
+   printf("%-6s %-8s %3d GPIO: tx %6.2f%% cpu %6.2f%%, "
+      "jitter [us] mean %6.1f p50 %6.1f p99 %7.1f max %7.1f (%d periods)\n",
+      servo ? "servo" : "pwm", lines, n,
+      tx >= 0 ? tx / (seconds * 1e7) : -1.0, cpu / (seconds * 1e7),
+      sum / count / 1000.0, dev[count / 2] / 1000.0,
+      dev[(count * 99) / 100] / 1000.0, dev[count - 1] / 1000.0, count);
+}
+
+int main(int argc, char *argv[])
+{
+   static const int steps[] = {1, 2, 5, 10, 20, 50};
+   int levels[MAX_GPIO] = {0};
+   int h, i, g, n, servo;
+
+   h = lgGpiochipOpen(0);
+
+   if (h < 0)
+   {
+      printf("can't open gpiochip 0 (%s)\n", lguErrorText(h));
+      return 1;
+   }
+
+   /* the probe first, then any line but the probe's input */
+
+   gpios[0] = PROBE;
+
+   for (i=1, g=0; i<MAX_GPIO; g++)
+   {
+      if ((g != PROBE) && (g != IN)) gpios[i++] = g;
+   }
+
+   lgGpioSetAlertsFunc(h, IN, alerts, NULL);
+
+   if (lgGpioClaimAlert(h, 0, LG_RISING_EDGE, IN, -1) != LG_OKAY)
+   {
+      printf("can't claim GPIO %d for alerts\n", IN);
+      return 1;
+   }
+
+   for (servo=0; servo<2; servo++)
+   {
+      for (i=0; i<sizeof(steps)/sizeof(steps[0]); i++)
+      {
+         n = steps[i];
+
+         for (g=0; g<n; g++) lgGpioClaimOutput(h, 0, gpios[g], 0);
+         measure(h, n, servo, "single");
+         for (g=0; g<n; g++) lgGpioFree(h, gpios[g]);
+
+         if (lgGroupClaimOutput(h, 0, n, gpios, levels) != LG_OKAY)
+         {
+            printf("can't claim a group of %d GPIO\n", n);
+            continue;
+         }
+         measure(h, n, servo, "group");
+         lgGroupFree(h, gpios[0]);
+      }
+   }
+
+   lgGpiochipClose(h);
+
+   return 0;
+}
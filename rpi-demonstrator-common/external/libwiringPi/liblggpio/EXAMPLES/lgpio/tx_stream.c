@@ -0,0 +1,107 @@
+/*
+tx_stream.c
+Public Domain
+
+Streams a frequency sweep on a GPIO for a few seconds. The wave is
+generated on the fly into a ring of four buffers, each refilled as
+soon as its eventfd completion arrives, so it may run for as long as
+wanted without copying pulses or polling lgTxRoom.
+
+gcc -Wall -o tx_stream tx_stream.c -llgpio
+
+./tx_stream [seconds]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <poll.h>
+
+#include <lgpio.h>
+
+#define OUT 20
+
+#define BUFS 4
+#define PULSES 256
+
+lgPulse_t ring[BUFS][PULSES];
+
+int halfPeriod = 1000;
+int step = -5;
+
+int fill(lgPulse_p pulses)
+{
+   int i;
+
+   /* a square wave sweeping between 100 Hz and 5 kHz */
+
+   for (i=0; i<PULSES; i++)
+   {
+      pulses[i].bits = (i & 1) ? 0 : 1;
+      pulses[i].mask = 1;
+      pulses[i].delay = halfPeriod;
+
+      if (i & 1)
+      {
+         halfPeriod += step;
+         if ((halfPeriod <= 100) || (halfPeriod >= 5000)) step = -step;
+      }
+   }
+
+   return PULSES;
+}
+
+int main(int argc, char *argv[])
+{
+   lgPulse_p bufs[BUFS];
+   struct pollfd pfd;
+   uint64_t done;
+   double start, secs = 5.0;
+   int h, efd, i, next = 0, sent = 0;
+
+   if (argc > 1) secs = atof(argv[1]);
+
+   for (i=0; i<BUFS; i++) bufs[i] = ring[i];
+
+   h = lgGpiochipOpen(0);
+
+   if (h < 0) { printf("ERROR: %s (%d)\n", lguErrorText(h), h); return 1; }
+
+   efd = lgTxStreamOpen(h, OUT, BUFS, bufs);
+
+   if (efd < 0)
+   {
+      printf("ERROR: %s (%d)\n", lguErrorText(efd), efd);
+      return 1;
+   }
+
+   for (next=0; next<BUFS; next++)
+      lgTxStreamPut(h, OUT, fill(bufs[next]));
+
+   start = lguTime();
+
+   pfd.fd = efd;
+   pfd.events = POLLIN;
+
+   while ((lguTime() - start) < secs)
+   {
+      if (poll(&pfd, 1, 1000) <= 0) continue;
+
+      if (read(efd, &done, sizeof(done)) != sizeof(done)) continue;
+
+      while (done--)
+      {
+         lgTxStreamPut(h, OUT, fill(bufs[next++ % BUFS]));
+         sent++;
+      }
+   }
+
+   lgTxStreamClose(h, OUT);
+
+   printf("%d buffers (%d pulses) streamed in %.1f seconds\n",
+      sent, sent * PULSES, lguTime() - start);
+
+   lgGpiochipClose(h);
+
+   return 0;
+}
@@ -0,0 +1,208 @@
+/*
+bench_batch.c
+Public Domain
+
+GPIO writes per second through rgpiod, one command per round trip
+and in batches. The batches are sent one at a time, pipelined with
+several in flight, and without replies. The last runs repeat the
+pipelined batches from several clients at once, each with its own
+connection, to exercise rgpiod's pool of worker threads.
+
+gcc -Wall -o bench_batch bench_batch.c -lrgpio -lpthread
+
+./bench_batch [clients]
+
+It may be run against rgpiod on the fake gpiochip from wiringPi/test
+
+make -C ../../../wiringPi/test libfakegpiochip.so
+
+LD_PRELOAD=../../../wiringPi/test/libfakegpiochip.so rgpiod -l &
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include <lgpio.h>
+#include <rgpio.h>
+
+#define OUT 21
+#define WRITES 20000
+#define BATCH 200
+#define IN_FLIGHT 8
+
+typedef struct
+{
+   int sbc;
+   int h;
+   int gpio;
+   int errors;
+} client_t;
+
+static int status[BATCH];
+
+static int single(client_t *c)
+{
+   int i;
+
+   for (i=0; i<WRITES; i++)
+      if (gpio_write(c->sbc, c->h, c->gpio, i & 1) < 0) c->errors++;
+
+   return WRITES;
+}
+
+static int collect(client_t *c, int b)
+{
+   int i, n;
+
+   n = batch_collect(c->sbc, b, status, BATCH);
+
+   if (n < 0) return c->errors++;
+
+   for (i=0; i<n; i++) if (status[i] < 0) c->errors++;
+
+   return n;
+}
+
+static int batched(client_t *c, int inFlight, int flags)
+{
+   int sent[IN_FLIGHT];
+   int i, j, b;
+
+   for (i=0; i<WRITES/BATCH; i++)
+   {
+      batch_begin(c->sbc);
+
+      for (j=0; j<BATCH; j++) gpio_write(c->sbc, c->h, c->gpio, j & 1);
+
+      /* collect the oldest batch once enough are in flight */
+
+      if ((i >= inFlight) && !(flags & BATCH_NO_REPLY))
+         collect(c, sent[i % inFlight]);
+
+      b = batch_send(c->sbc, flags);
+
+      if (b < 0) c->errors++;
+
+      sent[i % inFlight] = b;
+   }
+
+   if (!(flags & BATCH_NO_REPLY))
+   {
+      for (i=(WRITES/BATCH > inFlight ? WRITES/BATCH - inFlight : 0);
+           i<WRITES/BATCH; i++) collect(c, sent[i % inFlight]);
+   }
+   else
+   {
+      /* a command with a reply follows the batches, wait for it */
+
+      gpio_read(c->sbc, c->h, c->gpio);
+   }
+
+   return WRITES;
+}
+
+static void *pipelined(void *x)
+{
+   batched(x, IN_FLIGHT, 0);
+
+   return NULL;
+}
+
+static int clientOpen(client_t *c, int gpio)
+{
+   c->sbc = rgpiod_start(NULL, NULL);
+
+   if (c->sbc < 0) return c->sbc;
+
+   c->h = gpiochip_open(c->sbc, 0);
+
+   if (c->h < 0) return c->h;
+
+   c->gpio = gpio;
+   c->errors = 0;
+
+   return gpio_claim_output(c->sbc, c->h, 0, gpio, 0);
+}
+
+static void clientClose(client_t *c)
+{
+   gpiochip_close(c->sbc, c->h);
+   rgpiod_stop(c->sbc);
+}
+
+static void report(const char *name, int writes, double secs, int errors)
+{
+   printf("%-28s %8.0f writes per second (%d errors)\n",
+      name, writes / secs, errors);
+}
+
+int main(int argc, char *argv[])
+{
+   client_t c, *many;
+   pthread_t *thr;
+   char name[64];
+   double t0;
+   int i, n, clients = 4, errors;
+
+   if (argc > 1) clients = atoi(argv[1]);
+
+   if (clientOpen(&c, OUT) < 0)
+   {
+      printf("can't claim GPIO %d through rgpiod\n", OUT);
+      return 1;
+   }
+
+   t0 = lgu_time();
+   n = single(&c);
+   report("one per round trip", n, lgu_time() - t0, c.errors);
+
+   c.errors = 0;
+   t0 = lgu_time();
+   n = batched(&c, 1, 0);
+   report("batches of 200", n, lgu_time() - t0, c.errors);
+
+   c.errors = 0;
+   t0 = lgu_time();
+   n = batched(&c, IN_FLIGHT, 0);
+   report("batches of 200, 8 in flight", n, lgu_time() - t0, c.errors);
+
+   c.errors = 0;
+   t0 = lgu_time();
+   n = batched(&c, 1, BATCH_NO_REPLY);
+   report("batches of 200, no replies", n, lgu_time() - t0, c.errors);
+
+   clientClose(&c);
+
+   /* several clients, each on a GPIO of its own */
+
+   many = calloc(clients, sizeof(client_t));
+   thr = calloc(clients, sizeof(pthread_t));
+
+   for (i=0; i<clients; i++)
+   {
+      if (clientOpen(&many[i], OUT + 1 + i) < 0)
+      {
+         printf("can't connect client %d\n", i);
+         return 1;
+      }
+   }
+
+   t0 = lgu_time();
+
+   for (i=0; i<clients; i++)
+      pthread_create(&thr[i], NULL, pipelined, &many[i]);
+
+   for (i=0, errors=0; i<clients; i++)
+   {
+      pthread_join(thr[i], NULL);
+      errors += many[i].errors;
+   }
+
+   snprintf(name, sizeof(name), "%d clients, 8 in flight", clients);
+   report(name, clients * WRITES, lgu_time() - t0, errors);
+
+   for (i=0; i<clients; i++) clientClose(&many[i]);
+
+   return 0;
+}
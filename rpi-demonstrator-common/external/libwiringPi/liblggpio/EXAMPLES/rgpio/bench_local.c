@@ -0,0 +1,147 @@
+/*
+bench_local.c
+Public Domain
+
+GPIO writes and reads per second through rgpiod from a client on the
+same host, connected over TCP, over rgpiod's unix domain socket, and
+over the unix domain socket with a shared memory command ring. Each
+call waits for its status, so the rate is one round trip per call.
+The last run writes from several threads sharing the connection.
+
+gcc -Wall -o bench_local bench_local.c -lrgpio -lpthread
+
+./bench_local [socket path] [threads]
+
+It may be run against rgpiod on the fake gpiochip from wiringPi/test,
+polling the command ring for a millisecond after each command
+
+make -C ../../../wiringPi/test libfakegpiochip.so
+
+LD_PRELOAD=../../../wiringPi/test/libfakegpiochip.so \
+   rgpiod -l -u /tmp/rgpiod.sock -b 1000 &
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include <lgpio.h>
+#include <rgpio.h>
+
+#define OUT 21
+#define CALLS 20000
+
+typedef struct
+{
+   int sbc;
+   int h;
+   int gpio;
+   int errors;
+} client_t;
+
+static void *writer(void *x)
+{
+   client_t *c = x;
+   int i;
+
+   for (i=0; i<CALLS; i++)
+      if (gpio_write(c->sbc, c->h, c->gpio, i & 1) < 0) c->errors++;
+
+   return NULL;
+}
+
+static void run(const char *name, int sbc, int threads)
+{
+   client_t c[16];
+   pthread_t thr[16];
+   double t0, writeSecs, readSecs;
+   int i, errors = 0;
+
+   for (i=0; i<threads; i++)
+   {
+      c[i].sbc = sbc;
+      c[i].h = gpiochip_open(sbc, 0);
+      c[i].gpio = OUT + i;
+      c[i].errors = 0;
+
+      if (gpio_claim_output(sbc, c[i].h, 0, c[i].gpio, 0) < 0)
+      {
+         printf("can't claim GPIO %d through rgpiod\n", c[i].gpio);
+         return;
+      }
+   }
+
+   t0 = lgu_time();
+
+   for (i=0; i<threads; i++) pthread_create(&thr[i], NULL, writer, &c[i]);
+
+   for (i=0; i<threads; i++)
+   {
+      pthread_join(thr[i], NULL);
+      errors += c[i].errors;
+   }
+
+   writeSecs = lgu_time() - t0;
+
+   t0 = lgu_time();
+
+   for (i=0; i<CALLS; i++)
+      if (gpio_read(sbc, c[0].h, c[0].gpio) < 0) errors++;
+
+   readSecs = lgu_time() - t0;
+
+   printf("%-26s %8.0f writes %8.0f reads per second (%d errors)\n",
+      name, threads * CALLS / writeSecs, CALLS / readSecs, errors);
+
+   for (i=0; i<threads; i++) gpiochip_close(sbc, c[i].h);
+}
+
+int main(int argc, char *argv[])
+{
+   const char *path = "/tmp/rgpiod.sock";
+   char name[64];
+   int sbc, s, threads = 4;
+
+   if (argc > 1) path = argv[1];
+   if (argc > 2) threads = atoi(argv[2]);
+   if (threads < 1) threads = 1;
+   if (threads > 16) threads = 16;
+
+   sbc = rgpiod_start(NULL, NULL);
+
+   if (sbc < 0)
+   {
+      printf("can't connect to rgpiod over TCP (%s)\n", lgu_error_text(sbc));
+      return 1;
+   }
+
+   run("tcp", sbc, 1);
+   rgpiod_stop(sbc);
+
+   sbc = rgpiod_start(path, NULL);
+
+   if (sbc < 0)
+   {
+      printf("can't connect to %s (%s)\n", path, lgu_error_text(sbc));
+      return 1;
+   }
+
+   run("unix socket", sbc, 1);
+
+   s = rgpiod_shm_start(sbc);
+
+   if (s < 0)
+   {
+      printf("can't start the command ring (%s)\n", lgu_error_text(s));
+      return 1;
+   }
+
+   run("command ring", sbc, 1);
+
+   snprintf(name, sizeof(name), "command ring, %d threads", threads);
+   run(name, sbc, threads);
+
+   rgpiod_stop(sbc);
+
+   return 0;
+}
@@ -0,0 +1,119 @@
+/*
+bench_script.c
+Public Domain
+
+Script instructions per second executed by rgpiod. Each script loops
+p0 times over a few instructions: arithmetic on the accumulator and
+a variable, GPIO writes, and a subroutine call. The loop count is
+doubled until a run takes long enough to time.
+
+gcc -Wall -o bench_script bench_script.c -lrgpio
+
+./bench_script
+
+It may be run against rgpiod on the fake gpiochip from wiringPi/test
+
+make -C ../../../wiringPi/test libfakegpiochip.so
+
+LD_PRELOAD=../../../wiringPi/test/libfakegpiochip.so rgpiod -l &
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <lgpio.h>
+#include <rgpio.h>
+
+typedef struct
+{
+   const char *name;
+   const char *text;
+   int setup;  // instructions run once
+   int body;   // instructions run each time round the loop
+} bench_t;
+
+static bench_t bench[]=
+{
+   {"arithmetic",
+    "ld v0 p0 tag 1 lda v0 add 3 and 255 xor v0 dcr v0 jnz 1",
+    1, 6},
+
+   {"gpio writes",
+    "go 0 sta v1 gso v1 21 ld v0 p0 "
+    "tag 1 gw v1 21 1 gw v1 21 0 dcr v0 jnz 1 gc v1",
+    5, 4},
+
+   {"call and return",
+    "ld v0 p0 tag 1 call 2 dcr v0 jnz 1 halt tag 2 inra ret",
+    2, 5},
+};
+
+static double run(int sbc, int h, uint32_t loops)
+{
+   uint32_t par[10];
+   double t0;
+   int s;
+
+   t0 = lgu_time();
+
+   if (script_run(sbc, h, 1, &loops) < 0) return -1.0;
+
+   do
+   {
+      usleep(1000);
+      s = script_status(sbc, h, par);
+   }
+   while ((s == LG_SCRIPT_READY) || (s == LG_SCRIPT_RUNNING));
+
+   if (s != LG_SCRIPT_ENDED) return -1.0;
+
+   return lgu_time() - t0;
+}
+
+int main(int argc, char *argv[])
+{
+   int sbc, h, i;
+   uint32_t loops;
+   double secs;
+
+   sbc = rgpiod_start(NULL, NULL);
+
+   if (sbc < 0)
+   {
+      printf("can't connect to rgpiod (%s)\n", lgu_error_text(sbc));
+      return 1;
+   }
+
+   for (i=0; i<sizeof(bench)/sizeof(bench[0]); i++)
+   {
+      h = script_store(sbc, bench[i].text);
+
+      if (h < 0)
+      {
+         printf("can't store %s script (%s)\n",
+            bench[i].name, lgu_error_text(h));
+         continue;
+      }
+
+      while (script_status(sbc, h, NULL) == LG_SCRIPT_INITING) usleep(1000);
+
+      for (loops=1000; loops<(1<<30); loops*=2)
+      {
+         secs = run(sbc, h, loops);
+
+         if ((secs < 0) || (secs > 0.5)) break;
+      }
+
+      if (secs < 0) printf("%-16s failed\n", bench[i].name);
+      else
+         printf("%-16s %12.0f instructions per second\n", bench[i].name,
+            (bench[i].setup + (double)bench[i].body * loops) / secs);
+
+      script_delete(sbc, h);
+   }
+
+   rgpiod_stop(sbc);
+
+   return 0;
+}
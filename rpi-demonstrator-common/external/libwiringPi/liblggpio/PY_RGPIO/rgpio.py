@@ -141,6 +141,8 @@ tx_room                   See if more room for tx on a GPIO or group
 
 gpio_set_debounce_micros  Sets the debounce time for a GPIO
 gpio_set_watchdog_micros  Sets the watchdog time for a GPIO
+gpio_set_alert_depth      Sets the alert queue depth for a GPIO
+gpio_get_alert_stats      Gets the alert queue statistics for a GPIO
 
 callback                  Starts a GPIO callback
 
@@ -345,6 +347,8 @@ _CMD_GWDOG = 30
 _CMD_GIC = 31
 _CMD_GIL = 32
 _CMD_GMODE = 33
+_CMD_GADEP = 34
+_CMD_GASTA = 35
 _CMD_I2CO = 40
 _CMD_I2CC = 41
 _CMD_I2CRD = 42
@@ -513,6 +517,8 @@ BAD_PWM_FREQ = -102
 BAD_PWM_DUTY = -103
 GPIO_NOT_AN_OUTPUT = -104
 INVALID_GROUP_ALERT = -105
+BAD_ALERT_DEPTH = -106
+NOT_AN_ALERT = -107
 
 # rgpiod error text
 
@@ -623,6 +629,8 @@ _errors=[
    [BAD_PWM_DUTY,  "bad PWM dutycycle"],
    [GPIO_NOT_AN_OUTPUT,  "GPIO not set as an output"],
    [INVALID_GROUP_ALERT,  "can not set a group to alert"],
+   [BAD_ALERT_DEPTH,  "bad alert queue depth"],
+   [NOT_AN_ALERT,  "GPIO not claimed for alerts"],
 ]
 
 _except_a = "############################################################\n{}"
@@ -2007,6 +2015,52 @@ class sbc():
       ext = [struct.pack("III", handle&0xffff, gpio, watchdog_micros)]
       return _u2i(_lg_command_ext(self.sl, _CMD_GWDOG, 12, ext, L=3))
 
+   def gpio_set_alert_depth(self, handle, gpio, depth):
+      """
+      This sets the size of the alert queue for a GPIO.
+
+      handle:= >= 0 (as returned by [*gpiochip_open*]).
+        gpio:= the GPIO to be configured.
+       depth:= 1-65536 alerts.
+
+      If OK returns 0.
+
+      On failure returns a negative error code.
+
+      The depth is rounded up to a power of 2 and takes effect the
+      next time the GPIO is claimed for alerts.  The default is 1024.
+      """
+      ext = [struct.pack("III", handle&0xffff, gpio, depth)]
+      return _u2i(_lg_command_ext(self.sl, _CMD_GADEP, 12, ext, L=3))
+
+   def gpio_get_alert_stats(self, handle, gpio):
+      """
+      This returns the alert queue statistics for a GPIO.
+
+      handle:= >= 0 (as returned by [*gpiochip_open*]).
+        gpio:= the GPIO claimed for alerts.
+
+      If OK returns a list of okay status, alerts generated,
+      alerts dropped because the queue was full, queue depth,
+      alerts queued, and the most alerts queued at once.
+
+      On failure returns a negative error code.
+      """
+      bytes = CMD_INTERRUPTED
+      ext = [struct.pack("II", handle&0xffff, gpio)]
+      with self.sl.l:
+         bytes = u2i(
+            _lg_command_ext_nolock(self.sl, _CMD_GASTA, 8, ext, L=2))
+         if bytes > 0:
+            rdata = self._rxbuf(bytes)
+            events, dropped, depth, queued, high_water = struct.unpack(
+               "<QQIII", rdata)
+            bytes = OKAY
+         else:
+            events, dropped, depth, queued, high_water = 0, 0, 0, 0, 0
+      return _u2i_list(
+         [bytes, events, dropped, depth, queued, high_water])
+
 
    def gpio_claim_alert(
       self, handle, gpio, eFlags, lFlags=0, notify_handle=None):
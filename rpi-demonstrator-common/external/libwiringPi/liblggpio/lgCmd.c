@@ -92,6 +92,8 @@ cmdInfo_t cmdInfo[]=
 
    {LG_CMD_GDEB,  "GDEB",  101, 0, 1}, // lgGpioSetDebounce
    {LG_CMD_GWDOG, "GWDOG", 101, 0, 1}, // lgGpioSetWatchdog
+   {LG_CMD_GADEP, "GADEP", 101, 0, 1}, // lgGpioSetAlertDepth
+   {LG_CMD_GASTA, "GASTA", 101, 12, 0}, // lgGpioGetAlertStats
 
    /* I2C */
 
@@ -571,6 +573,7 @@ int cmdParse(char *text, cmdCtl_p ctlP, lgCmd_p cmdP, int cmdBufSize)
                break;
 
             case LG_CMD_FR:    // h v
+            case LG_CMD_GASTA: // h g
             case LG_CMD_GGR:   // h g
             case LG_CMD_GIL:   // h g
             case LG_CMD_GMODE: // h g
@@ -593,6 +596,7 @@ int cmdParse(char *text, cmdCtl_p ctlP, lgCmd_p cmdP, int cmdBufSize)
                valid = cmdScanf(text, ctlP, cmdP, "II", &matches);
                break;
                               
+            case LG_CMD_GADEP: // h g v
             case LG_CMD_GDEB:  // h g v
             case LG_CMD_GROOM: // h g t
             case LG_CMD_GBUSY: // h g t
@@ -976,7 +980,7 @@ int cmdParseScript(char *script, cmdScript_t *s, int diags)
 
       if (idx >= 0)
       {
-         fprintf(stderr, "cmd=%d size=%d a0=%d a1=%d a2=%d a3=%d\n",
+         LG_DBG(LG_DEBUG_SCRIPT, "cmd=%d size=%d a0=%d a1=%d a2=%d a3=%d",
             cmdP->cmd, cmdP->size, arg[0], arg[1], arg[2], arg[3]);
          if (cmdP->size)
          {
@@ -68,6 +68,45 @@ typedef struct
    uint16_t shorts;
 } lgCmd_t, *lgCmd_p;
 
+/*
+A shared memory command ring lets a client on the same host as rgpiod
+submit commands without a system call. The client fills the slot at
+its head and marks it submitted. rgpiod executes the slots in order,
+stores each status and marks the slot done. The client then marks it
+free again. A client which sleeps on a slot or'ds LG_SHM_WAITING into
+its state and waits on the state as a futex.
+*/
+
+#define LG_SHM_MAGIC 0x6c67736d /* ASCII lgsm */
+
+#define LG_SHM_SLOTS   64
+#define LG_SHM_MAX_EXT 48
+
+#define LG_SHM_FREE      0
+#define LG_SHM_SUBMITTED 1
+#define LG_SHM_DONE      2
+#define LG_SHM_WAITING   4
+
+typedef struct
+{
+   uint32_t state;
+   int32_t  status;
+   uint16_t cmd;
+   uint16_t size;
+   uint16_t longs;
+   uint16_t pad;
+   uint8_t  ext[LG_SHM_MAX_EXT];
+} lgShmSlot_t, *lgShmSlot_p;
+
+typedef struct
+{
+   uint32_t magic;
+   uint32_t slots;
+   uint32_t polling; /* rgpiod is polling, the doorbell needn't be rung */
+   uint32_t pad[13];
+   lgShmSlot_t slot[LG_SHM_SLOTS];
+} lgShmRing_t, *lgShmRing_p;
+
 typedef struct
 {
    int    eaten;
@@ -70,3 +70,12 @@ lgCtx_p lgCtxGet(void)
    return ctx;
 }
 
+void lgCtxSet(lgCtx_p ctx)
+{
+   pthread_once(&xInited, xInit);
+
+   // worker threads serve many clients, each with its own context
+
+   pthread_setspecific(slgGlobalKey, ctx);
+}
+
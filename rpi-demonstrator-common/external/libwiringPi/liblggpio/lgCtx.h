@@ -57,5 +57,7 @@ typedef struct lgCtx_s
 
 lgCtx_p lgCtxGet(void);
 
+void lgCtxSet(lgCtx_p ctx);
+
 #endif
 
@@ -141,6 +141,16 @@ static xErrInfo_t xErrInfo[]=
    {LG_BAD_PWM_DUTY,  "bad PWM dutycycle"},
    {LG_GPIO_NOT_AN_OUTPUT,  "GPIO not set as an output"},
    {LG_INVALID_GROUP_ALERT,  "can not set a group to alert"},
+   {LG_BAD_ALERT_DEPTH,  "bad alert queue depth"},
+   {LG_NOT_AN_ALERT,  "GPIO not claimed for alerts"},
+   {LG_BAD_TX_STREAM,  "bad tx stream buffer or pulse count"},
+   {LG_NO_TX_STREAM,  "no tx stream open on GPIO"},
+   {LG_BAD_NOTIFY_RING,  "bad notification ring size"},
+   {LG_NOT_A_NOTIFY_RING,  "not a shared memory notification"},
+   {LG_BAD_BATCH,  "bad command in a batch"},
+   {LG_BATCH_TOO_BIG,  "batch replies too large"},
+   {LG_SHM_NOT_LOCAL,  "command ring needs a local socket"},
+   {LG_NO_I2C_ARBITER,  "no arbiter on I2C bus"},
 };
 
 const char *lguErrorText(int error)
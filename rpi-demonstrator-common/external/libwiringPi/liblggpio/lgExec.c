@@ -570,6 +570,7 @@ int lgExecCmd(lgCmd_p cmdP, int cmdBufSize)
    lgCtx_p Ctx;
    lgLineInfo_t lInfo;
    lgChipInfo_t cInfo;
+   lgAlertStats_t aStats;
    res = LG_OKAY;
    char *cmdExt=(char*)&cmdP[1];
    uint32_t *argI=(uint32_t*)&cmdP[1];
@@ -583,7 +584,7 @@ int lgExecCmd(lgCmd_p cmdP, int cmdBufSize)
 
    if (Ctx->owner == 0)
    {
-      Ctx->owner = ++xPid;
+      Ctx->owner = __atomic_add_fetch(&xPid, 1, __ATOMIC_RELAXED);
 
       /* set default user if no preset user */
       if (!strlen(Ctx->user))
@@ -967,6 +968,27 @@ int lgExecCmd(lgCmd_p cmdP, int cmdBufSize)
          res = lgGpioSetWatchdog(argI[0], argI[1], argI[2]);
          break;
 
+      case LG_CMD_GADEP:
+         // handle gpio depth
+         res = lgGpioSetAlertDepth(argI[0], argI[1], argI[2]);
+         break;
+
+      case LG_CMD_GASTA:
+         // in: handle gpio
+         // out: eventsQ droppedQ depth queued high_water
+         res = lgGpioGetAlertStats(argI[0], argI[1], &aStats);
+         if (res == LG_OKAY)
+         {
+            argQ[0] = aStats.events;
+            argQ[1] = aStats.dropped;
+            argI[4] = aStats.depth;
+            argI[5] = aStats.queued;
+            argI[6] = aStats.high_water;
+            res = 28;
+            cmdP->size = res;
+         }
+         break;
+
       case LG_CMD_GSI:
          // handle gpio
          res = lgGpioClaimInput(argI[0],       0, argI[1]);
@@ -54,8 +54,6 @@ For more information, please refer to <http://unlicense.org/>
 #define LG_CHIP_BIT_ALERT  (1<<2)
 #define LG_CHIP_BIT_GROUP  (1<<3)
 
-void xWrite(lgChipObj_p chip, int gpio, int value);
-
 callbk_t lgGpioSamplesFunc = NULL;
 void *lgGpioSamplesUserdata = NULL;
 
@@ -335,7 +333,6 @@ static int xSetAsFree(lgChipObj_p chip, int gpio)
    lgLineInf_p GPIO;
    int i, g;
    lgTxRec_p pTx;
-   lgAlertRec_p pEvt;
 
    LG_DBG(LG_DEBUG_TRACE, "chip=*%p gpio=%d", (void*)chip, gpio);
 
@@ -356,17 +353,8 @@ static int xSetAsFree(lgChipObj_p chip, int gpio)
       LG_DBG(LG_DEBUG_ALLOC,
          "free alert GPIO: %d (mode %d)", gpio, GPIO->mode);
 
-      if ((pEvt = lgGpioGetAlertRec(chip, gpio)) != NULL)
-         pEvt->active = 0;
-
-      for (i=0; i<10; i++)
-      {
-         LG_DBG(LG_DEBUG_ALLOC, "waiting for inactive: %d", gpio);
-
-         usleep(200);
-
-         if ((pEvt = lgGpioGetAlertRec(chip, gpio)) == NULL) break;
-      }
+      /* returns once the alert thread has let go of the fd */
+      lgPthAlertCancel(chip, gpio);
 
       close(GPIO->fd);
 
@@ -390,14 +378,20 @@ static int xSetAsFree(lgChipObj_p chip, int gpio)
 
          if ((pTx = lgGpioGetTxRec(chip, g, LG_TX_PWM)) != NULL)
          {
-            pTx->active = 0;
-            LG_DBG(LG_DEBUG_ALLOC, "set PWM inactive: %d", gpio);
+            lgPthTxCancel(pTx);
+            LG_DBG(LG_DEBUG_ALLOC, "cancel PWM: %d", gpio);
          }
 
          if ((pTx = lgGpioGetTxRec(chip, g, LG_TX_WAVE)) != NULL)
          {
-            pTx->active = 0;
-            LG_DBG(LG_DEBUG_ALLOC, "set PWM inactive: %d", gpio);
+            lgPthTxCancel(pTx);
+            LG_DBG(LG_DEBUG_ALLOC, "cancel wave: %d", gpio);
+         }
+
+         if ((pTx = lgGpioGetTxRec(chip, g, LG_TX_STREAM)) != NULL)
+         {
+            lgPthTxCancel(pTx);
+            LG_DBG(LG_DEBUG_ALLOC, "cancel stream: %d", gpio);
          }
 
          lgPthTxUnlock();
@@ -574,7 +568,7 @@ static int xSetAsPwm(
       }
       else
       {
-         p->active = 0;
+         lgPthTxCancel(p);
       }
 
       lgPthTxUnlock();
@@ -585,8 +579,9 @@ static int xSetAsPwm(
 
       if ((micros_on + micros_off) > lgMinTxDelay)
       {
-         lgGpioCreateTxRec(
-            chip, gpio, micros_on, micros_off, micros_offset, cycles);
+         if (lgGpioCreateTxRec(
+            chip, gpio, micros_on, micros_off, micros_offset, cycles) == NULL)
+            return LG_NO_MEMORY;
          status = LG_TX_BUF - 1;
       }
       else return LG_BAD_PWM_MICROS;
@@ -654,48 +649,64 @@ static int xWave(
    {
       lgPthTxUnlock();
 
-      lgGroupCreateWaveRec(chip, gpio, count, pulsesTmp);
+      if (lgGroupCreateWaveRec(chip, gpio, count, pulsesTmp) == NULL)
+      {
+         free(pulsesTmp);
+         return LG_NO_MEMORY;
+      }
       status = LG_TX_BUF - 1;
    }
 
    return status;
 }
 
-void xWrite(lgChipObj_p chip, int gpio, int value)
+static int xStreamOpen(
+   lgChipObj_p chip, int gpio, int numBufs, lgPulse_p *bufs)
 {
    lgLineInf_p GPIO;
-   struct gpio_v2_line_values lv;
-   uint64_t m = 0;
+   lgTxRec_p p;
+   int zero = 0;
 
-   LG_DBG(LG_DEBUG_TRACE, "chip=*%p gpio=%d value=%d", (void*)chip, gpio, value);
+   LG_DBG(LG_DEBUG_TRACE, "chip=*%p gpio=%d", (void*)chip, gpio);
 
    GPIO = &chip->LineInf[gpio];
 
-   xSetBit(&m, GPIO->offset);
-   xAssignBit(GPIO->values_p, GPIO->offset, value);
+   if (!(GPIO->mode & LG_CHIP_BIT_OUTPUT))
+   {
+      /* not an output */
+      if (!(GPIO->mode & LG_CHIP_BIT_GROUP))
+      {
+         /* auto set output if a singleton */
+         xSetAsOutput(
+            chip, GPIO_V2_LINE_FLAG_OUTPUT, 1, &gpio, &zero);
+      }
+   }
 
-   lv.mask = m;
-   lv.bits = *GPIO->values_p;
+   if (!(GPIO->mode & LG_CHIP_BIT_OUTPUT)) return LG_GPIO_NOT_AN_OUTPUT;
 
-   ioctl(GPIO->fd, GPIO_V2_LINE_SET_VALUES_IOCTL, &lv);
+   lgPthTxLock();
+
+   p = lgGpioGetTxRec(chip, gpio, LG_TX_STREAM);
+
+   lgPthTxUnlock();
+
+   if (p != NULL) return LG_GPIO_BUSY;
+
+   p = lgGpioCreateStreamRec(chip, gpio, numBufs, bufs);
+
+   if (p == NULL) return LG_NO_MEMORY;
+
+   return p->event_fd;
 }
 
-void xGroupWrite(
-   lgChipObj_p chip, int gpio, uint64_t groupBits, uint64_t groupMask)
+void xGroupFlush(lgChipObj_p chip, int gpio, uint64_t groupMask)
 {
-   int i;
    lgLineInf_p GPIO;
    struct gpio_v2_line_values lv;
 
-   GPIO = &chip->LineInf[gpio];
+   /* writes the levels held in values_p for the lines in groupMask */
 
-   for (i=0; i<GPIO->group_size; i++)
-   {
-      if (groupMask & ((uint64_t)1<<i))
-      {
-         xAssignBit(GPIO->values_p, i, groupBits & (1<<i));
-      }
-   }
+   GPIO = &chip->LineInf[gpio];
 
    lv.mask = groupMask;
    lv.bits = *GPIO->values_p;
@@ -1082,7 +1093,6 @@ int lgGpioClaimAlert(
    uint64_t flags;
    uint32_t *offsets_p;
    lgChipObj_p chip;
-   lgAlertRec_p p;
    struct gpio_v2_line_request req;
    uint64_t *values_p;
 
@@ -1147,8 +1157,7 @@ int lgGpioClaimAlert(
                chip->LineInf[gpio].fd = req.fd;
                chip->LineInf[gpio].offset = 0;
 
-               if ((p = lgGpioGetAlertRec(chip, gpio)) != NULL)
-                  p->active= 0;
+               lgPthAlertCancel(chip, gpio);
 
                lgGpioCreateAlertRec(
                   chip, gpio, &chip->LineInf[gpio], nfyHandle);
@@ -1220,6 +1229,107 @@ int lgTxWave(int handle, int gpio, int count, lgPulse_p pulses)
    return status;
 }
 
+int lgTxStreamOpen(int handle, int gpio, int numBuffers, lgPulse_p *buffers)
+{
+   lgChipObj_p chip;
+   int i, status;
+
+   LG_DBG(LG_DEBUG_TRACE, "handle=%d gpio=%d numBuffers=%d",
+      handle, gpio, numBuffers);
+
+   if ((numBuffers < 1) || (numBuffers > LG_MAX_TX_STREAM_BUFS))
+      PARAM_ERROR(LG_BAD_TX_STREAM, "bad buffer count (%d)", numBuffers);
+
+   if (buffers == NULL)
+      PARAM_ERROR(LG_BAD_POINTER, "NULL buffers");
+
+   for (i=0; i<numBuffers; i++)
+   {
+      if (buffers[i] == NULL)
+         PARAM_ERROR(LG_BAD_POINTER, "NULL buffer (%d)", i);
+   }
+
+   status = lgHdlGetLockedObj(handle, LG_HDL_TYPE_GPIO, (void **)&chip);
+
+   if (status == LG_OKAY)
+   {
+      if (gpio < chip->lines)
+      {
+         status = xStreamOpen(chip, gpio, numBuffers, buffers);
+      }
+      else status = LG_BAD_GPIO_NUMBER;
+
+      lgHdlUnlock(handle);
+   }
+
+   return status;
+}
+
+int lgTxStreamPut(int handle, int gpio, int count)
+{
+   lgChipObj_p chip;
+   lgTxRec_p p;
+   int status;
+
+   LG_DBG(LG_DEBUG_TRACE, "handle=%d gpio=%d count=%d", handle, gpio, count);
+
+   if (count < 1)
+      PARAM_ERROR(LG_BAD_TX_STREAM, "bad pulse count (%d)", count);
+
+   status = lgHdlGetLockedObj(handle, LG_HDL_TYPE_GPIO, (void **)&chip);
+
+   if (status == LG_OKAY)
+   {
+      if (gpio < chip->lines)
+      {
+         lgPthTxLock();
+
+         if ((p = lgGpioGetTxRec(chip, gpio, LG_TX_STREAM)) != NULL)
+            status = lgPthTxStreamPut(p, count);
+         else
+            status = LG_NO_TX_STREAM;
+
+         lgPthTxUnlock();
+      }
+      else status = LG_BAD_GPIO_NUMBER;
+
+      lgHdlUnlock(handle);
+   }
+
+   return status;
+}
+
+int lgTxStreamClose(int handle, int gpio)
+{
+   lgChipObj_p chip;
+   lgTxRec_p p;
+   int status;
+
+   LG_DBG(LG_DEBUG_TRACE, "handle=%d gpio=%d", handle, gpio);
+
+   status = lgHdlGetLockedObj(handle, LG_HDL_TYPE_GPIO, (void **)&chip);
+
+   if (status == LG_OKAY)
+   {
+      if (gpio < chip->lines)
+      {
+         lgPthTxLock();
+
+         if ((p = lgGpioGetTxRec(chip, gpio, LG_TX_STREAM)) != NULL)
+            lgPthTxCancel(p);
+         else
+            status = LG_NO_TX_STREAM;
+
+         lgPthTxUnlock();
+      }
+      else status = LG_BAD_GPIO_NUMBER;
+
+      lgHdlUnlock(handle);
+   }
+
+   return status;
+}
+
 int lgTxBusy(int handle, int gpio, int kind)
 {
    lgChipObj_p chip;
@@ -1228,7 +1338,7 @@ int lgTxBusy(int handle, int gpio, int kind)
 
    LG_DBG(LG_DEBUG_TRACE, "handle=%d gpio=%d kind=%d", handle, gpio, kind);
 
-   if ((kind != LG_TX_PWM) && (kind != LG_TX_WAVE))
+   if ((kind != LG_TX_PWM) && (kind != LG_TX_WAVE) && (kind != LG_TX_STREAM))
       PARAM_ERROR(LG_BAD_TX_TYPE, "bad tx kind (%d)", kind);
 
    status = lgHdlGetLockedObj(handle, LG_HDL_TYPE_GPIO, (void **)&chip);
@@ -1239,8 +1349,9 @@ int lgTxBusy(int handle, int gpio, int kind)
       {
          lgPthTxLock();
 
-         if (((p = lgGpioGetTxRec(chip, gpio, kind)) != NULL) && p->active)
-            status = 1;
+         if ((p = lgGpioGetTxRec(chip, gpio, kind)) == NULL) status = 0;
+         else if (kind == LG_TX_STREAM) status = (p->buf_queued > 0);
+         else status = p->active;
 
          lgPthTxUnlock();
       }
@@ -1260,7 +1371,7 @@ int lgTxRoom(int handle, int gpio, int kind)
 
    LG_DBG(LG_DEBUG_TRACE, "handle=%d gpio=%d kind=%d", handle, gpio, kind);
 
-   if ((kind != LG_TX_PWM) && (kind != LG_TX_WAVE))
+   if ((kind != LG_TX_PWM) && (kind != LG_TX_WAVE) && (kind != LG_TX_STREAM))
       PARAM_ERROR(LG_BAD_TX_TYPE, "bad tx kind (%d)", kind);
 
    status = lgHdlGetLockedObj(handle, LG_HDL_TYPE_GPIO, (void **)&chip);
@@ -1271,7 +1382,14 @@ int lgTxRoom(int handle, int gpio, int kind)
       {
          lgPthTxLock();
 
-         if (((p = lgGpioGetTxRec(chip, gpio, kind)) != NULL) && p->active)
+         if (kind == LG_TX_STREAM)
+         {
+            if ((p = lgGpioGetTxRec(chip, gpio, kind)) != NULL)
+               status = p->num_bufs - p->buf_queued;
+            else
+               status = 0;
+         }
+         else if (((p = lgGpioGetTxRec(chip, gpio, kind)) != NULL) && p->active)
             status = LG_TX_BUF - p->entries;
          else
             status = LG_TX_BUF;
@@ -1560,7 +1678,6 @@ int lgGpioSetDebounce(int handle, int gpio, int debounce_us)
    int status;
    lgLineInf_p GPIO;
    lgChipObj_p chip;
-   lgAlertRec_p p;
 
    LG_DBG(LG_DEBUG_TRACE, "handle=%d gpio=%d debounce_us=%d",
       handle, gpio, debounce_us);
@@ -1578,8 +1695,7 @@ int lgGpioSetDebounce(int handle, int gpio, int debounce_us)
 
          GPIO->debounce_us = debounce_us;
 
-         if ((p = lgGpioGetAlertRec(chip, gpio)) != NULL)
-            p->debounce_nanos = debounce_us * 1e3;
+         lgPthAlertRefresh(chip, gpio);
       }
       else status = LG_BAD_GPIO_NUMBER;
 
@@ -1594,7 +1710,6 @@ int lgGpioSetWatchdog(int handle, int gpio, int watchdog_us)
    int status;
    lgLineInf_p GPIO;
    lgChipObj_p chip;
-   lgAlertRec_p p;
 
    LG_DBG(LG_DEBUG_TRACE, "handle=%d gpio=%d watchdog_us=%d",
       handle, gpio, watchdog_us);
@@ -1612,8 +1727,7 @@ int lgGpioSetWatchdog(int handle, int gpio, int watchdog_us)
 
          GPIO->watchdog_us = watchdog_us;
 
-         if ((p = lgGpioGetAlertRec(chip, gpio)) != NULL)
-            p->watchdog_nanos = watchdog_us * 1e3;
+         lgPthAlertRefresh(chip, gpio);
       }
       else status = LG_BAD_GPIO_NUMBER;
 
@@ -1623,6 +1737,56 @@ int lgGpioSetWatchdog(int handle, int gpio, int watchdog_us)
    return status;
 }
 
+int lgGpioSetAlertDepth(int handle, int gpio, int depth)
+{
+   int status;
+   lgChipObj_p chip;
+
+   LG_DBG(LG_DEBUG_TRACE, "handle=%d gpio=%d depth=%d",
+      handle, gpio, depth);
+
+   if ((depth < 1) || (depth > LG_MAX_ALERT_DEPTH))
+      PARAM_ERROR(LG_BAD_ALERT_DEPTH, "bad alert depth (%d)", depth);
+
+   status = lgHdlGetLockedObj(handle, LG_HDL_TYPE_GPIO, (void **)&chip);
+
+   if (status == LG_OKAY)
+   {
+      /* used by the next lgGpioClaimAlert */
+
+      if (gpio < chip->lines) chip->LineInf[gpio].alert_depth = depth;
+      else status = LG_BAD_GPIO_NUMBER;
+
+      lgHdlUnlock(handle);
+   }
+
+   return status;
+}
+
+int lgGpioGetAlertStats(int handle, int gpio, lgAlertStats_p stats)
+{
+   int status;
+   lgChipObj_p chip;
+
+   LG_DBG(LG_DEBUG_TRACE, "handle=%d gpio=%d stats=*%p",
+      handle, gpio, stats);
+
+   if (stats == NULL)
+      PARAM_ERROR(LG_BAD_POINTER, "stats=NULL");
+
+   status = lgHdlGetLockedObj(handle, LG_HDL_TYPE_GPIO, (void **)&chip);
+
+   if (status == LG_OKAY)
+   {
+      if (gpio < chip->lines) status = lgPthAlertStats(chip, gpio, stats);
+      else status = LG_BAD_GPIO_NUMBER;
+
+      lgHdlUnlock(handle);
+   }
+
+   return status;
+}
+
 int lgGpioSetAlertsFunc(
    int handle, int gpio, lgGpioAlertsFunc_t cbf, void *userdata)
 {
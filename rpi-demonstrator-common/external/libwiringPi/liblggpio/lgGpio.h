@@ -39,6 +39,7 @@ typedef struct lgLineInf_s
    int      fd;
    int      debounce_us;
    int      watchdog_us;
+   int      alert_depth;
    callbk_t alertFunc;
    void     *userdata;
    uint32_t offset;
@@ -59,9 +60,7 @@ typedef struct lgChipObj_s
    char userLabel[LG_GPIO_USER_LEN];
 } lgChipObj_t, *lgChipObj_p;
 
-void xWrite(lgChipObj_p chip, int gpio, int value);
-void xGroupWrite(
-   lgChipObj_p chip, int gpio, uint64_t groupBits, uint64_t groupMask);
+void xGroupFlush(lgChipObj_p chip, int gpio, uint64_t groupMask);
 
 extern callbk_t lgGpioSamplesFunc;
 extern void *lgGpioSamplesUserdata;
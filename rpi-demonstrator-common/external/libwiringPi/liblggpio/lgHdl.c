@@ -36,50 +36,64 @@ For more information, please refer to <http://unlicense.org/>
 #include "lgHdl.h"
 
 
-#define LG_HDL_FREE 0
-#define LG_HDL_RSVD 1
+/*
+A handle is a slot number with the slot's generation above it. The
+slot is found from the handle without any search and a handle left
+over from an earlier use of the slot no longer matches it. Handles
+are kept to 16 bits as rgpio places the gpiochip number above them.
+*/
+
+#define LG_HDL_SLOT_BITS 10
+#define LG_HDL_GEN_BITS   6
+
+#define LG_HDL_SLOTS (1 << LG_HDL_SLOT_BITS)
+#define LG_HDL_GENS  (1 << LG_HDL_GEN_BITS)
 
-#define LG_HDL_SLOTS 1024
+#define LG_HDL_SLOT(h) ((h) & (LG_HDL_SLOTS - 1))
+
+#define LG_HDL_NONE -1
 
 typedef struct
 {
    uint32_t magic;
-   int32_t first;
-   int32_t last;
+   int count;  // handles of type in use
+   int size;   // room in slots
+   int *slots; // slots in use by type, in no particular order
 } slgHdlTypeUsage_t;
 
 typedef struct
 {
+   int handle;             // handle using the slot, LG_HDL_NONE if free
+   int gen;                // generation of the slot's next handle
+   int nextFree;           // next slot on the free list
+   int typePos;            // position of slot in its type's slots
    char user[LG_USER_LEN]; // creator (defines permissions)
    void *obj;              // pointer to object
-   pthread_mutex_t mutex;  // access control
    int type;               // type of object, e.g. GPIO, file, etc.
-   int next;               // next handle of type
-   int previous;           // previous handle of type
    uint32_t magic;         // guard to check object of correct type
    callbk_t destructor;    // used to correctly free object resources
    int owner;              // id of owning thread
    int share;              // if object can be used by non-owners
-} lgHdlHdr_t, *lgHdlHdr_p;
-
-typedef struct
-{
-   lgHdlHdr_p header;
-   pthread_mutex_t mutex; // access control
-} lgHdl_t;
+   pthread_mutex_t mutex;  // access control
+} lgHdl_t, *lgHdl_p;
 
 static pthread_mutex_t slgHdlMutex = PTHREAD_MUTEX_INITIALIZER;
 
-lgHdl_t lgHdl[LG_HDL_SLOTS];
+static lgHdl_t lgHdl[LG_HDL_SLOTS];
+
+// slots are reused oldest freed first, which spaces out generations
+
+static int slgHdlFreeFirst;
+static int slgHdlFreeLast;
 
 static slgHdlTypeUsage_t slgHdlTypeUsage[]=
 {
-   {101442315, -1, -1}, {263997524, -1, -1}, {354388063, -1, -1},
-   {412249733, -1, -1}, {503487673, -1, -1}, {641332553, -1, -1},
-   {707085925, -1, -1}, {806156471, -1, -1}, {979542324, -1, -1},
-   {128752466, -1, -1}, {271619210, -1, -1}, {380943518, -1, -1},
-   {482972576, -1, -1}, {549545782, -1, -1}, {651826746, -1, -1},
-   {724133862, -1, -1}, {894093461, -1, -1}, {967000257, -1, -1},
+   {101442315, 0, 0, NULL}, {263997524, 0, 0, NULL}, {354388063, 0, 0, NULL},
+   {412249733, 0, 0, NULL}, {503487673, 0, 0, NULL}, {641332553, 0, 0, NULL},
+   {707085925, 0, 0, NULL}, {806156471, 0, 0, NULL}, {979542324, 0, 0, NULL},
+   {128752466, 0, 0, NULL}, {271619210, 0, 0, NULL}, {380943518, 0, 0, NULL},
+   {482972576, 0, 0, NULL}, {549545782, 0, 0, NULL}, {651826746, 0, 0, NULL},
+   {724133862, 0, 0, NULL}, {894093461, 0, 0, NULL}, {967000257, 0, 0, NULL},
 };
 
 static pthread_once_t xInited = PTHREAD_ONCE_INIT;
@@ -89,46 +103,78 @@ static void xInit(void)
    int i;
    for (i=0; i<LG_HDL_SLOTS; i++)
    {
-      lgHdl[i].header = NULL;
+      lgHdl[i].handle = LG_HDL_NONE;
+      lgHdl[i].nextFree = i + 1;
       pthread_mutex_init(&lgHdl[i].mutex, NULL);
    }
-}
 
+   lgHdl[LG_HDL_SLOTS-1].nextFree = -1;
 
-// return first available handle
+   slgHdlFreeFirst = 0;
+   slgHdlFreeLast = LG_HDL_SLOTS - 1;
+}
+
+// return the slot in use by handle, NULL if handle is not in use
 
-static int xHdlGet(void)
+static lgHdl_p xHdlFind(int handle)
 {
-   int handle;
-   int i;
+   lgHdl_p h;
 
-   handle = LG_NO_HANDLE;
+   if ((handle < 0) || (handle >= (LG_HDL_SLOTS * LG_HDL_GENS))) return NULL;
 
-   pthread_mutex_lock(&slgHdlMutex);
+   h = &lgHdl[LG_HDL_SLOT(handle)];
 
-   for (i=0; i<LG_HDL_SLOTS; i++)
+   if (__atomic_load_n(&h->handle, __ATOMIC_ACQUIRE) != handle) return NULL;
+
+   return h;
+}
+
+// add slot to the slots of type, called with slgHdlMutex held
+
+static int xTypeAdd(int type, int slot)
+{
+   slgHdlTypeUsage_t *t = &slgHdlTypeUsage[type];
+   int *slots;
+   int size;
+
+   if (t->count == t->size)
    {
-      if (lgHdl[i].header == LG_HDL_FREE)
-      {
-         lgHdl[i].header = (void *)LG_HDL_RSVD;
+      size = t->size ? t->size * 2 : 16;
 
-         handle = i;
+      slots = realloc(t->slots, size * sizeof(int));
 
-         break;
-      }
+      if (slots == NULL) return LG_NO_MEMORY;
+
+      t->slots = slots;
+      t->size = size;
    }
 
-   pthread_mutex_unlock(&slgHdlMutex);
+   lgHdl[slot].typePos = t->count;
+   t->slots[t->count++] = slot;
 
-   return handle;
+   return LG_OKAY;
+}
+
+// remove slot from the slots of type, called with slgHdlMutex held
+
+static void xTypeRemove(int type, int slot)
+{
+   slgHdlTypeUsage_t *t = &slgHdlTypeUsage[type];
+   int pos, last;
+
+   pos = lgHdl[slot].typePos;
+   last = t->slots[--t->count];
+
+   t->slots[pos] = last;
+   lgHdl[last].typePos = pos;
 }
 
 int lgHdlAlloc(
    int type, int objSize, void **objPtr, callbk_t destructor)
 {
    int handle;
-   int last;
-   lgHdlHdr_p h;
+   int slot;
+   lgHdl_p h;
    lgCtx_p Ctx;
 
    pthread_once(&xInited, xInit);
@@ -137,45 +183,34 @@ int lgHdlAlloc(
 
    if (Ctx == NULL) return LG_NO_MEMORY;
 
-   handle = xHdlGet();
+   *objPtr = calloc(1, objSize);
 
-   if (handle < 0) return handle;
+   if (*objPtr == NULL) ALLOC_ERROR(LG_NO_MEMORY, "");
 
-   *objPtr = calloc(1, objSize);
+   pthread_mutex_lock(&slgHdlMutex);
+
+   slot = slgHdlFreeFirst;
 
-   if (*objPtr == NULL)
+   if (slot < 0)
    {
-      lgHdl[handle].header = (void *)LG_HDL_FREE;
-      ALLOC_ERROR(LG_NO_MEMORY, "");
+      pthread_mutex_unlock(&slgHdlMutex);
+      free(*objPtr);
+      *objPtr = NULL;
+      return LG_NO_HANDLE;
    }
 
-   h = calloc(1, sizeof(lgHdlHdr_t));
-
-   if (h == NULL)
+   if (xTypeAdd(type, slot) != LG_OKAY)
    {
+      pthread_mutex_unlock(&slgHdlMutex);
       free(*objPtr);
       *objPtr = NULL;
-      lgHdl[handle].header = (void *)LG_HDL_FREE;
       ALLOC_ERROR(LG_NO_MEMORY, "");
    }
 
-   last = slgHdlTypeUsage[type].last;
+   h = &lgHdl[slot];
 
-   if (last >= 0)
-   {
-      // add handle to end of chain for type
-      h->previous = last;
-      h->next = -1;
-      lgHdl[last].header->next = handle;
-      slgHdlTypeUsage[type].last = handle;
-   }
-   else
-   {
-      h->previous = -1;
-      h->next = -1;
-      slgHdlTypeUsage[type].first = handle;
-      slgHdlTypeUsage[type].last = handle;
-   }
+   slgHdlFreeFirst = h->nextFree;
+   if (slgHdlFreeFirst < 0) slgHdlFreeLast = -1;
 
    h->magic = slgHdlTypeUsage[type].magic;
    h->destructor = destructor;
@@ -186,7 +221,13 @@ int lgHdlAlloc(
    h->owner = Ctx->owner;
    strncpy(h->user, Ctx->user, LG_USER_LEN);
 
-   lgHdl[handle].header = h;
+   handle = (h->gen << LG_HDL_SLOT_BITS) | slot;
+
+   // publish the handle once the slot is filled in
+
+   __atomic_store_n(&h->handle, handle, __ATOMIC_RELEASE);
+
+   pthread_mutex_unlock(&slgHdlMutex);
 
    return handle;
 }
@@ -195,10 +236,10 @@ int lgHdlLock(int handle)
 {
    pthread_once(&xInited, xInit);
 
-   if ((handle < 0) || (handle >= LG_HDL_SLOTS))
+   if ((handle < 0) || (handle >= (LG_HDL_SLOTS * LG_HDL_GENS)))
       PARAM_ERROR(LG_BAD_HANDLE, "bad handle (%d)", handle);
 
-   pthread_mutex_lock(&lgHdl[handle].mutex);   
+   pthread_mutex_lock(&lgHdl[LG_HDL_SLOT(handle)].mutex);
 
    return LG_OKAY;
 }
@@ -207,61 +248,55 @@ int lgHdlUnlock(int handle)
 {
    pthread_once(&xInited, xInit);
 
-   if ((handle < 0) || (handle >= LG_HDL_SLOTS))
+   if ((handle < 0) || (handle >= (LG_HDL_SLOTS * LG_HDL_GENS)))
       PARAM_ERROR(LG_BAD_HANDLE, "bad handle (%d)", handle);
 
-   pthread_mutex_unlock(&lgHdl[handle].mutex);   
+   pthread_mutex_unlock(&lgHdl[LG_HDL_SLOT(handle)].mutex);
 
    return LG_OKAY;
 }
 
 int lgHdlGetObj(int handle, int type, void **objPtr)
 {
-   lgHdlHdr_p h;
+   lgHdl_p h;
 
    pthread_once(&xInited, xInit);
 
-   if ((handle < 0) || (handle >= LG_HDL_SLOTS))
-      PARAM_ERROR(LG_BAD_HANDLE, "bad handle (%d)", handle);
+   h = xHdlFind(handle);
 
-   h = lgHdl[handle].header;
- 
-   if ((h == (void *)LG_HDL_FREE) || (h == (void *)LG_HDL_RSVD))
+   if (h == NULL)
       PARAM_ERROR(LG_BAD_HANDLE, "bad handle (%d)", handle);
 
    if ((h->type != type) || (h->magic != slgHdlTypeUsage[type].magic))
       PARAM_ERROR(LG_BAD_HANDLE, "bad handle (%d)", handle);
-   
+
    *objPtr = h->obj;
-   
+
    return LG_OKAY;
 }
 
 int lgHdlGetLockedObj(int handle, int type, void **objPtr)
 {
-   lgHdlHdr_p h;
+   lgHdl_p h;
    lgCtx_p Ctx;
 
    pthread_once(&xInited, xInit);
 
    Ctx = lgCtxGet();
 
-   if ((handle < 0) || (handle >= LG_HDL_SLOTS))
+   h = xHdlFind(handle);
+
+   if (h == NULL)
       PARAM_ERROR(LG_BAD_HANDLE, "bad handle (%d)", handle);
 
-   pthread_mutex_lock(&lgHdl[handle].mutex);   
+   pthread_mutex_lock(&h->mutex);
 
-   h = lgHdl[handle].header;
- 
-   if ((h == (void *)LG_HDL_FREE) || (h == (void *)LG_HDL_RSVD))
-   {
-      pthread_mutex_unlock(&lgHdl[handle].mutex);   
-      PARAM_ERROR(LG_BAD_HANDLE, "bad handle (%d)", handle);
-   }
+   // the handle may have been freed while waiting for the lock
 
-   if ((h->type != type) || (h->magic != slgHdlTypeUsage[type].magic))
+   if ((__atomic_load_n(&h->handle, __ATOMIC_ACQUIRE) != handle) ||
+       (h->type != type) || (h->magic != slgHdlTypeUsage[type].magic))
    {
-      pthread_mutex_unlock(&lgHdl[handle].mutex);   
+      pthread_mutex_unlock(&h->mutex);
       PARAM_ERROR(LG_BAD_HANDLE, "bad handle (%d)", handle);
    }
 
@@ -270,98 +305,95 @@ int lgHdlGetLockedObj(int handle, int type, void **objPtr)
         (h->share != Ctx->autoUseShare)  ||
         (strcmp(h->user, Ctx->user) != 0)))
    {
-      pthread_mutex_unlock(&lgHdl[handle].mutex);   
+      pthread_mutex_unlock(&h->mutex);
       PARAM_ERROR(LG_NO_PERMISSIONS,
          "not owned or shared by user (%d)", handle);
    }
 
    *objPtr = h->obj;
-   
+
    return LG_OKAY;
 }
 
 int lgHdlGetLockedObjTrusted(int handle, int type, void **objPtr)
 {
-   lgHdlHdr_p h;
+   lgHdl_p h;
 
    pthread_once(&xInited, xInit);
 
-   pthread_mutex_lock(&lgHdl[handle].mutex);   
+   h = xHdlFind(handle);
 
-   h = lgHdl[handle].header;
- 
-   if ((h == (void *)LG_HDL_FREE) || (h == (void *)LG_HDL_RSVD))
-   {
-      pthread_mutex_unlock(&lgHdl[handle].mutex);   
+   if (h == NULL)
       PARAM_ERROR(LG_BAD_HANDLE, "bad handle (%d)", handle);
-   }
 
-   if ((h->type != type) || (h->magic != slgHdlTypeUsage[type].magic))
+   pthread_mutex_lock(&h->mutex);
+
+   if ((__atomic_load_n(&h->handle, __ATOMIC_ACQUIRE) != handle) ||
+       (h->type != type) || (h->magic != slgHdlTypeUsage[type].magic))
    {
-      pthread_mutex_unlock(&lgHdl[handle].mutex);   
+      pthread_mutex_unlock(&h->mutex);
       PARAM_ERROR(LG_BAD_HANDLE, "bad handle (%d)", handle);
    }
 
    *objPtr = h->obj;
-   
+
    return LG_OKAY;
 }
 
 int lgHdlSetShare(int handle, int share)
 {
-   lgHdlHdr_p h;
+   lgHdl_p h;
    lgCtx_p Ctx;
 
    pthread_once(&xInited, xInit);
 
    Ctx = lgCtxGet();
 
-   if ((handle < 0) || (handle >= LG_HDL_SLOTS))
+   h = xHdlFind(handle);
+
+   if (h == NULL)
       PARAM_ERROR(LG_BAD_HANDLE, "bad handle (%d)", handle);
 
-   pthread_mutex_lock(&lgHdl[handle].mutex);   
+   pthread_mutex_lock(&h->mutex);
 
-   h = lgHdl[handle].header;
- 
-   if ((h == (void *)LG_HDL_FREE) || (h == (void *)LG_HDL_RSVD))
+   if (__atomic_load_n(&h->handle, __ATOMIC_ACQUIRE) != handle)
    {
-      pthread_mutex_unlock(&lgHdl[handle].mutex);   
+      pthread_mutex_unlock(&h->mutex);
       PARAM_ERROR(LG_BAD_HANDLE, "bad handle (%d)", handle);
    }
 
    if (h->owner != Ctx->owner)
    {
-      pthread_mutex_unlock(&lgHdl[handle].mutex);   
+      pthread_mutex_unlock(&h->mutex);
       PARAM_ERROR(LG_NO_PERMISSIONS, "not owned (%d)", handle);
    }
 
    h->share = share;
 
-   pthread_mutex_unlock(&lgHdl[handle].mutex);   
-   
+   pthread_mutex_unlock(&h->mutex);
+
    return LG_OKAY;
 }
 
 int lgHdlGetHandlesForType(int type, int *handles, int size)
 {
-   int hdl;
-   int count=0;
-   
+   slgHdlTypeUsage_t *t;
+   int i;
+   int count;
+
    pthread_once(&xInited, xInit);
 
+   t = &slgHdlTypeUsage[type];
+
    pthread_mutex_lock(&slgHdlMutex);
-   
-   hdl = slgHdlTypeUsage[type].first;
 
-   while (hdl >= 0)
-   {
-      if (count < size) handles[count] = hdl;
-      count ++;
-      hdl = lgHdl[hdl].header->next;
-   }
-   
+   count = t->count;
+
+   for (i=0; (i<count) && (i<size); i++)
+      handles[i] = lgHdl[t->slots[i]].handle;
+
    pthread_mutex_unlock(&slgHdlMutex);
-   
+
    return count;
 }
 
@@ -369,51 +401,47 @@ int lgHdlFree(int handle, int type)
 {
    int status;
    void **dummy;
-   lgHdlHdr_p h;
+   int slot;
+   lgHdl_p h;
 
    pthread_once(&xInited, xInit);
 
    LG_DBG(LG_DEBUG_TRACE, "handle=%d type=%d", handle, type);
 
    pthread_mutex_lock(&slgHdlMutex);
-   
+
    status = lgHdlGetObj(handle, type, (void **)&dummy);
 
    if (status == LG_OKAY)
    {
-      h = lgHdl[handle].header;
-      
-      if (h->previous >= 0)
-      {
-         // not first
-         lgHdl[h->previous].header->next = h->next;
-      }
-      else
-      {
-         // first
-         slgHdlTypeUsage[type].first = h->next;
-      }
+      slot = LG_HDL_SLOT(handle);
+      h = &lgHdl[slot];
 
-      if (h->next >= 0)
-      {
-         // not last
-         lgHdl[h->next].header->previous = h->previous;
-      }
-      else
-      {
-         slgHdlTypeUsage[type].last = h->previous;
-      }
-         
-      lgHdl[handle].header = NULL;
+      // stale from here on, lookups no longer find it
+
+      __atomic_store_n(&h->handle, LG_HDL_NONE, __ATOMIC_RELEASE);
+
+      xTypeRemove(type, slot);
 
       if (h->destructor != NULL) (h->destructor)(h->obj);
 
       if (h->obj != NULL) free(h->obj);
-      
-      free(h);
+
+      h->obj = NULL;
+      h->destructor = NULL;
+      h->gen = (h->gen + 1) & (LG_HDL_GENS - 1);
+
+      // to the end of the free list
+
+      h->nextFree = -1;
+
+      if (slgHdlFreeLast >= 0) lgHdl[slgHdlFreeLast].nextFree = slot;
+      else slgHdlFreeFirst = slot;
+
+      slgHdlFreeLast = slot;
    }
    pthread_mutex_unlock(&slgHdlMutex);
-   
+
    return status;
 }
 
@@ -421,19 +449,22 @@ int lgHdlFree(int handle, int type)
 void lgHdlPurgeByOwner(int owner)
 {
    int i;
-   lgHdlHdr_p h;
+   int handle;
+   lgHdl_p h;
 
    pthread_once(&xInited, xInit);
 
    for (i=0; i<LG_HDL_SLOTS; i++)
    {
-      h = lgHdl[i].header;
+      h = &lgHdl[i];
+
+      handle = __atomic_load_n(&h->handle, __ATOMIC_ACQUIRE);
 
-      if ((h != (void *)LG_HDL_FREE) && (h != (void *)LG_HDL_RSVD))
+      if (handle != LG_HDL_NONE)
       {
          if ((h->owner == owner) && (!h->share))
          {
-            lgHdlFree(i, h->type);
+            lgHdlFree(handle, h->type);
          }
       }
    }
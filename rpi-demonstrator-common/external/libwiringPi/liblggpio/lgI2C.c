@@ -27,6 +27,9 @@ For more information, please refer to <http://unlicense.org/>
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/ioctl.h>
@@ -59,6 +62,7 @@ For more information, please refer to <http://unlicense.org/>
 #define LG_I2C_SMBUS_BLOCK_MAX     32
 #define LG_I2C_SMBUS_I2C_BLOCK_MAX 32
 
+#define LG_I2C_FUNC_I2C                    0x00000001
 #define LG_I2C_FUNC_SMBUS_QUICK            0x00010000
 #define LG_I2C_FUNC_SMBUS_READ_BYTE        0x00020000
 #define LG_I2C_FUNC_SMBUS_WRITE_BYTE       0x00040000
@@ -72,6 +76,8 @@ For more information, please refer to <http://unlicense.org/>
 #define LG_I2C_FUNC_SMBUS_READ_I2C_BLOCK   0x04000000
 #define LG_I2C_FUNC_SMBUS_WRITE_I2C_BLOCK  0x08000000
 
+#define LG_I2C_M_RD 0x0001
+
 typedef struct
 {
    uint16_t state;
@@ -79,8 +85,65 @@ typedef struct
    uint32_t addr;
    uint32_t flags;
    uint32_t funcs;
+   int      bus;
+   int      priority; /* queue priority when the bus has an arbiter */
 } lgI2cObj_t, *lgI2cObj_p;
 
+/*
+An arbiter owns a bus opened for itself.  Requests from all the
+handles on the bus are queued by priority and executed by the
+arbiter's thread, which merges back-to-back requests to the same
+device into a single I2C_RDWR transfer.  A request ending with a
+write ends its transfer, the device may only act on it at the stop.
+A failed transfer fails every request in it, none is retried as that
+could repeat a write.  A caller of the SMBus and device functions
+waits for its request, a caller of lgI2cSubmit is called back.
+Transfers the arbiter can't express as I2C messages are made directly
+while holding the bus.
+*/
+
+typedef struct lgI2cReq_s
+{
+   lgI2cMsg_t *segs;
+   int numSegs;
+   int status;
+   int done;               /* set once a waiting caller's request ends */
+   uint64_t queued;
+   lgI2cDoneFunc_t cbf;    /* NULL if the caller is waiting */
+   void *userdata;
+   struct lgI2cReq_s *next;
+} lgI2cReq_t, *lgI2cReq_p;
+
+typedef struct
+{
+   int bus;
+   int fd;
+   int mergeMax;
+   int stop;
+   pthread_t *pthIdp;
+   pthread_mutex_t mutex;
+   pthread_cond_t work;    /* a request was queued */
+   pthread_cond_t done;    /* waiting callers' requests ended */
+   pthread_mutex_t busMutex;
+   lgI2cReq_p head[LG_I2C_PRIORITIES];
+   lgI2cReq_p tail[LG_I2C_PRIORITIES];
+   lgI2cMsg_t msgs[LG_I2C_RDRW_IOCTL_MAX_MSGS];
+   uint64_t started;
+   uint64_t busy_ns;       /* updated while holding busMutex */
+   uint64_t requests;
+   uint64_t transfers;
+   uint64_t merged;
+   uint64_t wait_ns;
+   uint64_t max_wait_ns;
+   uint32_t queued;
+   uint32_t high_water;
+} lgI2cArb_t, *lgI2cArb_p;
+
+/* the rwlock keeps an arbiter alive while it is used */
+
+static pthread_rwlock_t sI2cArbLock = PTHREAD_RWLOCK_INITIALIZER;
+static lgI2cArb_p sI2cArb[LG_I2C_ARB_BUSES];
+
 union lgI2cSmbusData
 {
    uint8_t  byte;
@@ -130,10 +193,385 @@ static void _lgI2cClose(lgI2cObj_p i2c)
    if (i2c) close(i2c->fd);
 }
 
+static uint64_t xI2cNanos(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+
+   return ((uint64_t)ts.tv_sec * 1000000000) + ts.tv_nsec;
+}
+
+static int xSegments(int fd, lgI2cMsg_t *segs, int numSegs)
+{
+   lgI2cRdwrIoctlData_t rdwr;
+   int status;
+
+   rdwr.msgs = segs;
+   rdwr.nmsgs = numSegs;
+
+   status = ioctl(fd, LG_I2C_RDWR, &rdwr);
+
+   if (status < 0) status = LG_BAD_I2C_SEG;
+
+   return status;
+}
+
+static lgI2cArb_p xI2cArbGet(lgI2cObj_p i2c)
+{
+   lgI2cArb_p arb;
+
+   if ((unsigned)i2c->bus >= LG_I2C_ARB_BUSES) return NULL;
+
+   /* buses without an arbiter don't touch the lock */
+
+   if (__atomic_load_n(&sI2cArb[i2c->bus], __ATOMIC_ACQUIRE) == NULL)
+      return NULL;
+
+   pthread_rwlock_rdlock(&sI2cArbLock);
+
+   arb = sI2cArb[i2c->bus];
+
+   if (arb == NULL) pthread_rwlock_unlock(&sI2cArbLock);
+
+   return arb;
+}
+
+static void xI2cArbPut(lgI2cArb_p arb)
+{
+   if (arb) pthread_rwlock_unlock(&sI2cArbLock);
+}
+
+static uint64_t xI2cBusLock(lgI2cArb_p arb)
+{
+   pthread_mutex_lock(&arb->busMutex);
+
+   return xI2cNanos();
+}
+
+static void xI2cBusUnlock(lgI2cArb_p arb, uint64_t start)
+{
+   __atomic_add_fetch(
+      &arb->busy_ns, xI2cNanos() - start, __ATOMIC_RELAXED);
+
+   pthread_mutex_unlock(&arb->busMutex);
+}
+
+static void xI2cArbQueue(lgI2cArb_p arb, lgI2cReq_p req, int priority)
+{
+   req->queued = xI2cNanos();
+   req->next = NULL;
+
+   pthread_mutex_lock(&arb->mutex);
+
+   if (arb->tail[priority]) arb->tail[priority]->next = req;
+   else                     arb->head[priority] = req;
+
+   arb->tail[priority] = req;
+
+   if (++arb->queued > arb->high_water) arb->high_water = arb->queued;
+
+   pthread_cond_signal(&arb->work);
+
+   pthread_mutex_unlock(&arb->mutex);
+}
+
+/* the device a request may share a transfer with, -1 if none */
+
+static int xI2cReqAddr(lgI2cReq_p req)
+{
+   int i;
+
+   if (req->numSegs < 1) return -1;
+
+   for (i=0; i<req->numSegs; i++)
+   {
+      if ((req->segs[i].addr != req->segs[0].addr) ||
+          (req->segs[i].flags & ~LG_I2C_M_RD))
+         return -1;
+   }
+
+   return req->segs[0].addr;
+}
+
+static int xI2cReqEndsWrite(lgI2cReq_p req)
+{
+   if (req->numSegs < 1) return 1;
+
+   return !(req->segs[req->numSegs - 1].flags & LG_I2C_M_RD);
+}
+
+/* the next request in priority order, called with the mutex held */
+
+static lgI2cReq_p xI2cArbPeek(lgI2cArb_p arb, int *priority)
+{
+   int p;
+
+   for (p=LG_I2C_PRIORITIES-1; p>=0; p--)
+   {
+      if (arb->head[p])
+      {
+         *priority = p;
+         return arb->head[p];
+      }
+   }
+
+   return NULL;
+}
+
+static int xI2cArbXfer(
+   lgI2cArb_p arb, int priority, lgI2cMsg_t *segs, int numSegs)
+{
+   lgI2cReq_t req;
+   uint64_t start;
+   int status;
+
+   /* a callback making a transfer mustn't wait for its own thread */
+
+   if (pthread_equal(pthread_self(), *arb->pthIdp))
+   {
+      start = xI2cBusLock(arb);
+      status = xSegments(arb->fd, segs, numSegs);
+      xI2cBusUnlock(arb, start);
+
+      return status;
+   }
+
+   req.segs = segs;
+   req.numSegs = numSegs;
+   req.done = 0;
+   req.cbf = NULL;
+
+   xI2cArbQueue(arb, &req, priority);
+
+   pthread_mutex_lock(&arb->mutex);
+
+   while (!req.done) pthread_cond_wait(&arb->done, &arb->mutex);
+
+   pthread_mutex_unlock(&arb->mutex);
+
+   return req.status;
+}
+
+static void *pthI2cArb(void *x)
+{
+   lgI2cArb_p arb = x;
+   lgI2cReq_p req, batch[LG_I2C_RDRW_IOCTL_MAX_MSGS], calls;
+   uint64_t now, wait, start;
+   int i, n, msgs, priority, status, addr;
+
+   pthread_mutex_lock(&arb->mutex);
+
+   while (1)
+   {
+      while (!arb->queued && !arb->stop)
+         pthread_cond_wait(&arb->work, &arb->mutex);
+
+      /* a stopping arbiter still completes the queued requests */
+
+      if (!arb->queued) break;
+
+      /*
+      take back-to-back requests to the same device while their
+      segments fit, until one ends with a write
+      */
+
+      n = 0;
+      msgs = 0;
+      addr = -1;
+
+      while ((n < arb->mergeMax) && (req = xI2cArbPeek(arb, &priority)))
+      {
+         if (n)
+         {
+            if ((msgs + req->numSegs) > LG_I2C_RDRW_IOCTL_MAX_MSGS) break;
+            if ((addr < 0) || (xI2cReqAddr(req) != addr)) break;
+            if (xI2cReqEndsWrite(batch[n-1])) break;
+         }
+         else addr = xI2cReqAddr(req);
+
+         arb->head[priority] = req->next;
+         if (arb->head[priority] == NULL) arb->tail[priority] = NULL;
+         arb->queued--;
+
+         memcpy(arb->msgs + msgs, req->segs,
+            req->numSegs * sizeof(lgI2cMsg_t));
+         msgs += req->numSegs;
+
+         batch[n++] = req;
+      }
+
+      pthread_mutex_unlock(&arb->mutex);
+
+      now = xI2cNanos();
+
+      start = xI2cBusLock(arb);
+
+      status = xSegments(arb->fd, arb->msgs, msgs);
+
+      xI2cBusUnlock(arb, start);
+
+      for (i=0; i<n; i++)
+         batch[i]->status = (status < 0) ? status : batch[i]->numSegs;
+
+      pthread_mutex_lock(&arb->mutex);
+
+      arb->transfers++;
+      arb->requests += n;
+      if (n > 1) arb->merged += n;
+
+      calls = NULL;
+
+      for (i=n-1; i>=0; i--)
+      {
+         wait = now - batch[i]->queued;
+         arb->wait_ns += wait;
+         if (wait > arb->max_wait_ns) arb->max_wait_ns = wait;
+
+         if (batch[i]->cbf)
+         {
+            batch[i]->next = calls;
+            calls = batch[i];
+         }
+         else batch[i]->done = 1;
+      }
+
+      pthread_cond_broadcast(&arb->done);
+
+      if (calls)
+      {
+         pthread_mutex_unlock(&arb->mutex);
+
+         while (calls)
+         {
+            req = calls;
+            calls = req->next;
+            req->cbf(req->status, req->userdata);
+            free(req);
+         }
+
+         pthread_mutex_lock(&arb->mutex);
+      }
+   }
+
+   pthread_mutex_unlock(&arb->mutex);
+
+   return NULL;
+}
+
+/* SMBus transfers as I2C messages, as the kernel does for I2C adapters */
+
+static int xI2cSmbusEmulated(int size)
+{
+   switch (size)
+   {
+      case LG_I2C_SMBUS_BYTE:
+      case LG_I2C_SMBUS_BYTE_DATA:
+      case LG_I2C_SMBUS_WORD_DATA:
+      case LG_I2C_SMBUS_PROC_CALL:
+      case LG_I2C_SMBUS_I2C_BLOCK_BROKEN:
+      case LG_I2C_SMBUS_I2C_BLOCK_DATA:
+         return 1;
+   }
+
+   /* QUICK needs an empty message, the block transfers a count byte */
+
+   return 0;
+}
+
+static int xI2cSmbusEmulate(lgI2cArb_p arb, lgI2cObj_p i2c,
+   char rw, uint8_t cmd, int size, union lgI2cSmbusData *data)
+{
+   lgI2cMsg_t msgs[2];
+   uint8_t wBuf[LG_I2C_SMBUS_BLOCK_MAX + 3];
+   uint8_t rBuf[LG_I2C_SMBUS_BLOCK_MAX];
+   int i, n, wLen, rLen, status;
+
+   wBuf[0] = cmd;
+   wLen = 1;
+   rLen = 0;
+
+   switch (size)
+   {
+      case LG_I2C_SMBUS_BYTE:
+         if (rw == LG_I2C_SMBUS_READ) {wLen = 0; rLen = 1;}
+         break;
+
+      case LG_I2C_SMBUS_BYTE_DATA:
+         if (rw == LG_I2C_SMBUS_READ) rLen = 1;
+         else wBuf[wLen++] = data->byte;
+         break;
+
+      case LG_I2C_SMBUS_WORD_DATA:
+      case LG_I2C_SMBUS_PROC_CALL:
+         if ((rw == LG_I2C_SMBUS_WRITE) || (size == LG_I2C_SMBUS_PROC_CALL))
+         {
+            wBuf[wLen++] = data->word & 0xFF;
+            wBuf[wLen++] = data->word >> 8;
+         }
+         if ((rw == LG_I2C_SMBUS_READ) || (size == LG_I2C_SMBUS_PROC_CALL))
+            rLen = 2;
+         break;
+
+      default: /* I2C block */
+         if (data->block[0] > LG_I2C_SMBUS_I2C_BLOCK_MAX)
+            data->block[0] = LG_I2C_SMBUS_I2C_BLOCK_MAX;
+         if (rw == LG_I2C_SMBUS_READ) rLen = data->block[0];
+         else for (i=1; i<=data->block[0]; i++) wBuf[wLen++] = data->block[i];
+   }
+
+   n = 0;
+
+   if (wLen)
+   {
+      msgs[n].addr = i2c->addr;
+      msgs[n].flags = 0;
+      msgs[n].len = wLen;
+      msgs[n++].buf = wBuf;
+   }
+
+   if (rLen)
+   {
+      msgs[n].addr = i2c->addr;
+      msgs[n].flags = LG_I2C_M_RD;
+      msgs[n].len = rLen;
+      msgs[n++].buf = rBuf;
+   }
+
+   status = xI2cArbXfer(arb, i2c->priority, msgs, n);
+
+   if (status < 0)
+   {
+      errno = EIO;
+      return -1;
+   }
+
+   switch (size)
+   {
+      case LG_I2C_SMBUS_BYTE:
+      case LG_I2C_SMBUS_BYTE_DATA:
+         if (rLen) data->byte = rBuf[0];
+         break;
+
+      case LG_I2C_SMBUS_WORD_DATA:
+      case LG_I2C_SMBUS_PROC_CALL:
+         if (rLen) data->word = rBuf[0] | (rBuf[1] << 8);
+         break;
+
+      default:
+         for (i=0; i<rLen; i++) data->block[i+1] = rBuf[i];
+   }
+
+   return 0;
+}
+
 static int xI2cSmbusAccess(
-   int fd, char rw, uint8_t cmd, int size, union lgI2cSmbusData *data)
+   lgI2cObj_p i2c, char rw, uint8_t cmd, int size, union lgI2cSmbusData *data)
 {
    struct lgI2cSmbusIoctlData args;
+   lgI2cArb_p arb;
+   uint64_t start;
+   int status;
 
    LG_DBG(LG_DEBUG_INTERNAL, "rw=%d reg=%d cmd=%d data=%s",
       rw, cmd, size, lgDbgBuf2Str(data->byte+1, (char*)data));
@@ -143,7 +581,65 @@ static int xI2cSmbusAccess(
    args.size       = size;
    args.data       = data;
 
-   return ioctl(fd, LG_I2C_SMBUS, &args);
+   arb = xI2cArbGet(i2c);
+
+   if (arb == NULL) return ioctl(i2c->fd, LG_I2C_SMBUS, &args);
+
+   if (xI2cSmbusEmulated(size))
+   {
+      status = xI2cSmbusEmulate(arb, i2c, rw, cmd, size, data);
+   }
+   else
+   {
+      start = xI2cBusLock(arb);
+      status = ioctl(i2c->fd, LG_I2C_SMBUS, &args);
+      xI2cBusUnlock(arb, start);
+   }
+
+   xI2cArbPut(arb);
+
+   return status;
+}
+
+static int xI2cDevice(lgI2cObj_p i2c, int rd, char *buf, int count)
+{
+   lgI2cMsg_t msg;
+   lgI2cArb_p arb;
+   uint64_t start;
+   int status;
+
+   arb = xI2cArbGet(i2c);
+
+   if (arb == NULL)
+   {
+      if (rd) return read(i2c->fd, buf, count);
+      else    return write(i2c->fd, buf, count);
+   }
+
+   if (count <= 0xFFFF)
+   {
+      msg.addr = i2c->addr;
+      msg.flags = rd ? LG_I2C_M_RD : 0;
+      msg.len = count;
+      msg.buf = (uint8_t *)buf;
+
+      status = xI2cArbXfer(arb, i2c->priority, &msg, 1);
+
+      if (status >= 0) status = count;
+   }
+   else
+   {
+      /* too long for one message */
+
+      start = xI2cBusLock(arb);
+      if (rd) status = read(i2c->fd, buf, count);
+      else    status = write(i2c->fd, buf, count);
+      xI2cBusUnlock(arb, start);
+   }
+
+   xI2cArbPut(arb);
+
+   return status;
 }
 
 int lgI2cWriteQuick(int handle, int bit)
@@ -163,7 +659,7 @@ int lgI2cWriteQuick(int handle, int bit)
       if (i2c->funcs & LG_I2C_FUNC_SMBUS_QUICK)
       {
          status = xI2cSmbusAccess(
-            i2c->fd, bit, 0, LG_I2C_SMBUS_QUICK, NULL);
+            i2c, bit, 0, LG_I2C_SMBUS_QUICK, NULL);
 
          if (status < 0)
          {
@@ -198,7 +694,7 @@ int lgI2cReadByte(int handle)
       if (i2c->funcs & LG_I2C_FUNC_SMBUS_READ_BYTE)
       {
          status = xI2cSmbusAccess(
-            i2c->fd, LG_I2C_SMBUS_READ, 0, LG_I2C_SMBUS_BYTE, &data);
+            i2c, LG_I2C_SMBUS_READ, 0, LG_I2C_SMBUS_BYTE, &data);
 
          if (status < 0)
          {
@@ -237,7 +733,7 @@ int lgI2cWriteByte(int handle, int bVal)
       if (i2c->funcs & LG_I2C_FUNC_SMBUS_WRITE_BYTE)
       {
          status = xI2cSmbusAccess(
-            i2c->fd,
+            i2c,
             LG_I2C_SMBUS_WRITE,
             bVal,
             LG_I2C_SMBUS_BYTE,
@@ -279,7 +775,7 @@ int lgI2cReadByteData(int handle, int reg)
    {
       if (i2c->funcs & LG_I2C_FUNC_SMBUS_READ_BYTE_DATA)
       {
-         status = xI2cSmbusAccess(i2c->fd,
+         status = xI2cSmbusAccess(i2c,
             LG_I2C_SMBUS_READ, reg, LG_I2C_SMBUS_BYTE_DATA, &data);
 
          if (status < 0)
@@ -325,7 +821,7 @@ int lgI2cWriteByteData(int handle, int reg, int bVal)
          data.byte = bVal;
 
          status = xI2cSmbusAccess(
-            i2c->fd,
+            i2c,
             LG_I2C_SMBUS_WRITE,
             reg,
             LG_I2C_SMBUS_BYTE_DATA,
@@ -368,7 +864,7 @@ int lgI2cReadWordData(int handle, int reg)
       if (i2c->funcs & LG_I2C_FUNC_SMBUS_READ_WORD_DATA)
       {
          status = (xI2cSmbusAccess(
-            i2c->fd,
+            i2c,
             LG_I2C_SMBUS_READ,
             reg,
             LG_I2C_SMBUS_WORD_DATA,
@@ -418,7 +914,7 @@ int lgI2cWriteWordData(int handle, int reg, int wVal)
          data.word = wVal;
 
          status = xI2cSmbusAccess(
-            i2c->fd,
+            i2c,
             LG_I2C_SMBUS_WRITE,
             reg,
             LG_I2C_SMBUS_WORD_DATA,
@@ -466,7 +962,7 @@ int lgI2cProcessCall(int handle, int reg, int wVal)
          data.word = wVal;
 
          status = (xI2cSmbusAccess(
-            i2c->fd,
+            i2c,
             LG_I2C_SMBUS_WRITE,
             reg, LG_I2C_SMBUS_PROC_CALL,
             &data));
@@ -511,7 +1007,7 @@ int lgI2cReadBlockData(int handle, int reg, char *rxBuf)
       if (i2c->funcs & LG_I2C_FUNC_SMBUS_READ_BLOCK_DATA)
       {
          status = (xI2cSmbusAccess(
-            i2c->fd,
+            i2c,
             LG_I2C_SMBUS_READ,
             reg,
             LG_I2C_SMBUS_BLOCK_DATA,
@@ -575,7 +1071,7 @@ int lgI2cWriteBlockData(
          data.block[0] = count;
 
          status = xI2cSmbusAccess(
-            i2c->fd,
+            i2c,
             LG_I2C_SMBUS_WRITE,
             reg,
             LG_I2C_SMBUS_BLOCK_DATA,
@@ -629,7 +1125,7 @@ int lgI2cBlockProcessCall(
          data.block[0] = count;
 
          status = xI2cSmbusAccess(
-            i2c->fd, LG_I2C_SMBUS_WRITE, reg,
+            i2c, LG_I2C_SMBUS_WRITE, reg,
             LG_I2C_SMBUS_BLOCK_PROC_CALL, &data);
 
          if (status < 0)
@@ -693,7 +1189,7 @@ int lgI2cReadI2CBlockData(
          data.block[0] = count;
 
          status = xI2cSmbusAccess(
-            i2c->fd, LG_I2C_SMBUS_READ, reg, size, &data);
+            i2c, LG_I2C_SMBUS_READ, reg, size, &data);
 
          if (status < 0)
          {
@@ -753,7 +1249,7 @@ int lgI2cWriteI2CBlockData(
          data.block[0] = count;
 
          status = xI2cSmbusAccess(
-            i2c->fd,
+            i2c,
             LG_I2C_SMBUS_WRITE,
             reg,
             LG_I2C_SMBUS_I2C_BLOCK_BROKEN,
@@ -793,7 +1289,7 @@ int lgI2cWriteDevice(int handle, const char *txBuf, int count)
 
    if (status == LG_OKAY)
    {
-      bytes = write(i2c->fd, txBuf, count);
+      bytes = xI2cDevice(i2c, 0, (char *)txBuf, count);
 
       if (bytes != count)
       {
@@ -822,7 +1318,7 @@ int lgI2cReadDevice(int handle, char *rxBuf, int count)
 
    if (status == LG_OKAY)
    {
-      status = read(i2c->fd, rxBuf, count);
+      status = xI2cDevice(i2c, 1, rxBuf, count);
 
       if (status != count)
       {
@@ -886,6 +1382,8 @@ int lgI2cOpen(int i2cDev, int i2cAddr, int i2cFlags)
    i2c->addr = i2cAddr;
    i2c->flags = i2cFlags;
    i2c->funcs = funcs;
+   i2c->bus = i2cDev;
+   i2c->priority = 0;
 
    return handle;
 }
@@ -912,8 +1410,8 @@ int lgI2cClose(int handle)
 int lgI2cSegments(
    int handle, lgI2cMsg_t *segs, int numSegs)
 {
-   lgI2cRdwrIoctlData_t rdwr;
    lgI2cObj_p i2c;
+   lgI2cArb_p arb;
    int status;
 
    LG_DBG(LG_DEBUG_USER, "handle=%d", handle);
@@ -928,12 +1426,14 @@ int lgI2cSegments(
 
    if (status == LG_OKAY)
    {
-      rdwr.msgs = segs;
-      rdwr.nmsgs = numSegs;
-
-      status = ioctl(i2c->fd, LG_I2C_RDWR, &rdwr);
+      arb = xI2cArbGet(i2c);
 
-      if (status < 0) status = LG_BAD_I2C_SEG;
+      if (arb)
+      {
+         status = xI2cArbXfer(arb, i2c->priority, segs, numSegs);
+         xI2cArbPut(arb);
+      }
+      else status = xSegments(i2c->fd, segs, numSegs);
 
       lgHdlUnlock(handle);
    }
@@ -941,22 +1441,6 @@ int lgI2cSegments(
    return status;
 }
 
-static int xSegments(int fd, lgI2cMsg_t *segs, int numSegs)
-{
-   lgI2cRdwrIoctlData_t rdwr;
-   int status;
-
-   rdwr.msgs = segs;
-   rdwr.nmsgs = numSegs;
-
-   status = ioctl(fd, LG_I2C_RDWR, &rdwr);
-
-   if (status < 0) status = LG_BAD_I2C_SEG;
-
-   return status;
-}
-
-
 int lgI2cZip(
    int handle, const char *inBuf, int inCount, char *outBuf, int outCount)
 {
@@ -964,6 +1448,8 @@ int lgI2cZip(
    int esc, setesc;
    lgI2cMsg_t segs[LG_I2C_RDRW_IOCTL_MAX_MSGS];
    lgI2cObj_p i2c;
+   lgI2cArb_p arb;
+   uint64_t start = 0;
    int status;
 
    LG_DBG(LG_DEBUG_TRACE, "handle=%d inBuf=%s outBuf=%p len=%d",
@@ -979,6 +1465,12 @@ int lgI2cZip(
 
    if (status == LG_OKAY)
    {
+      /* the sequence keeps the bus until it ends */
+
+      arb = xI2cArbGet(i2c);
+
+      if (arb) start = xI2cBusLock(arb);
+
       numSegs = 0;
 
       inPos = 0;
@@ -1085,9 +1577,252 @@ int lgI2cZip(
 
       if (status >= 0) status = outPos;
 
+      if (arb)
+      {
+         xI2cBusUnlock(arb, start);
+         xI2cArbPut(arb);
+      }
+
+      lgHdlUnlock(handle);
+   }
+
+   return status;
+}
+
+
+int lgI2cSetPriority(int handle, int priority)
+{
+   lgI2cObj_p i2c;
+   int status;
+
+   LG_DBG(LG_DEBUG_TRACE, "handle=%d priority=%d", handle, priority);
+
+   if ((unsigned)priority >= LG_I2C_PRIORITIES)
+      PARAM_ERROR(LG_BAD_I2C_PARAM, "bad priority (%d)", priority);
+
+   status = lgHdlGetLockedObj(handle, LG_HDL_TYPE_I2C, (void **)&i2c);
+
+   if (status == LG_OKAY)
+   {
+      i2c->priority = priority;
+
       lgHdlUnlock(handle);
    }
 
    return status;
 }
 
+int lgI2cSubmit(int handle, lgI2cMsg_t *segs, int numSegs,
+   lgI2cDoneFunc_t cbf, void *userdata)
+{
+   lgI2cObj_p i2c;
+   lgI2cArb_p arb;
+   lgI2cReq_p req;
+   int status;
+
+   LG_DBG(LG_DEBUG_TRACE, "handle=%d numSegs=%d", handle, numSegs);
+
+   if ((segs == NULL) || (cbf == NULL))
+      PARAM_ERROR(LG_BAD_POINTER, "null segments or callback");
+
+   if ((numSegs < 1) || (numSegs > LG_I2C_RDRW_IOCTL_MAX_MSGS))
+      PARAM_ERROR(LG_TOO_MANY_SEGS, "bad number of segments (%d)", numSegs);
+
+   status = lgHdlGetLockedObj(handle, LG_HDL_TYPE_I2C, (void **)&i2c);
+
+   if (status == LG_OKAY)
+   {
+      arb = xI2cArbGet(i2c);
+
+      if (arb)
+      {
+         req = malloc(sizeof(lgI2cReq_t));
+
+         if (req)
+         {
+            req->segs = segs;
+            req->numSegs = numSegs;
+            req->cbf = cbf;
+            req->userdata = userdata;
+
+            xI2cArbQueue(arb, req, i2c->priority);
+         }
+         else status = LG_NO_MEMORY;
+
+         xI2cArbPut(arb);
+      }
+      else
+      {
+         LG_DBG(LG_DEBUG_USER, "no arbiter on I2C bus %d", i2c->bus);
+         status = LG_NO_I2C_ARBITER;
+      }
+
+      lgHdlUnlock(handle);
+   }
+
+   return status;
+}
+
+int lgI2cArbiterStart(int i2cDev, int mergeMax)
+{
+   lgI2cArb_p arb;
+   uint32_t funcs;
+   char dev[32];
+   int fd;
+
+   LG_DBG(LG_DEBUG_TRACE, "i2cDev=%d mergeMax=%d", i2cDev, mergeMax);
+
+   if ((unsigned)i2cDev >= LG_I2C_ARB_BUSES)
+      PARAM_ERROR(LG_BAD_I2C_BUS, "bad I2C bus (%d)", i2cDev);
+
+   if ((mergeMax < 1) || (mergeMax > LG_I2C_RDRW_IOCTL_MAX_MSGS))
+      PARAM_ERROR(LG_BAD_I2C_PARAM, "bad mergeMax (%d)", mergeMax);
+
+   pthread_rwlock_wrlock(&sI2cArbLock);
+
+   arb = sI2cArb[i2cDev];
+
+   if (arb)
+   {
+      /* already arbitrated, just change the merging */
+
+      pthread_mutex_lock(&arb->mutex);
+      arb->mergeMax = mergeMax;
+      pthread_mutex_unlock(&arb->mutex);
+
+      pthread_rwlock_unlock(&sI2cArbLock);
+
+      return LG_OKAY;
+   }
+
+   sprintf(dev, "/dev/i2c-%d", i2cDev);
+
+   if ((fd = open(dev, O_RDWR)) < 0)
+   {
+      pthread_rwlock_unlock(&sI2cArbLock);
+      return LG_BAD_I2C_BUS;
+   }
+
+   if ((ioctl(fd, LG_I2C_FUNCS, &funcs) == 0) && !(funcs & LG_I2C_FUNC_I2C))
+   {
+      close(fd);
+      pthread_rwlock_unlock(&sI2cArbLock);
+      PARAM_ERROR(LG_BAD_I2C_BUS, "I2C bus %d can't combine messages", i2cDev);
+   }
+
+   arb = calloc(1, sizeof(lgI2cArb_t));
+
+   if (arb == NULL)
+   {
+      close(fd);
+      pthread_rwlock_unlock(&sI2cArbLock);
+      return LG_NO_MEMORY;
+   }
+
+   arb->bus = i2cDev;
+   arb->fd = fd;
+   arb->mergeMax = mergeMax;
+   arb->started = xI2cNanos();
+
+   pthread_mutex_init(&arb->mutex, NULL);
+   pthread_mutex_init(&arb->busMutex, NULL);
+   pthread_cond_init(&arb->work, NULL);
+   pthread_cond_init(&arb->done, NULL);
+
+   arb->pthIdp = lgThreadStart(pthI2cArb, arb);
+
+   if (arb->pthIdp == NULL)
+   {
+      close(fd);
+      free(arb);
+      pthread_rwlock_unlock(&sI2cArbLock);
+      return LG_INIT_FAILED;
+   }
+
+   __atomic_store_n(&sI2cArb[i2cDev], arb, __ATOMIC_RELEASE);
+
+   pthread_rwlock_unlock(&sI2cArbLock);
+
+   return LG_OKAY;
+}
+
+int lgI2cArbiterStop(int i2cDev)
+{
+   lgI2cArb_p arb;
+
+   LG_DBG(LG_DEBUG_TRACE, "i2cDev=%d", i2cDev);
+
+   if ((unsigned)i2cDev >= LG_I2C_ARB_BUSES)
+      PARAM_ERROR(LG_BAD_I2C_BUS, "bad I2C bus (%d)", i2cDev);
+
+   /* once the callers in progress are done no one else can find it */
+
+   pthread_rwlock_wrlock(&sI2cArbLock);
+
+   arb = sI2cArb[i2cDev];
+
+   __atomic_store_n(&sI2cArb[i2cDev], NULL, __ATOMIC_RELEASE);
+
+   pthread_rwlock_unlock(&sI2cArbLock);
+
+   if (arb == NULL)
+      PARAM_ERROR(LG_NO_I2C_ARBITER, "no arbiter on I2C bus %d", i2cDev);
+
+   pthread_mutex_lock(&arb->mutex);
+   arb->stop = 1;
+   pthread_cond_signal(&arb->work);
+   pthread_mutex_unlock(&arb->mutex);
+
+   lgThreadStop(arb->pthIdp);
+
+   pthread_cond_destroy(&arb->work);
+   pthread_cond_destroy(&arb->done);
+   pthread_mutex_destroy(&arb->busMutex);
+   pthread_mutex_destroy(&arb->mutex);
+
+   close(arb->fd);
+   free(arb);
+
+   return LG_OKAY;
+}
+
+int lgI2cArbiterStats(int i2cDev, lgI2cArbStats_p stats)
+{
+   lgI2cArb_p arb;
+
+   LG_DBG(LG_DEBUG_TRACE, "i2cDev=%d stats=%p", i2cDev, (void*)stats);
+
+   if (stats == NULL)
+      PARAM_ERROR(LG_BAD_POINTER, "null stats");
+
+   if ((unsigned)i2cDev >= LG_I2C_ARB_BUSES)
+      PARAM_ERROR(LG_BAD_I2C_BUS, "bad I2C bus (%d)", i2cDev);
+
+   pthread_rwlock_rdlock(&sI2cArbLock);
+
+   arb = sI2cArb[i2cDev];
+
+   if (arb == NULL)
+   {
+      pthread_rwlock_unlock(&sI2cArbLock);
+      PARAM_ERROR(LG_NO_I2C_ARBITER, "no arbiter on I2C bus %d", i2cDev);
+   }
+
+   pthread_mutex_lock(&arb->mutex);
+
+   stats->requests    = arb->requests;
+   stats->transfers   = arb->transfers;
+   stats->merged      = arb->merged;
+   stats->wait_ns     = arb->wait_ns;
+   stats->max_wait_ns = arb->max_wait_ns;
+   stats->busy_ns     = __atomic_load_n(&arb->busy_ns, __ATOMIC_RELAXED);
+   stats->elapsed_ns  = xI2cNanos() - arb->started;
+   stats->queued      = arb->queued;
+   stats->high_water  = arb->high_water;
+
+   pthread_mutex_unlock(&arb->mutex);
+
+   pthread_rwlock_unlock(&sI2cArbLock);
+
+   return LG_OKAY;
+}
@@ -28,9 +28,13 @@ For more information, please refer to <http://unlicense.org/>
 #define _GNU_SOURCE /* needed for pipes */
 
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
+#include <poll.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
 #include <fcntl.h>
 #include <pthread.h>
 #include <limits.h>
@@ -55,13 +59,44 @@ static void xCreatePipe(const char *name, int perm)
 }
 
 
+/*
+The memfd holds a page with the reader's waiting flag, the only part a
+reader maps writable, followed by the ring.  The alert thread keeps
+the ring's size and head in the lgNotify_t and never reads them back
+from the shared pages.
+*/
+
+static size_t xRingBytes(uint32_t size)
+{
+   return sizeof(lgNotifyRing_t) + (size * sizeof(lgGpioReport_t));
+}
+
+static size_t xRingPage(void)
+{
+   return sysconf(_SC_PAGESIZE);
+}
+
+static uint32_t *xRingWaiting(lgNotifyRing_p ring)
+{
+   return (uint32_t *)((char *)ring - xRingPage());
+}
+
 static void _notifyClose(lgNotify_t *h)
 {
    char fifo[128];
+   lgNotifyRing_p ring;
 
    LG_DBG(LG_DEBUG_INTERNAL, "fd=%d pipe_no=%d objp=*%p",
       h->fd, h->pipe_number, h);
 
+   if (h->ring)
+   {
+      ring = h->ring;
+      if (h->event_fd >= 0) close(h->event_fd);
+      munmap(xRingWaiting(ring), xRingPage() + xRingBytes(h->ring_size));
+      h->ring = NULL;
+   }
+
    if (h->fd >= 0) close(h->fd);
    
    if (h->pipe_number)
@@ -277,3 +312,278 @@ int lgNotifyClose(int handle)
 }
 
 
+
+/* ----------------------------------------------------------------------- */
+
+int lgNotifyOpenRing(int numReports)
+{
+   int handle;
+   uint32_t size;
+   lgNotify_t *h;
+   char *pages;
+
+   LG_DBG(LG_DEBUG_TRACE, "numReports=%d", numReports);
+
+   if (numReports == 0) numReports = LG_DEFAULT_NOTIFY_RING;
+
+   if ((numReports < 1) || (numReports > LG_MAX_NOTIFY_RING))
+      PARAM_ERROR(LG_BAD_NOTIFY_RING, "bad ring size (%d)", numReports);
+
+   for (size=1; size<(uint32_t)numReports; size<<=1);
+
+   handle = lgHdlAlloc(
+      LG_HDL_TYPE_NOTIFY, sizeof(lgNotify_t), (void**)&h, _notifyClose);
+
+   if (handle < 0) {return LG_NO_MEMORY;}
+
+   h->fd = memfd_create("lgnotify", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+   h->event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+   h->pipe_number = 0;
+
+   if ((h->fd < 0) || (h->event_fd < 0) ||
+       (ftruncate(h->fd, xRingPage() + xRingBytes(size)) < 0))
+   {
+      if (h->event_fd >= 0) close(h->event_fd);
+      lgHdlFree(handle, LG_HDL_TYPE_NOTIFY);
+      PARAM_ERROR(LG_NO_MEMORY, "can't create notification ring (%m)");
+   }
+
+   /* a reader can't shrink the ring from under the alert thread */
+
+   fcntl(h->fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL);
+
+   pages = mmap(NULL, xRingPage() + xRingBytes(size), PROT_READ | PROT_WRITE,
+      MAP_SHARED, h->fd, 0);
+
+   if (pages == MAP_FAILED)
+   {
+      close(h->event_fd);
+      lgHdlFree(handle, LG_HDL_TYPE_NOTIFY);
+      PARAM_ERROR(LG_NO_MEMORY, "can't map notification ring (%m)");
+   }
+
+   h->ring = pages + xRingPage();
+   h->ring_waiting = (uint32_t *)pages;
+   h->ring_size = size;
+   h->ring_mask = size - 1;
+   h->ring_head = 0;
+
+   ((lgNotifyRing_p)h->ring)->size = size;
+
+   h->max_emits = MAX_EMITS;
+   h->state = LG_NOTIFY_RUNNING;
+
+   return handle;
+}
+
+/* ----------------------------------------------------------------------- */
+
+int lgNotifyRingFds(int handle, int *memFd, int *eventFd)
+{
+   int status;
+   lgNotify_t *h;
+
+   LG_DBG(LG_DEBUG_TRACE, "handle=%d", handle);
+
+   status = lgHdlGetLockedObj(handle, LG_HDL_TYPE_NOTIFY, (void **)&h);
+
+   if (status == LG_OKAY)
+   {
+      if (h->ring)
+      {
+         if (memFd) *memFd = h->fd;
+         if (eventFd) *eventFd = h->event_fd;
+      }
+      else status = LG_NOT_A_NOTIFY_RING;
+
+      lgHdlUnlock(handle);
+   }
+
+   return status;
+}
+
+/* ----------------------------------------------------------------------- */
+
+void lgNotifyRingWrite(lgNotify_t *h, lgGpioReport_t *report, int count)
+{
+   lgNotifyRing_p ring = h->ring;
+   uint64_t head, one = 1;
+   int i;
+
+   /*
+   Called by the alert thread, the only writer.  Reports are never
+   held back for a slow reader, the oldest are overwritten instead.
+   write is moved on before any slot changes so that a reader copying
+   a slot being overwritten sees it has been lapped.  The size and
+   head come from h, the shared copies are only ever stored to.
+   */
+
+   if ((uint32_t)count > h->ring_size)
+   {
+      report += count - h->ring_size;
+      count = h->ring_size;
+   }
+
+   head = h->ring_head;
+   h->ring_head = head + count;
+
+   __atomic_store_n(&ring->write, head + count, __ATOMIC_RELAXED);
+   __atomic_thread_fence(__ATOMIC_RELEASE);
+
+   for (i=0; i<count; i++) ring->report[(head + i) & h->ring_mask] = report[i];
+
+   __atomic_store_n(&ring->head, head + count, __ATOMIC_SEQ_CST);
+
+   /* only ring the doorbell for a reader asleep in lgNotifyRingWait */
+
+   if (__atomic_load_n(h->ring_waiting, __ATOMIC_SEQ_CST))
+   {
+      if (write(h->event_fd, &one, sizeof(one)) != sizeof(one))
+         LG_DBG(LG_DEBUG_ALWAYS, "doorbell write failed (%m)");
+   }
+}
+
+/* ----------------------------------------------------------------------- */
+
+lgNotifyRing_p lgNotifyRingMap(int memFd)
+{
+   struct stat st;
+   size_t page = xRingPage();
+   char *pages;
+   lgNotifyRing_p ring;
+   uint32_t size;
+
+   LG_DBG(LG_DEBUG_TRACE, "memFd=%d", memFd);
+
+   if ((fstat(memFd, &st) < 0) ||
+       (st.st_size < (off_t)(page + sizeof(lgNotifyRing_t))))
+      return NULL;
+
+   /* the waiting flag writable, the ring itself read only, side by side */
+
+   pages = mmap(NULL, st.st_size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+   if (pages == MAP_FAILED) return NULL;
+
+   if ((mmap(pages, page, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED,
+           memFd, 0) == MAP_FAILED) ||
+       (mmap(pages + page, st.st_size - page, PROT_READ, MAP_SHARED | MAP_FIXED,
+           memFd, page) == MAP_FAILED))
+   {
+      munmap(pages, st.st_size);
+      return NULL;
+   }
+
+   ring = (lgNotifyRing_p)(pages + page);
+   size = ring->size;
+
+   if ((size == 0) || (size & (size - 1)) ||
+       ((off_t)(page + xRingBytes(size)) != st.st_size))
+   {
+      munmap(pages, st.st_size);
+      return NULL;
+   }
+
+   return ring;
+}
+
+void lgNotifyRingUnmap(lgNotifyRing_p ring)
+{
+   LG_DBG(LG_DEBUG_TRACE, "ring=*%p", (void*)ring);
+
+   if (ring) munmap(xRingWaiting(ring), xRingPage() + xRingBytes(ring->size));
+}
+
+/* ----------------------------------------------------------------------- */
+
+int lgNotifyRingRead(
+   lgNotifyRing_p ring,
+   uint64_t *seq,
+   lgGpioReport_t *reports,
+   int count,
+   uint64_t *lost)
+{
+   uint64_t head, write, next, skip;
+   uint32_t size, mask;
+   int i, n;
+
+   if ((ring == NULL) || (seq == NULL) || (reports == NULL) || (count < 1))
+      return 0;
+
+   size = ring->size;
+   mask = size - 1;
+   next = *seq;
+
+   head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+   if (head - next > size)
+   {
+      /* lapped, the oldest reports still in the ring come next */
+
+      skip = head - size - next;
+      if (lost) *lost += skip;
+      next += skip;
+   }
+
+   n = head - next;
+   if (n > count) n = count;
+
+   for (i=0; i<n; i++) reports[i] = ring->report[(next + i) & mask];
+
+   /* drop any report the alert thread overwrote while it was copied */
+
+   __atomic_thread_fence(__ATOMIC_ACQUIRE);
+   write = __atomic_load_n(&ring->write, __ATOMIC_RELAXED);
+
+   if (write - next > size)
+   {
+      skip = write - size - next;
+      if (skip > (uint64_t)n) skip = n;
+
+      memmove(reports, reports + skip, (n - skip) * sizeof(lgGpioReport_t));
+
+      if (lost) *lost += skip;
+      next += skip;
+      n -= skip;
+   }
+
+   *seq = next + n;
+
+   return n;
+}
+
+/* ----------------------------------------------------------------------- */
+
+int lgNotifyRingWait(
+   lgNotifyRing_p ring, int eventFd, uint64_t seq, int timeout_ms)
+{
+   struct pollfd pfd;
+   uint64_t count;
+
+   if (ring == NULL) return LG_BAD_POINTER;
+
+   if (__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) != seq) return 1;
+
+   /* pairs with the alert thread publishing head then checking waiting */
+
+   __atomic_store_n(xRingWaiting(ring), 1, __ATOMIC_SEQ_CST);
+
+   if (__atomic_load_n(&ring->head, __ATOMIC_SEQ_CST) == seq)
+   {
+      pfd.fd = eventFd;
+      pfd.events = POLLIN;
+      pfd.revents = 0;
+
+      if (poll(&pfd, 1, timeout_ms) > 0)
+      {
+         /* only resets the doorbell, the ring says what arrived */
+
+         if (read(eventFd, &count, sizeof(count)) != sizeof(count))
+            LG_DBG(LG_DEBUG_USER, "doorbell read failed (%m)");
+      }
+   }
+
+   __atomic_store_n(xRingWaiting(ring), 0, __ATOMIC_SEQ_CST);
+
+   return __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) != seq;
+}
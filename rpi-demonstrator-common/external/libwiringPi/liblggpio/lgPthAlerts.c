@@ -25,14 +25,17 @@ OTHER DEALINGS IN THE SOFTWARE.
 For more information, please refer to <http://unlicense.org/>
 */
 
-#define _GNU_SOURCE /* needed for ppoll */
+#define _GNU_SOURCE /* needed for pthread_setname_np */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <errno.h>
 #include <unistd.h>
 #include <string.h>
-#include <poll.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
 
 #include "lgDbg.h"
 #include "lgHdl.h"
@@ -41,28 +44,181 @@ For more information, please refer to <http://unlicense.org/>
 
 #define LG_MAX_ALERTS 2000
 #define LG_GPIO_MAX_ALERTS_PER_READ 128
+#define LG_ALERT_EPOLL_EVENTS 64
+
+/*
+The 50 microsecond leeway is to make sure the kernel has supplied
+current data for all GPIO before timing out debounce and watchdogs.
+
+Reports are held back 500 microseconds to make sure they are
+emitted in time order.
+*/
+#define LG_ALERT_LEEWAY_NANOS 50000
+#define LG_ALERT_HOLD_NANOS 500000
+
+/* longest wait for the alert thread to let go of a cancelled alert */
+#define LG_ALERT_CANCEL_NANOS 100000000
 
 pthread_t pthAlert;
 pthread_mutex_t lgAlertMutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t lgAlertFreed = PTHREAD_COND_INITIALIZER;
 volatile lgAlertRec_p alertRec = NULL;
-pthread_mutex_t lgAlertCondMutex = PTHREAD_MUTEX_INITIALIZER;
-pthread_cond_t lgAlertCond = PTHREAD_COND_INITIALIZER;
 int pthAlertRunning = LG_THREAD_NONE;
 
+/*
+The alert thread sleeps in epoll_wait on the line fds of all active
+alerts, a timerfd armed to the earliest debounce, watchdog or emit
+deadline, and an eventfd used to wake it when the alerts change.
+The sentinel data.ptr values tell the timer and wake fds apart from
+alert records.
+*/
+static int alertEpfd = -1;
+static int alertTimerFd = -1;
+static int alertWakeFd = -1;
+
+/*
+Each alert record queues its reports in its own ring.  Due reports
+are merged from the rings in time order into aBuf, a batch at a time,
+for the samples function and the notification pipes.
+*/
 lgGpioAlert_t aBuf[LG_MAX_ALERTS];
 
-static void xWaitForSignal(pthread_cond_t *cond, pthread_mutex_t *mutex)
+static lgAlertRec_p *mergeHeap = NULL;
+static int mergeHeapSize = 0;
+
+static void xAlertWake(void)
+{
+   uint64_t one = 1;
+
+   if (alertWakeFd >= 0)
+   {
+      if (write(alertWakeFd, &one, sizeof(one)) != sizeof(one))
+         LG_DBG(LG_DEBUG_ALWAYS, "wake failed (%s)", strerror(errno));
+   }
+}
+
+static void xAlertDrain(int fd)
+{
+   uint64_t ticks;
+
+   if (read(fd, &ticks, sizeof(ticks)) < 0)
+   {
+      if (errno != EAGAIN)
+         LG_DBG(LG_DEBUG_ALWAYS, "drain failed (%s)", strerror(errno));
+   }
+}
+
+static uint64_t xAlertDeadline(lgAlertRec_p p, uint64_t next)
 {
-   pthread_mutex_lock(mutex);
-   pthread_cond_wait(cond, mutex);
-   pthread_mutex_unlock(mutex);
+   uint64_t t;
+
+   /* first time at which xDebWatEvt(p, now-leeway) will report */
+
+   if (p->debounce_nanos && !p->debounced)
+   {
+      t = p->last_evt_ts + p->debounce_nanos + LG_ALERT_LEEWAY_NANOS + 1;
+      if (t < next) next = t;
+   }
+
+   if (p->watchdog_nanos && !p->watchdogd)
+   {
+      t = p->last_rpt_ts + p->watchdog_nanos + LG_ALERT_LEEWAY_NANOS + 1;
+      if (t < next) next = t;
+   }
+
+   return next;
 }
 
-void xSendUnwaitSignal(pthread_cond_t *cond, pthread_mutex_t *mutex)
+static void xAlertArm(uint64_t next, uint64_t *armed)
 {
-   pthread_mutex_lock(mutex);
-   pthread_cond_signal(cond);
-   pthread_mutex_unlock(mutex);
+   struct itimerspec its;
+
+   if (next == *armed) return;
+
+   memset(&its, 0, sizeof(its));
+
+   if (next != UINT64_MAX)
+   {
+      its.it_value.tv_sec = next / 1000000000;
+      its.it_value.tv_nsec = next % 1000000000;
+   }
+   /* else all zero, disarm */
+
+   if (timerfd_settime(alertTimerFd, TFD_TIMER_ABSTIME, &its, NULL) < 0)
+      LG_DBG(LG_DEBUG_ALWAYS, "timerfd_settime failed (%s)", strerror(errno));
+
+   *armed = next;
+}
+
+/*
+The ring is single producer, single consumer.  Both ends run in the
+alert thread, the atomics let lgPthAlertStats read the fill level
+and counters from any thread without stopping it.
+*/
+
+static uint32_t xRingUsed(lgAlertRec_p p)
+{
+   return __atomic_load_n(&p->head, __ATOMIC_ACQUIRE) -
+          __atomic_load_n(&p->tail, __ATOMIC_ACQUIRE);
+}
+
+static lgGpioAlert_p xRingFirst(lgAlertRec_p p)
+{
+   return &p->ring[p->tail & (p->depth - 1)];
+}
+
+static void xRingPush(lgAlertRec_p p, uint64_t timestamp, int level)
+{
+   uint32_t head = p->head;
+   uint32_t used = head - __atomic_load_n(&p->tail, __ATOMIC_ACQUIRE);
+   lgGpioAlert_p a;
+
+   __atomic_add_fetch(&p->events, 1, __ATOMIC_RELAXED);
+
+   if (used >= p->depth)
+   {
+      /* the report is lost but the debounce/watchdog state moves on */
+
+      if (__atomic_add_fetch(&p->dropped, 1, __ATOMIC_RELAXED) == 1)
+         LG_DBG(LG_DEBUG_ALWAYS, "gpio %d: more than %d alerts queued",
+            p->gpio, p->depth);
+      return;
+   }
+
+   a = &p->ring[head & (p->depth - 1)];
+
+   a->report.timestamp = timestamp;
+   a->report.level = level;
+   a->report.chip = p->chip->gpiochip;
+   a->report.gpio = p->gpio;
+   a->report.flags = 0;
+   a->nfyHandle = p->nfyHandle;
+
+   __atomic_store_n(&p->head, head + 1, __ATOMIC_RELEASE);
+
+   if (++used > p->high_water)
+      __atomic_store_n(&p->high_water, used, __ATOMIC_RELAXED);
+}
+
+static void xRingAlertFunc(lgAlertRec_p p, uint32_t from)
+{
+   uint32_t first;
+   uint32_t n;
+
+   /* pass the reports queued since from, in up to two pieces */
+
+   if (p->state->alertFunc == NULL) return;
+
+   while (from != p->head)
+   {
+      first = from & (p->depth - 1);
+      n = p->head - from;
+      if (n > (p->depth - first)) n = p->depth - first;
+
+      (p->state->alertFunc)(n, &p->ring[first], p->state->userdata);
+
+      from += n;
+   }
 }
 
 int tscomp(const void *p1, const void *p2)
@@ -70,7 +226,9 @@ int tscomp(const void *p1, const void *p2)
    const lgGpioAlert_t *e1 = p1;
    const lgGpioAlert_t *e2 = p2;
 
-   return e1->report.timestamp - e2->report.timestamp;
+   /* the difference of two timestamps may not fit an int */
+   return (e1->report.timestamp > e2->report.timestamp) -
+          (e1->report.timestamp < e2->report.timestamp);
 }
 
 uint64_t xMonotonicTimestamp(void)
@@ -82,168 +240,188 @@ uint64_t xMonotonicTimestamp(void)
    return ((uint64_t)1E9 * xts.tv_sec) + xts.tv_nsec;
 }
 
-void emitNotifications(int count)
+static void xNotifyWrite(int handle, lgGpioReport_t *report, int emit)
 {
-   static int maxHandles = 20;
-   static int *handles = NULL;
-   lgGpioReport_t report[LG_MAX_ALERTS];
-   int numHandles;
-   int i;
-   int status;
    lgNotify_t *h;
-   int emit;
-   int d;
-   int sent;
    int max_emits;
+   int sent;
+   int n;
    int err;
 
-   if (handles == NULL) handles = malloc(sizeof(int) * maxHandles);
+   if (lgHdlGetLockedObjTrusted(handle, LG_HDL_TYPE_NOTIFY, (void **)&h) < 0)
+      return;
 
-   numHandles = lgHdlGetHandlesForType(
-      LG_HDL_TYPE_NOTIFY, handles, maxHandles);
-   
-   if (numHandles > maxHandles)
+   if ((h->state == LG_NOTIFY_RUNNING) && h->ring)
    {
-      LG_DBG(LG_DEBUG_ALWAYS, "too many notifications");
-      numHandles = maxHandles;
+      lgNotifyRingWrite(h, report, emit);
    }
-
-   for (i=0; i<numHandles; i++)
+   else if (h->state == LG_NOTIFY_RUNNING)
    {
-      status = lgHdlGetLockedObjTrusted(
-         handles[i], LG_HDL_TYPE_NOTIFY, (void **)&h);
-      
-      if (status < 0) continue;
+      max_emits = h->max_emits;
 
-      if (h->state == LG_NOTIFY_CLOSING)
-      {
-         lgHdlFree(handles[i], LG_HDL_TYPE_NOTIFY);
-      }
-      else if (h->state >= LG_NOTIFY_RUNNING)
+      sent = 0;
+
+      while (emit > 0)
       {
-         emit = 0;
+         n = (emit > max_emits) ? max_emits : emit;
+
+         err = write(h->fd, report+sent, n*sizeof(lgGpioReport_t));
 
-         if (h->state == LG_NOTIFY_RUNNING)
+         if (err != (n*sizeof(lgGpioReport_t)))
          {
-            for (d=0; d<count; d++)
+            if (err < 0)
             {
-               /* is this for this notify handle? */
-               if (handles[i] == aBuf[d].nfyHandle)
+               if ((errno != EAGAIN) && (errno != EWOULDBLOCK))
                {
-                  report[emit] = aBuf[d].report;
-                  emit++;
-               }
-            }
-         }
+                  /* serious error, no point continuing */
 
-         if (emit)
-         {
-            max_emits = h->max_emits;
+                  LG_DBG(LG_DEBUG_ALWAYS, "fd=%d err=%d errno=%d",
+                     h->fd, err, errno);
 
-            sent = 0;
+                  LG_DBG(LG_DEBUG_ALWAYS, "%s", strerror(errno));
 
-            while (emit > 0)
-            {
-               if (emit > max_emits)
-               {
-                  err = write(h->fd,
-                           report+sent,
-                           max_emits*sizeof(lgGpioReport_t));
-
-                  if (err != (max_emits*sizeof(lgGpioReport_t)))
-                  {
-                     if (err < 0)
-                     {
-                        if ((errno != EAGAIN) && (errno != EWOULDBLOCK))
-                        {
-                           /* serious error, no point continuing */
-
-                           LG_DBG(LG_DEBUG_ALWAYS, "fd=%d err=%d errno=%d",
-                              h->fd, err, errno);
-
-                           LG_DBG(LG_DEBUG_ALWAYS, "%s", strerror(errno));
-
-                           h->state = LG_NOTIFY_CLOSING;
-                           break;
-                        }
-                        //else gpioStats.wouldBlockPipeWrite++;
-                     }
-                     else
-                     {
-                        //gpioStats.shortPipeWrite++;
-                        LG_DBG(LG_DEBUG_ALWAYS, "sent %zd, asked for %d",
-                           err/sizeof(lgGpioReport_t), max_emits);
-                     }
-                  }
-                  else
-                  {
-                     //gpioStats.goodPipeWrite++;
-                  }
-
-                  sent += max_emits;
-                  emit    -= max_emits;
-               }
-               else
-               {
-                  err = write(h->fd,
-                           report+sent,
-                           emit*sizeof(lgGpioReport_t));
-
-                  if (err != (emit*sizeof(lgGpioReport_t)))
-                  {
-                     if (err < 0)
-                     {
-                        if ((errno != EAGAIN) && (errno != EWOULDBLOCK))
-                        {
-                           LG_DBG(LG_DEBUG_ALWAYS, "fd=%d err=%d errno=%d",
-                              h->fd, err, errno);
-
-                           LG_DBG(LG_DEBUG_ALWAYS, "%s", strerror(errno));
-
-                           /* serious error, no point continuing */
-                           h->state = LG_NOTIFY_CLOSING;
-                           break;
-                        }
-                        //else gpioStats.wouldBlockPipeWrite++;
-                     }
-                     else
-                     {
-                        //gpioStats.shortPipeWrite++;
-                        LG_DBG(LG_DEBUG_ALWAYS, "sent %zd, asked for %d",
-                           err/sizeof(lgGpioReport_t), emit);
-                     }
-                  }
-                  else
-                  {
-                     //gpioStats.goodPipeWrite++;
-                  }
-
-                  sent += emit;
-                  emit = 0;
+                  h->state = LG_NOTIFY_CLOSING;
+                  break;
                }
+               //else gpioStats.wouldBlockPipeWrite++;
+            }
+            else
+            {
+               //gpioStats.shortPipeWrite++;
+               LG_DBG(LG_DEBUG_ALWAYS, "sent %zd, asked for %d",
+                  err/sizeof(lgGpioReport_t), n);
             }
          }
-      }
 
-      lgHdlUnlock(handles[i]);
+         sent += n;
+         emit -= n;
+      }
    }
+
+   if (h->state == LG_NOTIFY_CLOSING) lgHdlFree(handle, LG_HDL_TYPE_NOTIFY);
+
+   lgHdlUnlock(handle);
 }
 
-int emit(int count, uint64_t tmax)
+void emitNotifications(int count)
 {
-   int i;
+   static lgGpioReport_t report[LG_MAX_ALERTS];
+   int handle;
+   int emit;
+   int i, d;
+
+   /*
+   Send each notify handle its share of aBuf in one go.  Routed
+   entries are marked with a handle of -1, so each entry is looked
+   at once per distinct handle in the batch rather than once per
+   open handle.
+   */
 
    for (i=0; i<count; i++)
    {
-      if (aBuf[i].report.timestamp > tmax) break;
+      handle = aBuf[i].nfyHandle;
+
+      if (handle < 0) continue;
+
+      emit = 0;
+
+      for (d=i; d<count; d++)
+      {
+         if (aBuf[d].nfyHandle == handle)
+         {
+            report[emit++] = aBuf[d].report;
+            aBuf[d].nfyHandle = -1;
+         }
+      }
+
+      xNotifyWrite(handle, report, emit);
    }
- 
+}
+
+static void emit(int count)
+{
    if (lgGpioSamplesFunc)
-      (lgGpioSamplesFunc)(i, aBuf, lgGpioSamplesUserdata);
-   
-   emitNotifications(i);
+      (lgGpioSamplesFunc)(count, aBuf, lgGpioSamplesUserdata);
+
+   emitNotifications(count);
+}
+
+static uint64_t xMergeKey(lgAlertRec_p p)
+{
+   return xRingFirst(p)->report.timestamp;
+}
+
+static void xMergeDown(int n, int i)
+{
+   lgAlertRec_p t;
+   int c;
+
+   while ((c = (2 * i) + 1) < n)
+   {
+      if (((c + 1) < n) &&
+          (xMergeKey(mergeHeap[c+1]) < xMergeKey(mergeHeap[c]))) c++;
+
+      if (xMergeKey(mergeHeap[i]) <= xMergeKey(mergeHeap[c])) break;
+
+      t = mergeHeap[i]; mergeHeap[i] = mergeHeap[c]; mergeHeap[c] = t;
+
+      i = c;
+   }
+}
+
+static int xMergeDue(lgAlertRec_p p, uint64_t tmax)
+{
+   /* a cancelled alert has everything it queued flushed */
 
-   return i;
+   if (p->tail == p->head) return 0;
+   if (!p->active) return 1;
+   return xRingFirst(p)->report.timestamp <= tmax;
+}
+
+static void xMergeEmit(lgAlertRec_p head, uint64_t tmax)
+{
+   lgAlertRec_p p, *grown;
+   int i, n, records;
+   int count=0;
+
+   /* k-way merge of the due reports of every ring, oldest first */
+
+   records = 0;
+   for (p=head; p!=NULL; p=p->next) records++;
+
+   if (records > mergeHeapSize)
+   {
+      grown = realloc(mergeHeap, records * sizeof(lgAlertRec_p));
+      if (grown == NULL) return; /* try again next time */
+      mergeHeap = grown;
+      mergeHeapSize = records;
+   }
+
+   n = 0;
+   for (p=head; (p!=NULL) && (n<records); p=p->next)
+      if (xMergeDue(p, tmax)) mergeHeap[n++] = p;
+
+   for (i=(n/2)-1; i>=0; i--) xMergeDown(n, i);
+
+   while (n)
+   {
+      p = mergeHeap[0];
+
+      aBuf[count++] = *xRingFirst(p);
+      __atomic_store_n(&p->tail, p->tail + 1, __ATOMIC_RELEASE);
+
+      if (!xMergeDue(p, tmax)) mergeHeap[0] = mergeHeap[--n];
+
+      xMergeDown(n, 0);
+
+      if (count == LG_MAX_ALERTS)
+      {
+         emit(count);
+         count = 0;
+      }
+   }
+
+   if (count) emit(count);
 }
 
 void printbuf(int count, char *str)
@@ -279,8 +457,7 @@ void lgcheck(int count, char *str)
    }
 }
 
-void xDebWatEvt(
-   lgAlertRec_p p, uint64_t ts, int *cp, struct gpio_v2_line_event *ep)
+void xDebWatEvt(lgAlertRec_p p, uint64_t ts, struct gpio_v2_line_event *ep)
 {
    int64_t nano_diff;
 
@@ -319,25 +496,12 @@ void xDebWatEvt(
             LG_DBG(LG_DEBUG_ALWAYS, "g=%d(%d) diff=%"PRId64" deb=%"PRIu64" ts=%"PRIu64" lts=%"PRIu64"",
                p->gpio, p->last_evt_lv, nano_diff, p->debounce_nanos, ts/100000, p->last_evt_ts/100000);
             */
-            aBuf[*cp].report.timestamp = p->last_evt_ts + p->debounce_nanos;
-            aBuf[*cp].report.level = p->last_evt_lv;
-            aBuf[*cp].report.chip = p->chip->gpiochip;
-            aBuf[*cp].report.gpio = p->gpio;
-            aBuf[*cp].report.flags = 0;
-            aBuf[*cp].nfyHandle = p->nfyHandle;
-
-            if (++(*cp) < LG_MAX_ALERTS)
-            {
-               p->last_rpt_ts = p->last_evt_ts + p->debounce_nanos;
-               p->last_rpt_lv = p->last_evt_lv;
-               p->debounced = 1;
-               p->watchdogd = 0;
-            }
-            else
-            {
-               --(*cp);
-               LG_DBG(LG_DEBUG_ALWAYS, "more than %d alerts", LG_MAX_ALERTS);
-            }
+            xRingPush(p, p->last_evt_ts + p->debounce_nanos, p->last_evt_lv);
+
+            p->last_rpt_ts = p->last_evt_ts + p->debounce_nanos;
+            p->last_rpt_lv = p->last_evt_lv;
+            p->debounced = 1;
+            p->watchdogd = 0;
          }
       }
    }
@@ -366,24 +530,11 @@ void xDebWatEvt(
          LG_DBG(LG_DEBUG_ALWAYS, "g=%d(2) diff=%"PRId64" wdg=%"PRIu64" ts=%"PRIu64" lts=%"PRIu64"",
             p->gpio, nano_diff, p->watchdog_nanos, ts/100000, p->last_rpt_ts/100000);
          */
-         aBuf[*cp].report.timestamp = p->last_rpt_ts + p->watchdog_nanos;
-         aBuf[*cp].report.level = LG_TIMEOUT;
-         aBuf[*cp].report.chip = p->chip->gpiochip;
-         aBuf[*cp].report.gpio = p->gpio;
-         aBuf[*cp].report.flags = 0;
-         aBuf[*cp].nfyHandle = p->nfyHandle;
-
-         if (++(*cp) < LG_MAX_ALERTS)
-         {
-            p->watchdogd = 1;
-            p->last_rpt_ts = p->last_rpt_ts + p->watchdog_nanos;
-            p->last_rpt_lv = LG_TIMEOUT;
-         }
-         else
-         {
-            --(*cp);
-            LG_DBG(LG_DEBUG_ALWAYS, "more than %d alerts", LG_MAX_ALERTS);
-         }
+         xRingPush(p, p->last_rpt_ts + p->watchdog_nanos, LG_TIMEOUT);
+
+         p->watchdogd = 1;
+         p->last_rpt_ts = p->last_rpt_ts + p->watchdog_nanos;
+         p->last_rpt_lv = LG_TIMEOUT;
       }
    }
 
@@ -395,232 +546,188 @@ void xDebWatEvt(
 
       if (!p->debounce_nanos) // report straightaway if no debounce
       {
+         xRingPush(p, p->last_evt_ts, p->last_evt_lv);
 
-         aBuf[*cp].report.timestamp = p->last_evt_ts;
-         aBuf[*cp].report.level = p->last_evt_lv; 
-         aBuf[*cp].report.chip = p->chip->gpiochip;
-         aBuf[*cp].report.gpio = p->gpio;
-         aBuf[*cp].report.flags = 0;
-         aBuf[*cp].nfyHandle = p->nfyHandle;
-
-         if (++(*cp) < LG_MAX_ALERTS)
-         {
-            p->watchdogd = 0;
-            p->last_rpt_ts = p->last_evt_ts;
-            p->last_rpt_lv = p->last_evt_lv;
-         }
-         else
-         {
-            --(*cp);
-            LG_DBG(LG_DEBUG_ALWAYS, "more than %d alerts", LG_MAX_ALERTS);
-         }
+         p->watchdogd = 0;
+         p->last_rpt_ts = p->last_evt_ts;
+         p->last_rpt_lv = p->last_evt_lv;
       }
    }
 }
 
 void *lgPthAlert(void)
 {
-   lgAlertRec_p p, t;
-   int i, e;
-   int num_gpio;
-   int gpiobasecount;
-   int retval;
-   int count=0;
-   int sent;
+   lgAlertRec_p p, t, head;
+   int i, n, e;
+   int active;
+   int freed;
+   int pending;
    int bytes;
-   uint64_t lastGT=0;
-   uint64_t lastLT=0;
-   uint64_t nowLT;
-   uint64_t nowGT;
-   struct pollfd pfd[64];
-   lgAlertRec_p pAlertRec[64];
+   uint32_t from;
+   uint64_t now;
+   uint64_t next;
+   uint64_t armed=UINT64_MAX;
+   struct epoll_event ev[LG_ALERT_EPOLL_EVENTS];
    struct gpio_v2_line_event eIn[LG_GPIO_MAX_ALERTS_PER_READ];
-   struct timespec tspec = {0, 5e5}; /* 0.5 ms timeout */
 
    while (1)
    {
-      pthread_mutex_lock(&lgAlertMutex);
+      n = epoll_wait(alertEpfd, ev, LG_ALERT_EPOLL_EVENTS, -1);
 
-      if (alertRec != NULL)
+      if (n < 0)
       {
-         p = alertRec;
-         i = 0;
+         if (errno != EINTR)
+         {
+            LG_DBG(LG_DEBUG_ALWAYS, "epoll_wait failed (%s)", strerror(errno));
+            usleep(1000);
+         }
+         n = 0;
+      }
 
-         /* poll active alerts */
+      for (i=0; i<n; i++)
+      {
+         if (ev[i].data.ptr == &alertTimerFd)
+         {
+            xAlertDrain(alertTimerFd);
+            armed = 0; /* expired, force a rearm */
+            continue;
+         }
 
-         while (p != NULL)
+         if (ev[i].data.ptr == &alertWakeFd)
          {
-            if (p->active)
+            xAlertDrain(alertWakeFd);
+            continue;
+         }
+
+         p = ev[i].data.ptr;
+
+         /* only this thread frees records, so p is still valid */
+
+         if (!p->active) continue;
+
+         from = p->head;
+
+         bytes = read(p->fd, &eIn, sizeof(eIn));
+
+         if (bytes > 0)
+         {
+            e = 0;
+
+            while (bytes >= sizeof(eIn[0]))
             {
-               pfd[i].fd= p->state->fd;
-               pfd[i].events = POLLIN|POLLPRI;
-               pAlertRec[i] = p;
-               i++;
+               /* debounce and watchdog */
+               xDebWatEvt(p, eIn[e].timestamp_ns, &eIn[e]);
+
+               bytes -= sizeof(eIn[0]);
+
+               e++;
             }
-            else
+
+            if (e) p->last_rpt_ts = eIn[e-1].timestamp_ns;
+
+            if (bytes)
             {
-               /* delete inactive record */
+               if (p->active)
+                  LG_DBG(LG_DEBUG_ALWAYS, "bytes left=%d (%s)",
+                     bytes, strerror(errno));
+            }
+         }
+         else if ((bytes < 0) && (errno != EAGAIN))
+         {
+            if (p->active)
+               LG_DBG(LG_DEBUG_ALWAYS, "read error %d (%s)",
+                  errno, strerror(errno));
+         }
 
-               if (p->prev) p->prev->next = p->next;
-               else alertRec = p->next;
+         xRingAlertFunc(p, from);
+      }
 
-               if (p->next) p->next->prev = p->prev;
+      /*
+      Records are only unlinked by this thread and new ones are
+      added at the head, so the list from head on can be walked
+      unlocked while the callbacks run.
+      */
 
-               t = p; p = p->prev; free(t);
-            }
+      pthread_mutex_lock(&lgAlertMutex);
+      head = alertRec;
+      pthread_mutex_unlock(&lgAlertMutex);
 
-            if (p) p = p->next;
-         }
+      /* time out debounce and watchdogs, find the next deadline */
 
-         num_gpio = i;
+      now = xMonotonicTimestamp();
+      next = UINT64_MAX;
+      active = 0;
 
-         pthread_mutex_unlock(&lgAlertMutex);
+      for (p=head; p!=NULL; p=p->next)
+      {
+         if (!p->active) continue;
 
-         if (num_gpio > 0)
-         {
-            retval = ppoll(pfd, num_gpio, &tspec, NULL);
+         active++;
 
-            nowLT = xMonotonicTimestamp();
+         from = p->head;
 
-            for (i=0; i<num_gpio; i++)
-            {
-               gpiobasecount = count;
+         xDebWatEvt(p, now-LG_ALERT_LEEWAY_NANOS, NULL);
 
-               p = pAlertRec[i];
+         xRingAlertFunc(p, from);
 
-               if ((retval > 0) && (pfd[i].revents))
-               {
-                  /* GPIO changed during ppoll */
-
-                  bytes = read(pfd[i].fd, &eIn, sizeof(eIn));
-
-                  if (bytes > 0)
-                  {
-                     e = 0;
-
-                     while (bytes >= sizeof(eIn[0]))
-                     {
-                        /* debounce and watchdog */
-                        xDebWatEvt(p, eIn[e].timestamp_ns, &count, &eIn[e]);
-
-                        bytes -= sizeof(eIn[0]);
-
-                        e++;
-                     }
-
-                     if (e)
-                     {
-                        p->last_rpt_ts = eIn[e-1].timestamp_ns;
-
-                        if (eIn[e-1].timestamp_ns > lastGT)
-                        {
-                           lastGT = eIn[e-1].timestamp_ns;
-                           lastLT = nowLT;
-                        }
-                     }
-
-                     if (bytes)
-                     {
-                        if (p->active)
-                           LG_DBG(LG_DEBUG_ALWAYS, "bytes left=%d (%s)",
-                              bytes, strerror(errno));
-                     }
-                  }
-                  else
-                  {
-                     if (p->active)
-                        LG_DBG(LG_DEBUG_ALWAYS, "read error %d (%s)",
-                           errno, strerror(errno));
-                  }
-               }
+         next = xAlertDeadline(p, next);
+      }
 
-               if (gpiobasecount < count)
-               {
-                  if (p->state->alertFunc)
-                  {
-                     (p->state->alertFunc)(count-gpiobasecount,
-                        &aBuf[gpiobasecount], p->state->userdata);
-                  }
-               }
-            }
+      /* emit any due alerts, everything if no alert is left */
 
-            nowGT = lastGT + (nowLT - lastLT);
+      xMergeEmit(head, active ? now-LG_ALERT_HOLD_NANOS : UINT64_MAX);
 
-            // LG_DBG(LG_DEBUG_ALWAYS, "ts=%"PRIu64"", nowGT/100000);
+      for (p=head; p!=NULL; p=p->next)
+      {
+         if (p->active && (p->tail != p->head))
+         {
+            if ((xRingFirst(p)->report.timestamp + LG_ALERT_HOLD_NANOS) < next)
+               next = xRingFirst(p)->report.timestamp + LG_ALERT_HOLD_NANOS;
+         }
+      }
 
-            if (lastGT)
-            {
-               for (i=0; i<num_gpio; i++)
-               {
-                  gpiobasecount = count;
-
-                  p = pAlertRec[i];
-
-                  // The 50 microsecond leeway is to make sure the
-                  // kernel has supplied current data for all GPIO
-                  // before timing out debounce and watchdogs.
-                  xDebWatEvt(p, nowGT-50000, &count, NULL);
-
-                  if (gpiobasecount < count)
-                  {
-                     if (p->state->alertFunc)
-                     {
-                        (p->state->alertFunc)(count-gpiobasecount,
-                           &aBuf[gpiobasecount], p->state->userdata);
-                     }
-                  }
-               }
-            }
+      /* delete inactive records, they are already out of the epoll set */
 
-            if (count > 1)
-            {
-               /*
-               LG_DBG(LG_DEBUG_ALWAYS, "nowGT=%"PRIu64" count=%d",
-                  nowGT/100000, count);
-               */
-               // printbuf(count, "pre qsort");
-               qsort(aBuf, count, sizeof(aBuf[0]), tscomp);
-               //lgcheck(count, "check post qsort");
-               // printbuf(count, "post qsort");
-            }
+      pthread_mutex_lock(&lgAlertMutex);
 
-            /* emit any due alerts */
+      freed = 0;
+      pending = 0;
+      p = alertRec;
 
-            // printbuf(count, "pre emit");
-            // delay 500 microseconds before reporting a GPIO
-            // to make sure the events are sorted in time order.
-            sent = emit(count, nowGT-500000);
+      while (p != NULL)
+      {
+         t = p;
+         p = p->next;
 
-            if (sent)
+         if (!t->active)
+         {
+            /* cancelled since the merge, flush it first */
+
+            if (t->tail != t->head)
             {
-               if (sent != count)
-               {
-                  /* shuffle entries down */
-                  memmove(aBuf, aBuf+sent, sizeof(aBuf[0])*(count-sent));
-               }
-               count -= sent;
+               pending++;
+               continue;
             }
-            //printbuf(count, "post emit");
-         }
-         else /* no active alerts */
-         {
-            emit(count, -1); /* empty the buffer */
-            count = 0;
-            lastGT = 0;
 
-            xWaitForSignal(&lgAlertCond, &lgAlertCondMutex);
+            if (t->prev) t->prev->next = t->next;
+            else alertRec = t->next;
+
+            if (t->next) t->next->prev = t->prev;
+
+            free(t);
+            freed++;
          }
       }
-      else /* no alerts */
-      {
-         pthread_mutex_unlock(&lgAlertMutex);
 
-         emit(count, -1); /* empty the buffer */
-         count = 0;
-         lastGT = 0;
+      if (freed) pthread_cond_broadcast(&lgAlertFreed);
 
-         xWaitForSignal(&lgAlertCond, &lgAlertCondMutex);
-      }
+      pthread_mutex_unlock(&lgAlertMutex);
+
+      if (pending) next = now; /* go round again straightaway */
+
+      /* nothing pending means no timer, and no wakeups until an edge */
+
+      xAlertArm(next, &armed);
    }
 
    pthAlertRunning = LG_THREAD_NONE;
@@ -630,51 +737,210 @@ void *lgPthAlert(void)
 
 void lgPthAlertStart(void)
 {
+   struct epoll_event ev;
+
    if (!pthAlertRunning)
    {
+      if (alertEpfd < 0)
+      {
+         alertEpfd = epoll_create1(EPOLL_CLOEXEC);
+         alertTimerFd = timerfd_create(
+            CLOCK_MONOTONIC, TFD_NONBLOCK|TFD_CLOEXEC);
+         alertWakeFd = eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC);
+
+         if ((alertEpfd < 0) || (alertTimerFd < 0) || (alertWakeFd < 0))
+         {
+            LG_DBG(LG_DEBUG_ALWAYS, "can't create alert fds (%s)",
+               strerror(errno));
+
+            if (alertEpfd >= 0) close(alertEpfd);
+            if (alertTimerFd >= 0) close(alertTimerFd);
+            if (alertWakeFd >= 0) close(alertWakeFd);
+
+            alertEpfd = alertTimerFd = alertWakeFd = -1;
+
+            return;
+         }
+
+         ev.events = EPOLLIN;
+         ev.data.ptr = &alertTimerFd;
+         epoll_ctl(alertEpfd, EPOLL_CTL_ADD, alertTimerFd, &ev);
+
+         ev.events = EPOLLIN;
+         ev.data.ptr = &alertWakeFd;
+         epoll_ctl(alertEpfd, EPOLL_CTL_ADD, alertWakeFd, &ev);
+      }
+
       if (pthread_create(&pthAlert, NULL, (void*)lgPthAlert, NULL) == 0)
       {
+         pthread_setname_np(pthAlert, "lgAlert");
          pthread_detach(pthAlert);
          pthAlertRunning = LG_THREAD_STARTED;
       }
    }
 }
 
-void lgPthAlertStop(lgChipObj_p chip)
+static int xAlertMatch(lgAlertRec_p p, lgChipObj_p chip, int gpio)
+{
+   return (p->chip == chip) && ((gpio < 0) || (p->gpio == gpio));
+}
+
+static void xAlertCancel(lgChipObj_p chip, int gpio)
 {
-   lgAlertRec_p evt;
+   lgAlertRec_p p;
+   int pending;
+   struct timespec ts;
+
+   /* gpio < 0 cancels every alert on the chip */
+
+   pthread_mutex_lock(&lgAlertMutex);
+
+   for (p=alertRec; p!=NULL; p=p->next)
+   {
+      if (p->active && xAlertMatch(p, chip, gpio))
+      {
+         epoll_ctl(alertEpfd, EPOLL_CTL_DEL, p->fd, NULL);
+         p->active = 0;
+      }
+   }
+
+   xAlertWake();
+
+   /*
+   Wait for the thread to free the records so the caller may close
+   the line fds.  Not from the thread itself (an alert function),
+   and not forever in case an alert function is blocked on us.
+   */
 
+   if (pthAlertRunning && !pthread_equal(pthread_self(), pthAlert))
+   {
+      clock_gettime(CLOCK_REALTIME, &ts);
+      ts.tv_nsec += LG_ALERT_CANCEL_NANOS;
+      ts.tv_sec += ts.tv_nsec / 1000000000;
+      ts.tv_nsec %= 1000000000;
+
+      while (1)
+      {
+         pending = 0;
+
+         for (p=alertRec; p!=NULL; p=p->next)
+            if (xAlertMatch(p, chip, gpio)) pending++;
+
+         if (!pending) break;
+
+         if (pthread_cond_timedwait(&lgAlertFreed, &lgAlertMutex, &ts))
+         {
+            LG_DBG(LG_DEBUG_ALWAYS, "alert thread busy, %d pending", pending);
+            break;
+         }
+      }
+   }
+
+   pthread_mutex_unlock(&lgAlertMutex);
+}
+
+void lgPthAlertStop(lgChipObj_p chip)
+{
    /* stop any alert reads on chip */
-   
-   for (evt=alertRec; evt!=NULL; evt=evt->next)
+
+   xAlertCancel(chip, -1);
+}
+
+void lgPthAlertCancel(lgChipObj_p chip, int gpio)
+{
+   xAlertCancel(chip, gpio);
+}
+
+void lgPthAlertRefresh(lgChipObj_p chip, int gpio)
+{
+   lgAlertRec_p p;
+
+   /* pick up new debounce and watchdog settings */
+
+   pthread_mutex_lock(&lgAlertMutex);
+
+   for (p=alertRec; p!=NULL; p=p->next)
    {
-      if (chip->handle == evt->chip->handle) evt->active =0;
+      if (p->active && xAlertMatch(p, chip, gpio))
+      {
+         p->debounce_nanos = p->state->debounce_us * 1e3;
+         p->watchdog_nanos = p->state->watchdog_us * 1e3;
+      }
    }
 
-   xSendUnwaitSignal(&lgAlertCond, &lgAlertCondMutex);
+   pthread_mutex_unlock(&lgAlertMutex);
+
+   xAlertWake(); /* deadlines may have moved */
 }
 
 lgAlertRec_p lgGpioGetAlertRec(lgChipObj_p chip, int gpio)
 {
-   lgAlertRec_p p = alertRec;
+   lgAlertRec_p p;
+
+   pthread_mutex_lock(&lgAlertMutex);
+
+   p = alertRec;
 
    while ((p != NULL) && ((p->chip != chip) || (p->gpio != gpio)))
       p = p->next;
+
+   pthread_mutex_unlock(&lgAlertMutex);
+
    return p;
 }
 
+int lgPthAlertStats(lgChipObj_p chip, int gpio, lgAlertStats_p stats)
+{
+   lgAlertRec_p p;
+   int status = LG_NOT_AN_ALERT;
+
+   pthread_mutex_lock(&lgAlertMutex);
+
+   for (p=alertRec; p!=NULL; p=p->next)
+   {
+      if (p->active && xAlertMatch(p, chip, gpio))
+      {
+         stats->events = __atomic_load_n(&p->events, __ATOMIC_RELAXED);
+         stats->dropped = __atomic_load_n(&p->dropped, __ATOMIC_RELAXED);
+         stats->depth = p->depth;
+         stats->queued = xRingUsed(p);
+         stats->high_water =
+            __atomic_load_n(&p->high_water, __ATOMIC_RELAXED);
+         status = LG_OKAY;
+         break;
+      }
+   }
+
+   pthread_mutex_unlock(&lgAlertMutex);
+
+   return status;
+}
+
 lgAlertRec_p lgGpioCreateAlertRec(
    lgChipObj_p chip, int gpio, lgLineInf_p state, int nfyHandle)
 {
    lgAlertRec_p p;
+   struct epoll_event ev;
+   uint32_t depth;
 
-   p = malloc(sizeof(lgAlertRec_t));
+   /* round the queue depth up to a power of 2 */
+
+   for (depth=1; depth<state->alert_depth; depth<<=1);
+
+   if (state->alert_depth <= 0) depth = LG_DEFAULT_ALERT_DEPTH;
+
+   /* the ring follows the record in the same allocation */
+
+   p = calloc(1, sizeof(lgAlertRec_t) + (depth * sizeof(lgGpioAlert_t)));
 
    if (p)
    {
+      p->ring = (lgGpioAlert_p)(p + 1);
+      p->depth = depth;
       p->chip = chip;
       p->gpio = gpio;
       p->state = state;
+      p->fd = state->fd;
       p->nfyHandle = nfyHandle;
       p->active = 1;
       p->debounced = 1;
@@ -683,18 +949,31 @@ lgAlertRec_p lgGpioCreateAlertRec(
       p->debounce_nanos = state->debounce_us * 1e3;
       p->watchdog_nanos = state->watchdog_us * 1e3;
       p->eFlags = state->eFlags;
+
+      ev.events = EPOLLIN|EPOLLPRI;
+      ev.data.ptr = p;
+
       pthread_mutex_lock(&lgAlertMutex);
 
+      if (epoll_ctl(alertEpfd, EPOLL_CTL_ADD, p->fd, &ev) < 0)
+      {
+         pthread_mutex_unlock(&lgAlertMutex);
+
+         LG_DBG(LG_DEBUG_ALWAYS, "can't watch gpio %d (%s)",
+            gpio, strerror(errno));
+
+         free(p);
+
+         return NULL;
+      }
+
       p->prev = NULL;
       p->next = alertRec;
       if (alertRec) alertRec->prev = p;
       alertRec = p;
 
       pthread_mutex_unlock(&lgAlertMutex);
-
-      xSendUnwaitSignal(&lgAlertCond, &lgAlertCondMutex);
    }
    return p;
 }
 
-
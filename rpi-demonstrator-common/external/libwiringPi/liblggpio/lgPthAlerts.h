@@ -47,8 +47,16 @@ typedef struct lgAlertRec_s
    int gpio;
    int nfyHandle;
    lgLineInf_p state;
+   int fd;
    int active;
    lgChipObj_p chip;
+   lgGpioAlert_p ring; /* reports queued for emission */
+   uint32_t depth;     /* ring entries, a power of 2 */
+   uint32_t head;      /* next entry to fill */
+   uint32_t tail;      /* next entry to emit */
+   uint32_t high_water;
+   uint64_t events;
+   uint64_t dropped;
    struct lgAlertRec_s *prev;
    struct lgAlertRec_s *next;
 } lgAlertRec_t, *lgAlertRec_p;
@@ -61,6 +69,9 @@ lgAlertRec_p lgGpioCreateAlertRec(
 void *lgPthAlert(void);
 void lgPthAlertStart(void);
 void lgPthAlertStop(lgChipObj_p chip);
+void lgPthAlertCancel(lgChipObj_p chip, int gpio);
+void lgPthAlertRefresh(lgChipObj_p chip, int gpio);
+int lgPthAlertStats(lgChipObj_p chip, int gpio, lgAlertStats_p stats);
 
 #endif
 
@@ -0,0 +1,343 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#define _GNU_SOURCE /* needed for memfd_create and pthread_setname_np */
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "lgpio.h"
+#include "rgpiod.h"
+
+#include "lgCtx.h"
+#include "lgDbg.h"
+
+/*
+The command rings of all clients are served by one thread. While
+commands keep arriving it polls the rings, for gShmPollMicros after the
+last one, so that a client need only write to shared memory. Otherwise
+it sleeps on the rings' doorbells, eventfds a client writes after
+submitting a command while the ring's polling flag is clear.
+*/
+
+typedef struct lgShm_s
+{
+   lgShmRing_p ring;
+   lgCtx_p ctx;     // context of the client owning the ring
+   int memFd;
+   int bellFd;
+   uint32_t tail;   // next slot to execute
+   struct lgShm_s *prev;
+   struct lgShm_s *next;
+} lgShm_t, *lgShm_p;
+
+static pthread_mutex_t sShmMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t sShmOnce = PTHREAD_ONCE_INIT;
+
+static lgShm_p sShmFirst = NULL;
+static int sShmEpollFd = -1;
+
+/* the poller is the only user, big enough for any command's reply */
+
+static lgCmd_t sShmCmdBuf[CMD_MAX_EXTENSION/sizeof(lgCmd_t)];
+
+static uint64_t xShmNanos(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+
+   return ((uint64_t)ts.tv_sec * 1000000000) + ts.tv_nsec;
+}
+
+static void xShmSetPolling(uint32_t polling)
+{
+   lgShm_p s;
+
+   for (s=sShmFirst; s; s=s->next)
+      __atomic_store_n(&s->ring->polling, polling, __ATOMIC_RELAXED);
+}
+
+static int xShmServe(void)
+{
+   lgShm_p s;
+   lgShmSlot_p slot;
+   lgCmd_p cmdP = sShmCmdBuf;
+   uint32_t state, old;
+   int size, count = 0;
+
+   for (s=sShmFirst; s; s=s->next)
+   {
+      lgCtxSet(s->ctx);
+
+      while (1)
+      {
+         slot = &s->ring->slot[s->tail % LG_SHM_SLOTS];
+
+         state = __atomic_load_n(&slot->state, __ATOMIC_ACQUIRE);
+
+         if ((state & ~LG_SHM_WAITING) != LG_SHM_SUBMITTED) break;
+
+         /* the slot is the client's memory, read each field once */
+
+         size = slot->size;
+         if (size > LG_SHM_MAX_EXT) size = LG_SHM_MAX_EXT;
+
+         cmdP->magic = LG_MAGIC;
+         cmdP->size = size;
+         cmdP->cmd = slot->cmd;
+         cmdP->doubles = 0;
+         cmdP->longs = size / 4;
+         cmdP->shorts = 0;
+         memcpy(&cmdP[1], slot->ext, size);
+
+         switch (cmdP->cmd)
+         {
+            /* these need the client's socket */
+
+            case LG_CMD_BATCH:
+            case LG_CMD_NOIB:
+            case LG_CMD_SHMO:
+               cmdP->status = LG_UNKNOWN_COMMAND;
+               break;
+
+            default:
+               cmdP->status = lgExecCmd(cmdP, sizeof(sShmCmdBuf));
+         }
+
+         slot->status = cmdP->status;
+
+         old = __atomic_exchange_n(
+            &slot->state, LG_SHM_DONE, __ATOMIC_ACQ_REL);
+
+         if (old & LG_SHM_WAITING)
+            syscall(SYS_futex, &slot->state, FUTEX_WAKE, 1, NULL, NULL, 0);
+
+         s->tail++;
+         count++;
+      }
+   }
+
+   lgCtxSet(NULL);
+
+   return count;
+}
+
+static void *pthShmThread(void *x)
+{
+   struct epoll_event ev[16];
+   lgShm_p s;
+   uint64_t bell, idle;
+   int served;
+
+   idle = xShmNanos();
+
+   while (1)
+   {
+      pthread_mutex_lock(&sShmMutex);
+      served = xShmServe();
+      pthread_mutex_unlock(&sShmMutex);
+
+      if (served) idle = xShmNanos();
+
+      if ((xShmNanos() - idle) < (uint64_t)gShmPollMicros * 1000)
+      {
+         /* let a client sharing the CPU submit its command */
+
+         if (!served) sched_yield();
+         continue;
+      }
+
+      /*
+      Clients ring the doorbell from now on. A command submitted before
+      a client saw the cleared flag is found by serving once more.
+      */
+
+      pthread_mutex_lock(&sShmMutex);
+      xShmSetPolling(0);
+      __atomic_thread_fence(__ATOMIC_SEQ_CST);
+      served = xShmServe();
+      pthread_mutex_unlock(&sShmMutex);
+
+      if (!served) epoll_wait(sShmEpollFd, ev, 16, -1);
+
+      pthread_mutex_lock(&sShmMutex);
+      for (s=sShmFirst; s; s=s->next)
+      {
+         if (read(s->bellFd, &bell, sizeof(bell))) ; /* drain, ignore errors */
+      }
+      if (gShmPollMicros) xShmSetPolling(1);
+      pthread_mutex_unlock(&sShmMutex);
+
+      idle = xShmNanos();
+   }
+
+   return NULL;
+}
+
+static void xShmStart(void)
+{
+   pthread_attr_t attr;
+   pthread_t thr;
+
+   sShmEpollFd = epoll_create1(EPOLL_CLOEXEC);
+
+   if (sShmEpollFd < 0)
+   {
+      LG_DBG(LG_DEBUG_ALWAYS, "epoll_create1 failed (%m)");
+      return;
+   }
+
+   if (pthread_attr_init(&attr) ||
+       pthread_attr_setstacksize(&attr, STACK_SIZE) ||
+       pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED) ||
+       pthread_create(&thr, &attr, pthShmThread, NULL))
+   {
+      LG_DBG(LG_DEBUG_ALWAYS, "command ring pthread_create failed (%m)");
+      close(sShmEpollFd);
+      sShmEpollFd = -1;
+      return;
+   }
+
+   pthread_setname_np(thr, "lgShm");
+}
+
+/* ----------------------------------------------------------------------- */
+
+int lgShmOpen(lgCtx_p ctx, void **shm)
+{
+   lgShm_p s;
+   struct epoll_event ev;
+
+   LG_DBG(LG_DEBUG_TRACE, "ctx=%p", (void *)ctx);
+
+   pthread_once(&sShmOnce, xShmStart);
+
+   if (sShmEpollFd < 0)
+      PARAM_ERROR(LG_INIT_FAILED, "no command ring thread");
+
+   s = calloc(1, sizeof(lgShm_t));
+
+   if (s == NULL) PARAM_ERROR(LG_NO_MEMORY, "no memory for command ring");
+
+   s->ctx = ctx;
+   s->memFd = memfd_create("lgshm", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+   s->bellFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+
+   if ((s->memFd < 0) || (s->bellFd < 0) ||
+       (ftruncate(s->memFd, sizeof(lgShmRing_t)) < 0))
+   {
+      if (s->memFd >= 0) close(s->memFd);
+      if (s->bellFd >= 0) close(s->bellFd);
+      free(s);
+      PARAM_ERROR(LG_NO_MEMORY, "can't create command ring (%m)");
+   }
+
+   /* the client can't shrink the ring from under the poller */
+
+   fcntl(s->memFd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL);
+
+   s->ring = mmap(NULL, sizeof(lgShmRing_t), PROT_READ | PROT_WRITE,
+      MAP_SHARED, s->memFd, 0);
+
+   if (s->ring == MAP_FAILED)
+   {
+      close(s->memFd);
+      close(s->bellFd);
+      free(s);
+      PARAM_ERROR(LG_NO_MEMORY, "can't map command ring (%m)");
+   }
+
+   s->ring->magic = LG_SHM_MAGIC;
+   s->ring->slots = LG_SHM_SLOTS;
+
+   ev.events = EPOLLIN;
+   ev.data.ptr = s;
+
+   pthread_mutex_lock(&sShmMutex);
+
+   if (epoll_ctl(sShmEpollFd, EPOLL_CTL_ADD, s->bellFd, &ev) < 0)
+   {
+      pthread_mutex_unlock(&sShmMutex);
+      munmap(s->ring, sizeof(lgShmRing_t));
+      close(s->memFd);
+      close(s->bellFd);
+      free(s);
+      PARAM_ERROR(LG_INIT_FAILED, "epoll_ctl failed (%m)");
+   }
+
+   s->next = sShmFirst;
+   if (sShmFirst) sShmFirst->prev = s;
+   sShmFirst = s;
+
+   pthread_mutex_unlock(&sShmMutex);
+
+   *shm = s;
+
+   return LG_OKAY;
+}
+
+void lgShmFds(void *shm, int *memFd, int *bellFd)
+{
+   lgShm_p s = shm;
+
+   *memFd = s->memFd;
+   *bellFd = s->bellFd;
+}
+
+void lgShmClose(void *shm)
+{
+   lgShm_p s = shm;
+
+   LG_DBG(LG_DEBUG_TRACE, "shm=%p", shm);
+
+   if (s == NULL) return;
+
+   /* once unlinked the poller no longer uses the ring or its context */
+
+   pthread_mutex_lock(&sShmMutex);
+
+   epoll_ctl(sShmEpollFd, EPOLL_CTL_DEL, s->bellFd, NULL);
+
+   if (s->prev) s->prev->next = s->next; else sShmFirst = s->next;
+   if (s->next) s->next->prev = s->prev;
+
+   pthread_mutex_unlock(&sShmMutex);
+
+   munmap(s->ring, sizeof(lgShmRing_t));
+   close(s->memFd);
+   close(s->bellFd);
+   free(s);
+}
@@ -25,10 +25,15 @@ OTHER DEALINGS IN THE SOFTWARE.
 For more information, please refer to <http://unlicense.org/>
 */
 
+#define _GNU_SOURCE /* needed for pthread_setname_np */
+
 #include <inttypes.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <sys/epoll.h>
 #include <sys/socket.h>
 #include <netinet/tcp.h>
 #include <arpa/inet.h>
@@ -40,99 +45,350 @@ For more information, please refer to <http://unlicense.org/>
 #include "lgDbg.h"
 #include "lgHdl.h"
 
-static void *xSocketThreadHandler(void *fdC)
+/*
+Clients are served by a fixed pool of worker threads waiting on one
+epoll set. Each client socket is armed one shot so that only one
+worker at a time reads a client and its commands are executed in the
+order sent. A worker takes on the client's context while it executes
+the client's commands.
+
+A frame is a command, or a batch of commands (LG_CMD_BATCH) whose
+extension holds the commands one after another. The replies to a batch
+are returned together in one frame, in the order of the commands. A
+command or batch with LG_CMD_NO_REPLY or'd into cmd is not replied to.
+
+Clients connect over TCP or, if rgpiod was started with -u, over a
+unix domain socket. Only the latter may open a shared memory command
+ring (LG_CMD_SHMO), whose file descriptors are passed in the reply.
+*/
+
+#define LG_SOCK_MAX_EXT (CMD_MAX_EXTENSION - sizeof(lgCmd_t))
+
+// headers for the most commands a batch can hold, plus their data
+
+#define LG_BATCH_REPLY_SIZE (sizeof(lgCmd_t) + (2 * CMD_MAX_EXTENSION))
+
+typedef struct
+{
+   int sock;
+   int local;    // connected over the unix domain socket
+   int got;      // bytes of incoming frames in buf
+   void *shm;    // command ring, if opened
+   lgCtx_t ctx;  // context used by whichever worker serves the client
+   uint8_t buf[sizeof(lgCmd_t) + CMD_MAX_EXTENSION];
+} lgSockClient_t, *lgSockClient_p;
+
+typedef struct
 {
-   int sock = *(int*)fdC;
-   int opt;
-   lgCtx_p Ctx;
    lgCmd_t cmdBuf[CMD_MAX_EXTENSION/sizeof(lgCmd_t)];
-   lgCmd_p cmdP=cmdBuf;
-   uint32_t *arg=(uint32_t*)&cmdP[1];
+   uint8_t reply[LG_BATCH_REPLY_SIZE];
+} lgSockWorker_t, *lgSockWorker_p;
 
-   free(fdC);
+static int sEpollFd = -1;
 
-   Ctx = lgCtxGet();
+static void xSocketSend(int sock, void *buf, int len)
+{
+   if (send(sock, buf, len, MSG_NOSIGNAL)) ; /* ignore errors */
 
-   if (!Ctx) return 0;
+   LG_DBG(LG_DEBUG_INTERNAL, "ret=%s", lgDbgStr2Hex(len, (char *)buf));
+}
 
-   /* Disable the Nagle algorithm. */
-   opt = 1;
+static void xSocketBatch(
+   lgSockWorker_p w, lgSockClient_p c, lgCmd_p batch, uint8_t *ext)
+{
+   lgCmd_p cmdP = w->cmdBuf;
+   lgCmd_p rep = (lgCmd_p)w->reply;
+   uint8_t *out = (uint8_t *)&rep[1];
+   uint32_t pos = 0;
+   uint32_t data = 0;
+   int replies = 0;
+   int noReply, quiet, bad;
 
-   setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (char*)&opt, sizeof(int));
+   noReply = batch->cmd & LG_CMD_NO_REPLY;
 
-   while (1)
+   while (pos < batch->size)
    {
-      if (recv(sock, cmdP, sizeof(lgCmd_t), MSG_WAITALL) !=
-         sizeof(lgCmd_t)) break;
-
-      LG_DBG(LG_DEBUG_INTERNAL, "magic=%d size=%d cmd=%d Q=%d I=%d H=%d",
-         cmdP->magic, cmdP->size, cmdP->cmd,
-         cmdP->doubles, cmdP->longs, cmdP->shorts);
+      if ((batch->size - pos) < sizeof(lgCmd_t)) bad = 1;
+      else
+      {
+         memcpy(cmdP, ext+pos, sizeof(lgCmd_t));
+         bad = cmdP->size > (batch->size - pos - sizeof(lgCmd_t));
+      }
 
-      if (cmdP->size)
+      if (bad)
       {
-         if (cmdP->size < (sizeof(cmdBuf)-sizeof(lgCmd_t)))
-         {
-            /* read extension into buf */
-            if (recv(sock, &cmdBuf[1], cmdP->size, MSG_WAITALL) != cmdP->size)
-            {
-               /* Serious error.  No point continuing. */
+         /* the rest of the batch can't be parsed, reply and stop */
 
-               LG_DBG(LG_DEBUG_ALWAYS,
-                  "recv failed for %"PRId32" bytes, sock=%d",
-                  cmdP->size, sock);
+         LG_DBG(LG_DEBUG_ALWAYS, "bad batch at %"PRIu32", sock=%d",
+            pos, c->sock);
 
-               break;
-            }
-         }
-         else
+         if (!noReply)
          {
-            /* Serious error.  No point continuing. */
+            memset(cmdP, 0, sizeof(lgCmd_t));
+            cmdP->status = LG_BAD_BATCH;
+            memcpy(out, cmdP, sizeof(lgCmd_t));
+            out += sizeof(lgCmd_t);
+            replies++;
+         }
 
-            LG_DBG(LG_DEBUG_ALWAYS,
-               "message too large %"PRId32"(%zd), sock=%d",
-               cmdP->size, sizeof(cmdBuf)-sizeof(lgCmd_t), sock);
+         break;
+      }
 
-            break;
-         }
+      memcpy(&cmdP[1], ext+pos+sizeof(lgCmd_t), cmdP->size);
+
+      pos += sizeof(lgCmd_t) + cmdP->size;
+
+      quiet = noReply || (cmdP->cmd & LG_CMD_NO_REPLY);
+
+      cmdP->cmd &= ~LG_CMD_NO_REPLY;
+
+      /* a notification needs a socket of its own */
+
+      if ((cmdP->cmd == LG_CMD_BATCH) || (cmdP->cmd == LG_CMD_NOIB) ||
+          (cmdP->cmd == LG_CMD_SHMO))
+      {
+         cmdP->status = LG_BAD_BATCH;
+         cmdP->size = 0;
       }
+      else cmdP->status = lgExecCmd(cmdP, sizeof(w->cmdBuf));
+
+      if (quiet) continue;
+
+      if ((data + cmdP->size) > CMD_MAX_EXTENSION)
+      {
+         cmdP->status = LG_BATCH_TOO_BIG;
+         cmdP->size = 0;
+      }
+
+      memcpy(out, cmdP, sizeof(lgCmd_t) + cmdP->size);
+      out += sizeof(lgCmd_t) + cmdP->size;
+      data += cmdP->size;
+      replies++;
+   }
+
+   LG_DBG(LG_DEBUG_INTERNAL, "batch of %"PRIu32" bytes, %d replies",
+      batch->size, replies);
+
+   if (noReply) return;
+
+   rep->status = replies;
+   rep->size = out - (uint8_t *)&rep[1];
+   rep->cmd = LG_CMD_BATCH;
+   rep->doubles = 0;
+   rep->longs = 0;
+   rep->shorts = 0;
+
+   xSocketSend(c->sock, rep, sizeof(lgCmd_t) + rep->size);
+}
+
+static void xSocketShm(lgSockClient_p c, lgCmd_p cmdP, int noReply)
+{
+   struct msghdr msg;
+   struct iovec iov;
+   struct cmsghdr *cm;
+   union
+   {
+      char buf[CMSG_SPACE(2 * sizeof(int))];
+      struct cmsghdr align;
+   } ctl;
+   int fd[2];
+
+   cmdP->size = 0;
+
+   if (!c->local) cmdP->status = LG_SHM_NOT_LOCAL;
+   else if (c->shm == NULL)
+      cmdP->status = lgShmOpen(&c->ctx, &c->shm);
+   else cmdP->status = LG_OKAY;
+
+   if (noReply) return;
+
+   if (cmdP->status < 0)
+   {
+      xSocketSend(c->sock, cmdP, sizeof(lgCmd_t));
+      return;
+   }
+
+   /* the ring's memfd and doorbell ride with the reply */
+
+   lgShmFds(c->shm, &fd[0], &fd[1]);
+
+   memset(&msg, 0, sizeof(msg));
+   memset(&ctl, 0, sizeof(ctl));
+
+   iov.iov_base = cmdP;
+   iov.iov_len = sizeof(lgCmd_t);
+
+   msg.msg_iov = &iov;
+   msg.msg_iovlen = 1;
+   msg.msg_control = ctl.buf;
+   msg.msg_controllen = sizeof(ctl.buf);
+
+   cm = CMSG_FIRSTHDR(&msg);
+   cm->cmsg_level = SOL_SOCKET;
+   cm->cmsg_type = SCM_RIGHTS;
+   cm->cmsg_len = CMSG_LEN(2 * sizeof(int));
+   memcpy(CMSG_DATA(cm), fd, sizeof(fd));
+
+   if (sendmsg(c->sock, &msg, MSG_NOSIGNAL)) ; /* ignore errors */
+}
+
+static void xSocketFrame(
+   lgSockWorker_p w, lgSockClient_p c, lgCmd_p hdr, uint8_t *ext)
+{
+   lgCmd_p cmdP = w->cmdBuf;
+   uint32_t *arg = (uint32_t*)&cmdP[1];
+   int noReply;
+   int opt;
+
+   LG_DBG(LG_DEBUG_INTERNAL, "magic=%d size=%d cmd=%d Q=%d I=%d H=%d",
+      hdr->magic, hdr->size, hdr->cmd,
+      hdr->doubles, hdr->longs, hdr->shorts);
+
+   if ((hdr->cmd & ~LG_CMD_NO_REPLY) == LG_CMD_BATCH)
+   {
+      xSocketBatch(w, c, hdr, ext);
+      return;
+   }
+
+   noReply = hdr->cmd & LG_CMD_NO_REPLY;
+
+   *cmdP = *hdr;
+   cmdP->cmd &= ~LG_CMD_NO_REPLY;
+   memcpy(&cmdP[1], ext, hdr->size);
+
+   if (cmdP->cmd == LG_CMD_SHMO)
+   {
+      xSocketShm(c, cmdP, noReply);
+      return;
+   }
+
+   if (cmdP->cmd == LG_CMD_NOIB)
+   {
+     /* Enable the Nagle algorithm. */
+      opt = 0;
+      setsockopt(
+         c->sock, IPPROTO_TCP, TCP_NODELAY, (char*)&opt, sizeof(int));
+
+      /* set sock as the argument */
+      arg[0] = c->sock;
+   }
+
+   cmdP->status = lgExecCmd(cmdP, sizeof(w->cmdBuf));
+
+   LG_DBG(LG_DEBUG_INTERNAL, "status=%d size=%d cmd=%d Q=%d I=%d H=%d",
+      cmdP->status, cmdP->size, cmdP->cmd,
+      cmdP->doubles, cmdP->longs, cmdP->shorts);
+
+   if (!noReply) xSocketSend(c->sock, cmdP, sizeof(lgCmd_t)+cmdP->size);
+}
+
+/* read what the client has sent and execute every complete frame */
+
+static int xSocketRead(lgSockWorker_p w, lgSockClient_p c)
+{
+   lgCmd_t hdr;
+   int n, len, pos;
+
+   n = recv(c->sock, c->buf + c->got, sizeof(c->buf) - c->got, MSG_DONTWAIT);
+
+   if (n == 0) return -1;
+
+   if (n < 0)
+   {
+      if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR))
+         return 0;
+
+      return -1;
+   }
+
+   c->got += n;
+
+   pos = 0;
 
-      if (cmdP->cmd == LG_CMD_NOIB)
+   while ((c->got - pos) >= (int)sizeof(lgCmd_t))
+   {
+      memcpy(&hdr, c->buf + pos, sizeof(lgCmd_t));
+
+      if (hdr.size >= LG_SOCK_MAX_EXT)
       {
-        /* Enable the Nagle algorithm. */
-         opt = 0;
-         setsockopt(
-            sock, IPPROTO_TCP, TCP_NODELAY, (char*)&opt, sizeof(int));
+         /* Serious error.  No point continuing. */
+
+         LG_DBG(LG_DEBUG_ALWAYS,
+            "message too large %"PRId32"(%zd), sock=%d",
+            hdr.size, LG_SOCK_MAX_EXT, c->sock);
 
-         /* set sock as the argument */
-         arg[0] = sock;
+         return -1;
       }
 
-      cmdP->status = lgExecCmd(cmdBuf, sizeof(cmdBuf));
+      len = sizeof(lgCmd_t) + hdr.size;
 
-      LG_DBG(LG_DEBUG_INTERNAL, "status=%d size=%d cmd=%d Q=%d I=%d H=%d",
-         cmdP->status, cmdP->size, cmdP->cmd,
-         cmdP->doubles, cmdP->longs, cmdP->shorts);
+      if ((c->got - pos) < len) break;
 
-      if (write(sock, cmdBuf, sizeof(lgCmd_t)+cmdP->size)) ; /* ignore errors */
+      xSocketFrame(w, c, &hdr, c->buf + pos + sizeof(lgCmd_t));
 
-      LG_DBG(LG_DEBUG_INTERNAL, "ret=%s",
-         lgDbgStr2Hex(sizeof(lgCmd_t)+cmdP->size, (char *)&cmdBuf));
+      pos += len;
+   }
+
+   if (pos)
+   {
+      c->got -= pos;
+      memmove(c->buf, c->buf + pos, c->got);
    }
 
+   return 0;
+}
+
+static void xSocketClose(lgSockClient_p c)
+{
+   epoll_ctl(sEpollFd, EPOLL_CTL_DEL, c->sock, NULL);
+
    //lgNotifyCloseOrphans(-1, sock);
 
-   lgHdlPurgeByOwner(Ctx->owner);
+   lgShmClose(c->shm);
 
-   close(sock);
+   lgHdlPurgeByOwner(c->ctx.owner);
 
-   LG_DBG(LG_DEBUG_INTERNAL, "Socket %d closed", sock);
+   close(c->sock);
 
-   LG_DBG(LG_DEBUG_INTERNAL, "free context memory %d", Ctx->owner);
+   LG_DBG(LG_DEBUG_INTERNAL, "Socket %d closed", c->sock);
 
-   free(Ctx);
+   LG_DBG(LG_DEBUG_INTERNAL, "free context memory %d", c->ctx.owner);
 
-   return 0;
+   free(c);
+}
+
+static void *xSocketWorker(void *x)
+{
+   lgSockWorker_p w;
+   lgSockClient_p c;
+   struct epoll_event ev;
+
+   w = malloc(sizeof(lgSockWorker_t));
+
+   if (w == NULL)
+      ALLOC_ERROR((void*)LG_NO_MEMORY, "no memory for socket worker");
+
+   while (1)
+   {
+      if (epoll_wait(sEpollFd, &ev, 1, -1) != 1) continue;
+
+      c = ev.data.ptr;
+
+      lgCtxSet(&c->ctx);
+
+      if (xSocketRead(w, c) < 0) xSocketClose(c);
+      else
+      {
+         ev.events = EPOLLIN | EPOLLONESHOT;
+         ev.data.ptr = c;
+
+         epoll_ctl(sEpollFd, EPOLL_CTL_MOD, c->sock, &ev);
+      }
+
+      lgCtxSet(NULL);
+   }
+
+   return NULL;
 }
 
 static int xAddrAllowed(struct sockaddr *saddr)
@@ -154,13 +410,80 @@ static int xAddrAllowed(struct sockaddr *saddr)
    return 0;
 }
 
+static void xSocketAccept(int fdC, int local, struct sockaddr_storage *client)
+{
+   struct epoll_event ev;
+   lgSockClient_p sock;
+   int opt;
+
+   lgNotifyCloseOrphans(-1, fdC);
+
+   /* a unix domain socket is only reachable from this host */
+
+   if (!local)
+   {
+      if (!xAddrAllowed((struct sockaddr *)client))
+      {
+         LG_DBG(LG_DEBUG_ALWAYS, "Connection rejected, closing");
+         close(fdC);
+         return;
+      }
+
+      LG_DBG(LG_DEBUG_INTERNAL, "Connection accepted on socket %d", fdC);
+
+      /* Enable tcp_keepalive */
+      opt = 1;
+
+      if (setsockopt(fdC, SOL_SOCKET, SO_KEEPALIVE, &opt, sizeof(opt)) < 0)
+      {
+         LG_DBG(LG_DEBUG_ALWAYS,
+            "setsockopt() fail, closing socket %d", fdC);
+         close(fdC);
+         return;
+      }
+
+      LG_DBG(LG_DEBUG_INTERNAL,
+         "SO_KEEPALIVE enabled on socket %d\n", fdC);
+
+      /* Disable the Nagle algorithm. */
+      opt = 1;
+
+      setsockopt(fdC, IPPROTO_TCP, TCP_NODELAY, (char*)&opt, sizeof(int));
+   }
+   else LG_DBG(LG_DEBUG_INTERNAL, "Local connection on socket %d", fdC);
+
+   sock = calloc(1, sizeof(lgSockClient_t));
+
+   if (sock == NULL)
+   {
+      LG_DBG(LG_DEBUG_ALWAYS, "no memory, closing");
+      close(fdC);
+      return;
+   }
+
+   sock->sock = fdC;
+   sock->local = local;
+
+   ev.events = EPOLLIN | EPOLLONESHOT;
+   ev.data.ptr = sock;
+
+   if (epoll_ctl(sEpollFd, EPOLL_CTL_ADD, fdC, &ev) < 0)
+   {
+      LG_DBG(LG_DEBUG_ALWAYS, "epoll_ctl failed (%m), closing");
+      close(fdC);
+      free(sock);
+   }
+}
+
 /* ----------------------------------------------------------------------- */
 
 void *pthSocketThread(void *x)
 {
-   int fdC=0, c, *sock;
+   int fdC=0, c, i, l, listeners;
    struct sockaddr_storage client;
+   struct pollfd pfd[2];
    pthread_attr_t attr;
+   pthread_t thr;
 
    if (pthread_attr_init(&attr))
       PARAM_ERROR((void*)LG_INIT_FAILED,
@@ -174,66 +497,59 @@ void *pthSocketThread(void *x)
       PARAM_ERROR((void*)LG_INIT_FAILED,
          "pthread_attr_setdetachstate failed (%m)");
 
-   /* gFdSock opened in initialisation so that we can treat
+   sEpollFd = epoll_create1(EPOLL_CLOEXEC);
+
+   if (sEpollFd < 0)
+      PARAM_ERROR((void*)LG_INIT_FAILED, "epoll_create1 failed (%m)");
+
+   for (i=0; i<gSockWorkers; i++)
+   {
+      if (pthread_create(&thr, &attr, xSocketWorker, NULL))
+         PARAM_ERROR((void*)LG_INIT_FAILED,
+            "socket worker pthread_create failed (%m)");
+
+      pthread_setname_np(thr, "lgSock");
+   }
+
+   /* gFdSock and gFdUnix opened in initialisation so that we can treat
       failure to bind as fatal. */
 
    listen(gFdSock, 100);
 
-   c = sizeof(client);
+   pfd[0].fd = gFdSock;
+   pfd[0].events = POLLIN;
+   listeners = 1;
 
-   while (fdC >= 0)
+   if (gFdUnix >= 0)
    {
-      pthread_t thr;
+      listen(gFdUnix, 100);
 
-      fdC = accept(gFdSock, (struct sockaddr *)&client, (socklen_t*)&c);
+      pfd[1].fd = gFdUnix;
+      pfd[1].events = POLLIN;
+      listeners = 2;
+   }
 
-      lgNotifyCloseOrphans(-1, fdC);
+   while (fdC >= 0)
+   {
+      if (poll(pfd, listeners, -1) < 0)
+      {
+         if (errno == EINTR) continue;
+         break;
+      }
 
-      if (xAddrAllowed((struct sockaddr *)&client))
+      for (l=0; l<listeners; l++)
       {
-         LG_DBG(LG_DEBUG_INTERNAL, "Connection accepted on socket %d", fdC);
+         if (!(pfd[l].revents & POLLIN)) continue;
 
-         sock = malloc(sizeof(int));
+         c = sizeof(client);
 
-         if (sock != NULL)
-         {
-            *sock = fdC;
-
-            /* Enable tcp_keepalive */
-            int optval = 1;
-            socklen_t optlen = sizeof(optval);
-
-            if (setsockopt(fdC, SOL_SOCKET, SO_KEEPALIVE, &optval, optlen) < 0)
-            {
-              LG_DBG(LG_DEBUG_ALWAYS,
-                 "setsockopt() fail, closing socket %d", fdC);
-              close(fdC);
-            }
-
-            LG_DBG(LG_DEBUG_INTERNAL,
-               "SO_KEEPALIVE enabled on socket %d\n", fdC);
-
-            if (pthread_create
-               (&thr, &attr, xSocketThreadHandler, (void*) sock) < 0)
-               PARAM_ERROR((void*)LG_INIT_FAILED,
-                  "socket pthread_create failed (%m)");
-         }
-         else
-         {
-            LG_DBG(LG_DEBUG_ALWAYS, "no memory, closing");
-            close(fdC);
-         }
-      }
-      else
-      {
-         LG_DBG(LG_DEBUG_ALWAYS, "Connection rejected, closing");
-         close(fdC);
+         fdC = accept(pfd[l].fd, (struct sockaddr *)&client, (socklen_t*)&c);
+
+         if (fdC < 0) break;
+
+         xSocketAccept(fdC, pfd[l].fd == gFdUnix, &client);
       }
    }
 
-   if (fdC < 0)
-      PARAM_ERROR((void*)LG_INIT_FAILED, "accept failed (%m)");
-
-   return 0;
+   PARAM_ERROR((void*)LG_INIT_FAILED, "accept failed (%m)");
 }
-
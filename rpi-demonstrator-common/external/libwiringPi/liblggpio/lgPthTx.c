@@ -25,175 +25,371 @@ OTHER DEALINGS IN THE SOFTWARE.
 For more information, please refer to <http://unlicense.org/>
 */
 
+#define _GNU_SOURCE /* needed for pthread_setname_np */
+
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/eventfd.h>
 
 #include "lgDbg.h"
 #include "lgHdl.h"
 #include "lgPthTx.h"
 
+/* an edge this late restarts its record's timing from now */
+#define LG_TX_SLIP_NS 1000000
+
 int lgMinTxDelay = 10;
 
 static pthread_t pthTx;
 static pthread_mutex_t lgTxMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t lgTxCond;
 static volatile lgTxRec_p txRec = NULL;
 static int pthTxRunning = LG_THREAD_NONE;
-static struct timespec pthTxReq;
-static int pthTxDelayMicros = 0;
 
-void *lgPthTx(void)
+/* min-heap of the active records keyed by due */
+
+static lgTxRec_p *txHeap = NULL;
+static int txHeapSize = 0;
+static int txHeapAlloc = 0;
+
+/* the edges of one wakeup, one entry per line request */
+
+typedef struct
+{
+   lgChipObj_p chip;
+   int gpio;
+   uint64_t *values_p;
+   uint64_t mask;
+} lgTxBatch_t;
+
+static lgTxBatch_t *txBatch = NULL;
+static int txBatched = 0;
+
+static uint64_t xNow(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+
+   return ((uint64_t)ts.tv_sec * 1000000000) + ts.tv_nsec;
+}
+
+static void xHeapSet(int i, lgTxRec_p p)
+{
+   txHeap[i] = p;
+   p->heap_pos = i;
+}
+
+static void xHeapUp(int i)
+{
+   lgTxRec_p p = txHeap[i];
+   int parent;
+
+   while (i)
+   {
+      parent = (i - 1) / 2;
+      if (txHeap[parent]->due <= p->due) break;
+      xHeapSet(i, txHeap[parent]);
+      i = parent;
+   }
+
+   xHeapSet(i, p);
+}
+
+static void xHeapDown(int i)
+{
+   lgTxRec_p p = txHeap[i];
+   int c;
+
+   while ((c = (2 * i) + 1) < txHeapSize)
+   {
+      if ((c + 1 < txHeapSize) && (txHeap[c+1]->due < txHeap[c]->due)) c++;
+      if (p->due <= txHeap[c]->due) break;
+      xHeapSet(i, txHeap[c]);
+      i = c;
+   }
+
+   xHeapSet(i, p);
+}
+
+static int xHeapInsert(lgTxRec_p p)
+{
+   lgTxRec_p *heap;
+   lgTxBatch_t *batch;
+   int size;
+
+   if (txHeapSize == txHeapAlloc)
+   {
+      /* the batch never holds more entries than there are records */
+
+      size = txHeapAlloc ? txHeapAlloc * 2 : 16;
+
+      heap = realloc(txHeap, size * sizeof(lgTxRec_p));
+      if (heap == NULL) return LG_NO_MEMORY;
+      txHeap = heap;
+
+      batch = realloc(txBatch, size * sizeof(lgTxBatch_t));
+      if (batch == NULL) return LG_NO_MEMORY;
+      txBatch = batch;
+
+      txHeapAlloc = size;
+   }
+
+   xHeapSet(txHeapSize++, p);
+   xHeapUp(p->heap_pos);
+
+   /* an earlier edge than the one the thread sleeps for */
+
+   if (p->heap_pos == 0) pthread_cond_signal(&lgTxCond);
+
+   return LG_OKAY;
+}
+
+static void xHeapRemove(lgTxRec_p p)
+{
+   int i = p->heap_pos;
+
+   if (i < 0) return;
+
+   p->heap_pos = -1;
+
+   if (i == --txHeapSize) return;
+
+   xHeapSet(i, txHeap[txHeapSize]);
+   xHeapUp(i);
+   xHeapDown(txHeap[i]->heap_pos);
+}
+
+static void xTxQueue(lgChipObj_p chip, int gpio, uint64_t bits, uint64_t mask)
 {
-   lgTxRec_p p, t;
+   lgLineInf_p GPIO;
    int i;
 
-   clock_gettime(CLOCK_MONOTONIC, &pthTxReq); // get current time
+   /* lines of one request are set together by a single ioctl */
 
-   while (1)
+   GPIO = &chip->LineInf[gpio];
+
+   for (i=0; i<txBatched; i++)
    {
-      lgPthTxLock();
+      if (txBatch[i].values_p == GPIO->values_p) break;
+   }
+
+   if (i == txBatched)
+   {
+      txBatch[i].chip = chip;
+      txBatch[i].gpio = gpio;
+      txBatch[i].values_p = GPIO->values_p;
+      txBatch[i].mask = 0;
+      txBatched++;
+   }
+
+   /* a line with a second edge due now must show the first one too */
+
+   if (txBatch[i].mask & mask)
+   {
+      xGroupFlush(txBatch[i].chip, txBatch[i].gpio, txBatch[i].mask);
+      txBatch[i].mask = 0;
+   }
+
+   *GPIO->values_p = (*GPIO->values_p & ~mask) | (bits & mask);
+   txBatch[i].mask |= mask;
+}
 
-      // update times
+static void xTxLevel(lgTxRec_p p, int level)
+{
+   uint64_t m = (uint64_t)1 << p->chip->LineInf[p->gpio].offset;
 
-      for (p=txRec; p!=NULL; p=p->next)
-         p->next_micros -= pthTxDelayMicros;
+   xTxQueue(p->chip, p->gpio, level ? m : 0, m);
+}
 
-      // output changed edges and calculate next delay
+static void xTxFlush(void)
+{
+   int i;
 
-      pthTxDelayMicros = 20000; // run at least fifty times a second
+   for (i=0; i<txBatched; i++)
+      xGroupFlush(txBatch[i].chip, txBatch[i].gpio, txBatch[i].mask);
 
-      p = txRec;
-      
-      while (p != NULL)
+   txBatched = 0;
+}
+
+static void xTxEdge(lgTxRec_p p)
+{
+   int i;
+
+   if (p->type == LG_TX_PWM)
+   {
+      if (p->next_level || (p->micros_on[0] == 0))
       {
-         if (p->active)
+          /* start of cycle */
+
+         if ((p->cycles[0] <= 0) && (p->entries > 1))
          {
-            if (p->next_micros <= 0)
+            for (i=0; i<p->entries-1; i++)
             {
-               if (p->type == LG_TX_PWM)
-               {
-                  if (p->next_level || (p->micros_on[0] == 0))
-                  {
-                      /* start of cycle */
-
-                     if ((p->cycles[0] <= 0) && (p->entries > 1))
-                     {
-                        for (i=0; i<p->entries; i++)
-                        {
-                           p->micros_on[i] = p->micros_on[i+1];
-                           p->micros_off[i] = p->micros_off[i+1];
-                           p->cycles[i] = p->cycles[i+1];
-                        }
-                        --p->entries;
-                     }
-                  
-                     if (p->cycles[0] == 0) /* 0 is a result of countdown */
-                     {
-                        xWrite(p->chip, p->gpio, 0);
-                        p->active = 0;
-                     }
-                     else if (p->micros_on[0])
-                     {
-                        xWrite(p->chip, p->gpio, 1);
-                        p->next_micros += p->micros_on[0];
-                        if (p->micros_off[0]) p->next_level = 0;
-                     }
-                     else
-                     {
-                        xWrite(p->chip, p->gpio, 0);
-                        p->next_micros += p->micros_off[0];
-                        p->next_level = 1;
-                     }
-
-                     if (--p->cycles[0] < 0) p->cycles[0] = -1;
-                  }
-                  else /* middle of cycle */
-                  {
-                     xWrite(p->chip, p->gpio, 0);
-                     p->next_micros += p->micros_off[0];
-                     p->next_level = 1;
-                  }
-               }
-               else if (p->type == LG_TX_WAVE)
-               {
-                  if (p->pulse_pos >= p->num_pulses[0])
-                  {
-                     if (p->entries > 1)
-                     {
-                        for (i=0; i<p->entries; i++)
-                        {
-                           p->pulses[i] = p->pulses[i+1];
-                           p->num_pulses[i] = p->num_pulses[i+1];
-                        }
-                        --p->entries;
-                        p->pulse_pos = 0;
-                     }
-                  }
-
-                  if (p->pulse_pos < p->num_pulses[0])
-                  {
-                     xGroupWrite(p->chip, p->gpio,
-                        p->pulses[0][p->pulse_pos].bits,
-                        p->pulses[0][p->pulse_pos].mask);
-                     p->next_micros += p->pulses[0][p->pulse_pos].delay;
-                     (p->pulse_pos)++;
-                  }
-                  else p->active = 0;
-               }
+               p->micros_on[i] = p->micros_on[i+1];
+               p->micros_off[i] = p->micros_off[i+1];
+               p->cycles[i] = p->cycles[i+1];
             }
+            --p->entries;
+         }
 
-            if (p->next_micros < pthTxDelayMicros)
-               pthTxDelayMicros = p->next_micros;
+         if (p->cycles[0] == 0) /* 0 is a result of countdown */
+         {
+            xTxLevel(p, 0);
+            p->active = 0;
+         }
+         else if (p->micros_on[0])
+         {
+            xTxLevel(p, 1);
+            p->due += p->micros_on[0] * 1000LL;
+            if (p->micros_off[0]) p->next_level = 0;
          }
          else
          {
-            /* delete inactive record */
-            
-            if (p->prev) p->prev->next = p->next;
-            else txRec = p->next;
+            xTxLevel(p, 0);
+            p->due += p->micros_off[0] * 1000LL;
+            p->next_level = 1;
+         }
 
-            if (p->next) p->next->prev = p->prev;
+         if (--p->cycles[0] < 0) p->cycles[0] = -1;
+      }
+      else /* middle of cycle */
+      {
+         xTxLevel(p, 0);
+         p->due += p->micros_off[0] * 1000LL;
+         p->next_level = 1;
+      }
+   }
+   else if (p->type == LG_TX_WAVE)
+   {
+      if (p->pulse_pos >= p->num_pulses[0])
+      {
+         if (p->entries > 1)
+         {
+            free(p->pulses[0]);
 
-            if (p->type == LG_TX_WAVE)
+            for (i=0; i<p->entries-1; i++)
             {
-               /* free the malloc'd pulses */
-               for (i=0; i<p->entries; i++)
-               {
-                  free(p->pulses[i]);
-                  p->pulses[i] = NULL;
-               }
+               p->pulses[i] = p->pulses[i+1];
+               p->num_pulses[i] = p->num_pulses[i+1];
             }
-
-            t = p; p = p->prev; free(t);
+            --p->entries;
+            p->pulse_pos = 0;
          }
+      }
 
-         if (p) p = p->next;
+      if (p->pulse_pos < p->num_pulses[0])
+      {
+         xTxQueue(p->chip, p->gpio,
+            p->pulses[0][p->pulse_pos].bits,
+            p->pulses[0][p->pulse_pos].mask);
+         p->due += p->pulses[0][p->pulse_pos].delay * 1000LL;
+         (p->pulse_pos)++;
       }
+      else p->active = 0;
+   }
+   else if (p->type == LG_TX_STREAM)
+   {
+      uint64_t one = 1;
+      lgPulse_p pulse = &p->bufs[p->buf_head][p->buf_pos];
+
+      xTxQueue(p->chip, p->gpio, pulse->bits, pulse->mask);
+      p->due += pulse->delay * 1000LL;
 
-      pthTxReq.tv_nsec += (pthTxDelayMicros * 1000);
-      if (pthTxReq.tv_nsec >= 1000000000)
+      if (++p->buf_pos >= p->buf_count[p->buf_head])
       {
-         pthTxReq.tv_sec += 1;
-         pthTxReq.tv_nsec -= 1000000000;
+         /* the caller may refill the buffer now */
+
+         p->buf_pos = 0;
+         p->buf_head = (p->buf_head + 1) % p->num_bufs;
+         --p->buf_queued;
+
+         if (write(p->event_fd, &one, sizeof(one)) != sizeof(one))
+            LG_DBG(LG_DEBUG_ALWAYS, "stream eventfd write failed");
       }
+   }
+}
 
-      lgPthTxUnlock();
+void *lgPthTx(void)
+{
+   lgTxRec_p p;
+   uint64_t now;
+   struct timespec ts;
 
-      // sleep until next edge
+   lgPthTxLock();
 
-      while (clock_nanosleep(
-         CLOCK_MONOTONIC, TIMER_ABSTIME, &pthTxReq, NULL));
+   while (1)
+   {
+      now = xNow();
+
+      /* every edge that is due, lines of one request written together */
+
+      while (txHeapSize && (txHeap[0]->due <= now))
+      {
+         p = txHeap[0];
+
+         xTxEdge(p);
+
+         if ((p->type == LG_TX_STREAM) && !p->buf_queued)
+         {
+            /* ran dry, the next lgPthTxStreamPut carries on */
+
+            xHeapRemove(p);
+         }
+         else if (p->active)
+         {
+            /*
+               due moves on from the previous edge, not from now, so
+               the wakeup latency does not add up.  Only a record that
+               has fallen well behind starts again from now.
+            */
+
+            if ((p->due + LG_TX_SLIP_NS) < now) p->due = now;
+
+            xHeapDown(0);
+         }
+         else lgPthTxCancel(p);
+      }
+
+      xTxFlush();
+
+      // sleep until the next edge or until an earlier one is added
+
+      if (txHeapSize)
+      {
+         ts.tv_sec = txHeap[0]->due / 1000000000;
+         ts.tv_nsec = txHeap[0]->due % 1000000000;
+
+         pthread_cond_timedwait(&lgTxCond, &lgTxMutex, &ts);
+      }
+      else pthread_cond_wait(&lgTxCond, &lgTxMutex);
    }
 
+   lgPthTxUnlock();
+
    pthTxRunning = LG_THREAD_NONE;
    pthread_exit(NULL);
 }
 
 void lgPthTxStart(void)
 {
+   pthread_condattr_t attr;
+
    if (!pthTxRunning)
    {
+      /* the heap is keyed by CLOCK_MONOTONIC so the sleeps must be too */
+
+      pthread_condattr_init(&attr);
+      pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+      pthread_cond_init(&lgTxCond, &attr);
+      pthread_condattr_destroy(&attr);
+
       if (pthread_create(&pthTx, NULL, (void*)lgPthTx, NULL) == 0)
       {
          pthread_detach(pthTx);
+         pthread_setname_np(pthTx, "lgTx");
          pthTxRunning = LG_THREAD_STARTED;
       }
    }
@@ -209,16 +405,50 @@ void lgPthTxUnlock(void)
    pthread_mutex_unlock(&lgTxMutex);
 }
 
+void lgPthTxCancel(lgTxRec_p p)
+{
+   int i;
+
+   xHeapRemove(p);
+
+   if (p->prev) p->prev->next = p->next;
+   else txRec = p->next;
+
+   if (p->next) p->next->prev = p->prev;
+
+   if (p->type == LG_TX_WAVE)
+   {
+      /* free the malloc'd pulses */
+      for (i=0; i<p->entries; i++)
+      {
+         free(p->pulses[i]);
+         p->pulses[i] = NULL;
+      }
+   }
+   else if (p->type == LG_TX_STREAM)
+   {
+      /* the buffers belong to the caller */
+      close(p->event_fd);
+   }
+
+   free(p);
+}
+
 void lgPthTxStop(lgChipObj_p chip)
 {
-   lgTxRec_p pwm;
+   lgTxRec_p pwm, next;
 
    /* stop any PWM on chip */
-   
-   for (pwm=txRec; pwm!=NULL; pwm=pwm->next)
+
+   lgPthTxLock();
+
+   for (pwm=txRec; pwm!=NULL; pwm=next)
    {
-      if (chip->handle == pwm->chip->handle) pwm->active =0;
+      next = pwm->next;
+      if (chip->handle == pwm->chip->handle) lgPthTxCancel(pwm);
    }
+
+   lgPthTxUnlock();
 }
 
 lgTxRec_p lgGpioGetTxRec(lgChipObj_p chip, int gpio, int type)
@@ -234,6 +464,26 @@ lgTxRec_p lgGpioGetTxRec(lgChipObj_p chip, int gpio, int type)
    return p;
 }
 
+static lgTxRec_p xTxAdd(lgTxRec_p p)
+{
+   /* called with lgPthTxLock held, frees p if the heap can't grow */
+
+   p->heap_pos = -1;
+
+   if (xHeapInsert(p) != LG_OKAY)
+   {
+      free(p);
+      return NULL;
+   }
+
+   p->prev = NULL;
+   p->next = txRec;
+   if (txRec) txRec->prev = p;
+   txRec = p;
+
+   return p;
+}
+
 lgTxRec_p lgGpioCreateTxRec(
    lgChipObj_p chip,
    int gpio,
@@ -243,7 +493,7 @@ lgTxRec_p lgGpioCreateTxRec(
    int cycles)
 {
    lgTxRec_p p;
-   int usec, ct, cyc, frac, left;
+   uint64_t usec, ct;
 
    p = malloc(sizeof(lgTxRec_t));
 
@@ -260,19 +510,18 @@ lgTxRec_p lgGpioCreateTxRec(
       if (micros_on) p->next_level = 1; else p->next_level = 0;
       p->active = 1;
 
-      lgPthTxLock();
+      /*
+         start on the next whole cycle so that every PWM with the
+         same period has its edges at the same instants
+      */
 
-      usec = pthTxReq.tv_nsec / 1000;
+      usec = xNow() / 1000;
       ct = micros_on + micros_off;
-      cyc = usec / ct;
-      frac = usec - (ct *cyc);
-      left = ct - frac + pthTxDelayMicros + micros_offset;
-      p->next_micros = left;
-      
-      p->prev = NULL;
-      p->next = txRec;
-      if (txRec) txRec->prev = p;
-      txRec = p;
+      p->due = (usec - (usec % ct) + ct + micros_offset) * 1000;
+
+      lgPthTxLock();
+
+      p = xTxAdd(p);
 
       lgPthTxUnlock();
    }
@@ -302,10 +551,61 @@ lgTxRec_p lgGroupCreateWaveRec(
       p->num_pulses[0] = count;
       p->pulse_pos = 0;
 
+      p->due = xNow();
+
+      lgPthTxLock();
+
+      p = xTxAdd(p);
+
+      lgPthTxUnlock();
+   }
+
+   return p;
+}
+
+lgTxRec_p lgGpioCreateStreamRec(
+   lgChipObj_p chip,
+   int gpio,
+   int numBufs,
+   lgPulse_p *bufs)
+{
+   lgTxRec_p p;
+
+   /* the record, then the ring of buffer pointers and their counts */
+
+   p = malloc(sizeof(lgTxRec_t) + numBufs * (sizeof(lgPulse_p) + sizeof(int)));
+
+   if (p)
+   {
+      p->event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+
+      if (p->event_fd < 0)
+      {
+         free(p);
+         return NULL;
+      }
+
+      p->type = LG_TX_STREAM;
+      p->chip = chip;
+      p->gpio = gpio;
+      p->entries = 0;
+      p->active = 1;
+
+      p->bufs = (lgPulse_p *)(p + 1);
+      p->buf_count = (int *)(p->bufs + numBufs);
+      memcpy(p->bufs, bufs, numBufs * sizeof(lgPulse_p));
+      p->num_bufs = numBufs;
+      p->buf_head = 0;
+      p->buf_queued = 0;
+      p->buf_pos = 0;
+
+      p->due = 0;
+      p->heap_pos = -1;
+
+      /* only in the heap while it has buffers queued */
+
       lgPthTxLock();
 
-      p->next_micros = pthTxDelayMicros;
-      
       p->prev = NULL;
       p->next = txRec;
       if (txRec) txRec->prev = p;
@@ -317,3 +617,31 @@ lgTxRec_p lgGroupCreateWaveRec(
    return p;
 }
 
+int lgPthTxStreamPut(lgTxRec_p p, int count)
+{
+   uint64_t now;
+
+   if (p->buf_queued == p->num_bufs) return LG_TX_QUEUE_FULL;
+
+   p->buf_count[(p->buf_head + p->buf_queued) % p->num_bufs] = count;
+   p->buf_queued++;
+
+   if (p->heap_pos < 0)
+   {
+      /*
+         restart a stream that ran dry. If the last pulse's delay has
+         not yet run out the stream carries on without a gap.
+      */
+
+      now = xNow();
+      if (p->due < now) p->due = now;
+
+      if (xHeapInsert(p) != LG_OKAY)
+      {
+         p->buf_queued--;
+         return LG_NO_MEMORY;
+      }
+   }
+
+   return p->num_bufs - p->buf_queued;
+}
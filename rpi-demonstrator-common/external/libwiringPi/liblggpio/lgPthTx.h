@@ -40,11 +40,12 @@ typedef struct lgTxRec_s
    int active;
    struct lgTxRec_s *prev;
    struct lgTxRec_s *next;
-   int next_micros;
+   uint64_t due;  /* CLOCK_MONOTONIC nanos of the next edge */
+   int heap_pos;  /* index in the tx thread's heap */
    lgChipObj_p chip;
    int gpio;
    int entries; /* number of entries in LG_TX_BUF arrays */
-   int type;    /* PWM or WAVE */
+   int type;    /* PWM, WAVE, or STREAM */
    union
    {
       struct
@@ -61,6 +62,16 @@ typedef struct lgTxRec_s
          int num_pulses[LG_TX_BUF];
          int pulse_pos;
       };
+      struct
+      {
+         lgPulse_p *bufs;  /* the caller's ring, not copied */
+         int *buf_count;   /* pulses handed over in each buffer */
+         int num_bufs;
+         int buf_head;     /* buffer being sent */
+         int buf_queued;   /* buffers handed over and not yet sent */
+         int buf_pos;      /* next pulse in bufs[buf_head] */
+         int event_fd;     /* one count per buffer sent */
+      };
    };
 } lgTxRec_t, *lgTxRec_p;
 
@@ -77,6 +88,13 @@ lgTxRec_p lgGpioCreateTxRec(
 lgTxRec_p lgGroupCreateWaveRec(
    lgChipObj_p chip, int gpio, int count, lgPulse_p pulses);
 
+lgTxRec_p lgGpioCreateStreamRec(
+   lgChipObj_p chip, int gpio, int numBufs, lgPulse_p *bufs);
+
+int lgPthTxStreamPut(lgTxRec_p p, int count); /* lgPthTxLock held */
+
+void lgPthTxCancel(lgTxRec_p p); /* call with lgPthTxLock held */
+
 void lgPthTxStart(void);
 void lgPthTxStop(lgChipObj_p chip);
 void lgPthTxLock(void);
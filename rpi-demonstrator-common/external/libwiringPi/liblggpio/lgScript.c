@@ -44,6 +44,79 @@ For more information, please refer to <http://unlicense.org/>
 
 #define LG_SCRIPT_STACK_SIZE 256
 
+/*
+A stored script is compiled once into an array of ops. Each op holds a
+pointer to every operand, whether a parameter, a variable, or a
+constant kept in the op, and the instruction number of any jump, so
+that running a step does no substitution or lookup. The script thread
+dispatches from op to op by computed goto. GPIO reads and writes and
+the delays are called directly, other lgpio commands go through
+lgExecCmd. Each step is traced if LG_DEBUG_SCRIPT is set when the
+script starts.
+*/
+
+enum
+{
+   LG_SOP_CMD,   // any other lgpio command, through lgExecCmd
+   LG_SOP_GR,
+   LG_SOP_GW,
+   LG_SOP_MICS,
+   LG_SOP_MILS,
+   LG_SOP_ADD,
+   LG_SOP_AND,
+   LG_SOP_CALL,
+   LG_SOP_CMP,
+   LG_SOP_DCR,
+   LG_SOP_DCRA,
+   LG_SOP_DIV,
+   LG_SOP_HALT,
+   LG_SOP_INR,
+   LG_SOP_INRA,
+   LG_SOP_JGE,
+   LG_SOP_JGT,
+   LG_SOP_JLE,
+   LG_SOP_JLT,
+   LG_SOP_JMP,
+   LG_SOP_JNZ,
+   LG_SOP_JZ,
+   LG_SOP_LD,
+   LG_SOP_LDA,
+   LG_SOP_MLT,
+   LG_SOP_MOD,
+   LG_SOP_NOP,
+   LG_SOP_OR,
+   LG_SOP_POP,
+   LG_SOP_POPA,
+   LG_SOP_PUSH,
+   LG_SOP_PUSHA,
+   LG_SOP_RET,
+   LG_SOP_RL,
+   LG_SOP_RLA,
+   LG_SOP_RR,
+   LG_SOP_RRA,
+   LG_SOP_SHL,
+   LG_SOP_SHLA,
+   LG_SOP_SHR,
+   LG_SOP_SHRA,
+   LG_SOP_STA,
+   LG_SOP_SUB,
+   LG_SOP_SYS,
+   LG_SOP_X,
+   LG_SOP_XA,
+   LG_SOP_XOR,
+   LG_SOP_COUNT
+};
+
+typedef struct
+{
+   const void *code;       // the op's label in pthScript
+   int op;
+   int cmd;
+   int jump;               // instruction number of a jump or call
+   int *arg[CMD_MAX_ARG];
+   int imm[CMD_MAX_ARG];   // constant operands
+} lgScriptOp_t, *lgScriptOp_p;
+
 typedef struct
 {
    int id;
@@ -53,6 +126,8 @@ typedef struct
    pthread_mutex_t pthMutex;
    pthread_cond_t pthCond;
    cmdScript_t script;
+   lgScriptOp_p op;
+   int ops;
    char user[LG_USER_LEN];
    int share;
 } lgScript_t, *lgScript_p;
@@ -65,6 +140,10 @@ static void _scriptClose(lgScript_p s)
    if (s->script.par) free(s->script.par);
 
    s->script.par = NULL;
+
+   if (s->op) free(s->op);
+
+   s->op = NULL;
 }
 
 
@@ -89,46 +168,6 @@ int myScriptNameValid(char *name)
    return valid;
 }
 
-static int scrPop(lgScript_p s, int *SP, int *S)
-{
-   if ((*SP) > 0)
-   {
-      return S[--(*SP)];
-   }
-   else
-   {
-      s->run_state = LG_SCRIPT_FAILED;
-      LG_DBG(LG_DEBUG_ALWAYS, "script %d too many pops", s->id);
-      return 0;
-   }
-}
-
-/* ----------------------------------------------------------------------- */
-
-static void scrPush(lgScript_p s, int *SP, int *S, int val)
-{
-   if ((*SP) < LG_SCRIPT_STACK_SIZE)
-   {
-      S[(*SP)++] = val;
-   }
-   else
-   {
-      s->run_state = LG_SCRIPT_FAILED;
-      LG_DBG(LG_DEBUG_ALWAYS, "script %d too many pushes", s->id);
-   }
-}
-
-/* ----------------------------------------------------------------------- */
-
-static void scrSwap(int *v1, int *v2)
-{
-   int t;
-
-   t=*v1; *v1=*v2; *v2= t;
-}
-
-/* ----------------------------------------------------------------------- */
-
 int scrSys(char *cmd, uint32_t p0, uint32_t p1)
 {
    char cmdBuf[1024];
@@ -171,14 +210,237 @@ static uint32_t xsr(uint32_t x, unsigned int n)
 
 /* ----------------------------------------------------------------------- */
 
+static int xScriptOpcode(int cmd)
+{
+   switch (cmd)
+   {
+      case LG_CMD_GR:    return LG_SOP_GR;
+      case LG_CMD_GW:    return LG_SOP_GW;
+      case LG_CMD_MICS:  return LG_SOP_MICS;
+      case LG_CMD_MILS:  return LG_SOP_MILS;
+
+      case LG_CMD_ADD:   return LG_SOP_ADD;
+      case LG_CMD_AND:   return LG_SOP_AND;
+      case LG_CMD_CALL:  return LG_SOP_CALL;
+      case LG_CMD_CMP:   return LG_SOP_CMP;
+      case LG_CMD_DCR:   return LG_SOP_DCR;
+      case LG_CMD_DCRA:  return LG_SOP_DCRA;
+      case LG_CMD_DIV:   return LG_SOP_DIV;
+      case LG_CMD_HALT:  return LG_SOP_HALT;
+      case LG_CMD_INR:   return LG_SOP_INR;
+      case LG_CMD_INRA:  return LG_SOP_INRA;
+      case LG_CMD_JGE:   return LG_SOP_JGE;
+      case LG_CMD_JGT:   return LG_SOP_JGT;
+      case LG_CMD_JLE:   return LG_SOP_JLE;
+      case LG_CMD_JLT:   return LG_SOP_JLT;
+      case LG_CMD_JMP:   return LG_SOP_JMP;
+      case LG_CMD_JNZ:   return LG_SOP_JNZ;
+      case LG_CMD_JZ:    return LG_SOP_JZ;
+      case LG_CMD_LD:    return LG_SOP_LD;
+      case LG_CMD_LDA:   return LG_SOP_LDA;
+      case LG_CMD_MLT:   return LG_SOP_MLT;
+      case LG_CMD_MOD:   return LG_SOP_MOD;
+      case LG_CMD_NOP:   return LG_SOP_NOP;
+      case LG_CMD_OR:    return LG_SOP_OR;
+      case LG_CMD_POP:   return LG_SOP_POP;
+      case LG_CMD_POPA:  return LG_SOP_POPA;
+      case LG_CMD_PUSH:  return LG_SOP_PUSH;
+      case LG_CMD_PUSHA: return LG_SOP_PUSHA;
+      case LG_CMD_RET:   return LG_SOP_RET;
+      case LG_CMD_RL:    return LG_SOP_RL;
+      case LG_CMD_RLA:   return LG_SOP_RLA;
+      case LG_CMD_RR:    return LG_SOP_RR;
+      case LG_CMD_RRA:   return LG_SOP_RRA;
+      case LG_CMD_SHL:   return LG_SOP_SHL;
+      case LG_CMD_SHLA:  return LG_SOP_SHLA;
+      case LG_CMD_SHR:   return LG_SOP_SHR;
+      case LG_CMD_SHRA:  return LG_SOP_SHRA;
+      case LG_CMD_STA:   return LG_SOP_STA;
+      case LG_CMD_SUB:   return LG_SOP_SUB;
+      case LG_CMD_SYS:   return LG_SOP_SYS;
+      case LG_CMD_X:     return LG_SOP_X;
+      case LG_CMD_XA:    return LG_SOP_XA;
+      case LG_CMD_XOR:   return LG_SOP_XOR;
+   }
+
+   /* script commands the engine doesn't implement */
+
+   if (cmd >= LG_CMD_SCRIPT) return -1;
+
+   return LG_SOP_CMD;
+}
+
+static int xScriptIsJump(int op)
+{
+   return ((op == LG_SOP_CALL) ||
+           (op == LG_SOP_JGE) || (op == LG_SOP_JGT) ||
+           (op == LG_SOP_JLE) || (op == LG_SOP_JLT) ||
+           (op == LG_SOP_JMP) || (op == LG_SOP_JNZ) || (op == LG_SOP_JZ));
+}
+
+static int xScriptIsRegister(int op, int i)
+{
+   /* the y operands, a variable unless a parameter is named */
+
+   switch (op)
+   {
+      case LG_SOP_DCR: case LG_SOP_INR: case LG_SOP_LD:
+      case LG_SOP_POP: case LG_SOP_PUSH: case LG_SOP_STA: case LG_SOP_XA:
+      case LG_SOP_RL: case LG_SOP_RR: case LG_SOP_SHL: case LG_SOP_SHR:
+         return (i == 0);
+
+      case LG_SOP_X:
+         return (i < 2);
+   }
+
+   return 0;
+}
+
+static int xScriptCompile(lgScript_p s)
+{
+   cmdScript_t *sc = &s->script;
+   cmdInstr_t *in;
+   lgScriptOp_p o;
+   int i, a;
+
+   s->op = calloc(sc->instrs ? sc->instrs : 1, sizeof(lgScriptOp_t));
+
+   if (s->op == NULL) return LG_NO_MEMORY;
+
+   s->ops = sc->instrs;
+
+   for (i=0; i<sc->instrs; i++)
+   {
+      in = &sc->instr[i];
+      o = &s->op[i];
+
+      o->op = xScriptOpcode(in->cmd);
+      o->cmd = in->cmd;
+
+      if (o->op < 0)
+         PARAM_ERROR(LG_BAD_SCRIPT_CMD, "unsupported script command (%d)",
+            in->cmd);
+
+      for (a=0; a<CMD_MAX_ARG; a++)
+      {
+         if (in->opt[a] == CMD_PAR) o->arg[a] = &sc->par[in->arg[a]];
+         else if ((in->opt[a] == CMD_VAR) || xScriptIsRegister(o->op, a))
+         {
+            if (in->arg[a] >= LG_MAX_SCRIPT_VARS)
+               PARAM_ERROR(LG_BAD_VAR_NUM, "bad variable (%d)", in->arg[a]);
+
+            o->arg[a] = &sc->var[in->arg[a]];
+         }
+         else
+         {
+            o->imm[a] = in->arg[a];
+            o->arg[a] = &o->imm[a];
+         }
+      }
+
+      /* cmdParseScript has turned the tag into an instruction number */
+
+      if (xScriptIsJump(o->op))
+      {
+         if (in->arg[0] > (uint32_t)sc->instrs)
+            PARAM_ERROR(LG_BAD_TAG, "bad jump (%d)", in->arg[0]);
+
+         o->jump = in->arg[0];
+      }
+   }
+
+   return LG_OKAY;
+}
+
+static void xScriptTrace(lgScript_p s, int PC, lgScriptOp_p o, int A, int F)
+{
+   LG_DBG(LG_DEBUG_SCRIPT,
+      "script %d PC=%d cmd=%d p0=%d p1=%d p2=%d p3=%d A=%d F=%d",
+      s->id, PC, o->cmd, *o->arg[0], *o->arg[1], *o->arg[2], *o->arg[3],
+      A, F);
+}
+
+/* ----------------------------------------------------------------------- */
+
+/* go to the instruction at next unless the script has ended or is stopped */
+
+#define SCR_NEXT(next)                                             \
+   do                                                              \
+   {                                                               \
+      PC = (next);                                                 \
+      if ((unsigned)PC >= (unsigned)s->ops)                        \
+      {                                                            \
+         s->run_state = LG_SCRIPT_ENDED;                           \
+         goto scrStop;                                             \
+      }                                                            \
+      if (__atomic_load_n(&s->request, __ATOMIC_RELAXED) !=        \
+          LG_SCRIPT_RUN) goto scrStop;                             \
+      o = &s->op[PC];                                              \
+      if (trace) xScriptTrace(s, PC, o, A, F);                     \
+      goto *o->code;                                               \
+   }                                                               \
+   while (0)
+
+#define P0 (*o->arg[0])
+#define P1 (*o->arg[1])
+#define P2 (*o->arg[2])
+
 static void *pthScript(void *x)
 {
+   static const void *code[LG_SOP_COUNT]=
+   {
+      [LG_SOP_CMD]   = &&opCmd,
+      [LG_SOP_GR]    = &&opGr,
+      [LG_SOP_GW]    = &&opGw,
+      [LG_SOP_MICS]  = &&opMics,
+      [LG_SOP_MILS]  = &&opMils,
+      [LG_SOP_ADD]   = &&opAdd,
+      [LG_SOP_AND]   = &&opAnd,
+      [LG_SOP_CALL]  = &&opCall,
+      [LG_SOP_CMP]   = &&opCmp,
+      [LG_SOP_DCR]   = &&opDcr,
+      [LG_SOP_DCRA]  = &&opDcra,
+      [LG_SOP_DIV]   = &&opDiv,
+      [LG_SOP_HALT]  = &&opHalt,
+      [LG_SOP_INR]   = &&opInr,
+      [LG_SOP_INRA]  = &&opInra,
+      [LG_SOP_JGE]   = &&opJge,
+      [LG_SOP_JGT]   = &&opJgt,
+      [LG_SOP_JLE]   = &&opJle,
+      [LG_SOP_JLT]   = &&opJlt,
+      [LG_SOP_JMP]   = &&opJmp,
+      [LG_SOP_JNZ]   = &&opJnz,
+      [LG_SOP_JZ]    = &&opJz,
+      [LG_SOP_LD]    = &&opLd,
+      [LG_SOP_LDA]   = &&opLda,
+      [LG_SOP_MLT]   = &&opMlt,
+      [LG_SOP_MOD]   = &&opMod,
+      [LG_SOP_NOP]   = &&opNop,
+      [LG_SOP_OR]    = &&opOr,
+      [LG_SOP_POP]   = &&opPop,
+      [LG_SOP_POPA]  = &&opPopa,
+      [LG_SOP_PUSH]  = &&opPush,
+      [LG_SOP_PUSHA] = &&opPusha,
+      [LG_SOP_RET]   = &&opRet,
+      [LG_SOP_RL]    = &&opRl,
+      [LG_SOP_RLA]   = &&opRla,
+      [LG_SOP_RR]    = &&opRr,
+      [LG_SOP_RRA]   = &&opRra,
+      [LG_SOP_SHL]   = &&opShl,
+      [LG_SOP_SHLA]  = &&opShla,
+      [LG_SOP_SHR]   = &&opShr,
+      [LG_SOP_SHRA]  = &&opShra,
+      [LG_SOP_STA]   = &&opSta,
+      [LG_SOP_SUB]   = &&opSub,
+      [LG_SOP_SYS]   = &&opSys,
+      [LG_SOP_X]     = &&opX,
+      [LG_SOP_XA]    = &&opXa,
+      [LG_SOP_XOR]   = &&opXor,
+   };
    lgScript_p s;
-   int i, t;
-   cmdInstr_t instr;
-   int32_t p0, p1, p0o, p1o, *t1, *t2;
+   lgScriptOp_p o;
+   int i, t, trace;
    int32_t PC, A, F, SP;
-   uint32_t tmp;
    int S[LG_SCRIPT_STACK_SIZE];
    lgCtx_p Ctx;
    lgCmd_t cmdBuf[CMD_MAX_EXTENSION/sizeof(lgCmd_t)];
@@ -194,6 +456,17 @@ static void *pthScript(void *x)
    strncpy(Ctx->user, s->user, LG_USER_LEN);
    Ctx->autoUseShare = s->share;
 
+   /* link the compiled script to the code of each op */
+
+   for (i=0; i<s->ops; i++) s->op[i].code = code[s->op[i].op];
+
+   /* the fast ops bypass lgExecCmd, give the context its owner now */
+
+   cmdP->magic = LG_MAGIC;
+   cmdP->size = 0;
+   cmdP->cmd = LG_CMD_TICK;
+   lgExecCmd(cmdBuf, sizeof(cmdBuf));
+
    s->run_state = LG_SCRIPT_READY;
 
    while ((volatile int)s->request != LG_SCRIPT_DELETE)
@@ -206,268 +479,169 @@ static void *pthScript(void *x)
 
       A  = 0;
       F  = 0;
-      PC = 0;
       SP = 0;
 
-      while (((volatile int)s->request   == LG_SCRIPT_RUN    ) &&
-                           (s->run_state == LG_SCRIPT_RUNNING))
-      {
-         // get local copy of next instruction
+      trace = ((lgDbgLevel & LG_DEBUG_SCRIPT) == LG_DEBUG_SCRIPT);
 
-         instr = s->script.instr[PC];
+      SCR_NEXT(0);
 
-         if (instr.cmd < LG_CMD_SCRIPT)
-         {
-            // parameter and variable substitution
+      opCmd:
+         cmdP->magic = LG_MAGIC;
+         cmdP->size = 0;
+         cmdP->cmd = o->cmd;
+         cmdP->doubles = 0;
+         cmdP->longs = 0;
+         cmdP->shorts = 0;
+         for (i=0; i<CMD_MAX_ARG; i++) arg[i] = *o->arg[i];
+         A = lgExecCmd(cmdBuf, sizeof(cmdBuf)); F = A;
+         SCR_NEXT(PC+1);
 
-            for (i=0; i<CMD_MAX_OPT; i++)
-            {
-               t = instr.arg[i];
-               if      (instr.opt[i] == CMD_VAR) instr.arg[i] = s->script.var[t];
-               else if (instr.opt[i] == CMD_PAR) instr.arg[i] = s->script.par[t];
-            }
+      opGr:  A = lgGpioRead(P0, P1); F = A;                 SCR_NEXT(PC+1);
 
-            fprintf(stderr, "PC=%d cmd=%d p0=%d p1=%d p2=%d p3=%d\n",
-               PC, instr.cmd,
-               instr.arg[0], instr.arg[1], instr.arg[2], instr.arg[3]);
+      opGw:  A = lgGpioWrite(P0, P1, P2); F = A;            SCR_NEXT(PC+1);
 
-            fflush(stderr);
+      opMics:
+         if ((uint32_t)P0 <= LG_MAX_MICS_DELAY)
+            {lguSleep((uint32_t)P0 / 1E6); A = LG_OKAY;}
+         else A = LG_BAD_MICS_DELAY;
+         F = A;
+         SCR_NEXT(PC+1);
 
-            cmdP->magic = LG_MAGIC;
-            cmdP->size = 0;
-            cmdP->cmd = instr.cmd;
-            cmdP->doubles = 0;
-            cmdP->longs = 0;
-            cmdP->shorts = 0;
+      opMils:
+         if ((uint32_t)P0 <= LG_MAX_MILS_DELAY)
+            {lguSleep((uint32_t)P0 / 1E3); A = LG_OKAY;}
+         else A = LG_BAD_MILS_DELAY;
+         F = A;
+         SCR_NEXT(PC+1);
 
-            for (i=0; i<CMD_MAX_ARG; i++) arg[i] = instr.arg[i];
+      opAdd:   A += P0; F = A;                              SCR_NEXT(PC+1);
 
-            A = lgExecCmd(cmdBuf, sizeof(cmdBuf));
+      opAnd:   A &= P0; F = A;                              SCR_NEXT(PC+1);
 
-            F = A;
+      opCall:
+         if (SP >= LG_SCRIPT_STACK_SIZE) goto scrPush;
+         S[SP++] = PC + 1;
+         SCR_NEXT(o->jump);
 
-            PC++;
-         }
-         else
-         {
-            p0o = instr.arg[0];
-            p1o = instr.arg[1];
+      opCmp:   F = A - P0;                                  SCR_NEXT(PC+1);
 
-            // parameter and variable substitution
+      opDcr:   F = --P0;                                    SCR_NEXT(PC+1);
 
-            for (i=0; i<2; i++) // maximum of two parameters
-            {
-               t = instr.arg[i];
-               if      (instr.opt[i] == CMD_VAR) instr.arg[i] = s->script.var[t];
-               else if (instr.opt[i] == CMD_PAR) instr.arg[i] = s->script.par[t];
-            }
+      opDcra:  F = --A;                                     SCR_NEXT(PC+1);
 
-            p0 = instr.arg[0];
-            p1 = instr.arg[1];
+      opDiv:
+         if (P0 == 0) goto scrDiv;
+         A = (P0 == -1) ? (int32_t)(0U - (uint32_t)A) : A / P0; F = A;
+         SCR_NEXT(PC+1);
 
-            fprintf(stderr, "PC=%d cmd=%d p0=%d p0o=%d p1=%d p1o=%d\n",
-               PC, instr.cmd,
-               instr.arg[0], p0o, instr.arg[1], p1o);
+      opHalt:
+         s->run_state = LG_SCRIPT_ENDED;
+         goto scrStop;
 
-            fflush(stderr);
+      opInr:   F = ++P0;                                    SCR_NEXT(PC+1);
 
-            switch (instr.cmd)
-            {
-               case LG_CMD_ADD:   A+=p0; F=A;                     PC++; break;
+      opInra:  F = ++A;                                     SCR_NEXT(PC+1);
 
-               case LG_CMD_AND:   A&=p0; F=A;                     PC++; break;
+      opJge:   SCR_NEXT((F >= 0) ? o->jump : PC+1);
 
-               case LG_CMD_CALL:  scrPush(s, &SP, S, PC+1);    PC = p0; break;
+      opJgt:   SCR_NEXT((F >  0) ? o->jump : PC+1);
 
-               case LG_CMD_CMP:   F=A-p0;                         PC++; break;
+      opJle:   SCR_NEXT((F <= 0) ? o->jump : PC+1);
 
-               case LG_CMD_DCR:
-                  if (instr.opt[0] == CMD_PAR)
-                     {--s->script.par[p0o]; F=s->script.par[p0o];}
-                  else
-                     {--s->script.var[p0o]; F=s->script.var[p0o];}
-                  PC++;
-                  break;
+      opJlt:   SCR_NEXT((F <  0) ? o->jump : PC+1);
 
-               case LG_CMD_DCRA:  --A; F=A;                       PC++; break;
+      opJmp:   SCR_NEXT(o->jump);
 
-               case LG_CMD_DIV:   A/=p0; F=A;                     PC++; break;
+      opJnz:   SCR_NEXT(F ? o->jump : PC+1);
 
-               case LG_CMD_HALT:  s->run_state = LG_SCRIPT_ENDED;       break;
+      opJz:    SCR_NEXT(F ? PC+1 : o->jump);
 
-               case LG_CMD_INR:
-                  if (instr.opt[0] == CMD_PAR)
-                     {++s->script.par[p0o]; F=s->script.par[p0o];}
-                  else
-                     {++s->script.var[p0o]; F=s->script.var[p0o];}
-                  PC++;
-                  break;
-
-               case LG_CMD_INRA:  ++A; F=A;                       PC++; break;
-
-               case LG_CMD_JLE:   if (F<=0) PC=p0; else PC++;           break;
-
-               case LG_CMD_JLT:   if (F<0)  PC=p0; else PC++;           break;
+      opLd:    P0 = P1;                                     SCR_NEXT(PC+1);
 
-               case LG_CMD_JMP:   PC=p0;                                break;
-
-               case LG_CMD_JNZ:   if (F)    PC=p0; else PC++;           break;
-
-               case LG_CMD_JGE:   if (F>=0) PC=p0; else PC++;           break;
-
-               case LG_CMD_JGT:   if (F>0)  PC=p0; else PC++;           break;
-
-               case LG_CMD_JZ:    if (!F)   PC=p0; else PC++;           break;
-
-               case LG_CMD_LD:
-                  if (instr.opt[0] == CMD_PAR) s->script.par[p0o]=p1;
-                  else                         s->script.var[p0o]=p1;
-                  PC++;
-                  break;
-
-               case LG_CMD_LDA:   A=p0;                           PC++; break;
-
-               case LG_CMD_MLT:   A*=p0; F=A;                     PC++; break;
-
-               case LG_CMD_MOD:   A%=p0; F=A;                     PC++; break;
-
-               case LG_CMD_OR:    A|=p0; F=A;                     PC++; break;
-
-               case LG_CMD_POP:
-                  if (instr.opt[0] == CMD_PAR)
-                     s->script.par[p0o]=scrPop(s, &SP, S);
-                  else
-                     s->script.var[p0o]=scrPop(s, &SP, S);
-                  PC++;
-                  break;
-
-               case LG_CMD_POPA:  A=scrPop(s, &SP, S);            PC++; break;
-
-               case LG_CMD_PUSH:
-                  if (instr.opt[0] == CMD_PAR)
-                     scrPush(s, &SP, S, s->script.par[p0o]);
-                  else
-                     scrPush(s, &SP, S, s->script.var[p0o]);
-                  PC++;
-                  break;
-
-               case LG_CMD_PUSHA: scrPush(s, &SP, S, A);          PC++; break;
-
-               case LG_CMD_RET:   PC=scrPop(s, &SP, S);                 break;
-
-               case LG_CMD_RL:
-                  if (instr.opt[0] == CMD_PAR)
-                  {
-                     tmp = xrl(s->script.par[p0o], p1);
-                     s->script.par[p0o] = tmp;
-                     F=tmp;
-                  }
-                  else
-                  {
-                     tmp = xrl(s->script.var[p0o], p1);
-                     s->script.var[p0o] = tmp;
-                     F=tmp;
-                  }
-                  PC++;
-                  break;
-
-               case LG_CMD_RLA:   A=xrl(A, p0); F=A;              PC++; break;
-
-               case LG_CMD_RR:
-                  if (instr.opt[0] == CMD_PAR)
-                  {
-                     tmp = xrr(s->script.par[p0o], p1);
-                     s->script.par[p0o] = tmp;
-                     F=tmp;
-                  }
-                  else
-                  {
-                     tmp = xrr(s->script.var[p0o], p1);
-                     s->script.var[p0o] = tmp;
-                     F=tmp;
-                  }
-                  PC++;
-                  break;
-
-               case LG_CMD_RRA:   A=xrr(A, p0); F=A;              PC++; break;
-
-               case LG_CMD_SHL:
-                  if (instr.opt[0] == CMD_PAR)
-                  {
-                     tmp = xsl(s->script.par[p0o], p1);
-                     s->script.par[p0o] = tmp;
-                     F=tmp;
-                  }
-                  else
-                  {
-                     tmp = xsl(s->script.var[p0o], p1);
-                     s->script.var[p0o] = tmp;
-                     F=tmp;
-                  }
-                  PC++;
-                  break;
-
-               case LG_CMD_SHLA:   A=xsl(A, p0); F=A;              PC++; break;
-
-               case LG_CMD_SHR:
-                  if (instr.opt[0] == CMD_PAR)
-                  {
-                     tmp = xsr(s->script.par[p0o], p1);
-                     s->script.par[p0o] = tmp;
-                     F=tmp;
-                  }
-                  else
-                  {
-                     tmp = xsr(s->script.var[p0o], p1);
-                     s->script.var[p0o] = tmp;
-                     F=tmp;
-                  }
-                  PC++;
-                  break;
-
-               case LG_CMD_SHRA:   A=xsr(A, p0); F=A;              PC++; break;
-
-               case LG_CMD_STA:
-                  if (instr.opt[0] == CMD_PAR) s->script.par[p0o]=A;
-                  else                         s->script.var[p0o]=A;
-                  PC++;
-                  break;
-
-               case LG_CMD_SUB:   A-=p0; F=A;                     PC++; break;
-
-               case LG_CMD_SYS:
-                  //A=scrSys((char*)instr.arg[4], A, 0);
-                  F=A;
-                  PC++;
-                  break;
-
-               case LG_CMD_X:
-                  if (instr.opt[0] == CMD_PAR) t1 = &s->script.par[p0o];
-                  else                         t1 = &s->script.var[p0o];
-
-                  if (instr.opt[1] == CMD_PAR) t2 = &s->script.par[p1o];
-                  else                         t2 = &s->script.var[p1o];
-
-                  scrSwap(t1, t2);
-                  PC++;
-                  break;
-
-               case LG_CMD_XA:
-                  if (instr.opt[0] == CMD_PAR)
-                     scrSwap(&s->script.par[p0o], &A);
-                  else
-                     scrSwap(&s->script.var[p0o], &A);
-                  PC++;
-                  break;
-
-               case LG_CMD_XOR:   A^=p0; F=A;                     PC++; break;
-
-            }
-         }
+      opLda:   A = P0;                                      SCR_NEXT(PC+1);
 
-         if (PC >= s->script.instrs) s->run_state = LG_SCRIPT_ENDED;
-      }
+      opMlt:   A *= P0; F = A;                              SCR_NEXT(PC+1);
+
+      opMod:
+         if (P0 == 0) goto scrDiv;
+         A = (P0 == -1) ? 0 : A % P0; F = A;
+         SCR_NEXT(PC+1);
+
+      opNop:                                                SCR_NEXT(PC+1);
+
+      opOr:    A |= P0; F = A;                              SCR_NEXT(PC+1);
+
+      opPop:
+         if (SP <= 0) goto scrPop;
+         P0 = S[--SP];
+         SCR_NEXT(PC+1);
+
+      opPopa:
+         if (SP <= 0) goto scrPop;
+         A = S[--SP];
+         SCR_NEXT(PC+1);
+
+      opPush:
+         if (SP >= LG_SCRIPT_STACK_SIZE) goto scrPush;
+         S[SP++] = P0;
+         SCR_NEXT(PC+1);
+
+      opPusha:
+         if (SP >= LG_SCRIPT_STACK_SIZE) goto scrPush;
+         S[SP++] = A;
+         SCR_NEXT(PC+1);
+
+      opRet:
+         if (SP <= 0) goto scrPop;
+         SCR_NEXT(S[--SP]);
+
+      opRl:    P0 = xrl(P0, P1); F = P0;                    SCR_NEXT(PC+1);
+
+      opRla:   A = xrl(A, P0); F = A;                       SCR_NEXT(PC+1);
+
+      opRr:    P0 = xrr(P0, P1); F = P0;                    SCR_NEXT(PC+1);
+
+      opRra:   A = xrr(A, P0); F = A;                       SCR_NEXT(PC+1);
 
+      opShl:   P0 = xsl(P0, P1); F = P0;                    SCR_NEXT(PC+1);
+
+      opShla:  A = xsl(A, P0); F = A;                       SCR_NEXT(PC+1);
+
+      opShr:   P0 = xsr(P0, P1); F = P0;                    SCR_NEXT(PC+1);
+
+      opShra:  A = xsr(A, P0); F = A;                       SCR_NEXT(PC+1);
+
+      opSta:   P0 = A;                                      SCR_NEXT(PC+1);
+
+      opSub:   A -= P0; F = A;                              SCR_NEXT(PC+1);
+
+      opSys:
+         //A=scrSys((char*)instr.arg[4], A, 0);
+         F = A;
+         SCR_NEXT(PC+1);
+
+      opX:     t = P0; P0 = P1; P1 = t;                     SCR_NEXT(PC+1);
+
+      opXa:    t = P0; P0 = A; A = t;                       SCR_NEXT(PC+1);
+
+      opXor:   A ^= P0; F = A;                              SCR_NEXT(PC+1);
+
+      scrPop:
+         LG_DBG(LG_DEBUG_ALWAYS, "script %d too many pops", s->id);
+         s->run_state = LG_SCRIPT_FAILED;
+         goto scrStop;
+
+      scrPush:
+         LG_DBG(LG_DEBUG_ALWAYS, "script %d too many pushes", s->id);
+         s->run_state = LG_SCRIPT_FAILED;
+         goto scrStop;
+
+      scrDiv:
+         LG_DBG(LG_DEBUG_ALWAYS, "script %d divide by zero", s->id);
+         s->run_state = LG_SCRIPT_FAILED;
+         goto scrStop;
+
+      scrStop:
       if (((volatile int)s->request == LG_SCRIPT_HALT)  ||
           ((volatile int)s->request == LG_SCRIPT_DELETE))
          s->run_state = LG_SCRIPT_HALTED;
@@ -484,6 +658,10 @@ static void *pthScript(void *x)
    return 0;
 }
 
+#undef P0
+#undef P1
+#undef P2
+
 /* ----------------------------------------------------------------------- */
 
 void lgRawDumpScript(int handle)
@@ -548,6 +726,8 @@ int lgScriptStore(char *script)
 
    status = cmdParseScript(script, &s->script, 0);
 
+   if (status == 0) status = xScriptCompile(s);
+
    if (status == 0)
    {
       /* set the owner's user and share */
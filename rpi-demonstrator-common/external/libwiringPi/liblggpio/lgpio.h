@@ -106,11 +106,16 @@ lgTxPulse                    Starts pulses on a GPIO
 lgTxPwm                      Starts PWM pulses on a GPIO
 lgTxServo                    Starts Servo pulses on a GPIO
 lgTxWave                     Starts a wave on a group of GPIO
+lgTxStreamOpen               Registers buffers to stream a wave from
+lgTxStreamPut                Hands the next stream buffer over for tx
+lgTxStreamClose              Stops a wave stream
 lgTxBusy                     See if tx is active on a GPIO or group
 lgTxRoom                     See if more room for tx on a GPIO or group
 
 lgGpioSetDebounce            Sets the debounce time for a GPIO
 lgGpioSetWatchdog            Sets the watchdog time for a GPIO
+lgGpioSetAlertDepth          Sets the alert queue depth for a GPIO
+lgGpioGetAlertStats          Gets the alert queue statistics for a GPIO
 
 lgGpioSetAlertsFunc          Starts a GPIO callback
 lgGpioSetSamplesFunc         Starts a GPIO callback for all GPIO
@@ -146,6 +151,12 @@ lgI2cBlockProcessCall        SMBus block process call
 lgI2cSegments                Performs multiple I2C transactions
 lgI2cZip                     Performs multiple I2C transactions
 
+lgI2cArbiterStart            Queues and merges the transactions on a bus
+lgI2cArbiterStop             Stops queuing the transactions on a bus
+lgI2cArbiterStats            Gets the queue statistics of a bus
+lgI2cSetPriority             Sets the queue priority of an I2C device
+lgI2cSubmit                  Queues I2C segments with a completion callback
+
 NOTIFICATIONS
 
 lgNotifyOpen                 Request a notification
@@ -153,6 +164,13 @@ lgNotifyClose                Close a notification
 lgNotifyPause                Pause notifications
 lgNotifyResume               Start notifications
 
+lgNotifyOpenRing             Request a shared memory notification
+lgNotifyRingFds              Get the fds of a shared memory notification
+lgNotifyRingMap              Map a shared memory notification
+lgNotifyRingUnmap            Unmap a shared memory notification
+lgNotifyRingRead             Read reports from a shared memory notification
+lgNotifyRingWait             Wait for reports on a shared memory notification
+
 SERIAL
 
 lgSerialOpen                 Opens a serial device
@@ -310,10 +328,19 @@ extern "C" {
 
 #define LG_TX_PWM 0
 #define LG_TX_WAVE 1
+#define LG_TX_STREAM 2
+
+#define LG_MAX_TX_STREAM_BUFS 1024
 
 #define LG_MAX_MICS_DEBOUNCE   5000000 /* 5 seconds */
 #define LG_MAX_MICS_WATCHDOG 300000000 /* 5 minutes */
 
+#define LG_DEFAULT_ALERT_DEPTH 1024
+#define LG_MAX_ALERT_DEPTH    65536
+
+#define LG_DEFAULT_NOTIFY_RING 4096
+#define LG_MAX_NOTIFY_RING  1048576
+
 /* Script constants
 */
 
@@ -347,6 +374,12 @@ extern "C" {
 #define LG_MAX_I2C_DEVICE_COUNT (1<<16)
 #define LG_MAX_I2C_ADDR 0x7F
 
+/* I2C arbiter */
+
+#define LG_I2C_ARB_BUSES 32     /* buses 0-31 may have an arbiter */
+#define LG_I2C_PRIORITIES 4     /* priorities 0 (default) to 3 (highest) */
+#define LG_I2C_DEFAULT_MERGE 8  /* requests merged into one transfer */
+
 /* i2cZip commands */
 
 #define LG_I2C_END          0
@@ -372,6 +405,12 @@ typedef struct
    int      fd;
    int      pipe_number;
    int      max_emits;
+   int      event_fd;   /* doorbell of a shared memory notification */
+   void     *ring;      /* the mapped lgNotifyRing_t, NULL for a pipe */
+   uint32_t *ring_waiting; /* the reader's flag, on the page before */
+   uint32_t ring_size;  /* the writer's own copies, never read back */
+   uint32_t ring_mask;
+   uint64_t ring_head;
 } lgNotify_t;
 
 typedef void (*callbk_t) ();
@@ -385,12 +424,31 @@ typedef struct
    uint8_t flags; /* none defined, ignore report if non-zero */
 } lgGpioReport_t;
 
+typedef struct lgNotifyRing_s
+{
+   uint32_t size;     /* report slots, a power of 2 */
+   uint32_t spare1;
+   uint64_t head;     /* sequence number of the next report published */
+   uint64_t write;    /* sequence number up to which slots may be changing */
+   uint64_t spare;
+   lgGpioReport_t report[]; /* report n is in report[n & (size-1)] */
+} lgNotifyRing_t, *lgNotifyRing_p;
+
 typedef struct lgGpioAlert_s
 {
    lgGpioReport_t report;
    int nfyHandle;
 } lgGpioAlert_t, *lgGpioAlert_p;
 
+typedef struct lgAlertStats_s
+{
+   uint64_t events;     /* alerts generated */
+   uint64_t dropped;    /* alerts lost to a full queue */
+   uint32_t depth;      /* queue size */
+   uint32_t queued;     /* alerts waiting to be emitted */
+   uint32_t high_water; /* most alerts queued at once */
+} lgAlertStats_t, *lgAlertStats_p;
+
 typedef struct lgLineInfo_s
 {
    uint32_t offset;               /* GPIO number */
@@ -414,6 +472,19 @@ typedef struct
    uint8_t  *buf;  /* pointer to msg data */
 } lgI2cMsg_t;
 
+typedef struct lgI2cArbStats_s
+{
+   uint64_t requests;    /* requests completed */
+   uint64_t transfers;   /* I2C_RDWR transfers made for them */
+   uint64_t merged;      /* requests which shared a transfer */
+   uint64_t wait_ns;     /* total time requests waited in the queue */
+   uint64_t max_wait_ns; /* longest time a request waited */
+   uint64_t busy_ns;     /* time the bus spent in transfers */
+   uint64_t elapsed_ns;  /* time since the arbiter started */
+   uint32_t queued;      /* requests waiting now */
+   uint32_t high_water;  /* most requests waiting at once */
+} lgI2cArbStats_t, *lgI2cArbStats_p;
+
 
 
 typedef void (*lgGpioAlertsFunc_t)  (int           num_alerts,
@@ -422,6 +493,8 @@ typedef void (*lgGpioAlertsFunc_t)  (int           num_alerts,
 
 typedef void *(lgThreadFunc_t) (void *);
 
+typedef void (*lgI2cDoneFunc_t) (int status, void *userdata);
+
 
 /* semi-private prototypes
 */
@@ -1206,6 +1279,105 @@ int main(int argc, char *argv[])
 ...
 D*/
 
+/*F*/
+int lgTxStreamOpen(
+   int handle, int gpio, int numBuffers, lgPulse_p *buffers);
+/*D
+This registers a ring of pulse buffers from which a wave is streamed
+to an output GPIO or group of GPIO.
+
+. .
+    handle: >= 0 (as returned by [*lgGpiochipOpen*])
+      gpio: the GPIO or group leader
+numBuffers: the number of buffers in the ring (1-LG_MAX_TX_STREAM_BUFS)
+   buffers: an array of numBuffers pointers to arrays of pulses
+. .
+
+If OK returns an eventfd which becomes readable as buffers complete.
+
+On failure returns a negative error code.
+
+The buffers belong to the caller and are not copied.  They must stay
+valid until the stream is closed.  Nothing is transmitted until the
+first buffer is handed over with [*lgTxStreamPut*].
+
+The buffers are used in ring order, buffers[0] first.  Pulses have
+the same meaning as for [*lgTxWave*].
+
+Each read of the eventfd returns (as a uint64_t) the number of buffers
+completed since the last read.  A completed buffer may be refilled and
+handed over again at once.  The eventfd is non-blocking and is closed
+by [*lgTxStreamClose*], it should not be closed by the caller.
+
+Output is gapless as long as the next buffer is handed over before the
+last pulse of the current one has been sent.  If the stream runs dry
+the GPIO keep their levels and output resumes with the next buffer.
+
+There can be one stream per GPIO or group.  [*lgTxBusy*] and
+[*lgTxRoom*] report on it with kind LG_TX_STREAM.
+
+...
+lgPulse_t ring[4][256];
+lgPulse_p bufs[4] = {ring[0], ring[1], ring[2], ring[3]};
+uint64_t done;
+int efd, next = 0;
+
+efd = lgTxStreamOpen(h, 20, 4, bufs);
+
+for (next=0; next<4; next++)
+   lgTxStreamPut(h, 20, fill(bufs[next]));
+
+while (running)
+{
+   poll_for_readable(efd);
+   read(efd, &done, sizeof(done));
+   while (done--) lgTxStreamPut(h, 20, fill(bufs[next++ % 4]));
+}
+
+lgTxStreamClose(h, 20);
+...
+D*/
+
+/*F*/
+int lgTxStreamPut(int handle, int gpio, int count);
+/*D
+This hands the next buffer of a wave stream over for transmission.
+
+. .
+handle: >= 0 (as returned by [*lgGpiochipOpen*])
+  gpio: the GPIO or group leader
+ count: the number of pulses in the buffer (>0)
+. .
+
+If OK returns the number of buffers the caller may still fill.
+
+On failure returns a negative error code.
+
+The buffer handed over is the one after the previous one in ring
+order.  It must not be changed until its completion is signalled
+on the eventfd returned by [*lgTxStreamOpen*].
+
+LG_TX_QUEUE_FULL is returned if every buffer is already queued.
+D*/
+
+/*F*/
+int lgTxStreamClose(int handle, int gpio);
+/*D
+This stops a wave stream and closes its eventfd.
+
+. .
+handle: >= 0 (as returned by [*lgGpiochipOpen*])
+  gpio: the GPIO or group leader
+. .
+
+If OK returns 0.
+
+On failure returns a negative error code.
+
+Queued buffers are dropped.  The GPIO keep their levels.  The buffers
+may be reused or freed once this returns.
+D*/
+
 /*F*/
 int lgTxBusy(int handle, int gpio, int kind);
 /*D
@@ -1215,11 +1387,13 @@ are active on the GPIO or group.
 . .
 handle: >= 0 (as returned by [*lgGpiochipOpen*])
   gpio: the gpio or group to be checked
-  kind: LG_TX_PWM or LG_TX_WAVE
+  kind: LG_TX_PWM, LG_TX_WAVE, or LG_TX_STREAM
 . .
 
 If OK returns 1 for busy and 0 for not busy.
 
+A stream is busy while it has buffers queued.
+
 On failure returns a negative error code.
 
 ...
@@ -1237,11 +1411,13 @@ transmissions of the specified kind on the GPIO or group.
 . .
 handle: >= 0 (as returned by [*lgGpiochipOpen*])
   gpio: the gpio or group to be checked
-  kind: LG_TX_PWM or LG_TX_WAVE
+  kind: LG_TX_PWM, LG_TX_WAVE, or LG_TX_STREAM
 . .
 
 If OK returns the number of free entries (0 if none).
 
+For a stream this is the number of buffers the caller may fill.
+
 On failure returns a negative error code.
 
 ...
@@ -1319,6 +1495,66 @@ lgSetWatchdogTime(h, 17, 200000); // alert if nothing for 0.2 seconds
 ...
 D*/
 
+/*F*/
+int lgGpioSetAlertDepth(int handle, int gpio, int depth);
+/*D
+This sets the size of the alert queue for a GPIO.
+
+. .
+handle: >= 0 (as returned by [*lgGpiochipOpen*])
+  gpio: the GPIO to be configured
+ depth: 1-LG_MAX_ALERT_DEPTH alerts
+. .
+
+If OK returns 0.
+
+On failure returns a negative error code.
+
+Each GPIO claimed for alerts queues its alerts until they are
+passed to the samples function and notification pipes (at most
+about half a millisecond).  The depth is rounded up to a power
+of 2 and takes effect the next time the GPIO is claimed for
+alerts.  The default is LG_DEFAULT_ALERT_DEPTH (1024).
+
+Alerts which arrive while the queue is full are counted as
+dropped, see [*lgGpioGetAlertStats*].
+
+...
+lgGpioSetAlertDepth(h, 17, 8192); // room for bursts on GPIO 17
+lgGpioClaimAlert(h, 0, LG_BOTH_EDGES, 17, -1);
+...
+D*/
+
+/*F*/
+int lgGpioGetAlertStats(int handle, int gpio, lgAlertStats_p stats);
+/*D
+This returns the alert queue statistics for a GPIO.
+
+. .
+handle: >= 0 (as returned by [*lgGpiochipOpen*])
+  gpio: the GPIO claimed for alerts
+ stats: A pointer to space for a lgAlertStats_t object
+. .
+
+If OK returns 0 and updates stats.
+
+On failure returns a negative error code.
+
+The counters start from zero each time the GPIO is claimed for
+alerts.  A non-zero dropped count means the queue depth should
+be increased with [*lgGpioSetAlertDepth*].
+
+...
+lgAlertStats_t st;
+
+if (lgGpioGetAlertStats(h, 17, &st) == LG_OKAY)
+{
+   printf("%"PRIu64" alerts, %"PRIu64" dropped, high water %u of %u\n",
+      st.events, st.dropped, st.high_water, st.depth);
+}
+...
+D*/
+
 /*F*/
 int lgGpioSetAlertsFunc(
    int handle, int gpio, lgGpioAlertsFunc_t cbf, void *userdata);
@@ -1478,6 +1714,8 @@ int lgNotifyOpenWithSize(int pipeSize);
 
 int  lgNotifyOpenInBand(int fd);
 
+void lgNotifyRingWrite(lgNotify_t *h, lgGpioReport_t *report, int count);
+
 /*F*/
 int lgNotifyOpen(void);
 /*D
@@ -1616,6 +1854,154 @@ lgNotifyClose(h);
 ...
 D*/
 
+/*F*/
+int lgNotifyOpenRing(int numReports);
+/*D
+This function requests a notification which delivers reports
+through a ring in shared memory rather than through a pipe.
+
+. .
+numReports: the ring size (0 for the default, otherwise
+            1-LG_MAX_NOTIFY_RING, rounded up to a power of 2)
+. .
+
+If OK returns a handle (>= 0).
+
+On failure returns a negative error code.
+
+The handle is used as nfyHandle by [*lgGpioClaimAlert*] and may be
+paused, resumed, and closed like any other notification.
+
+The ring lives in a memfd and is paired with an eventfd doorbell, see
+[*lgNotifyRingFds*].  A reader in this process or in one which has
+been given the memfd maps it with [*lgNotifyRingMap*] and takes the
+reports out with [*lgNotifyRingRead*] without a system call per report.
+
+The alert thread never waits for the reader.  When the ring is full
+the oldest reports are overwritten.  Each report has a sequence number
+so the reader learns how many it missed rather than losing them
+silently.  The eventfd is only written while the reader is asleep
+in [*lgNotifyRingWait*].
+
+The memfd starts with a page holding the flag the reader sets while
+it waits, followed by the ring.  Only that page is mapped writable
+by [*lgNotifyRingMap*], and the alert thread never trusts anything
+a reader could have changed.
+
+...
+lgNotifyRing_p ring;
+lgGpioReport_t rep[64];
+uint64_t seq = 0, lost = 0;
+int h, memFd, evFd, i, n;
+
+h = lgNotifyOpenRing(0);
+lgNotifyRingFds(h, &memFd, &evFd);
+ring = lgNotifyRingMap(memFd);
+
+lgGpioClaimAlert(chip, 0, LG_BOTH_EDGES, 16, h);
+
+while (lgNotifyRingWait(ring, evFd, seq, 1000) >= 0)
+{
+   n = lgNotifyRingRead(ring, &seq, rep, 64, &lost);
+
+   for (i=0; i<n; i++) handle(&rep[i]);
+}
+...
+D*/
+
+/*F*/
+int lgNotifyRingFds(int handle, int *memFd, int *eventFd);
+/*D
+This function returns the memfd and eventfd of a shared memory
+notification.
+
+. .
+ handle: >= 0 (as returned by [*lgNotifyOpenRing*])
+  memFd: the memfd holding the ring
+eventFd: the doorbell
+. .
+
+If OK returns 0.
+
+On failure returns a negative error code.
+
+The fds stay owned by the library and are closed by [*lgNotifyClose*].
+They may be dup'd, inherited, or passed over a Unix socket to another
+process.
+D*/
+
+/*F*/
+lgNotifyRing_p lgNotifyRingMap(int memFd);
+/*D
+This function maps the ring of a shared memory notification.
+
+. .
+memFd: the memfd (as returned by [*lgNotifyRingFds*])
+. .
+
+If OK returns the ring.
+
+On failure returns NULL.
+
+The ring is mapped read only, with the reader's waiting flag on a
+writable page just before it.  Each ring should have a single reader.
+D*/
+
+/*F*/
+void lgNotifyRingUnmap(lgNotifyRing_p ring);
+/*D
+This function unmaps a ring mapped by [*lgNotifyRingMap*].
+
+. .
+ring: the mapped ring
+. .
+D*/
+
+/*F*/
+int lgNotifyRingRead(
+   lgNotifyRing_p ring,
+   uint64_t *seq,
+   lgGpioReport_t *reports,
+   int count,
+   uint64_t *lost);
+/*D
+This function takes the reports from a shared memory notification.
+
+. .
+   ring: the mapped ring
+    seq: the sequence number of the next report to read, 0 to start
+reports: an array to receive the reports
+  count: the size of the reports array
+   lost: a count incremented by the number of reports missed (may be NULL)
+. .
+
+Returns the number of reports copied, 0 if none are waiting.
+
+*seq is advanced past the reports returned.  If the alert thread
+has overwritten reports that were not read in time, *seq skips them
+and *lost is increased by their number.
+D*/
+
+/*F*/
+int lgNotifyRingWait(
+   lgNotifyRing_p ring, int eventFd, uint64_t seq, int timeout_ms);
+/*D
+This function waits for reports on a shared memory notification.
+
+. .
+      ring: the mapped ring
+   eventFd: the doorbell (as returned by [*lgNotifyRingFds*])
+       seq: the sequence number of the next report to read
+timeout_ms: how long to wait, -1 for ever
+. .
+
+Returns 1 if reports are waiting, 0 on timeout.
+
+On failure returns a negative error code.
+
+It returns at once if reports are already waiting.
+D*/
+
 
 /* I2C API
 */
@@ -2079,6 +2465,161 @@ End
 ...
 D*/
 
+/*F*/
+int lgI2cArbiterStart(int i2cDev, int mergeMax);
+/*D
+This starts queuing the transactions of all the devices on an I2C bus
+through a thread which arbitrates between them.
+
+. .
+  i2cDev: 0-31
+mergeMax: 1-42, the most requests merged into one transfer
+. .
+
+If OK returns 0.
+
+On failure returns a negative error code.
+
+While the arbiter runs, the transactions of every device opened on the
+bus wait in a queue.  Requests are served from the highest priority
+queue first, see [*lgI2cSetPriority*], and in order within a priority.
+
+The arbiter merges up to mergeMax back-to-back requests to the same
+device into a single I2C_RDWR transfer, as [*lgI2cSegments*] does, so
+the requests are separated by a repeated start rather than a stop.
+A request ending with a write is the last in its transfer, as a
+device may only act on the write at the stop.  Requests addressing
+more than one device, or with segment flags other than read, are
+transferred on their own.  If a merged transfer fails every request
+in it fails; none is retried, as that could repeat a write made
+before the failure.  Set mergeMax to 1 for devices which need a stop
+between all transactions.
+
+SMBus transactions are sent as the equivalent I2C messages.  Write
+quick, block data, and block process call transactions, and
+[*lgI2cZip*] sequences, are made directly but hold the bus so that
+they don't interleave with the arbiter's transfers.
+
+The bus must support I2C_RDWR.  If the bus already has an arbiter its
+mergeMax is updated.  LG_I2C_DEFAULT_MERGE (8) is a reasonable choice.
+
+...
+lgI2cArbiterStart(1, LG_I2C_DEFAULT_MERGE);
+...
+D*/
+
+/*F*/
+int lgI2cArbiterStop(int i2cDev);
+/*D
+This stops the arbiter of an I2C bus once its queued requests have
+been transferred.  Transactions are made directly again afterwards.
+
+. .
+i2cDev: 0-31
+. .
+
+If OK returns 0.
+
+On failure returns a negative error code.
+D*/
+
+/*F*/
+int lgI2cArbiterStats(int i2cDev, lgI2cArbStats_p stats);
+/*D
+This returns the queue statistics of an I2C bus with an arbiter.
+
+. .
+i2cDev: 0-31
+ stats: A pointer to space for a lgI2cArbStats_t object
+. .
+
+If OK returns 0 and updates stats.
+
+On failure returns a negative error code.
+
+The counters start from zero when the arbiter is started.  The mean
+queue wait is wait_ns/requests and the bus utilization is
+busy_ns/elapsed_ns.  The mean number of requests per transfer is
+requests/transfers.
+
+...
+lgI2cArbStats_t st;
+
+if (lgI2cArbiterStats(1, &st) == LG_OKAY)
+{
+   printf("%.1f us mean wait, %.0f%% busy, %.1f requests per transfer\n",
+      st.wait_ns / 1E3 / st.requests,
+      st.busy_ns * 100.0 / st.elapsed_ns,
+      (double)st.requests / st.transfers);
+}
+...
+D*/
+
+/*F*/
+int lgI2cSetPriority(int handle, int priority);
+/*D
+This sets the priority of an I2C device's transactions in the queue of
+its bus's arbiter.
+
+. .
+  handle: >= 0 (as returned by [*lgI2cOpen*])
+priority: 0-3
+. .
+
+If OK returns 0.
+
+On failure returns a negative error code.
+
+Requests of a higher priority are transferred before those of a lower
+priority, which may wait indefinitely on a busy bus.  Devices are
+opened with priority 0.
+D*/
+
+/*F*/
+int lgI2cSubmit(int handle, lgI2cMsg_t *segs, int count,
+   lgI2cDoneFunc_t cbf, void *userdata);
+/*D
+This queues I2C segments with the arbiter of the device's bus and
+returns without waiting for them to be transferred.
+
+. .
+  handle: >= 0 (as returned by [*lgI2cOpen*])
+    segs: an array of I2C segments
+   count: 1-42, the number of I2C segments
+     cbf: the function called when the segments have been transferred
+userdata: a pointer to arbitrary user data
+. .
+
+If OK returns 0.
+
+On failure returns a negative error code.
+
+The segments and their buffers must remain valid until the callback is
+called.  The callback is passed the number of segments transferred or
+a negative error code.  It runs on the arbiter's thread and should
+return promptly; transactions it makes on the same bus are made
+directly.
+
+The bus must have an arbiter, see [*lgI2cArbiterStart*].
+
+...
+void done(int status, void *userdata)
+{
+   printf("temperature read (%d)\n", status);
+}
+
+uint8_t reg = 0, temp[2];
+
+lgI2cMsg_t segs[2]=
+{
+   {0x48, 0, 1, &reg},
+   {0x48, 1, 2, temp},
+};
+
+lgI2cSubmit(h, segs, 2, done, NULL);
+...
+D*/
+
 /* Serial API
 */
 
@@ -2506,8 +3047,12 @@ A value of 0 or 1.
 byteVal:: 0-255
 An 8-bit byte value.
 
+*buffers::
+An array of pointers to arrays of lgPulse_t objects.
+
 cbf::
-An alerts callback function.
+An alerts callback function, or a function called when I2C segments
+queued by [*lgI2cSubmit*] have been transferred.
 
 cfgId::
 A number identifying a configuration item.
@@ -2535,6 +3080,9 @@ The number of items.
 debounce_us::
 The debounce time in microseconds.
 
+depth::1-LG_MAX_ALERT_DEPTH
+The number of alerts a GPIO may queue, rounded up to a power of 2.
+
 *dirPath::
 A directory path which.
 
@@ -2554,6 +3102,9 @@ LG_BOTH_EDGES
 error::
 An error code.  All error codes are negative.
 
+eventFd::
+The eventfd doorbell of a shared memory notification.
+
 f::
 A function.
 
@@ -2621,8 +3172,8 @@ A whole number, negative or positive.
 *ioBuf::
 A pointer to a buffer used to hold data to send and the data received.
 
-kind:: LG_TX_PWM or LG_TX_WAVE
-A type of transmission: PWM or wave.
+kind:: LG_TX_PWM, LG_TX_WAVE, or LG_TX_STREAM
+A type of transmission: PWM, wave, or wave stream.
 
 level::
 A GPIO level (0 or 1).
@@ -2645,6 +3196,20 @@ LG_SET_PULL_DOWN
 LG_SET_PULL_NONE
 . .
 
+lgAlertStats_p::
+A pointer to a lgAlertStats_t object.
+
+. .
+typedef struct lgAlertStats_s
+{
+   uint64_t events;     // alerts generated
+   uint64_t dropped;    // alerts lost to a full queue
+   uint32_t depth;      // queue size
+   uint32_t queued;     // alerts waiting to be emitted
+   uint32_t high_water; // most alerts queued at once
+} lgAlertStats_t, *lgAlertStats_p;
+. .
+
 lgChipInfo_p::
 A pointer to a lgChipInfo_t object.
 
@@ -2697,6 +3262,29 @@ since the Epoch (start of 1970).  Later kernels use the number of
 nanoseconds since boot.  It's probably best not to make any assumption
 as to the timestamp origin.
 
+lgI2cArbStats_p::
+A pointer to a lgI2cArbStats_t object.
+
+. .
+typedef struct lgI2cArbStats_s
+{
+   uint64_t requests;    // requests completed
+   uint64_t transfers;   // I2C_RDWR transfers made for them
+   uint64_t merged;      // requests which shared a transfer
+   uint64_t wait_ns;     // total time requests waited in the queue
+   uint64_t max_wait_ns; // longest time a request waited
+   uint64_t busy_ns;     // time the bus spent in transfers
+   uint64_t elapsed_ns;  // time since the arbiter started
+   uint32_t queued;      // requests waiting now
+   uint32_t high_water;  // most requests waiting at once
+} lgI2cArbStats_t, *lgI2cArbStats_p;
+. .
+
+lgI2cDoneFunc_t::
+. .
+typedef void (*lgI2cDoneFunc_t) (int status, void *userdata);
+. .
+
 lgI2cMsg_t::
 . .
 typedef struct
@@ -2721,6 +3309,21 @@ typedef struct lgLine_s
 } lgLineInfo_t, *lgLineInfo_p;
 . .
 
+lgNotifyRing_p::
+A pointer to the ring of a shared memory notification.
+
+. .
+typedef struct lgNotifyRing_s
+{
+   uint32_t size;     // report slots, a power of 2
+   uint32_t spare1;
+   uint64_t head;     // sequence number of the next report published
+   uint64_t write;    // sequence number up to which slots may be changing
+   uint64_t spare;
+   lgGpioReport_t report[]; // report n is in report[n & (size-1)]
+} lgNotifyRing_t, *lgNotifyRing_p;
+. .
+
 lgPulse_p::
 A pointer to a lgPulse_t object.
 
@@ -2741,9 +3344,27 @@ typedef void *(lgThreadFunc_t) (void *);
 lineInfo::
 A pointer to a lgLineInfo_t object.
 
+*lost::
+A count of the reports missed by a reader.
+
+memFd::
+The memfd holding the ring of a shared memory notification.
+
+mergeMax::1-42
+The most I2C requests an arbiter merges into one transfer.
+
 nfyHandle:: >= 0
 This associates a notification with a GPIO alert.
 
+numReports::0-LG_MAX_NOTIFY_RING
+The size of a notification ring, rounded up to a power of 2.
+
+numBuffers::1-LG_MAX_TX_STREAM_BUFS
+The number of pulse buffers in a wave stream.
+
+priority::0-3
+The priority of an I2C device's requests in its bus's arbiter queue.
+
 *pth::
 A thread identifier, returned by [*lgGpioStartThread*].
 
@@ -2780,6 +3401,12 @@ PWM frequency
 pwmOffset:: >= 0
 The offset in microseconds from the nominal PWM pulse start.
 
+*reports::
+An array of lgGpioReport_t objects.
+
+ring::
+A ring mapped by [*lgNotifyRingMap*].
+
 *rxBuf::
 A pointer to a buffer used to receive data.
 
@@ -2789,6 +3416,9 @@ The size of an input buffer.
 *segs::
 An array of segments which make up a combined I2C transaction.
 
+*seq::
+The sequence number of the next report to be read from a ring.
+
 serBaud::
 The speed of serial communication in bits per second.
 
@@ -2825,6 +3455,9 @@ See [*lgSpiOpen*].
 *txBuf::
 An pointer to a buffer of data to transmit.
 
+timeout_ms::
+A timeout in milliseconds, -1 for none.
+
 txCount::
 The size of an output buffer.
 
@@ -2976,6 +3609,16 @@ PARAMS*/
 #define LG_BAD_PWM_DUTY        -103 // bad PWM dutycycle
 #define LG_GPIO_NOT_AN_OUTPUT  -104 // GPIO not set as an output
 #define LG_INVALID_GROUP_ALERT -105 // can not set a group to alert
+#define LG_BAD_ALERT_DEPTH     -106 // bad alert queue depth
+#define LG_NOT_AN_ALERT        -107 // GPIO not claimed for alerts
+#define LG_BAD_TX_STREAM       -108 // bad tx stream buffer or pulse count
+#define LG_NO_TX_STREAM        -109 // no tx stream open on GPIO
+#define LG_BAD_NOTIFY_RING     -110 // bad notification ring size
+#define LG_NOT_A_NOTIFY_RING   -111 // not a shared memory notification
+#define LG_BAD_BATCH           -112 // bad command in a batch
+#define LG_BATCH_TOO_BIG       -113 // batch replies too large
+#define LG_SHM_NOT_LOCAL       -114 // command ring needs a local socket
+#define LG_NO_I2C_ARBITER      -115 // no arbiter on I2C bus
 
 /*DEF_E*/
 
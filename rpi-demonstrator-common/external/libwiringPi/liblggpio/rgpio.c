@@ -35,13 +35,18 @@ For more information, please refer to <http://unlicense.org/>
 #include <time.h>
 #include <netdb.h>
 #include <pthread.h>
+#include <sched.h>
 #include <signal.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
 #include <netinet/tcp.h>
 #include <sys/select.h>
+#include <linux/futex.h>
 
 #include <arpa/inet.h>
 
@@ -58,6 +63,20 @@ For more information, please refer to <http://unlicense.org/>
 
 #define MAX_SBC 32
 
+#define MAX_BATCHES 16
+
+/* the largest batch extension rgpiod accepts */
+
+#define MAX_BATCH_SIZE (CMD_MAX_EXTENSION - sizeof(lgCmd_t) - 1)
+
+/* how long to spin on a command ring slot while rgpiod is polling */
+
+#define SHM_SPIN_NS 20000
+
+/* how often a sleeping command checks rgpiod is still connected */
+
+#define SHM_CHECK_MS 100
+
 typedef void (*CBF_t) ();
 
 struct callback_s
@@ -74,6 +93,14 @@ struct callback_s
    callback_t *next;
 };
 
+typedef struct
+{
+   int id;      // batch number, 0 if the slot is free
+   int count;   // commands in the batch
+   int replied; // replies to the batch have been received
+   int *status; // status of each command
+} lgBatch_t;
+
 typedef struct
 {
    size_t count; // number of elements
@@ -101,6 +128,20 @@ static int             gCancelState [MAX_SBC];
 
 static uint8_t         *gMsgBuf     [MAX_SBC];
 
+static int             gBatching    [MAX_SBC];
+static pthread_t       gBatchThread [MAX_SBC];
+static uint8_t         *gBatchBuf   [MAX_SBC];
+static uint32_t        gBatchSize   [MAX_SBC];
+static int             gBatchCount  [MAX_SBC];
+static int             gBatchNext   [MAX_SBC]; // number of next batch sent
+static int             gBatchRecv   [MAX_SBC]; // number of next batch replied
+static lgBatch_t       gBatch       [MAX_SBC][MAX_BATCHES];
+
+static lgShmRing_p     gShmRing     [MAX_SBC];
+static int             gShmBell     [MAX_SBC];
+static uint32_t        gShmHead     [MAX_SBC]; // next slot to submit
+static int             gShmFence    [MAX_SBC]; // unreplied commands sent
+
 static callback_t     *gCallBackFirst = 0;
 static callback_t     *gCallBackLast  = 0;
 
@@ -152,63 +193,332 @@ static void _pmu(int sbc)
    pthread_setcancelstate(cancelState, NULL);
 }
 
-static int lg_command
-   (int sbc, int command, int extents, lgExtent_t *ext, int rl)
+static int recvMax(int sbc, void *buf, int bufsize, int sent)
 {
-   int i;
-   lgCmd_p h;
-   uint8_t *p;
-   size_t len;
- 
-   if ((sbc < 0) || (sbc >= MAX_SBC) || !gPiInUse[sbc])
+   /*
+   Copy at most bufSize bytes from the receieved message to
+   buf (if buf non-null).  Discard the rest of the message.
+   */
+   uint8_t scratch[4096];
+   int remaining, fetch, count;
+
+   remaining = sent;
+
+   if (sent < bufsize) count = sent; else count = bufsize;
+
+   if (count && buf)
    {
-      return lgif_unconnected_sbc;
+      recv(gPigCommand[sbc], buf, count, MSG_WAITALL);
+      remaining -= count;
+
+/*
+      printf("recvMax(bs=%d sent=%d): %s\n",
+         bufsize, sent, lgDbgStr2Hex(count, (unsigned char *)buf));
+*/
    }
 
-   if (gAbort)
+   while (remaining)
    {
-      rgpiod_stop(sbc);
-      return lgif_unconnected_sbc;
+      fetch = remaining;
+      if (fetch > sizeof(scratch)) fetch = sizeof(scratch);
+      recv(gPigCommand[sbc], scratch, fetch, MSG_WAITALL);
+      remaining -= fetch;
    }
 
-   _pml(sbc);
+   return count;
+}
 
-   p = gMsgBuf[sbc];
-   
-   h = (lgCmd_p) p;
+static size_t xCmdBuild(
+   uint8_t *p, int command, int extents, lgExtent_t *ext)
+{
+   int i;
+   lgCmd_t h;
+   uint8_t *start = p;
 
-   h->magic = LG_MAGIC;
-   h->size = 0;
-   h->cmd = command;
-   h->doubles = 0;
-   h->longs = 0;
-   h->shorts = 0;
+   h.magic = LG_MAGIC;
+   h.size = 0;
+   h.cmd = command;
+   h.doubles = 0;
+   h.longs = 0;
+   h.shorts = 0;
 
    p += sizeof(lgCmd_t);
 
    for (i=0; i<extents; i++)
    {
-      h->size += ext[i].size;
+      h.size += ext[i].size;
       memcpy(p, ext[i].ptr, ext[i].size);
       p += ext[i].size;
 
       switch(ext[i].bytes)
       {
          case 8:
-            h->doubles += ext[i].count;
+            h.doubles += ext[i].count;
             break;
 
          case 4:
-            h->longs += ext[i].count;
+            h.longs += ext[i].count;
             break;
 
          case 2:
-            h->shorts += ext[i].count;
+            h.shorts += ext[i].count;
             break;
       }
    }
 
-   len = sizeof(lgCmd_t) + h->size;
+   /* batched commands follow each other unaligned */
+
+   memcpy(start, &h, sizeof(lgCmd_t));
+
+   return sizeof(lgCmd_t) + h.size;
+}
+
+static int xBatchAdd(
+   int sbc, int command, int extents, lgExtent_t *ext, int rl)
+{
+   int i;
+   size_t len;
+
+   /* the caller of a command which returns data unlocks */
+
+   if (!rl) return lgif_not_batchable;
+
+   len = sizeof(lgCmd_t);
+
+   for (i=0; i<extents; i++) len += ext[i].size;
+
+   if ((gBatchSize[sbc] + len) > MAX_BATCH_SIZE)
+   {
+      _pmu(sbc);
+      return lgif_batch_full;
+   }
+
+   gBatchSize[sbc] += xCmdBuild(
+      gBatchBuf[sbc] + sizeof(lgCmd_t) + gBatchSize[sbc],
+      command, extents, ext);
+
+   gBatchCount[sbc]++;
+
+   _pmu(sbc);
+
+   return LG_OKAY;
+}
+
+static int xBatchRecv(int sbc)
+{
+   /* receive the replies to the oldest batch not yet replied */
+
+   lgBatch_t *b;
+   lgCmd_t h;
+   int i, replies;
+
+   b = &gBatch[sbc][gBatchRecv[sbc] % MAX_BATCHES];
+
+   if (recv(gPigCommand[sbc], &h, sizeof(h), MSG_WAITALL) != sizeof(h))
+      return lgif_bad_recv;
+
+   replies = h.status;
+
+   for (i=0; i<replies; i++)
+   {
+      if (recv(gPigCommand[sbc], &h, sizeof(h), MSG_WAITALL) != sizeof(h))
+         return lgif_bad_recv;
+
+      if (h.size) recvMax(sbc, NULL, 0, h.size);
+
+      if (i < b->count) b->status[i] = h.status;
+   }
+
+   /* rgpiod stops at a command it can't parse */
+
+   for (; i<b->count; i++) b->status[i] = LG_BAD_BATCH;
+
+   b->replied = 1;
+
+   gBatchRecv[sbc]++;
+
+   gShmFence[sbc] = 0;
+
+   return LG_OKAY;
+}
+
+static int xBatchDrain(int sbc)
+{
+   int status;
+
+   while (gBatchRecv[sbc] != gBatchNext[sbc])
+   {
+      status = xBatchRecv(sbc);
+
+      if (status < 0) return status;
+   }
+
+   return LG_OKAY;
+}
+
+static lgShmSlot_p xShmSubmit(
+   int sbc, int command, int extents, lgExtent_t *ext)
+{
+   lgShmSlot_p slot;
+   uint64_t bell = 1;
+   uint8_t *p;
+   size_t size;
+   int i;
+
+   for (i=0, size=0; i<extents; i++) size += ext[i].size;
+
+   if (size > LG_SHM_MAX_EXT) return NULL;
+
+   slot = &gShmRing[sbc]->slot[gShmHead[sbc] % LG_SHM_SLOTS];
+
+   /* a slot not yet collected by an earlier command's thread */
+
+   if (__atomic_load_n(&slot->state, __ATOMIC_ACQUIRE) != LG_SHM_FREE)
+      return NULL;
+
+   slot->cmd = command;
+   slot->size = size;
+   slot->longs = size / 4;
+
+   for (i=0, p=slot->ext; i<extents; i++)
+   {
+      memcpy(p, ext[i].ptr, ext[i].size);
+      p += ext[i].size;
+   }
+
+   __atomic_store_n(&slot->state, LG_SHM_SUBMITTED, __ATOMIC_RELEASE);
+
+   gShmHead[sbc]++;
+
+   /* pairs with rgpiod clearing polling before its last look at the ring */
+
+   __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+   if (!__atomic_load_n(&gShmRing[sbc]->polling, __ATOMIC_RELAXED))
+   {
+      if (write(gShmBell[sbc], &bell, sizeof(bell))) ; /* ignore errors */
+   }
+
+   return slot;
+}
+
+static int xShmWait(int sbc, lgShmSlot_p slot, int spin)
+{
+   struct timespec ts, start, now;
+   uint32_t state;
+   int i, status;
+   char c;
+
+   if (spin)
+   {
+      clock_gettime(CLOCK_MONOTONIC, &start);
+
+      for (i=0; ; i++)
+      {
+         if (__atomic_load_n(&slot->state, __ATOMIC_ACQUIRE) == LG_SHM_DONE)
+            break;
+
+         if ((i & 63) == 63)
+         {
+            /* rgpiod may be polling on this CPU */
+
+            sched_yield();
+
+            clock_gettime(CLOCK_MONOTONIC, &now);
+
+            if (((now.tv_sec - start.tv_sec) * 1000000000 +
+                 (now.tv_nsec - start.tv_nsec)) > SHM_SPIN_NS) break;
+         }
+      }
+   }
+
+   ts.tv_sec = 0;
+   ts.tv_nsec = SHM_CHECK_MS * 1000000;
+
+   while ((state = __atomic_load_n(&slot->state, __ATOMIC_ACQUIRE)) !=
+          LG_SHM_DONE)
+   {
+      if (!(state & LG_SHM_WAITING))
+      {
+         if (!__atomic_compare_exchange_n(&slot->state, &state,
+               state | LG_SHM_WAITING, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            continue;
+
+         state |= LG_SHM_WAITING;
+      }
+
+      if ((syscall(SYS_futex, &slot->state, FUTEX_WAIT, state, &ts,
+            NULL, 0) < 0) && (errno == ETIMEDOUT))
+      {
+         /* the slot is never done if rgpiod has gone */
+
+         if (recv(gPigCommand[sbc], &c, 1, MSG_PEEK | MSG_DONTWAIT) == 0)
+            return lgif_bad_recv;
+      }
+   }
+
+   status = slot->status;
+
+   __atomic_store_n(&slot->state, LG_SHM_FREE, __ATOMIC_RELEASE);
+
+   return status;
+}
+
+static int lg_command
+   (int sbc, int command, int extents, lgExtent_t *ext, int rl)
+{
+   lgShmSlot_p slot;
+   int spin;
+   lgCmd_p h;
+   size_t len;
+ 
+   if ((sbc < 0) || (sbc >= MAX_SBC) || !gPiInUse[sbc])
+   {
+      return lgif_unconnected_sbc;
+   }
+
+   if (gAbort)
+   {
+      rgpiod_stop(sbc);
+      return lgif_unconnected_sbc;
+   }
+
+   _pml(sbc);
+
+   if (gBatching[sbc] && pthread_equal(gBatchThread[sbc], pthread_self()))
+      return xBatchAdd(sbc, command, extents, ext, rl);
+
+   /*
+   Commands returning only a status go through the command ring, unless
+   commands sent on the socket may not yet have been executed.
+   */
+
+   if (gShmRing[sbc] && rl && !gShmFence[sbc] &&
+       (gBatchRecv[sbc] == gBatchNext[sbc]))
+   {
+      slot = xShmSubmit(sbc, command, extents, ext);
+
+      if (slot != NULL)
+      {
+         spin = __atomic_load_n(&gShmRing[sbc]->polling, __ATOMIC_RELAXED);
+
+         _pmu(sbc);
+
+         return xShmWait(sbc, slot, spin);
+      }
+   }
+
+   /* replies to batches sent earlier arrive first */
+
+   if (xBatchDrain(sbc) < 0)
+   {
+      _pmu(sbc);
+      return lgif_bad_recv;
+   }
+
+   h = (lgCmd_p) gMsgBuf[sbc];
+
+   len = xCmdBuild(gMsgBuf[sbc], command, extents, ext);
 /*
    printf("tx=%s\n", lgDbgStr2Hex(len, (char *)h));
 */
@@ -225,6 +535,8 @@ static int lg_command
       return lgif_bad_recv;
    }
 
+   gShmFence[sbc] = 0;
+
    if (rl) _pmu(sbc);
 /*
    printf("rx=%s\n", lgDbgStr2Hex(sizeof(lgCmd_t), (char *)h));
@@ -309,11 +621,39 @@ static int lg_command_3(int sbc, int command, int p1, int p2, int p3, int rl)
 }
 
 
+static int lgOpenUnixSocket(const char *path)
+{
+   int sock;
+   struct sockaddr_un addr;
+
+   if (strlen(path) >= sizeof(addr.sun_path)) return lgif_bad_connect;
+
+   sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+   if (sock == -1) return lgif_bad_socket;
+
+   memset(&addr, 0, sizeof(addr));
+   addr.sun_family = AF_UNIX;
+   strcpy(addr.sun_path, path);
+
+   if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) == -1)
+   {
+      close(sock);
+      return lgif_bad_connect;
+   }
+
+   return sock;
+}
+
 static int lgOpenSocket(const char *addrStr, const char *portStr)
 {
    int sock, err, opt;
    struct addrinfo hints, *res, *rp;
 
+   /* a path names rgpiod's unix domain socket */
+
+   if (addrStr[0] == '/') return lgOpenUnixSocket(addrStr);
+
    memset (&hints, 0, sizeof (hints));
 
    hints.ai_family   = PF_UNSPEC;
@@ -470,41 +810,6 @@ static int intCallback(
    return lgif_bad_callback;
 }
 
-static int recvMax(int sbc, void *buf, int bufsize, int sent)
-{
-   /*
-   Copy at most bufSize bytes from the receieved message to
-   buf (if buf non-null).  Discard the rest of the message.
-   */
-   uint8_t scratch[4096];
-   int remaining, fetch, count;
-
-   remaining = sent;
-
-   if (sent < bufsize) count = sent; else count = bufsize;
-
-   if (count && buf)
-   {
-      recv(gPigCommand[sbc], buf, count, MSG_WAITALL);
-      remaining -= count;
-
-/*
-      printf("recvMax(bs=%d sent=%d): %s\n",
-         bufsize, sent, lgDbgStr2Hex(count, (unsigned char *)buf));
-*/
-   }
-
-   while (remaining)
-   {
-      fetch = remaining;
-      if (fetch > sizeof(scratch)) fetch = sizeof(scratch);
-      recv(gPigCommand[sbc], scratch, fetch, MSG_WAITALL);
-      remaining -= fetch;
-   }
-
-   return count;
-}
-
 /* PUBLIC ----------------------------------------------------------------- */
 
 /* START/STOP */
@@ -516,6 +821,7 @@ int rgpiod_start(const char *addrStr, const char *portStr)
    int *userdata;
    struct sigaction new_action, old_action;
    const char *userStr;
+   const char *shmStr;
 
    if (!xInited)
    {
@@ -595,9 +901,14 @@ int rgpiod_start(const char *addrStr, const char *portStr)
             if (gPthNotify[sbc])
             {
                gMsgBuf[sbc] = malloc(CMD_MAX_EXTENSION);
+               gBatchBuf[sbc] = malloc(CMD_MAX_EXTENSION);
 
-               if (gMsgBuf[sbc] != NULL)
+               if ((gMsgBuf[sbc] != NULL) && (gBatchBuf[sbc] != NULL))
                {
+                  gBatching[sbc] = 0;
+                  gBatchNext[sbc] = 1;
+                  gBatchRecv[sbc] = 1;
+
                   userStr = getenv(LG_ENVUSER);
 
                   if (userStr && strlen(userStr))
@@ -605,6 +916,13 @@ int rgpiod_start(const char *addrStr, const char *portStr)
                      lgu_set_user(sbc, userStr, NULL);
                   }
 
+                  shmStr = getenv(LG_ENVSHM);
+
+                  if ((addrStr[0] == '/') && shmStr && atoi(shmStr))
+                  {
+                     rgpiod_shm_start(sbc);
+                  }
+
                   return sbc;
                }
                else return lgif_bad_malloc;
@@ -619,6 +937,8 @@ int rgpiod_start(const char *addrStr, const char *portStr)
 
 void rgpiod_stop(int sbc)
 {
+   int i;
+
    if ((sbc < 0) || (sbc >= MAX_SBC) || !gPiInUse[sbc]) return;
 
    if (gPthNotify[sbc])
@@ -649,11 +969,306 @@ void rgpiod_stop(int sbc)
 
    _pml(sbc);
    gPiInUse[sbc] = 0;
+   if (gShmRing[sbc])
+   {
+      munmap(gShmRing[sbc], sizeof(lgShmRing_t));
+      close(gShmBell[sbc]);
+      gShmRing[sbc] = NULL;
+   }
    free(gMsgBuf[sbc]);
    gMsgBuf[sbc] = NULL;
+   free(gBatchBuf[sbc]);
+   gBatchBuf[sbc] = NULL;
+   gBatching[sbc] = 0;
+   for (i=0; i<MAX_BATCHES; i++)
+   {
+      if (gBatch[sbc][i].id) free(gBatch[sbc][i].status);
+      gBatch[sbc][i].id = 0;
+   }
    _pmu(sbc);
 }
 
+int rgpiod_shm_start(int sbc)
+{
+   lgCmd_t h;
+   struct msghdr msg;
+   struct iovec iov;
+   struct cmsghdr *cm;
+   union
+   {
+      char buf[CMSG_SPACE(2 * sizeof(int))];
+      struct cmsghdr align;
+   } ctl;
+   lgShmRing_p ring;
+   int fd[2];
+
+   if ((sbc < 0) || (sbc >= MAX_SBC) || !gPiInUse[sbc])
+      return lgif_unconnected_sbc;
+
+   _pml(sbc);
+
+   if (gShmRing[sbc])
+   {
+      _pmu(sbc);
+      return LG_OKAY;
+   }
+
+   if (xBatchDrain(sbc) < 0)
+   {
+      _pmu(sbc);
+      return lgif_bad_recv;
+   }
+
+   h.magic = LG_MAGIC;
+   h.size = 0;
+   h.cmd = LG_CMD_SHMO;
+   h.doubles = 0;
+   h.longs = 0;
+   h.shorts = 0;
+
+   if (send(gPigCommand[sbc], &h, sizeof(h), 0) != sizeof(h))
+   {
+      _pmu(sbc);
+      return lgif_bad_send;
+   }
+
+   /* the ring's memfd and doorbell arrive with the reply */
+
+   memset(&msg, 0, sizeof(msg));
+
+   iov.iov_base = &h;
+   iov.iov_len = sizeof(h);
+
+   msg.msg_iov = &iov;
+   msg.msg_iovlen = 1;
+   msg.msg_control = ctl.buf;
+   msg.msg_controllen = sizeof(ctl.buf);
+
+   if (recvmsg(gPigCommand[sbc], &msg, MSG_WAITALL | MSG_CMSG_CLOEXEC) !=
+       sizeof(h))
+   {
+      _pmu(sbc);
+      return lgif_bad_recv;
+   }
+
+   gShmFence[sbc] = 0;
+
+   cm = CMSG_FIRSTHDR(&msg);
+
+   if ((cm == NULL) || (cm->cmsg_type != SCM_RIGHTS) ||
+       (cm->cmsg_len != CMSG_LEN(2 * sizeof(int))))
+   {
+      _pmu(sbc);
+      return (h.status < 0) ? h.status : lgif_bad_shm;
+   }
+
+   memcpy(fd, CMSG_DATA(cm), sizeof(fd));
+
+   ring = mmap(NULL, sizeof(lgShmRing_t), PROT_READ | PROT_WRITE,
+      MAP_SHARED, fd[0], 0);
+
+   close(fd[0]);
+
+   if ((ring == MAP_FAILED) || (ring->magic != LG_SHM_MAGIC) ||
+       (ring->slots != LG_SHM_SLOTS))
+   {
+      if (ring != MAP_FAILED) munmap(ring, sizeof(lgShmRing_t));
+      close(fd[1]);
+      _pmu(sbc);
+      return lgif_bad_shm;
+   }
+
+   gShmBell[sbc] = fd[1];
+   gShmHead[sbc] = 0;
+   gShmRing[sbc] = ring;
+
+   _pmu(sbc);
+
+   return LG_OKAY;
+}
+
+
+/* BATCHES */
+
+int batch_begin(int sbc)
+{
+   if ((sbc < 0) || (sbc >= MAX_SBC) || !gPiInUse[sbc])
+      return lgif_unconnected_sbc;
+
+   _pml(sbc);
+
+   if (gBatching[sbc])
+   {
+      _pmu(sbc);
+      return lgif_bad_batch;
+   }
+
+   gBatching[sbc] = 1;
+   gBatchThread[sbc] = pthread_self();
+   gBatchSize[sbc] = 0;
+   gBatchCount[sbc] = 0;
+
+   _pmu(sbc);
+
+   return LG_OKAY;
+}
+
+int batch_cancel(int sbc)
+{
+   if ((sbc < 0) || (sbc >= MAX_SBC) || !gPiInUse[sbc])
+      return lgif_unconnected_sbc;
+
+   _pml(sbc);
+
+   if (!gBatching[sbc] || !pthread_equal(gBatchThread[sbc], pthread_self()))
+   {
+      _pmu(sbc);
+      return lgif_bad_batch;
+   }
+
+   gBatching[sbc] = 0;
+
+   _pmu(sbc);
+
+   return LG_OKAY;
+}
+
+int batch_send(int sbc, int batch_flags)
+{
+   lgCmd_p h;
+   lgBatch_t *b = NULL;
+   int *status = NULL;
+   int noReply;
+   size_t len;
+
+   if ((sbc < 0) || (sbc >= MAX_SBC) || !gPiInUse[sbc])
+      return lgif_unconnected_sbc;
+
+   _pml(sbc);
+
+   if (!gBatching[sbc] || !pthread_equal(gBatchThread[sbc], pthread_self()))
+   {
+      _pmu(sbc);
+      return lgif_bad_batch;
+   }
+
+   noReply = batch_flags & BATCH_NO_REPLY;
+
+   if (gBatchCount[sbc] && !noReply)
+   {
+      b = &gBatch[sbc][gBatchNext[sbc] % MAX_BATCHES];
+
+      /* the batch stays open until there is room for its replies */
+
+      if (b->id)
+      {
+         _pmu(sbc);
+         return lgif_batch_full;
+      }
+
+      status = malloc(gBatchCount[sbc] * sizeof(int));
+
+      if (status == NULL)
+      {
+         _pmu(sbc);
+         return lgif_bad_malloc;
+      }
+   }
+
+   gBatching[sbc] = 0;
+
+   if (!gBatchCount[sbc])
+   {
+      _pmu(sbc);
+      return 0;
+   }
+
+   h = (lgCmd_p) gBatchBuf[sbc];
+
+   h->magic = LG_MAGIC;
+   h->size = gBatchSize[sbc];
+   h->cmd = LG_CMD_BATCH | (noReply ? LG_CMD_NO_REPLY : 0);
+   h->doubles = 0;
+   h->longs = 0;
+   h->shorts = 0;
+
+   len = sizeof(lgCmd_t) + h->size;
+
+   if (send(gPigCommand[sbc], h, len, 0) != len)
+   {
+      free(status);
+      _pmu(sbc);
+      return lgif_bad_send;
+   }
+
+   if (noReply)
+   {
+      /* the command ring waits until a reply shows the batch is done */
+
+      gShmFence[sbc] = 1;
+      _pmu(sbc);
+      return 0;
+   }
+
+   b->id = gBatchNext[sbc]++;
+   b->count = gBatchCount[sbc];
+   b->replied = 0;
+   b->status = status;
+
+   _pmu(sbc);
+
+   return b->id;
+}
+
+int batch_collect(int sbc, int batch, int *status, int status_count)
+{
+   lgBatch_t *b;
+   int err, count;
+
+   if ((sbc < 0) || (sbc >= MAX_SBC) || !gPiInUse[sbc])
+      return lgif_unconnected_sbc;
+
+   if (batch <= 0) return lgif_bad_batch;
+
+   _pml(sbc);
+
+   b = &gBatch[sbc][batch % MAX_BATCHES];
+
+   if (b->id != batch)
+   {
+      _pmu(sbc);
+      return lgif_bad_batch;
+   }
+
+   /* replies arrive in order, any earlier batches are received first */
+
+   while (!b->replied)
+   {
+      err = xBatchRecv(sbc);
+
+      if (err < 0)
+      {
+         _pmu(sbc);
+         return err;
+      }
+   }
+
+   count = b->count;
+
+   if (status != NULL)
+   {
+      if (status_count > count) status_count = count;
+      memcpy(status, b->status, status_count * sizeof(int));
+   }
+
+   free(b->status);
+   b->id = 0;
+
+   _pmu(sbc);
+
+   return count;
+}
+
 
 /* FILES */
 
@@ -970,6 +1585,47 @@ int gpio_set_watchdog_time(int sbc, int handle, int gpio, int watchdog_us)
       sbc, LG_CMD_GWDOG, handle&0xffff, gpio, watchdog_us, 1);
 }
 
+int gpio_set_alert_depth(int sbc, int handle, int gpio, int depth)
+{
+   return lg_command_3(
+      sbc, LG_CMD_GADEP, handle&0xffff, gpio, depth, 1);
+}
+
+int gpio_get_alert_stats(int sbc, int handle, int gpio, lgAlertStats_p stats)
+{
+   int status;
+   int bytes;
+   lgExtent_t ext[1];
+   uint32_t pars[] = {handle&0xffff, gpio};
+   uint8_t buf[28];
+
+   ext[0].size = sizeof(pars);
+   ext[0].count = sizeof(pars)/sizeof(pars[0]);
+   ext[0].bytes = sizeof(pars[0]);
+   ext[0].ptr = &pars;
+
+   bytes = lg_command(sbc, LG_CMD_GASTA, 1, ext, 0);
+
+   if (bytes > 0)
+   {
+      /* two 64 bit and three 32 bit counters, no padding on the wire */
+
+      memset(buf, 0, sizeof(buf));
+      recvMax(sbc, buf, sizeof(buf), bytes);
+      memcpy(&stats->events, buf, 8);
+      memcpy(&stats->dropped, buf+8, 8);
+      memcpy(&stats->depth, buf+16, 4);
+      memcpy(&stats->queued, buf+20, 4);
+      memcpy(&stats->high_water, buf+24, 4);
+      status = LG_OKAY;
+   }
+   else status = bytes;
+
+   _pmu(sbc);
+
+   return status;
+}
+
 int tx_pulse(
    int sbc, int handle, int gpio,
    int micros_on, int micros_off,
@@ -1771,6 +2427,15 @@ const char *lgu_error_text(int errnum)
             return "not connected to sbc";
          case lgif_too_many_pis:
             return "too many connected sbcs";
+         case lgif_bad_batch:
+            return "batch not open, already open, or unknown";
+         case lgif_batch_full:
+            return "batch full";
+         case lgif_not_batchable:
+            return "command returns data, can't be batched";
+
+         case lgif_bad_shm:
+            return "can't map the command ring";
 
          default:
             return "unknown error";
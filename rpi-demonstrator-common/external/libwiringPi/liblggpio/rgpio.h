@@ -45,6 +45,8 @@ The rgpiod daemon must be running on the SBCs you wish to control.
 *Features*
 
 o reading and writing GPIO singly and in groups
+o batches of commands sent in one message
+o a shared memory command ring for clients on the daemon's host
 o software timed PWM and waves
 o GPIO callbacks
 o pipe notification of GPIO alerts
@@ -87,6 +89,14 @@ ESSENTIAL
 
 rgpiod_start               Connects to a rgpiod daemon
 rgpiod_stop                Disconnects from a rgpiod daemon
+rgpiod_shm_start           Sends commands through shared memory
+
+BATCHES
+
+batch_begin                Starts collecting commands into a batch
+batch_send                 Sends the batch of commands
+batch_collect              Gets the results of a batch
+batch_cancel               Discards the batch of commands
 
 FILES
 
@@ -133,6 +143,8 @@ tx_room                    See if more room for tx on a GPIO or group
 
 gpio_set_debounce_time     Sets the debounce time for a GPIO
 gpio_set_watchdog_time     Sets the watchdog time for a GPIO
+gpio_set_alert_depth       Sets the alert queue depth for a GPIO
+gpio_get_alert_stats       Gets the alert queue statistics for a GPIO
 
 callback                   Starts a GPIO callback
 callback_cancel            Stops a GPIO callback
@@ -245,6 +257,8 @@ extern "C" {
 #define FALLING_EDGE  2
 #define BOTH_EDGES   3
 
+#define BATCH_NO_REPLY 1
+
 typedef void (*CBFunc_t)
    (int sbc, int chip, int gpio,
    int level, uint64_t tick, void *userdata);
@@ -264,9 +278,10 @@ notification streams.
 
 . .
 addrStr: specifies the host or IP address of the SBC running the
-         rgpiod daemon.  It may be NULL in which case localhost
-         is used unless overridden by the LG_ADDR environment
-         variable.
+         rgpiod daemon, or the path of the unix domain socket
+         it listens on (rgpiod -u).  It may be NULL in which case
+         localhost is used unless overridden by the LG_ADDR
+         environment variable.
 
 portStr: specifies the port address used by the SBC running the
          rgpiod daemon.  It may be NULL in which case "8889"
@@ -284,6 +299,10 @@ the SBC to be used.
 If the LG_USER environment variable exists that user will be
 "logged in" using [*lgu_set_user*].  This only has an effect if
 the rgpiod daemon is running with access control enabled.
+
+A path (starting with /) connects to the daemon's unix domain socket
+and the port is ignored.  If the LG_SHM environment variable is
+non-zero [*rgpiod_shm_start*] is then called as well.
 D*/
 
 /*F*/
@@ -297,6 +316,144 @@ sbc: >= 0 (as returned by [*rgpiod_start*]).
 . .
 D*/
 
+/*F*/
+int rgpiod_shm_start(int sbc);
+/*D
+Maps a command ring shared with the rgpiod daemon.  The sbc must be
+connected through the daemon's unix domain socket.
+
+. .
+sbc: >= 0 (as returned by [*rgpiod_start*]).
+. .
+
+If OK returns 0.
+
+On failure returns a negative error code.
+
+From then on commands which only return a status, such as
+[*gpio_read*] and [*gpio_write*], are put in the ring rather than
+sent on the socket, provided their parameters fit in 48 bytes.
+While the daemon is polling the ring (rgpiod -b) such a command
+costs no system calls.  Otherwise the daemon is woken by an eventfd
+and the caller sleeps on a futex until the command is done.  Other
+commands, and those issued while batch replies are outstanding, use
+the socket as before.
+
+The ring is released by [*rgpiod_stop*].
+D*/
+
+
+/* ------------------------------------------------------------- BATCH API
+*/
+
+/*F*/
+int batch_begin(int sbc);
+/*D
+Starts a batch of commands for the calling thread.
+
+. .
+sbc: >= 0 (as returned by [*rgpiod_start*]).
+. .
+
+If OK returns 0.
+
+On failure returns a negative error code.
+
+Until [*batch_send*] or [*batch_cancel*] is called the commands the
+calling thread issues to the sbc are not sent but added to the
+batch.  Each returns 0 as soon as it is added, its result is got
+from [*batch_collect*].  Commands issued to the sbc by other threads
+are sent as usual.
+
+Commands which return data, such as [*i2c_read_device*], may not be
+added to a batch.  They return lgif_not_batchable.
+
+Commands return lgif_batch_full once the batch holds 64K bytes.
+
+A batch is sent to the rgpiod daemon in one message and the daemon
+replies to all its commands in one message.  Many GPIO writes may be
+made for the cost of one round trip over the network.
+
+...
+batch_begin(sbc);
+
+for (i=0; i<8; i++) gpio_write(sbc, h, leds[i], (pattern >> i) & 1);
+
+b = batch_send(sbc, 0);
+
+// do other things while the batch is on its way
+
+if (batch_collect(sbc, b, status, 8) == 8)
+{
+   for (i=0; i<8; i++)
+      if (status[i] < 0) printf("LED %d: %s\n", i, lgu_error_text(status[i]));
+}
+...
+D*/
+
+/*F*/
+int batch_send(int sbc, int batch_flags);
+/*D
+Sends the batch of commands started with [*batch_begin*] by the
+calling thread.
+
+. .
+        sbc: >= 0 (as returned by [*rgpiod_start*]).
+batch_flags: 0 or BATCH_NO_REPLY.
+. .
+
+If OK returns a batch number (> 0) to be passed to [*batch_collect*],
+or 0 if the batch was empty or sent with BATCH_NO_REPLY.
+
+On failure returns a negative error code.
+
+The batch is sent without waiting for earlier batches to be
+replied to.  Up to 16 batches may be awaiting [*batch_collect*], the
+batch is kept open and lgif_batch_full returned if there are more.
+
+If batch_flags is BATCH_NO_REPLY the daemon does not reply to
+the batch.  The results of its commands are lost.
+D*/
+
+/*F*/
+int batch_collect(int sbc, int batch, int *status, int status_count);
+/*D
+Waits for the replies to a batch and gets the result of each
+of its commands.
+
+. .
+         sbc: >= 0 (as returned by [*rgpiod_start*]).
+       batch: > 0 (as returned by [*batch_send*]).
+     *status: an array to receive the results, may be NULL.
+status_count: the number of elements in status.
+. .
+
+If OK returns the number of commands in the batch.
+
+On failure returns a negative error code.
+
+The results are stored in the order the commands were added to the
+batch, at most status_count of them.  Each is the value the command
+would have returned had it been sent on its own.
+
+Batches may be collected in any order.  Each may be collected
+once.
+D*/
+
+/*F*/
+int batch_cancel(int sbc);
+/*D
+Discards the batch of commands started with [*batch_begin*]
+by the calling thread.
+
+. .
+sbc: >= 0 (as returned by [*rgpiod_start*]).
+. .
+
+If OK returns 0.
+
+On failure returns a negative error code.
+D*/
 
 /* -------------------------------------------------------------- FILE API
 */
@@ -1201,6 +1358,50 @@ The level is set to LG_TIMEOUT (2) for a watchdog alert.
 D*/
 
 
+/*F*/
+int gpio_set_alert_depth(int sbc, int handle, int gpio, int depth);
+/*D
+This sets the size of the alert queue for a GPIO.
+
+. .
+   sbc: >= 0 (as returned by [*rgpiod_start*]).
+handle: >= 0 (as returned by [*gpiochip_open*]).
+  gpio: the GPIO to be configured.
+ depth: 1-LG_MAX_ALERT_DEPTH alerts.
+. .
+
+If OK returns 0.
+
+On failure returns a negative error code.
+
+The depth is rounded up to a power of 2 and takes effect the
+next time the GPIO is claimed for alerts.  The default is
+LG_DEFAULT_ALERT_DEPTH (1024).
+D*/
+
+
+/*F*/
+int gpio_get_alert_stats(int sbc, int handle, int gpio, lgAlertStats_p stats);
+/*D
+This returns the alert queue statistics for a GPIO.
+
+. .
+   sbc: >= 0 (as returned by [*rgpiod_start*]).
+handle: >= 0 (as returned by [*gpiochip_open*]).
+  gpio: the GPIO claimed for alerts.
+ stats: A pointer to space for a lgAlertStats_t object.
+. .
+
+If OK returns 0 and updates stats.
+
+On failure returns a negative error code.
+
+The counters start from zero each time the GPIO is claimed for
+alerts.  Alerts are dropped when they arrive while the queue is
+full, see [*gpio_set_alert_depth*].
+D*/
+
+
 /*F*/
 int gpio_claim_alert(
    int sbc, int handle, int lFlags, int eFlags, int gpio, int nfyHandle);
@@ -2517,6 +2718,16 @@ the rgpiod daemon.  It may be NULL in which case localhost
 is used unless overridden by the LG_ADDR environment
 variable.
 
+batch::>0
+A batch number, as returned by [*batch_send*].
+
+batch_flags::
+0 or BATCH_NO_REPLY.
+
+. .
+BATCH_NO_REPLY 1
+. .
+
 bitVal::
 A value of 0 or 1.
 
@@ -2569,6 +2780,9 @@ command.
 debounce_us::
 The debounce time in microseconds.
 
+depth::1-LG_MAX_ALERT_DEPTH
+The number of alerts a GPIO may queue, rounded up to a power of 2.
+
 double::
 A floating point number.
 
@@ -2692,6 +2906,20 @@ LG_SET_PULL_DOWN
 LG_SET_PULL_NONE
 . .
 
+lgAlertStats_p::
+A pointer to a lgAlertStats_t object.
+
+. .
+typedef struct lgAlertStats_s
+{
+   uint64_t events;     // alerts generated
+   uint64_t dropped;    // alerts lost to a full queue
+   uint32_t depth;      // queue size
+   uint32_t queued;     // alerts waiting to be emitted
+   uint32_t high_water; // most alerts queued at once
+} lgAlertStats_t, *lgAlertStats_p;
+. .
+
 lgChipInfo_p::
 A pointer to a lgChipInfo_t object.
 
@@ -2880,6 +3108,12 @@ A SPI device.
 spi_flags::
 See [*spi_open*] and [*bb_spi_open*].
 
+*status::
+An array to receive the result of each command of a batch.
+
+status_count::
+The number of elements in status.
+
 thread_func::
 A function of type gpioThreadFunc_t used as the main function of a
 thread.
@@ -2957,6 +3191,10 @@ typedef enum
    lgif_callback_not_found = -2010,
    lgif_unconnected_sbc    = -2011,
    lgif_too_many_pis       = -2012,
+   lgif_bad_batch          = -2013,
+   lgif_batch_full         = -2014,
+   lgif_not_batchable      = -2015,
+   lgif_bad_shm            = -2016,
 } lgifError_t;
 
 /*DEF_E*/
@@ -39,6 +39,7 @@ For more information, please refer to <http://unlicense.org/>
 #include <signal.h>
 #include <ctype.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <netdb.h>
 
 #include "lgpio.h"
@@ -52,11 +53,15 @@ int      gPermits = 0;
 int      gNumSockNetAddr = 0;
 uint32_t gSockNetAddr[MAX_CONNECT_ADDRESSES];
 int      gFdSock = -1;
+int      gSockWorkers = LG_DEFAULT_SOCKET_WORKERS;
+int      gFdUnix = -1;
+int      gShmPollMicros = LG_DEFAULT_SHM_POLL;
 
 /* locals */
 
 static int      CfgIfFlags = LG_DEFAULT_IF_FLAGS;
 static int      CfgSocketPort = LG_DEFAULT_SOCKET_PORT;
+static char    *CfgUnixPath = NULL;
 static pthread_t pthSocket;
 
 /* prototypes */
@@ -65,6 +70,40 @@ void *pthSocketThread(void *x);
 
 /* ----------------------------------------------------------------------- */
 
+static int xOpenUnixSocket(void)
+{
+   struct sockaddr_un server;
+
+   LG_DBG(LG_DEBUG_STARTUP, "path=%s", CfgUnixPath);
+
+   if (strlen(CfgUnixPath) >= sizeof(server.sun_path))
+      PARAM_ERROR(LG_INIT_FAILED, "socket path too long (%s)", CfgUnixPath);
+
+   gFdUnix = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+   if (gFdUnix == -1)
+      PARAM_ERROR(LG_INIT_FAILED, "unix socket failed (%m)");
+
+   memset(&server, 0, sizeof(server));
+   server.sun_family = AF_UNIX;
+   strcpy(server.sun_path, CfgUnixPath);
+
+   /* remove the socket left by an earlier run */
+
+   unlink(CfgUnixPath);
+
+   if (bind(gFdUnix, (struct sockaddr *)&server, sizeof(server)) < 0)
+      PARAM_ERROR(LG_INIT_FAILED, "bind to %s failed (%m)", CfgUnixPath);
+
+   /* as open to local users as the TCP port */
+
+   if (chmod(CfgUnixPath, 0666) < 0)
+      LG_DBG(LG_DEBUG_ALWAYS, "can't set permissions for %s (%m)",
+         CfgUnixPath);
+
+   return LG_OKAY;
+}
+
 static int xOpenSocket(void)
 {
    int i;
@@ -138,6 +177,8 @@ static int xOpenSocket(void)
          PARAM_ERROR(LG_INIT_FAILED, "bind to port %d failed (%m)", port);
    }
 
+   if (CfgUnixPath && (xOpenUnixSocket() < 0)) return LG_INIT_FAILED;
+
    if (pthread_create(&pthSocket, &pthAttr, pthSocketThread, &i))
       PARAM_ERROR(LG_INIT_FAILED, "pthread_create socket failed (%m)");
 
@@ -164,10 +205,14 @@ static void xUsage()
 {
    fprintf(stderr, "\n" \
       "Usage: rgpiod [OPTION] ...\n" \
+      "   -b value,   command ring poll microseconds (0-1000000, default 0)\n" \
       "   -c dir,     set config dir (default launch dir)\n" \
+      "   -i bus,     queue and merge the I2C transactions on bus (default off)\n" \
       "   -l,         localhost socket only (default local+remote)\n" \
       "   -n IP addr, allow address, name or dotted (default allow all)\n" \
       "   -p value,   socket port (1024-32000, default 8889)\n" \
+      "   -t value,   socket worker threads (1-64, default 8)\n" \
+      "   -u path,    also listen on a unix domain socket (default off)\n" \
       "   -v,         display rgpiod version and exit\n" \
       "   -w dir,     set working directory (default launch directory)\n" \
       "   -x,         enable access control (default off)\n" \
@@ -223,14 +268,27 @@ static void xInitOpts(int argc, char *argv[])
    int opt, err, i;
    uint32_t addr;
 
-   while ((opt = getopt(argc, argv, "c:ln:p:vw:x")) != -1)
+   while ((opt = getopt(argc, argv, "b:c:i:ln:p:t:u:vw:x")) != -1)
    {
       switch (opt)
       {
+         case 'b':
+            i = xGetNum(optarg, &err);
+            if ((i >= LG_MIN_SHM_POLL) && (i <= LG_MAX_SHM_POLL))
+               gShmPollMicros = i;
+            else xFatal("invalid -b option (%d)", i);
+            break;
+
          case 'c': /* configuration directory */
             lguSetConfigDir(optarg);
             break;
 
+         case 'i':
+            i = xGetNum(optarg, &err);
+            if (err || (lgI2cArbiterStart(i, LG_I2C_DEFAULT_MERGE) < 0))
+               xFatal("invalid -i option (%s)", optarg);
+            break;
+
          case 'l':
             CfgIfFlags |= LG_LOCALHOST_SOCK_IF;
             break; 
@@ -249,6 +307,17 @@ static void xInitOpts(int argc, char *argv[])
             else xFatal("invalid -p option (%d)", i);
             break;
 
+         case 't':
+            i = xGetNum(optarg, &err);
+            if ((i >= LG_MIN_SOCKET_WORKERS) && (i <= LG_MAX_SOCKET_WORKERS))
+               gSockWorkers = i;
+            else xFatal("invalid -t option (%d)", i);
+            break;
+
+         case 'u':
+            CfgUnixPath = optarg;
+            break;
+
          case 'v':
             printf("rgpiod_%d.%d.%d.%d\n",
                (RGPIOD_VERSION>>24)&0xff, (RGPIOD_VERSION>>16)&0xff,
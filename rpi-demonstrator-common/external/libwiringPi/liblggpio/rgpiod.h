@@ -37,6 +37,7 @@ For more information, please refer to <http://unlicense.org/>
 #define LG_ENVADDR "LG_ADDR"
 #define LG_ENVPORT "LG_PORT"
 #define LG_ENVSHARE "LG_SHARE"
+#define LG_ENVSHM "LG_SHM"
 #define LG_ENVUSER "LG_USER"
 
 #define LG_DEFAULT_USER "default"
@@ -55,11 +56,29 @@ extern "C" {
 
 int lgExecCmd(lgCmd_p h, int bufSize);
 
+struct lgCtx_s;
+
+int lgShmOpen(struct lgCtx_s *ctx, void **shm);
+void lgShmFds(void *shm, int *memFd, int *bellFd);
+void lgShmClose(void *shm);
+
 /* port */
 
 #define LG_MIN_SOCKET_PORT 1024
 #define LG_MAX_SOCKET_PORT 32000
 
+/* socket worker threads */
+
+#define LG_MIN_SOCKET_WORKERS      1
+#define LG_MAX_SOCKET_WORKERS     64
+#define LG_DEFAULT_SOCKET_WORKERS  8
+
+/* microseconds the command ring thread polls before sleeping */
+
+#define LG_MIN_SHM_POLL        0
+#define LG_MAX_SHM_POLL  1000000
+#define LG_DEFAULT_SHM_POLL    0
+
 /* ifFlags: */
 
 #define LG_LOCALHOST_SOCK_IF 4
@@ -97,6 +116,9 @@ extern int gPermits;
 extern int gNumSockNetAddr;
 extern uint32_t gSockNetAddr[MAX_CONNECT_ADDRESSES];
 extern int gFdSock;
+extern int gSockWorkers;
+extern int gFdUnix;
+extern int gShmPollMicros;
 
 #ifdef __cplusplus
 }
@@ -140,6 +162,8 @@ extern int gFdSock;
 #define LG_CMD_GIC   31 // gpiochip get chip info
 #define LG_CMD_GIL   32 // gpiochip get line info
 #define LG_CMD_GMODE 33 // gpio get mode
+#define LG_CMD_GADEP 34 // gpio set alert queue depth
+#define LG_CMD_GASTA 35 // gpio get alert queue statistics
 
 #define LG_CMD_I2CO  40 // I2C open
 #define LG_CMD_I2CC  41 // I2C close
@@ -193,9 +217,11 @@ extern int gFdSock;
 #define LG_CMD_CSI   116 // set internals setting
 #define LG_CMD_NOIB  117 // open a notification inband in a socket
 #define LG_CMD_SHELL 118 // run a shell command
+#define LG_CMD_BATCH 119 // run a batch of commands
 
 #define LG_CMD_SBC   120 // print the SBC's host name
 #define LG_CMD_FREE  121 // release resources
+#define LG_CMD_SHMO  122 // open a shared memory command ring
 
 #define LG_CMD_SHARE 130 // set the share id for handles
 #define LG_CMD_USER  131 // set the user
@@ -209,6 +235,8 @@ extern int gFdSock;
 #define LG_CMD_LGV   140 // print the lg library version
 #define LG_CMD_TICK  141 // print the number of nanonseconds since the Epoch
 
+#define LG_CMD_NO_REPLY 0x8000 // or'd into cmd, don't reply to the command
+
 /*DEF_E*/
 
 /*DEF_S Convenience Command Codes*/
@@ -107,6 +107,8 @@ GSOX h lf g v     GPIO claim for output\n\
 GW h g v          GPIO write\n\
 GWAVE h g p*      GPIO group tx wave\n\
 GWDOG h g us      GPIO watchdog time\n\
+GADEP h g n       GPIO alert queue depth\n\
+GASTA h g         GPIO alert queue statistics\n\
 \n\
 I2CC h            I2C close device\n\
 I2CO ib id if     I2C open device\n\
@@ -421,6 +423,19 @@ static void xShowResult(int rv, lgCmd_p cmdP, char *cmdExt)
          }
          break;
 
+      case 12: /* GASTA */
+         if (r < 0)
+         {
+            printf("%d\n", r);
+            xReport(RGS_SCRIPT_ERR, "ERROR: %s", lguErrorText(r));
+         }
+         else
+         {
+            printf("%"PRIu64" %"PRIu64" %u %u %u\n",
+               argQ[0], argQ[1], argI[4], argI[5], argI[6]);
+         }
+         break;
+
       default:
          printf("*** command=%d, status=%d\n", cmdP->cmd, r);
          if (r < 0) xReport(RGS_SCRIPT_ERR, "ERROR: %s", lguErrorText(r));
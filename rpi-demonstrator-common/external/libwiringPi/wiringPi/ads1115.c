@@ -29,12 +29,18 @@
  * channels as usual, also some fake digitalOutputs - these are the control
  * registers that allow the user to put it into single/diff mode, set the
  * gain and data rates.
+ *
+ * In continuous mode the ALERT/RDY pin is wired to a Pi GPIO and set up
+ *	as a conversion-ready signal. Each falling edge on it reads the
+ *	result (and starts the next channel when rotating through several),
+ *	so analogRead just hands back the latest sample.
  *********************************************************************************
  */
 
-#include <byteswap.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <pthread.h>
 
 #include <wiringPi.h>
 #include <wiringPiI2C.h>
@@ -127,24 +133,63 @@ static const uint16_t gains [6] =
   CONFIG_PGA_6_144V, CONFIG_PGA_4_096V, CONFIG_PGA_2_048V, CONFIG_PGA_1_024V, CONFIG_PGA_0_512V, CONFIG_PGA_0_256V
 } ;
 
+static const uint16_t muxes [8] =
+{
+  CONFIG_MUX_SINGLE_0, CONFIG_MUX_SINGLE_1, CONFIG_MUX_SINGLE_2, CONFIG_MUX_SINGLE_3,
+  CONFIG_MUX_DIFF_0_1, CONFIG_MUX_DIFF_2_3, CONFIG_MUX_DIFF_0_3, CONFIG_MUX_DIFF_1_3
+} ;
+
+// Continuous mode state, hung off node->devData. contLock guards
+//	node->devData of every ads1115 node: it's held while continuous mode
+//	is started or stopped and while the state is looked at from outside
+//	the ISR, which gets the state itself and is stopped before it goes.
+
+struct ads1115Continuous
+{
+  pthread_mutex_t lock ;
+  struct wiringPiNodeStruct *node ;
+  int  alertPin ;
+  int  chans [8] ;		// Channels to rotate through
+  int  numChans ;
+  int  current ;		// Index into chans [] of the conversion in progress
+  int  depth ;			// Ring buffer size per channel
+  int  latest [8] ;
+  unsigned int head  [8] ;	// Next slot to write
+  unsigned int count [8] ;	// Samples not yet drained
+  struct ads1115Sample *ring [8] ;
+} ;
+
+static pthread_mutex_t contLock = PTHREAD_MUTEX_INITIALIZER ;
+
 
 /*
- * analogRead:
- *	Pin is the channel to sample on the device.
- *	Channels 0-3 are single ended inputs,
- *	channels 4-7 are the various differential combinations.
+ * writeReg16:
+ *	The registers are big-endian 16-bit values, sent with the pointer
+ *	byte in one message.
  *********************************************************************************
  */
 
-static int myAnalogRead (struct wiringPiNodeStruct *node, int pin)
+static int writeReg16 (struct wiringPiNodeStruct *node, int reg, uint16_t value)
 {
-  int chan = pin - node->pinBase ;
-  int16_t  result ;
-  uint16_t config = CONFIG_DEFAULT ;
+  uint8_t data [2] ;
 
-  chan &= 7 ;
+  data [0] = value >> 8 ;
+  data [1] = value & 0xFF ;
+
+  return wiringPiI2CWriteRegBurstTo (node->fd, node->data2, reg, data, 2) ;
+}
 
-// Setup the configuration register
+
+/*
+ * makeConfig:
+ *	Config register value for a conversion on the given channel with
+ *	the current gain and data rate.
+ *********************************************************************************
+ */
+
+static uint16_t makeConfig (struct wiringPiNodeStruct *node, int chan)
+{
+  uint16_t config = CONFIG_DEFAULT ;
 
 //	Set PGA/voltage range
 
@@ -159,47 +204,92 @@ static int myAnalogRead (struct wiringPiNodeStruct *node, int pin)
 //	Set single-ended channel or differential mode
 
   config &= ~CONFIG_MUX_MASK ;
+  config |= muxes [chan & 7] ;
+
+  return config ;
+}
+
+
+/*
+ * toResult:
+ *	Sometimes with a 0v input on a single-ended channel the internal 0v
+ *	reference can be higher than the input, so you get a negative result...
+ *********************************************************************************
+ */
+
+static int toResult (int chan, const uint8_t conv [2])
+{
+  int16_t result = (int16_t)((conv [0] << 8) | conv [1]) ;
+
+  if ( (chan < 4) && (result < 0) ) 
+    return 0 ;
+  else
+    return (int)result ;
+}
+
+
+/*
+ * analogRead:
+ *	Pin is the channel to sample on the device.
+ *	Channels 0-3 are single ended inputs,
+ *	channels 4-7 are the various differential combinations.
+ *	In continuous mode the latest sample of the channel is returned, and
+ *	channels that aren't sampled read 0: a single-shot conversion would
+ *	stop the continuous one.
+ *********************************************************************************
+ */
+
+static int myAnalogRead (struct wiringPiNodeStruct *node, int pin)
+{
+  struct ads1115Continuous *cont ;
+  int chan = pin - node->pinBase ;
+  int      value ;
+  uint16_t config ;
+  uint8_t  ptrConfig = 1, ptrConv = 0 ;
+  uint8_t  status [2], conv [2] ;
+  struct wiringPiI2CMsg msgs [4] ;
+
+  chan &= 7 ;
 
-  switch (chan)
+  pthread_mutex_lock (&contLock) ;
+  if ((cont = (struct ads1115Continuous *)node->devData) != NULL)
   {
-    case 0: config |= CONFIG_MUX_SINGLE_0 ; break ;
-    case 1: config |= CONFIG_MUX_SINGLE_1 ; break ;
-    case 2: config |= CONFIG_MUX_SINGLE_2 ; break ;
-    case 3: config |= CONFIG_MUX_SINGLE_3 ; break ;
-
-    case 4: config |= CONFIG_MUX_DIFF_0_1 ; break ;
-    case 5: config |= CONFIG_MUX_DIFF_2_3 ; break ;
-    case 6: config |= CONFIG_MUX_DIFF_0_3 ; break ;
-    case 7: config |= CONFIG_MUX_DIFF_1_3 ; break ;
+    value = 0 ;
+    if (cont->ring [chan] != NULL)
+    {
+      pthread_mutex_lock (&cont->lock) ;
+        value = cont->latest [chan] ;
+      pthread_mutex_unlock (&cont->lock) ;
+    }
+    pthread_mutex_unlock (&contLock) ;
+    return value ;
   }
+  pthread_mutex_unlock (&contLock) ;
 
 //	Start a single conversion
 
-  config |= CONFIG_OS_SINGLE ;
-  config = bswap_16 (config) ;
-  wiringPiI2CWriteReg16 (node->fd, 1, config) ;
+  config = makeConfig (node, chan) | CONFIG_OS_SINGLE ;
+  writeReg16 (node, 1, config) ;
 
-// Wait for the conversion to complete
+// Wait for the conversion to complete. Each poll reads the config and
+//	the conversion register in one combined transaction, so the poll
+//	that sees the conversion done already has the result.
+
+  msgs [0].flags = 0 ;            msgs [0].len = 1 ; msgs [0].buf = &ptrConfig ;
+  msgs [1].flags = WPI_I2C_M_RD ; msgs [1].len = 2 ; msgs [1].buf = status ;
+  msgs [2].flags = 0 ;            msgs [2].len = 1 ; msgs [2].buf = &ptrConv ;
+  msgs [3].flags = WPI_I2C_M_RD ; msgs [3].len = 2 ; msgs [3].buf = conv ;
 
   for (;;)
   {
-    result =  wiringPiI2CReadReg16 (node->fd, 1) ;
-    result = bswap_16 (result) ;
-    if ((result & CONFIG_OS_MASK) != 0)
+    if (wiringPiI2CTransferTo (node->fd, node->data2, msgs, 4) < 0)
+      return 0 ;
+    if ((status [0] & (CONFIG_OS_MASK >> 8)) != 0)
       break ;
     delayMicroseconds (100) ;
   }
 
-  result =  wiringPiI2CReadReg16 (node->fd, 0) ;
-  result = bswap_16 (result) ;
-
-// Sometimes with a 0v input on a single-ended channel the internal 0v reference
-//	can be higher than the input, so you get a negative result...
-
-  if ( (chan < 4) && (result < 0) ) 
-    return 0 ;
-  else
-    return (int)result ;
+  return toResult (chan, conv) ;
 }
 
 
@@ -259,8 +349,7 @@ static void myAnalogWrite (struct wiringPiNodeStruct *node, int pin, int data)
   else
     ndata = (int16_t)data ;
 
-  ndata = bswap_16 (ndata) ;
-  wiringPiI2CWriteReg16 (node->fd, reg, data) ;
+  writeReg16 (node, reg, (uint16_t)ndata) ;
 }
 
 
@@ -285,9 +374,236 @@ int ads1115Setup (const int pinBase, int i2cAddr)
   node->fd           = fd ;
   node->data0        = CONFIG_PGA_4_096V ;	// Gain in data0
   node->data1        = CONFIG_DR_128SPS ;	// Samples/sec in data1
+  node->data2        = i2cAddr ;		// Bus address in data2
   node->analogRead   = myAnalogRead ;
   node->analogWrite  = myAnalogWrite ;
   node->digitalWrite = myDigitalWrite ;
 
   return TRUE ;
 }
+
+
+/*
+ * conversionReady:
+ *	ISR for the ALERT/RDY pin. Collect the finished conversion and, when
+ *	rotating, start the next channel - one bus transaction for both.
+ *********************************************************************************
+ */
+
+static void conversionReady (struct WPIWfiStatus wfiStatus, void *userdata)
+{
+  struct ads1115Continuous  *cont = (struct ads1115Continuous *)userdata ;
+  struct wiringPiNodeStruct *node = cont->node ;
+  uint8_t  ptrConv = 0, conv [2], next [3] ;
+  uint16_t config ;
+  struct wiringPiI2CMsg msgs [3] ;
+  struct ads1115Sample *sample ;
+  int chan, count = 2 ;
+
+  if (wfiStatus.edge != INT_EDGE_FALLING)
+    return ;
+
+  pthread_mutex_lock (&cont->lock) ;
+
+  chan = cont->chans [cont->current] ;
+
+  msgs [0].flags = 0 ;            msgs [0].len = 1 ; msgs [0].buf = &ptrConv ;
+  msgs [1].flags = WPI_I2C_M_RD ; msgs [1].len = 2 ; msgs [1].buf = conv ;
+
+  if (cont->numChans > 1)
+  {
+    cont->current = (cont->current + 1) % cont->numChans ;
+    config    = makeConfig (node, cont->chans [cont->current]) | CONFIG_OS_SINGLE ;
+    config    = (config & ~CONFIG_CQUE_MASK) | CONFIG_CQUE_1CONV ;
+    next [0]  = 1 ;
+    next [1]  = config >> 8 ;
+    next [2]  = config & 0xFF ;
+    msgs [2].flags = 0 ; msgs [2].len = 3 ; msgs [2].buf = next ;
+    count = 3 ;
+  }
+
+  if (wiringPiI2CTransferTo (node->fd, node->data2, msgs, count) == count)
+  {
+    sample = &cont->ring [chan][cont->head [chan]] ;
+    sample->timeStamp_us = wfiStatus.timeStamp_us ;
+    sample->value        = toResult (chan, conv) ;
+
+    cont->latest [chan] = sample->value ;
+    cont->head   [chan] = (cont->head [chan] + 1) % cont->depth ;
+    if (cont->count [chan] < (unsigned int)cont->depth)
+      ++cont->count [chan] ;
+  }
+
+  pthread_mutex_unlock (&cont->lock) ;
+}
+
+
+/*
+ * ads1115StartContinuous:
+ *	Sample the channels in channelMask (bit n = channel n) back to back,
+ *	driven by the ALERT/RDY pin on the Pi's alertPin. A single channel
+ *	uses the chip's own continuous mode, several are rotated through
+ *	with single-shot conversions. Each channel keeps the last depth
+ *	samples for ads1115ReadSamples.
+ *	wiringPi must be set up as the ISR needs it.
+ *********************************************************************************
+ */
+
+int ads1115StartContinuous (int pinBase, int alertPin, int channelMask, int depth)
+{
+  struct wiringPiNodeStruct *node ;
+  struct ads1115Continuous  *cont ;
+  uint16_t config ;
+  int chan ;
+
+  if ((node = wiringPiFindNode (pinBase)) == NULL)
+    return -1 ;
+  if (((channelMask & 0xFF) == 0) || (depth < 1))
+    return -1 ;
+
+  if ((cont = (struct ads1115Continuous *)calloc (1, sizeof (struct ads1115Continuous))) == NULL)
+    return -1 ;
+
+  pthread_mutex_init (&cont->lock, NULL) ;
+  cont->node     = node ;
+  cont->alertPin = alertPin ;
+  cont->depth    = depth ;
+
+  for (chan = 0 ; chan < 8 ; ++chan)
+  {
+    if ((channelMask & (1 << chan)) == 0)
+      continue ;
+    if ((cont->ring [chan] = (struct ads1115Sample *)calloc (depth, sizeof (struct ads1115Sample))) == NULL)
+      goto fail ;
+    cont->chans [cont->numChans++] = chan ;
+  }
+
+  pthread_mutex_lock (&contLock) ;
+
+  if (node->devData != NULL)
+    goto failLocked ;
+
+// ALERT/RDY as conversion ready: Hi_thresh MSB set, Lo_thresh MSB clear
+
+  if ((writeReg16 (node, 3, 0x8000) < 0) || (writeReg16 (node, 2, 0x0000) < 0))
+    goto failLocked ;
+
+  if (wiringPiISR2 (alertPin, INT_EDGE_FALLING, conversionReady, cont) < 0)
+    goto failLocked ;
+
+  config = makeConfig (node, cont->chans [0]) | CONFIG_OS_SINGLE ;
+  config = (config & ~CONFIG_CQUE_MASK) | CONFIG_CQUE_1CONV ;
+  if (cont->numChans == 1)
+    config &= ~CONFIG_MODE ;
+
+  if (writeReg16 (node, 1, config) < 0)
+  {
+    wiringPiISRStop (alertPin) ;
+    writeReg16 (node, 1, CONFIG_DEFAULT & ~CONFIG_OS_SINGLE) ;
+    goto failLocked ;
+  }
+
+  node->devData = cont ;
+
+  pthread_mutex_unlock (&contLock) ;
+
+  return 0 ;
+
+failLocked:
+  pthread_mutex_unlock (&contLock) ;
+fail:
+  for (chan = 0 ; chan < 8 ; ++chan)
+    free (cont->ring [chan]) ;
+  pthread_mutex_destroy (&cont->lock) ;
+  free (cont) ;
+  return -1 ;
+}
+
+
+/*
+ * ads1115StopContinuous:
+ *	Back to single-shot reads.
+ *********************************************************************************
+ */
+
+int ads1115StopContinuous (int pinBase)
+{
+  struct wiringPiNodeStruct *node ;
+  struct ads1115Continuous  *cont ;
+  int chan ;
+
+  if ((node = wiringPiFindNode (pinBase)) == NULL)
+    return -1 ;
+
+  pthread_mutex_lock (&contLock) ;
+
+  if ((cont = (struct ads1115Continuous *)node->devData) == NULL)
+  {
+    pthread_mutex_unlock (&contLock) ;
+    return -1 ;
+  }
+
+  wiringPiISRStop (cont->alertPin) ;
+
+  node->devData = NULL ;
+  writeReg16 (node, 1, CONFIG_DEFAULT & ~CONFIG_OS_SINGLE) ;
+
+  pthread_mutex_unlock (&contLock) ;
+
+  for (chan = 0 ; chan < 8 ; ++chan)
+    free (cont->ring [chan]) ;
+  pthread_mutex_destroy (&cont->lock) ;
+  free (cont) ;
+
+  return 0 ;
+}
+
+
+/*
+ * ads1115ReadSamples:
+ *	Drain up to max buffered samples of the channel on pin, oldest first.
+ *	Returns the number copied, or -1 if the channel isn't being sampled.
+ *********************************************************************************
+ */
+
+int ads1115ReadSamples (int pin, struct ads1115Sample *samples, int max)
+{
+  struct wiringPiNodeStruct *node ;
+  struct ads1115Continuous  *cont ;
+  unsigned int tail ;
+  int chan, i, n ;
+
+  if ((node = wiringPiFindNode (pin)) == NULL)
+    return -1 ;
+
+  chan = (pin - node->pinBase) & 7 ;
+
+  pthread_mutex_lock (&contLock) ;
+
+  if (((cont = (struct ads1115Continuous *)node->devData) == NULL) || (cont->ring [chan] == NULL))
+  {
+    pthread_mutex_unlock (&contLock) ;
+    return -1 ;
+  }
+
+  if (max <= 0)
+  {
+    pthread_mutex_unlock (&contLock) ;
+    return 0 ;
+  }
+
+  pthread_mutex_lock (&cont->lock) ;
+
+    n    = ((unsigned int)max < cont->count [chan]) ? max : (int)cont->count [chan] ;
+    tail = (cont->head [chan] + cont->depth - cont->count [chan]) % cont->depth ;
+
+    for (i = 0 ; i < n ; ++i)
+      samples [i] = cont->ring [chan][(tail + i) % cont->depth] ;
+
+    cont->count [chan] -= n ;
+
+  pthread_mutex_unlock (&cont->lock) ;
+  pthread_mutex_unlock (&contLock) ;
+
+  return n ;
+}
@@ -44,12 +44,24 @@
 #define	ADS1115_DR_475		6
 #define	ADS1115_DR_860		7
 
+//	Continuous mode samples
+
+struct ads1115Sample
+{
+  long long int timeStamp_us ;	// Kernel timestamp of the ALERT/RDY edge
+  int           value ;
+} ;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 extern int ads1115Setup (int pinBase, int i2cAddress) ;
 
+extern int ads1115StartContinuous (int pinBase, int alertPin, int channelMask, int depth) ;
+extern int ads1115StopContinuous  (int pinBase) ;
+extern int ads1115ReadSamples     (int pin, struct ads1115Sample *samples, int max) ;
+
 #ifdef __cplusplus
 }
 #endif
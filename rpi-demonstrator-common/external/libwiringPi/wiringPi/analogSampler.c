@@ -0,0 +1,558 @@
+/*
+ * analogSampler.c:
+ *	Sample analog pins of extension nodes in the background and keep
+ *	a history of each.
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://github.com/WiringPi/WiringPi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+/*
+ * Notes:
+ *	Drivers like the pcf8591, mcp3002/3004, mcp3422 and max31855 do a
+ *	blocking bus transfer (the mcp3422 even waits for the conversion)
+ *	in every analogRead. Pins handed to analogSamplerAdd are read by
+ *	one worker thread at their own rate instead, each into a ring of
+ *	timestamped samples, and analogRead on them just returns the newest
+ *	sample.
+ *
+ *	That's done by putting our own analogRead into the node; the
+ *	driver's is kept for the worker and for pins of the node that
+ *	aren't sampled, and goes back into the node when its last sampled
+ *	pin is removed.
+ *
+ *	The drivers aren't reentrant (the pcf8591 writes a control byte
+ *	then reads, the mcp3422 configures, waits and reads), so every call
+ *	into the driver of a sampled node, from the worker or from our
+ *	analogRead, is made holding that node's driverLock.
+ *********************************************************************************
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "wiringPi.h"
+
+#include "analogSampler.h"
+
+#define	MAX_CHANNELS	64
+
+typedef int (*analogReadFunc) (struct wiringPiNodeStruct *node, int pin) ;
+
+struct samplerChannel
+{
+  int                        active ;
+  unsigned int               generation ;	// Bumped on every (re)configuration
+  int                        pin ;
+  struct wiringPiNodeStruct *node ;
+  analogReadFunc             read ;		// The driver's analogRead
+  pthread_mutex_t           *driverLock ;	// Shared by all pins of the node
+
+  long long int periodNs ;
+  long long int due ;				// CLOCK_MONOTONIC, nS
+
+  struct analogSample *ring ;
+  int depth, head, count ;			// head: where the next one goes
+} ;
+
+static struct samplerChannel channels [MAX_CHANNELS] ;
+
+// One per sampled node. Never destroyed: a slot whose node has no
+//	sampled pins left is handed to the next node.
+
+struct nodeLock
+{
+  struct wiringPiNodeStruct *node ;
+  pthread_mutex_t            lock ;
+} ;
+
+static struct nodeLock nodeLocks [MAX_CHANNELS] ;
+static pthread_once_t  nodeLocksOnce = PTHREAD_ONCE_INIT ;
+
+static pthread_mutex_t samplerLock = PTHREAD_MUTEX_INITIALIZER ;
+static pthread_cond_t  samplerCond ;
+static pthread_t       samplerThread ;
+static int             samplerRunning = FALSE ;
+static int             samplerStop ;
+
+
+static long long int monoNanos (void)
+{
+  struct timespec ts ;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts) ;
+
+  return (long long int)ts.tv_sec * 1000000000LL + ts.tv_nsec ;
+}
+
+
+/*
+ * findChannel:
+ *	Called with samplerLock held.
+ *********************************************************************************
+ */
+
+static struct samplerChannel *findChannel (int pin)
+{
+  int i ;
+
+  for (i = 0 ; i < MAX_CHANNELS ; ++i)
+    if (channels [i].active && (channels [i].pin == pin))
+      return &channels [i] ;
+
+  return NULL ;
+}
+
+static struct samplerChannel *findNode (struct wiringPiNodeStruct *node)
+{
+  int i ;
+
+  for (i = 0 ; i < MAX_CHANNELS ; ++i)
+    if (channels [i].active && (channels [i].node == node))
+      return &channels [i] ;
+
+  return NULL ;
+}
+
+
+/*
+ * initNodeLocks: claimNodeLock:
+ *	The second is called with samplerLock held, for a node with no
+ *	sampled pins yet.
+ *********************************************************************************
+ */
+
+static void initNodeLocks (void)
+{
+  int i ;
+
+  for (i = 0 ; i < MAX_CHANNELS ; ++i)
+    pthread_mutex_init (&nodeLocks [i].lock, NULL) ;
+}
+
+static pthread_mutex_t *claimNodeLock (struct wiringPiNodeStruct *node)
+{
+  int i ;
+
+  for (i = 0 ; i < MAX_CHANNELS ; ++i)
+    if ((nodeLocks [i].node == NULL) || (findNode (nodeLocks [i].node) == NULL))
+      break ;
+
+  nodeLocks [i].node = node ;		// There can't be more nodes than channels
+
+  return &nodeLocks [i].lock ;
+}
+
+
+/*
+ * cachedAnalogRead:
+ *	What the node's analogRead becomes while any of its pins are sampled.
+ *********************************************************************************
+ */
+
+static int cachedAnalogRead (struct wiringPiNodeStruct *node, int pin)
+{
+  struct samplerChannel *c ;
+  analogReadFunc read = NULL ;
+  pthread_mutex_t *lock = NULL ;
+  int value = 0 ;
+
+  pthread_mutex_lock (&samplerLock) ;
+
+  if (((c = findChannel (pin)) != NULL) && (c->count > 0))
+  {
+    value = c->ring [(c->head + c->depth - 1) % c->depth].value ;
+    pthread_mutex_unlock (&samplerLock) ;
+    return value ;
+  }
+
+  if ((c != NULL) || ((c = findNode (node)) != NULL))
+  {
+    read = c->read ;
+    lock = c->driverLock ;
+  }
+
+  pthread_mutex_unlock (&samplerLock) ;
+
+  if (read == NULL)			// Removed while we were looking
+    read = node->analogRead ;
+
+  if (read == cachedAnalogRead)
+    return 0 ;
+
+  if (lock == NULL)
+    return read (node, pin) ;
+
+  pthread_mutex_lock (lock) ;
+    value = read (node, pin) ;
+  pthread_mutex_unlock (lock) ;
+
+  return value ;
+}
+
+
+/*
+ * samplerWorker:
+ *	Read whichever pin is due next, then sleep until the next one is.
+ *	The bus transfer is done without the lock held; if the pin was
+ *	removed or changed meanwhile the sample is dropped.
+ *********************************************************************************
+ */
+
+static void *samplerWorker (UNU void *arg)
+{
+  struct samplerChannel *c, *next ;
+  struct wiringPiNodeStruct *node ;
+  struct timespec wakeUp ;
+  analogReadFunc read ;
+  pthread_mutex_t *lock ;
+  unsigned int generation ;
+  long long int now, timeStamp ;
+  int i, pin, value ;
+
+  piThreadEnter (WPI_THREAD_SAMPLER, 0) ;
+
+  pthread_mutex_lock (&samplerLock) ;
+
+  while (!samplerStop)
+  {
+    next = NULL ;
+    for (i = 0 ; i < MAX_CHANNELS ; ++i)
+      if (channels [i].active && ((next == NULL) || (channels [i].due < next->due)))
+        next = &channels [i] ;
+
+    if (next == NULL)
+    {
+      pthread_cond_wait (&samplerCond, &samplerLock) ;
+      continue ;
+    }
+
+    now = monoNanos () ;
+    if (next->due > now)
+    {
+      wakeUp.tv_sec  = next->due / 1000000000LL ;
+      wakeUp.tv_nsec = next->due % 1000000000LL ;
+      pthread_cond_timedwait (&samplerCond, &samplerLock, &wakeUp) ;
+      continue ;
+    }
+
+    piThreadWokeUp (now - next->due) ;
+
+    next->due += next->periodNs ;
+    if (next->due <= now)			// Fallen behind, don't try to catch up
+      next->due = now + next->periodNs ;
+
+    pin        = next->pin ;
+    node       = next->node ;
+    read       = next->read ;
+    lock       = next->driverLock ;
+    generation = next->generation ;
+
+    pthread_mutex_unlock (&samplerLock) ;
+      pthread_mutex_lock   (lock) ;
+        value     = read (node, pin) ;
+        timeStamp = (long long int)piMicros64 () ;
+      pthread_mutex_unlock (lock) ;
+    pthread_mutex_lock (&samplerLock) ;
+
+    c = next ;
+    if (!c->active || (c->generation != generation))
+      continue ;
+
+    c->ring [c->head].timeStamp_us = timeStamp ;
+    c->ring [c->head].value        = value ;
+    c->head = (c->head + 1) % c->depth ;
+    if (c->count < c->depth)
+      ++c->count ;
+  }
+
+  pthread_mutex_unlock (&samplerLock) ;
+
+  piThreadExit () ;
+
+  return NULL ;
+}
+
+
+/*
+ * startWorker:
+ *	Called with samplerLock held.
+ *********************************************************************************
+ */
+
+static int startWorker (void)
+{
+  pthread_condattr_t attr ;
+
+  if (samplerRunning)
+    return 0 ;
+
+  pthread_condattr_init     (&attr) ;
+  pthread_condattr_setclock (&attr, CLOCK_MONOTONIC) ;
+  pthread_cond_init         (&samplerCond, &attr) ;
+  pthread_condattr_destroy  (&attr) ;
+
+  samplerStop = FALSE ;
+  if (pthread_create (&samplerThread, NULL, samplerWorker, NULL) != 0)
+  {
+    pthread_cond_destroy (&samplerCond) ;
+    return -1 ;
+  }
+
+  samplerRunning = TRUE ;
+
+  return 0 ;
+}
+
+
+/*
+ * analogSamplerAdd:
+ *	Sample an analog pin of an extension node every periodMs, keeping
+ *	the last depth samples. Adding a pin again changes its rate; a new
+ *	depth starts its history afresh.
+ *	Returns 0, or -1 if the pin isn't on a node or there's no room.
+ *********************************************************************************
+ */
+
+int analogSamplerAdd (const int pin, const int periodMs, const int depth)
+{
+  struct wiringPiNodeStruct *node ;
+  struct samplerChannel *c, *other ;
+  struct analogSample *ring = NULL ;
+  int i ;
+
+  if ((periodMs <= 0) || (depth <= 0))
+    return -1 ;
+
+  if (((pin & PI_GPIO_MASK) == 0) || ((node = wiringPiFindNode (pin)) == NULL))
+    return -1 ;
+
+  pthread_once (&nodeLocksOnce, initNodeLocks) ;
+
+  pthread_mutex_lock (&samplerLock) ;
+
+  if (((c = findChannel (pin)) == NULL) || (c->depth != depth))
+  {
+    if ((ring = (struct analogSample *)calloc (depth, sizeof (struct analogSample))) == NULL)
+    {
+      pthread_mutex_unlock (&samplerLock) ;
+      return -1 ;
+    }
+  }
+
+  if (c == NULL)
+  {
+    for (i = 0 ; (i < MAX_CHANNELS) && channels [i].active ; ++i)
+      ;
+    if ((i == MAX_CHANNELS) || (startWorker () < 0))
+    {
+      pthread_mutex_unlock (&samplerLock) ;
+      free (ring) ;
+      return -1 ;
+    }
+
+    c = &channels [i] ;
+    c->pin  = pin ;
+    c->node = node ;
+
+    if ((other = findNode (node)) != NULL)
+    {
+      c->read       = other->read ;
+      c->driverLock = other->driverLock ;
+    }
+    else
+    {
+      c->read          = node->analogRead ;
+      c->driverLock    = claimNodeLock (node) ;
+      node->analogRead = cachedAnalogRead ;
+    }
+    c->active = TRUE ;
+  }
+
+  if (ring != NULL)
+  {
+    free (c->ring) ;
+    c->ring  = ring ;
+    c->depth = depth ;
+    c->head  = 0 ;
+    c->count = 0 ;
+  }
+
+  ++c->generation ;
+  c->periodNs = (long long int)periodMs * 1000000LL ;
+  c->due      = monoNanos () ;			// First sample straight away
+
+  pthread_cond_signal   (&samplerCond) ;
+  pthread_mutex_unlock (&samplerLock) ;
+
+  return 0 ;
+}
+
+
+/*
+ * analogSamplerRemove:
+ *	Stop sampling a pin; analogRead on it goes back to the driver.
+ *********************************************************************************
+ */
+
+int analogSamplerRemove (const int pin)
+{
+  struct samplerChannel *c ;
+
+  pthread_mutex_lock (&samplerLock) ;
+
+  if ((c = findChannel (pin)) == NULL)
+  {
+    pthread_mutex_unlock (&samplerLock) ;
+    return -1 ;
+  }
+
+  c->active = FALSE ;
+  ++c->generation ;
+  free (c->ring) ;
+  c->ring  = NULL ;
+  c->depth = 0 ;
+  c->count = 0 ;
+
+  if (findNode (c->node) == NULL)		// Last one on this node
+    c->node->analogRead = c->read ;
+
+  pthread_cond_signal  (&samplerCond) ;
+  pthread_mutex_unlock (&samplerLock) ;
+
+  return 0 ;
+}
+
+
+/*
+ * analogSamplerStop:
+ *	Remove all pins and stop the worker thread.
+ *********************************************************************************
+ */
+
+void analogSamplerStop (void)
+{
+  int i ;
+
+  for (i = 0 ; i < MAX_CHANNELS ; ++i)
+    if (channels [i].active)
+      analogSamplerRemove (channels [i].pin) ;
+
+  pthread_mutex_lock (&samplerLock) ;
+
+  if (!samplerRunning)
+  {
+    pthread_mutex_unlock (&samplerLock) ;
+    return ;
+  }
+
+  samplerStop = TRUE ;
+  pthread_cond_signal  (&samplerCond) ;
+  pthread_mutex_unlock (&samplerLock) ;
+
+  pthread_join (samplerThread, NULL) ;
+
+  pthread_mutex_lock (&samplerLock) ;
+    pthread_cond_destroy (&samplerCond) ;
+    samplerRunning = FALSE ;
+  pthread_mutex_unlock (&samplerLock) ;
+}
+
+
+/*
+ * analogSamplerHistory:
+ *	Copy up to max of the newest samples of a pin, oldest first.
+ *	Returns the number copied, or -1 if the pin isn't sampled.
+ *********************************************************************************
+ */
+
+int analogSamplerHistory (const int pin, struct analogSample *samples, const int max)
+{
+  struct samplerChannel *c ;
+  int count, first, i ;
+
+  pthread_mutex_lock (&samplerLock) ;
+
+  if ((c = findChannel (pin)) == NULL)
+  {
+    pthread_mutex_unlock (&samplerLock) ;
+    return -1 ;
+  }
+
+  count = (max < c->count) ? max : c->count ;
+  first = c->head + c->depth - count ;
+
+  for (i = 0 ; i < count ; ++i)
+    samples [i] = c->ring [(first + i) % c->depth] ;
+
+  pthread_mutex_unlock (&samplerLock) ;
+
+  return count ;
+}
+
+
+/*
+ * analogSamplerStats:
+ *	Minimum, maximum and average over the last samples of a pin (all of
+ *	the history if last is 0) - a moving average when called regularly.
+ *	Returns the number of samples used, or -1 if the pin isn't sampled.
+ *********************************************************************************
+ */
+
+int analogSamplerStats (const int pin, const int last, struct analogStats *stats)
+{
+  struct samplerChannel *c ;
+  struct analogSample *s ;
+  long long int sum = 0 ;
+  int count, first, i ;
+
+  pthread_mutex_lock (&samplerLock) ;
+
+  if ((c = findChannel (pin)) == NULL)
+  {
+    pthread_mutex_unlock (&samplerLock) ;
+    return -1 ;
+  }
+
+  count = c->count ;
+  if ((last > 0) && (last < count))
+    count = last ;
+  first = c->head + c->depth - count ;
+
+  memset (stats, 0, sizeof (struct analogStats)) ;
+  stats->count = count ;
+
+  for (i = 0 ; i < count ; ++i)
+  {
+    s    = &c->ring [(first + i) % c->depth] ;
+    sum += s->value ;
+    if ((i == 0) || (s->value < stats->min)) stats->min = s->value ;
+    if ((i == 0) || (s->value > stats->max)) stats->max = s->value ;
+    stats->timeStamp_us = s->timeStamp_us ;
+  }
+
+  if (count > 0)
+    stats->average = (double)sum / count ;
+
+  pthread_mutex_unlock (&samplerLock) ;
+
+  return count ;
+}
@@ -0,0 +1,51 @@
+/*
+ * analogSampler.h:
+ *	Sample analog pins of extension nodes in the background and keep
+ *	a history of each.
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://github.com/WiringPi/WiringPi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct analogSample
+{
+  long long int timeStamp_us ;		// piMicros64 () when it was taken
+  int           value ;
+} ;
+
+struct analogStats
+{
+  int           count ;			// Samples the figures are over
+  int           min, max ;
+  double        average ;
+  long long int timeStamp_us ;		// Newest sample
+} ;
+
+extern int  analogSamplerAdd     (const int pin, const int periodMs, const int depth) ;
+extern int  analogSamplerRemove  (const int pin) ;
+extern void analogSamplerStop    (void) ;
+extern int  analogSamplerHistory (const int pin, struct analogSample *samples, const int max) ;
+extern int  analogSamplerStats   (const int pin, const int last, struct analogStats *stats) ;
+
+#ifdef __cplusplus
+}
+#endif
@@ -64,14 +64,18 @@ static int altitude ;
 
 /*
  * read16:
- *	Quick hack to read the 16-bit data with the correct endian
+ *	Read big-endian 16-bit data in one combined transaction
  *********************************************************************************
  */
 
 uint16_t read16 (int fd, int reg)
 {
-  return (wiringPiI2CReadReg8 (fd, reg) <<  8) | wiringPiI2CReadReg8 (fd, reg + 1) ;
+  uint8_t data [2] ;
 
+  if (wiringPiI2CReadRegBurstTo (fd, I2C_ADDRESS, reg, data, 2) < 0)
+    return 0xFFFF ;
+
+  return (data [0] << 8) | data [1] ;
 }
 
 
@@ -88,16 +92,17 @@ static void bmp180ReadTempPress (int fd)
   double pu, s, x, y, z ;
 
   uint8_t data [4] ;
+  uint8_t cmd ;
 
 // Start a temperature sensor reading
 
-  wiringPiI2CWriteReg8 (fd, 0xF4, 0x2E) ;
+  cmd = 0x2E ;
+  wiringPiI2CWriteRegBurstTo (fd, I2C_ADDRESS, 0xF4, &cmd, 1) ;
   delay (5) ;
 
 // Read the raw data
 
-  data [0] = wiringPiI2CReadReg8 (fd, 0xF6) ;
-  data [1] = wiringPiI2CReadReg8 (fd, 0xF7) ;
+  wiringPiI2CReadRegBurstTo (fd, I2C_ADDRESS, 0xF6, data, 2) ;
 
 // And calculate...
 
@@ -113,14 +118,13 @@ static void bmp180ReadTempPress (int fd)
 
 // Start a pressure snsor reading
 
-  wiringPiI2CWriteReg8 (fd, 0xF4, 0x34 | (BMP180_OSS << 6)) ;
+  cmd = 0x34 | (BMP180_OSS << 6) ;
+  wiringPiI2CWriteRegBurstTo (fd, I2C_ADDRESS, 0xF4, &cmd, 1) ;
   delay (5) ;
 
 // Read the raw data
 
-  data [0] = wiringPiI2CReadReg8 (fd, 0xF6) ;
-  data [1] = wiringPiI2CReadReg8 (fd, 0xF7) ;
-  data [2] = wiringPiI2CReadReg8 (fd, 0xF8) ;
+  wiringPiI2CReadRegBurstTo (fd, I2C_ADDRESS, 0xF6, data, 3) ;
 
 // And calculate...
 
@@ -190,6 +194,7 @@ int bmp180Setup (const int pinBase)
   double c3, c4, b1 ;
   int fd ;
   struct wiringPiNodeStruct *node ;
+  uint8_t cal [22] ;
 
   if ((fd = wiringPiI2CSetup (I2C_ADDRESS)) < 0)
     return FALSE ;
@@ -200,19 +205,22 @@ int bmp180Setup (const int pinBase)
   node->analogRead  = myAnalogRead ;
   node->analogWrite = myAnalogWrite ;
 
-// Read calibration data
-
-  AC1 = read16 (fd, 0xAA) ;
-  AC2 = read16 (fd, 0xAC) ;
-  AC3 = read16 (fd, 0xAE) ;
-  AC4 = read16 (fd, 0xB0) ;
-  AC5 = read16 (fd, 0xB2) ;
-  AC6 = read16 (fd, 0xB4) ;
-  VB1 = read16 (fd, 0xB6) ;
-  VB2 = read16 (fd, 0xB8) ;
-   MB = read16 (fd, 0xBA) ;
-   MC = read16 (fd, 0xBC) ;
-   MD = read16 (fd, 0xBE) ;
+// Read calibration data: all 11 big-endian words in one burst
+
+  if (wiringPiI2CReadRegBurstTo (fd, I2C_ADDRESS, 0xAA, cal, sizeof (cal)) < 0)
+    return FALSE ;
+
+  AC1 = (cal [ 0] << 8) | cal [ 1] ;
+  AC2 = (cal [ 2] << 8) | cal [ 3] ;
+  AC3 = (cal [ 4] << 8) | cal [ 5] ;
+  AC4 = (cal [ 6] << 8) | cal [ 7] ;
+  AC5 = (cal [ 8] << 8) | cal [ 9] ;
+  AC6 = (cal [10] << 8) | cal [11] ;
+  VB1 = (cal [12] << 8) | cal [13] ;
+  VB2 = (cal [14] << 8) | cal [15] ;
+   MB = (cal [16] << 8) | cal [17] ;
+   MC = (cal [18] << 8) | cal [19] ;
+   MD = (cal [20] << 8) | cal [21] ;
 
 // Calculate coefficients
 
@@ -23,15 +23,296 @@
  */
 
 #include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
 #include <time.h>
 #include <string.h>
 #include <errno.h>
+#include <pthread.h>
 
 #include "wiringPi.h"
 #include "wiringSerial.h"
 
 #include "drcSerial.h"
 
+/*
+ * Notes:
+ *	Commands go out through the buffered serial transport and every
+ *	request that gets a reply ('r', 'a' and '@') is put on a FIFO. The
+ *	DRC device answers strictly in order, so the transport's receive
+ *	thread just completes the oldest pending request each time enough
+ *	bytes have arrived. That way any number of reads can be on the wire
+ *	at once instead of paying a full round trip for each one.
+ *
+ *	Writes inside a node transaction (wiringPiNodeBegin/Commit) are only
+ *	queued, and go out with one writev () on the commit.
+ *********************************************************************************
+ */
+
+#define	DRC_MAX_PENDING	256
+#define	DRC_TIMEOUT	2000		// mS
+
+#define	DRC_DIGITAL	0
+#define	DRC_ANALOG	1
+#define	DRC_PING	2
+
+struct drcRequest
+{
+  int          type ;
+  int          pin ;
+  int          got ;			// Reply bytes so far
+  int          value ;
+  int         *result ;			// NULL once the waiter has given up
+  drcCallback  callback ;
+  void        *userdata ;
+} ;
+
+struct drcSerial
+{
+  struct serialBuf *sb ;
+  int pinBase ;
+
+  pthread_mutex_t lock ;
+  pthread_cond_t  done ;
+
+  struct drcRequest pending [DRC_MAX_PENDING] ;
+  unsigned int head, count ;
+  unsigned int issued, completed ;	// Sequence numbers
+  int          calling ;		// Callbacks being run
+
+  int depth ;				// Transaction nesting level
+} ;
+
+
+/*
+ * deadline:
+ *	timedwait wants an absolute CLOCK_REALTIME time
+ *********************************************************************************
+ */
+
+static void deadline (struct timespec *ts, int mS)
+{
+  clock_gettime (CLOCK_REALTIME, ts) ;
+  ts->tv_sec  += mS / 1000 ;
+  ts->tv_nsec += (mS % 1000) * 1000000L ;
+  if (ts->tv_nsec >= 1000000000L)
+  {
+    ts->tv_nsec -= 1000000000L ;
+    ++ts->tv_sec ;
+  }
+}
+
+
+/*
+ * receiver:
+ *	Called by the transport's receive thread when bytes have arrived.
+ *	Complete pending requests in order and run the callbacks after the
+ *	lock has been dropped.
+ *********************************************************************************
+ */
+
+static void receiver (struct serialBuf *sb, void *userdata)
+{
+  struct drcSerial  *drc = (struct drcSerial *)userdata ;
+  struct drcRequest *req ;
+  struct drcRequest  finished [64] ;
+  uint8_t buf [64] ;
+  int len, i, n ;
+
+  while ((len = serialBufGet (sb, buf, sizeof (buf), 0)) > 0)
+  {
+    n = 0 ;
+
+    pthread_mutex_lock (&drc->lock) ;
+
+    for (i = 0 ; i < len ; ++i)
+    {
+      if (drc->count == 0)		// Nothing asked for this one
+        continue ;
+
+      req = &drc->pending [drc->head] ;
+
+      /**/ if (req->type == DRC_DIGITAL)
+        req->value = (buf [i] == '0') ? LOW : HIGH ;
+      else if (req->type == DRC_PING)
+        req->value = (buf [i] == '@') ;
+      else
+        req->value = (req->value << 8) | buf [i] ;
+
+      if ((req->type == DRC_ANALOG) && (++req->got < 2))
+        continue ;
+
+      if (req->result != NULL)
+        *req->result = req->value ;
+      if (req->callback != NULL)
+        finished [n++] = *req ;
+
+      drc->head = (drc->head + 1) % DRC_MAX_PENDING ;
+      --drc->count ;
+      ++drc->completed ;
+    }
+
+    drc->calling += n ;
+    pthread_cond_broadcast (&drc->done) ;
+    pthread_mutex_unlock (&drc->lock) ;
+
+    if (n == 0)
+      continue ;
+
+    for (i = 0 ; i < n ; ++i)
+      finished [i].callback (drc->pinBase + finished [i].pin, finished [i].value, finished [i].userdata) ;
+
+    pthread_mutex_lock (&drc->lock) ;
+      drc->calling -= n ;
+      pthread_cond_broadcast (&drc->done) ;
+    pthread_mutex_unlock (&drc->lock) ;
+  }
+}
+
+
+/*
+ * queue:
+ *	Queue command bytes. Called with the lock held so commands go out
+ *	in the same order as the requests are put on the FIFO.
+ *********************************************************************************
+ */
+
+static void queue (struct drcSerial *drc, int command, int pin, int extra)
+{
+  uint8_t buf [3] ;
+  int len = 0 ;
+
+  buf [len++] = command ;
+  if (pin >= 0)
+    buf [len++] = pin ;
+  if (extra >= 0)
+    buf [len++] = extra ;
+
+  serialBufPut (drc->sb, buf, len) ;
+}
+
+
+/*
+ * issue:
+ *	Put a read on the FIFO and queue its command. When the FIFO is full
+ *	what's queued is sent and we wait for room. The request's sequence
+ *	number goes to *seq. Returns -1 if the device has stopped answering.
+ *********************************************************************************
+ */
+
+static int issue (struct drcSerial *drc, int type, int pin, int *result, drcCallback callback, void *userdata, unsigned int *seq)
+{
+  struct drcRequest *req ;
+  struct timespec ts ;
+
+  pthread_mutex_lock (&drc->lock) ;
+
+  if (drc->count == DRC_MAX_PENDING)
+  {
+    serialBufFlush (drc->sb) ;
+    deadline (&ts, DRC_TIMEOUT) ;
+    while (drc->count == DRC_MAX_PENDING)
+      if (pthread_cond_timedwait (&drc->done, &drc->lock, &ts) != 0)
+      {
+        pthread_mutex_unlock (&drc->lock) ;
+        return -1 ;
+      }
+  }
+
+  req = &drc->pending [(drc->head + drc->count) % DRC_MAX_PENDING] ;
+  req->type     = type ;
+  req->pin      = pin ;
+  req->got      = 0 ;
+  req->value    = 0 ;
+  req->result   = result ;
+  req->callback = callback ;
+  req->userdata = userdata ;
+  ++drc->count ;
+  *seq = drc->issued++ ;
+
+  /**/ if (type == DRC_DIGITAL)
+    queue (drc, 'r', pin, -1) ;
+  else if (type == DRC_ANALOG)
+    queue (drc, 'a', pin, -1) ;
+  else
+    queue (drc, '@', -1, -1) ;
+
+  pthread_mutex_unlock (&drc->lock) ;
+
+  return 0 ;
+}
+
+
+/*
+ * unlockAndSend:
+ *	Drop the lock and, unless we're inside a transaction, send what's
+ *	queued. The depth is read before the lock goes so a commit can't
+ *	slip in between.
+ *********************************************************************************
+ */
+
+static int unlockAndSend (struct drcSerial *drc)
+{
+  int send = (drc->depth == 0) ;
+
+  pthread_mutex_unlock (&drc->lock) ;
+
+  return send ? serialBufFlush (drc->sb) : 0 ;
+}
+
+
+/*
+ * abandon:
+ *	The requests writing into result [0..count-1] stay on the FIFO, to
+ *	keep the replies in step, but what they read is thrown away.
+ *	Called with the lock held.
+ *********************************************************************************
+ */
+
+static void abandon (struct drcSerial *drc, int *result, int count)
+{
+  unsigned int i, slot ;
+
+  for (i = 0 ; i < drc->count ; ++i)
+  {
+    slot = (drc->head + i) % DRC_MAX_PENDING ;
+    if ((drc->pending [slot].result >= result) && (drc->pending [slot].result < result + count))
+      drc->pending [slot].result = NULL ;
+  }
+}
+
+
+/*
+ * await:
+ *	Send what's queued and wait for request seq (and so everything
+ *	before it) to complete. If it doesn't, the ones writing into
+ *	result [0..count-1] are abandoned.
+ *********************************************************************************
+ */
+
+static int await (struct drcSerial *drc, unsigned int seq, int *result, int count)
+{
+  struct timespec ts ;
+  int ret = 0 ;
+
+  serialBufFlush (drc->sb) ;
+  deadline (&ts, DRC_TIMEOUT) ;
+
+  pthread_mutex_lock (&drc->lock) ;
+
+  while ((int)(drc->completed - seq) <= 0)
+    if (pthread_cond_timedwait (&drc->done, &drc->lock, &ts) != 0)
+    {
+      abandon (drc, result, count) ;
+      ret = -1 ;
+      break ;
+    }
+
+  pthread_mutex_unlock (&drc->lock) ;
+
+  return ret ;
+}
+
 
 /*
  * myPinMode:
@@ -41,14 +322,18 @@
 
 static void myPinMode (struct wiringPiNodeStruct *node, int pin, int mode)
 {
+  struct drcSerial *drc = (struct drcSerial *)node->devData ;
+
+  pthread_mutex_lock (&drc->lock) ;
+
   /**/ if (mode == OUTPUT)
-    serialPutchar (node->fd, 'o') ;       // Input
+    queue (drc, 'o', pin - node->pinBase, -1) ;	// Output
   else if (mode == PWM_OUTPUT)
-    serialPutchar (node->fd, 'p') ;       // PWM
+    queue (drc, 'p', pin - node->pinBase, -1) ;	// PWM
   else
-    serialPutchar (node->fd, 'i') ;       // Default to input
+    queue (drc, 'i', pin - node->pinBase, -1) ;	// Default to input
 
-  serialPutchar (node->fd, pin - node->pinBase) ;
+  unlockAndSend (drc) ;
 }
 
 
@@ -60,22 +345,20 @@ static void myPinMode (struct wiringPiNodeStruct *node, int pin, int mode)
 
 static void myPullUpDnControl (struct wiringPiNodeStruct *node, int pin, int mode)
 {
+  struct drcSerial *drc = (struct drcSerial *)node->devData ;
+
+  pthread_mutex_lock (&drc->lock) ;
 
 // Force pin into input mode
 
-  serialPutchar (node->fd, 'i' ) ;
-  serialPutchar (node->fd, pin - node->pinBase) ;
+  queue (drc, 'i', pin - node->pinBase, -1) ;
 
   /**/ if (mode == PUD_UP)
-  {
-    serialPutchar (node->fd, '1') ;
-    serialPutchar (node->fd, pin - node->pinBase) ;
-  }
+    queue (drc, '1', pin - node->pinBase, -1) ;
   else if (mode == PUD_OFF)
-  {
-    serialPutchar (node->fd, '0') ;
-    serialPutchar (node->fd, pin - node->pinBase) ;
-  }
+    queue (drc, '0', pin - node->pinBase, -1) ;
+
+  unlockAndSend (drc) ;
 }
 
 
@@ -86,8 +369,11 @@ static void myPullUpDnControl (struct wiringPiNodeStruct *node, int pin, int mod
 
 static void myDigitalWrite (struct wiringPiNodeStruct *node, int pin, int value)
 {
-  serialPutchar (node->fd, value == 0 ? '0' : '1') ;
-  serialPutchar (node->fd, pin - node->pinBase) ;
+  struct drcSerial *drc = (struct drcSerial *)node->devData ;
+
+  pthread_mutex_lock (&drc->lock) ;
+  queue (drc, value == 0 ? '0' : '1', pin - node->pinBase, -1) ;
+  unlockAndSend (drc) ;
 }
 
 
@@ -98,40 +384,242 @@ static void myDigitalWrite (struct wiringPiNodeStruct *node, int pin, int value)
 
 static void myPwmWrite (struct wiringPiNodeStruct *node, int pin, int value)
 {
-  serialPutchar (node->fd, 'v') ;
-  serialPutchar (node->fd, pin - node->pinBase) ;
-  serialPutchar (node->fd, value & 0xFF) ;
+  struct drcSerial *drc = (struct drcSerial *)node->devData ;
+
+  pthread_mutex_lock (&drc->lock) ;
+  queue (drc, 'v', pin - node->pinBase, value & 0xFF) ;
+  unlockAndSend (drc) ;
+}
+
+
+/*
+ * readMany:
+ *	Put count reads of consecutive pins on the wire in one go and wait
+ *	for the last reply.
+ *********************************************************************************
+ */
+
+static int readMany (struct wiringPiNodeStruct *node, int type, int pin, int count, int *values)
+{
+  struct drcSerial *drc = (struct drcSerial *)node->devData ;
+  unsigned int seq = 0 ;
+  int i ;
+
+  for (i = 0 ; i < count ; ++i)
+  {
+    values [i] = (type == DRC_ANALOG) ? -1 : LOW ;
+    if (issue (drc, type, pin - node->pinBase + i, &values [i], NULL, NULL, &seq) < 0)
+    {
+      pthread_mutex_lock (&drc->lock) ;		// The ones queued mustn't write to values later
+        abandon (drc, values, i) ;
+      pthread_mutex_unlock (&drc->lock) ;
+      return -1 ;
+    }
+  }
+
+  return await (drc, seq, values, count) ;
 }
 
 
 /*
- * myAnalogRead:
+ * myAnalogRead: myAnalogReadMany:
  *********************************************************************************
  */
 
 static int myAnalogRead (struct wiringPiNodeStruct *node, int pin)
 {
-  int vHi, vLo ;
+  int value ;
 
-  serialPutchar (node->fd, 'a') ;
-  serialPutchar (node->fd, pin - node->pinBase) ;
-  vHi = serialGetchar (node->fd) ;
-  vLo = serialGetchar (node->fd) ;
+  if (readMany (node, DRC_ANALOG, pin, 1, &value) < 0)
+    return -1 ;
 
-  return (vHi << 8) | vLo ;
+  return value ;
+}
+
+static int myAnalogReadMany (struct wiringPiNodeStruct *node, int pin, int count, int *values)
+{
+  return (readMany (node, DRC_ANALOG, pin, count, values) < 0) ? -1 : count ;
 }
 
 
 /*
- * myDigitalRead:
+ * myDigitalRead: myDigitalReadAll:
  *********************************************************************************
  */
 
 static int myDigitalRead (struct wiringPiNodeStruct *node, int pin)
 {
-  serialPutchar (node->fd, 'r') ; // Send read command
-  serialPutchar (node->fd, pin - node->pinBase) ;
-  return (serialGetchar (node->fd) == '0') ? 0 : 1 ;
+  int value ;
+
+  if (readMany (node, DRC_DIGITAL, pin, 1, &value) < 0)
+    return -1 ;
+
+  return value ;
+}
+
+static unsigned int myDigitalReadAll (struct wiringPiNodeStruct *node)
+{
+  int values [32] ;
+  unsigned int mask = 0 ;
+  int count, i ;
+
+  count = node->pinMax - node->pinBase + 1 ;
+  if (count > 32)
+    count = 32 ;
+
+  if (readMany (node, DRC_DIGITAL, node->pinBase, count, values) < 0)
+    return 0 ;
+
+  for (i = 0 ; i < count ; ++i)
+    if (values [i] != LOW)
+      mask |= 1u << i ;
+
+  return mask ;
+}
+
+
+/*
+ * myBeginTransaction: myCommitTransaction:
+ *	Hold back writes until the final commit.
+ *********************************************************************************
+ */
+
+static int myBeginTransaction (struct wiringPiNodeStruct *node)
+{
+  struct drcSerial *drc = (struct drcSerial *)node->devData ;
+
+  pthread_mutex_lock (&drc->lock) ;
+    ++drc->depth ;
+  pthread_mutex_unlock (&drc->lock) ;
+
+  return 0 ;
+}
+
+static int myCommitTransaction (struct wiringPiNodeStruct *node)
+{
+  struct drcSerial *drc = (struct drcSerial *)node->devData ;
+
+  pthread_mutex_lock (&drc->lock) ;
+
+  if (drc->depth == 0)
+  {
+    pthread_mutex_unlock (&drc->lock) ;
+    return -1 ;
+  }
+
+  --drc->depth ;
+
+  return (unlockAndSend (drc) < 0) ? -1 : 0 ;
+}
+
+
+/*
+ * findDrc:
+ *	The node for pin, if it's one of ours.
+ *********************************************************************************
+ */
+
+static struct wiringPiNodeStruct *findDrc (int pin)
+{
+  struct wiringPiNodeStruct *node ;
+
+  if ((node = wiringPiFindNode (pin)) == NULL)
+    return NULL ;
+
+  if (node->digitalRead != myDigitalRead)
+    return NULL ;
+
+  return node ;
+}
+
+
+/*
+ * drcSerialReadAsync:
+ *	Start a digital (or analog) read and return straight away. The
+ *	callback runs on the serial receive thread when the reply arrives,
+ *	so it mustn't block or do synchronous reads on this device.
+ *	Inside a transaction the request only goes out with the commit.
+ *********************************************************************************
+ */
+
+int drcSerialReadAsync (const int pin, const int analog, drcCallback callback, void *userdata)
+{
+  struct wiringPiNodeStruct *node ;
+  struct drcSerial *drc ;
+  unsigned int seq ;
+
+  if ((callback == NULL) || ((node = findDrc (pin)) == NULL))
+    return -1 ;
+
+  drc = (struct drcSerial *)node->devData ;
+
+  if (issue (drc, analog ? DRC_ANALOG : DRC_DIGITAL, pin - node->pinBase, NULL, callback, userdata, &seq) < 0)
+    return -1 ;
+
+  pthread_mutex_lock (&drc->lock) ;
+
+  return (unlockAndSend (drc) < 0) ? -1 : 0 ;
+}
+
+
+/*
+ * drcSerialReadPins:
+ *	Snapshot count consecutive digital pins with all the reads in
+ *	flight together.
+ *********************************************************************************
+ */
+
+int drcSerialReadPins (const int pin, const int count, int *values)
+{
+  struct wiringPiNodeStruct *node ;
+
+  if ((count <= 0) || ((node = findDrc (pin)) == NULL) || (pin + count - 1 > node->pinMax))
+    return -1 ;
+
+  return readMany (node, DRC_DIGITAL, pin, count, values) ;
+}
+
+
+/*
+ * drcSerialFlush:
+ *	Send everything queued and wait for all outstanding replies and
+ *	their callbacks, e.g. before tearing down state the callbacks use.
+ *	Not to be called from a callback.
+ *********************************************************************************
+ */
+
+int drcSerialFlush (const int pinBase)
+{
+  struct wiringPiNodeStruct *node ;
+  struct drcSerial *drc ;
+  struct timespec ts ;
+  unsigned int seq ;
+  int ret = 0 ;
+
+  if ((node = findDrc (pinBase)) == NULL)
+    return -1 ;
+
+  drc = (struct drcSerial *)node->devData ;
+
+  pthread_mutex_lock (&drc->lock) ;
+    seq = drc->issued - 1 ;
+  pthread_mutex_unlock (&drc->lock) ;
+
+  if (await (drc, seq, NULL, 0) < 0)
+    return -1 ;
+
+  deadline (&ts, DRC_TIMEOUT) ;
+
+  pthread_mutex_lock (&drc->lock) ;
+    while (drc->calling > 0)
+      if (pthread_cond_timedwait (&drc->done, &drc->lock, &ts) != 0)
+      {
+        ret = -1 ;
+        break ;
+      }
+  pthread_mutex_unlock (&drc->lock) ;
+
+  return ret ;
 }
 
 
@@ -147,7 +635,8 @@ int drcSetupSerial (const int pinBase, const int numPins, const char *device, co
 {
   int fd ;
   int ok, tries ;
-  time_t then ;
+  unsigned int seq ;
+  struct drcSerial *drc ;
   struct wiringPiNodeStruct *node ;
 
   if ((fd = serialOpen (device, baud)) < 0)
@@ -160,37 +649,56 @@ int drcSetupSerial (const int pinBase, const int numPins, const char *device, co
   while (serialDataAvail (fd))
     (void)serialGetchar (fd) ;
 
+  if ((drc = (struct drcSerial *)calloc (1, sizeof (struct drcSerial))) == NULL)
+  {
+    serialClose (fd) ;
+    return FALSE ;
+  }
+
+  drc->pinBase = pinBase ;
+  pthread_mutex_init (&drc->lock, NULL) ;
+  pthread_cond_init  (&drc->done, NULL) ;
+
+  if ((drc->sb = serialBufOpen (fd)) == NULL)
+    goto fail ;
+
+  serialBufSetReceiver (drc->sb, receiver, drc) ;
+
   ok = FALSE ;
   for (tries = 1 ; (tries < 5) && (!ok) ; ++tries)
   {
-    serialPutchar (fd, '@') ;		// Ping
-    then = time (NULL) + 2 ;
-    while (time (NULL) < then)
-      if (serialDataAvail (fd))
-      {
-        if (serialGetchar (fd) == '@')
-        {
-          ok = TRUE ;
-          break ;
-        }
-      }
+    if (issue (drc, DRC_PING, -1, &ok, NULL, NULL, &seq) < 0)	// Ping
+      break ;
+    (void)await (drc, seq, &ok, 1) ;
   }
 
   if (!ok)
   {
-    serialClose (fd) ;
-    return FALSE ;
+    serialBufClose (drc->sb) ;
+    goto fail ;
   }
 
   node = wiringPiNewNode (pinBase, numPins) ;
 
-  node->fd              = fd ;
-  node->pinMode         = myPinMode ;
-  node->pullUpDnControl = myPullUpDnControl ;
-  node->analogRead      = myAnalogRead ;
-  node->digitalRead     = myDigitalRead ;
-  node->digitalWrite    = myDigitalWrite ;
-  node->pwmWrite        = myPwmWrite ;
+  node->fd                = fd ;
+  node->devData           = drc ;
+  node->pinMode           = myPinMode ;
+  node->pullUpDnControl   = myPullUpDnControl ;
+  node->analogRead        = myAnalogRead ;
+  node->analogReadMany    = myAnalogReadMany ;
+  node->digitalRead       = myDigitalRead ;
+  node->digitalReadAll    = myDigitalReadAll ;
+  node->digitalWrite      = myDigitalWrite ;
+  node->pwmWrite          = myPwmWrite ;
+  node->beginTransaction  = myBeginTransaction ;
+  node->commitTransaction = myCommitTransaction ;
 
   return TRUE ;
+
+fail:
+  pthread_cond_destroy  (&drc->done) ;
+  pthread_mutex_destroy (&drc->lock) ;
+  free (drc) ;
+  serialClose (fd) ;
+  return FALSE ;
 }
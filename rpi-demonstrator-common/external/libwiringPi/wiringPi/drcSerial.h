@@ -26,7 +26,14 @@
 extern "C" {
 #endif
 
-extern int drcSetupSerial (const int pinBase, const int numPins, const char *device, const int baud) ;
+// Called on the serial receive thread when an async read completes
+
+typedef void (*drcCallback) (int pin, int value, void *userdata) ;
+
+extern int drcSetupSerial     (const int pinBase, const int numPins, const char *device, const int baud) ;
+extern int drcSerialReadAsync (const int pin, const int analog, drcCallback callback, void *userdata) ;
+extern int drcSerialReadPins  (const int pin, const int count, int *values) ;
+extern int drcSerialFlush     (const int pinBase) ;
 
 #ifdef __cplusplus
 }
@@ -23,6 +23,17 @@
  ***********************************************************************
  */
 
+/*
+ * Notes:
+ *	Reading a w1_slave file makes the kernel start a conversion and wait
+ *	for it, about 750mS per sensor. The background sampler instead
+ *	writes "trigger" to the therm_bulk_read file of each bus master. That
+ *	converts every sensor on the bus at the same time, and the w1_slave
+ *	reads that follow return straight away. The results are published to
+ *	a per-sensor cache which analogRead returns without blocking.
+ *********************************************************************************
+ */
+
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -30,81 +41,361 @@
 #include <unistd.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <malloc.h>
 #include <ctype.h>
+#include <limits.h>
+#include <libgen.h>
+#include <time.h>
+#include <pthread.h>
 
 #include "wiringPi.h"
 
 #include "ds18b20.h"
 
-#define	W1_PREFIX	"/sys/bus/w1/devices/28-"
+#define	W1_ROOT		"/sys/bus/w1/devices"
+#define	W1_FAMILY	"28-"
 #define	W1_POSTFIX	"/w1_slave"
+#define	W1_BULK		"/therm_bulk_read"
+
+struct ds18b20Sensor
+{
+  struct ds18b20Sensor *next ;
+  int  fd ;
+  char bulk [PATH_MAX] ;	// therm_bulk_read of the bus master, or ""
+  int  value ;			// Cached result, atomic access only
+  int  valid ;			// Set once the sampler published a value
+} ;
+
+static char w1Root [PATH_MAX] = W1_ROOT ;
+
+static struct ds18b20Sensor *sensors = NULL ;
+static pthread_mutex_t sensorLock = PTHREAD_MUTEX_INITIALIZER ;
+
+static pthread_t       samplerThread ;
+static pthread_mutex_t samplerLock = PTHREAD_MUTEX_INITIALIZER ;
+static pthread_cond_t  samplerCond = PTHREAD_COND_INITIALIZER ;
+static int samplerRunning = FALSE ;
+static int samplerStop    = FALSE ;
+static int samplerPeriod  = 0 ;
+
+
+/*
+ * parse:
+ *	The w1_slave file is two short lines:
+ *	    72 01 4b 46 7f ff 0e 10 57 : crc=57 YES
+ *	    72 01 4b 46 7f ff 0e 10 57 t=23125
+ *	Check the first ends with YES and pick the number off the second.
+ *	We know it's temp * 1000, but we only really want temp * 10, so do a
+ *	bit of rounding.
+ *********************************************************************************
+ */
+
+static int parse (const char *buffer, int len)
+{
+  const char *end = buffer + len ;
+  const char *eol, *p ;
+  int temp, sign ;
+
+  if ((eol = memchr (buffer, '\n', len)) == NULL)
+    return -9997 ;
+
+  if (((eol - buffer) < 3) || (memcmp (eol - 3, "YES", 3) != 0))
+    return -9997 ;
+
+  for (p = eol + 1 ; (p + 1) < end ; ++p)
+    if ((p [0] == 't') && (p [1] == '='))
+      break ;
+
+  if ((p + 1) >= end)
+    return -9996 ;
+
+  p += 2 ;
+
+  if ((p < end) && (*p == '-'))	// Negative number?
+  {
+    sign = -1 ;
+    ++p ;
+  }
+  else
+    sign = 1 ;
+
+  temp = 0 ;
+  while ((p < end) && isdigit (*p) && (temp < 1000000))
+  {
+    temp = temp * 10 + (*p - '0') ;
+    ++p ;
+  }
+
+  temp = (temp + 50) / 100 ;
+  return temp * sign ;
+}
+
+
+/*
+ * readSensor:
+ *	Rewind the file - we're keeping it open to keep things going
+ *	smoothly - and read it. It's only a couple of lines.
+ *********************************************************************************
+ */
+
+static int readSensor (int fd)
+{
+  char buffer [128] ;
+  int  len ;
+
+  lseek (fd, 0, SEEK_SET) ;
+
+  if ((len = read (fd, buffer, sizeof (buffer))) <= 0)	// Read nothing, or it failed in some odd way
+    return -9998 ;
+
+  return parse (buffer, len) ;
+}
 
 
 /*
  * myAnalogRead:
+ *	From the cache while the sampler runs, otherwise straight off the
+ *	sensor.
  *********************************************************************************
  */
 
 static int myAnalogRead (struct wiringPiNodeStruct *node, int pin)
 {
-  int  chan = pin - node->pinBase ;
-  int  fd = node->fd ;
-  char buffer [4096] ;
-  char *p ;
-  int  temp, sign ;
+  struct ds18b20Sensor *sensor = (struct ds18b20Sensor *)node->devData ;
+  int chan = pin - node->pinBase ;
 
   if (chan != 0)
     return -9999 ;
 
-// Rewind the file - we're keeping it open to keep things going
-//	smoothly
+  if (__atomic_load_n (&sensor->valid, __ATOMIC_ACQUIRE))
+    return __atomic_load_n (&sensor->value, __ATOMIC_RELAXED) ;
 
-  lseek (fd, 0, SEEK_SET) ;
+  return readSensor (sensor->fd) ;
+}
 
-// Read the file - we know it's only a couple of lines, so this ought to be
-//	more than enough
 
-  if (read (fd, buffer, 4096) <= 0)	// Read nothing, or it failed in some odd way
-    return -9998 ;
+/*
+ * triggerBus: waitBus:
+ *	Start a conversion on every sensor of a bus, and wait for it to
+ *	finish. therm_bulk_read reads back -1 while it's converting.
+ *********************************************************************************
+ */
 
-// Look for YES, then t=
+static void triggerBus (const char *bulk)
+{
+  int fd ;
 
-  if (strstr (buffer, "YES") == NULL)
-    return -9997 ;
+  if ((fd = open (bulk, O_WRONLY)) < 0)
+    return ;
 
-  if ((p = strstr (buffer, "t=")) == NULL)
-    return -9996 ;
+  if (write (fd, "trigger\n", 8) < 0)
+    fprintf (stderr, "ds18b20: Unable to trigger %s\n", bulk) ;
 
-// p points to the 't', so we skip over it...
+  close (fd) ;
+}
 
-  p += 2 ;
+static void waitBus (const char *bulk)
+{
+  char buffer [8] ;
+  int  fd, len, tries ;
+
+  for (tries = 0 ; tries < 100 ; ++tries)	// 1 second at most
+  {
+    if ((fd = open (bulk, O_RDONLY)) < 0)
+      return ;
+    len = read (fd, buffer, sizeof (buffer)) ;
+    close (fd) ;
+
+    if ((len < 2) || (buffer [0] != '-') || (buffer [1] != '1'))
+      return ;
+
+    delay (10) ;
+  }
+}
+
+
+/*
+ * firstOnBus:
+ *	Is sensor the first one in the list on its bus?
+ *********************************************************************************
+ */
+
+static int firstOnBus (struct ds18b20Sensor *sensor)
+{
+  struct ds18b20Sensor *s ;
 
-// and extract the number
-//	(without caring about overflow)
+  for (s = sensors ; s != sensor ; s = s->next)
+    if (strcmp (s->bulk, sensor->bulk) == 0)
+      return FALSE ;
 
+  return TRUE ;
+}
 
-  if (*p == '-')	// Negative number?
+
+/*
+ * sampleAll:
+ *	One bulk conversion per bus, then read and publish every sensor.
+ *	Sensors on a bus without therm_bulk_read (older kernels) still
+ *	convert when their w1_slave file is read.
+ *********************************************************************************
+ */
+
+static void sampleAll (void)
+{
+  struct ds18b20Sensor *s ;
+
+  pthread_mutex_lock (&sensorLock) ;
+
+    for (s = sensors ; s != NULL ; s = s->next)
+      if ((s->bulk [0] != 0) && firstOnBus (s))
+        triggerBus (s->bulk) ;
+
+    for (s = sensors ; s != NULL ; s = s->next)
+      if ((s->bulk [0] != 0) && firstOnBus (s))
+        waitBus (s->bulk) ;
+
+    for (s = sensors ; s != NULL ; s = s->next)
+    {
+      __atomic_store_n (&s->value, readSensor (s->fd), __ATOMIC_RELAXED) ;
+      __atomic_store_n (&s->valid, TRUE, __ATOMIC_RELEASE) ;
+    }
+
+  pthread_mutex_unlock (&sensorLock) ;
+}
+
+
+/*
+ * sampler:
+ *	The background thread: sample, then sleep for what's left of the
+ *	period or until ds18b20SamplerStop wakes us.
+ *********************************************************************************
+ */
+
+static void *sampler (UNU void *arg)
+{
+  struct timespec next ;
+
+  piThreadEnter (WPI_THREAD_SAMPLER, 0) ;
+
+  pthread_mutex_lock (&samplerLock) ;
+
+  while (!samplerStop)
   {
-    sign = -1 ;
-    ++p ;
+    clock_gettime (CLOCK_REALTIME, &next) ;
+    next.tv_sec  +=  samplerPeriod / 1000 ;
+    next.tv_nsec += (samplerPeriod % 1000) * 1000000L ;
+    if (next.tv_nsec >= 1000000000L)
+    {
+      next.tv_nsec -= 1000000000L ;
+      ++next.tv_sec ;
+    }
+
+    pthread_mutex_unlock (&samplerLock) ;
+      sampleAll () ;
+    pthread_mutex_lock (&samplerLock) ;
+
+    while (!samplerStop)
+      if (pthread_cond_timedwait (&samplerCond, &samplerLock, &next) != 0)
+        break ;
   }
-  else
-    sign = 1 ;
 
-  temp = 0 ;
-  while (isdigit (*p))
+  pthread_mutex_unlock (&samplerLock) ;
+
+  piThreadExit () ;
+
+  return NULL ;
+}
+
+
+/*
+ * ds18b20SamplerStart:
+ *	Sample all DS18B20s set up so far (and later) every periodMs in the
+ *	background. The first round is done before returning, so analogRead
+ *	has a value straight away.
+ *********************************************************************************
+ */
+
+int ds18b20SamplerStart (int periodMs)
+{
+  int ret ;
+
+  if (periodMs < 0)
+    periodMs = 0 ;
+
+  pthread_mutex_lock (&samplerLock) ;
+
+  if (samplerRunning)
   {
-    temp = temp * 10 + (*p - '0') ;
-    ++p ;
+    samplerPeriod = periodMs ;
+    pthread_mutex_unlock (&samplerLock) ;
+    return 0 ;
   }
 
-// We know it returns temp * 1000, but we only really want temp * 10, so
-//	do a bit of rounding...
+  samplerPeriod = periodMs ;
+  samplerStop   = FALSE ;
 
-  temp = (temp + 50) / 100 ;
-  return temp * sign ;
+  sampleAll () ;
+
+  ret = pthread_create (&samplerThread, NULL, sampler, NULL) ;
+  samplerRunning = (ret == 0) ;
+
+  pthread_mutex_unlock (&samplerLock) ;
+
+  return (ret == 0) ? 0 : -1 ;
+}
+
+
+/*
+ * ds18b20SamplerStop:
+ *	Stop the background thread; analogRead reads the sensors directly
+ *	again.
+ *********************************************************************************
+ */
+
+void ds18b20SamplerStop (void)
+{
+  struct ds18b20Sensor *s ;
+
+  pthread_mutex_lock (&samplerLock) ;
+
+  if (!samplerRunning)
+  {
+    pthread_mutex_unlock (&samplerLock) ;
+    return ;
+  }
+
+  samplerStop = TRUE ;
+  pthread_cond_signal (&samplerCond) ;
+  pthread_mutex_unlock (&samplerLock) ;
+
+  pthread_join (samplerThread, NULL) ;
+
+  pthread_mutex_lock (&samplerLock) ;
+    samplerRunning = FALSE ;
+  pthread_mutex_unlock (&samplerLock) ;
+
+  pthread_mutex_lock (&sensorLock) ;
+    for (s = sensors ; s != NULL ; s = s->next)
+      __atomic_store_n (&s->valid, FALSE, __ATOMIC_RELEASE) ;
+  pthread_mutex_unlock (&sensorLock) ;
+}
+
+
+/*
+ * ds18b20SetW1Root:
+ *	Look for the sensors somewhere other than /sys/bus/w1/devices,
+ *	e.g. a fake sysfs tree for testing. Affects later ds18b20Setup calls.
+ *********************************************************************************
+ */
+
+void ds18b20SetW1Root (const char *root)
+{
+  if (root == NULL)
+    root = W1_ROOT ;
+
+  snprintf (w1Root, sizeof (w1Root), "%s", root) ;
 }
 
 
@@ -118,29 +409,49 @@ int ds18b20Setup (const int pinBase, const char *deviceId)
 {
   int fd ;
   struct wiringPiNodeStruct *node ;
-  char *fileName ;
+  struct ds18b20Sensor *sensor ;
+  char fileName [PATH_MAX] ;
+  char master   [PATH_MAX] ;
 
-// Allocate space for the filename
-
-  if ((fileName = malloc (strlen (W1_PREFIX) + strlen (W1_POSTFIX) + strlen (deviceId) + 1)) == NULL)
+  if (snprintf (fileName, sizeof (fileName), "%s/%s%s%s", w1Root, W1_FAMILY, deviceId, W1_POSTFIX) >= (int)sizeof (fileName))
     return FALSE ;
 
-  sprintf (fileName, "%s%s%s", W1_PREFIX, deviceId, W1_POSTFIX) ;
+  if ((sensor = (struct ds18b20Sensor *)calloc (1, sizeof (struct ds18b20Sensor))) == NULL)
+    return FALSE ;
 
   fd = open (fileName, O_RDONLY) ;
 
-  free (fileName) ;
-
   if (fd < 0)
+  {
+    free (sensor) ;
     return FALSE ;
+  }
+
+// The slave directory is a link into its bus master's directory, which
+//	has the therm_bulk_read file
+
+  fileName [strlen (fileName) - strlen (W1_POSTFIX)] = 0 ;
+  if (realpath (fileName, master) != NULL)
+  {
+    snprintf (sensor->bulk, sizeof (sensor->bulk), "%s%s", dirname (master), W1_BULK) ;
+    if (access (sensor->bulk, W_OK) != 0)
+      sensor->bulk [0] = 0 ;
+  }
 
 // We'll keep the file open, to make access a little faster
 //	although it's very slow reading these things anyway )-:
 
   node = wiringPiNewNode (pinBase, 1) ;
 
+  sensor->fd       = fd ;
   node->fd         = fd ;
+  node->devData    = sensor ;
   node->analogRead = myAnalogRead ;
 
+  pthread_mutex_lock (&sensorLock) ;
+    sensor->next = sensors ;
+    sensors      = sensor ;
+  pthread_mutex_unlock (&sensorLock) ;
+
   return TRUE ;
 }
@@ -29,6 +29,10 @@ extern "C" {
 
 extern int ds18b20Setup (const int pinBase, const char *serialNum) ;
 
+extern int  ds18b20SamplerStart (int periodMs) ;
+extern void ds18b20SamplerStop  (void) ;
+extern void ds18b20SetW1Root    (const char *root) ;
+
 #ifdef __cplusplus
 }
 #endif
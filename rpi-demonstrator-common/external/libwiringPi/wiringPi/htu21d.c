@@ -58,6 +58,7 @@ static int myAnalogRead (struct wiringPiNodeStruct *node, int pin)
   uint32_t sTemp, sHumid ;
   double   fTemp, fHumid ;
   int      cTemp, cHumid ;
+  struct wiringPiI2CMsg msg ;
 
   /**/ if (chan == 0)	// Read Temperature
   {
@@ -65,13 +66,18 @@ static int myAnalogRead (struct wiringPiNodeStruct *node, int pin)
 // Send read temperature command:
 
     data [0] = 0xF3 ;
-    if (write (fd, data, 1) != 1)
+    msg.flags = 0 ;
+    msg.len   = 1 ;
+    msg.buf   = data ;
+    if (wiringPiI2CTransferTo (fd, I2C_ADDRESS, &msg, 1) < 0)
       return -9999 ;
 
 // Wait then read the data
 
     delay (50) ;
-    if (read (fd, data, 3) != 3)
+    msg.flags = WPI_I2C_M_RD ;
+    msg.len   = 3 ;
+    if (wiringPiI2CTransferTo (fd, I2C_ADDRESS, &msg, 1) < 0)
       return -9998 ;
 
     if (!checksum (data))
@@ -89,13 +95,18 @@ static int myAnalogRead (struct wiringPiNodeStruct *node, int pin)
 // Send read humidity command:
 
     data [0] = 0xF5 ;
-    if (write (fd, data, 1) != 1)
+    msg.flags = 0 ;
+    msg.len   = 1 ;
+    msg.buf   = data ;
+    if (wiringPiI2CTransferTo (fd, I2C_ADDRESS, &msg, 1) < 0)
       return -9999 ;
 
 // Wait then read the data
 
     delay (50) ;
-    if (read (fd, data, 3) != 3)
+    msg.flags = WPI_I2C_M_RD ;
+    msg.len   = 3 ;
+    if (wiringPiI2CTransferTo (fd, I2C_ADDRESS, &msg, 1) < 0)
       return -9998 ;
 
     if (!checksum (data))
@@ -124,7 +135,8 @@ int htu21dSetup (const int pinBase)
   int fd ;
   struct wiringPiNodeStruct *node ;
   uint8_t data ;
-  int status ;
+  uint8_t status ;
+  struct wiringPiI2CMsg msg ;
 
   if ((fd = wiringPiI2CSetup (I2C_ADDRESS)) < 0)
     return FALSE ;
@@ -136,15 +148,19 @@ int htu21dSetup (const int pinBase)
 
 // Send a reset code to it:
 
-  data = 0xFE ;
-  if (write (fd, &data, 1) != 1)
+  data      = 0xFE ;
+  msg.flags = 0 ;
+  msg.len   = 1 ;
+  msg.buf   = &data ;
+  if (wiringPiI2CTransferTo (fd, I2C_ADDRESS, &msg, 1) < 0)
     return FALSE ;
 
   delay (15) ;
 
 // Read the status register to check it's really there
 
-  status = wiringPiI2CReadReg8 (fd, 0xE7) ;
+  if (wiringPiI2CReadRegBurstTo (fd, I2C_ADDRESS, 0xE7, &status, 1) < 0)
+    return FALSE ;
 
   return (status == 0x02) ? TRUE : FALSE ;
 }
@@ -23,98 +23,37 @@
  */
 
 #include <stdio.h>
+#include <stdint.h>
 #include <pthread.h>
 
 #include "wiringPi.h"
 #include "wiringPiI2C.h"
 #include "mcp23x0817.h"
+#include "mcp23xShadow.h"
 
 #include "mcp23008.h"
 
 
 /*
- * myPinMode:
+ * readRegs: writeRegs:
+ *	The 23008 only has the one port, so len is always 1.
  *********************************************************************************
  */
 
-static void myPinMode (struct wiringPiNodeStruct *node, int pin, int mode)
+static int readRegs (struct wiringPiNodeStruct *node, int reg, uint8_t *data, UNU int len)
 {
-  int mask, old, reg ;
+  int value ;
 
-  reg  = MCP23x08_IODIR ;
-  mask = 1 << (pin - node->pinBase) ;
-  old  = wiringPiI2CReadReg8 (node->fd, reg) ;
+  if ((value = wiringPiI2CReadReg8 (node->fd, reg)) < 0)
+    return -1 ;
+  data [0] = value ;
 
-  if (mode == OUTPUT)
-    old &= (~mask) ;
-  else
-    old |=   mask ;
-
-  wiringPiI2CWriteReg8 (node->fd, reg, old) ;
+  return 0 ;
 }
 
-
-/*
- * myPullUpDnControl:
- *********************************************************************************
- */
-
-static void myPullUpDnControl (struct wiringPiNodeStruct *node, int pin, int mode)
+static int writeRegs (struct wiringPiNodeStruct *node, int reg, const uint8_t *data, UNU int len)
 {
-  int mask, old, reg ;
-
-  reg  = MCP23x08_GPPU ;
-  mask = 1 << (pin - node->pinBase) ;
-
-  old  = wiringPiI2CReadReg8 (node->fd, reg) ;
-
-  if (mode == PUD_UP)
-    old |=   mask ;
-  else
-    old &= (~mask) ;
-
-  wiringPiI2CWriteReg8 (node->fd, reg, old) ;
-}
-
-
-/*
- * myDigitalWrite:
- *********************************************************************************
- */
-
-static void myDigitalWrite (struct wiringPiNodeStruct *node, int pin, int value)
-{
-  int bit, old ;
-
-  bit  = 1 << ((pin - node->pinBase) & 7) ;
-
-  old = node->data2 ;
-  if (value == LOW)
-    old &= (~bit) ;
-  else
-    old |=   bit ;
-
-  wiringPiI2CWriteReg8 (node->fd, MCP23x08_GPIO, old) ;
-  node->data2 = old ;
-}
-
-
-/*
- * myDigitalRead:
- *********************************************************************************
- */
-
-static int myDigitalRead (struct wiringPiNodeStruct *node, int pin)
-{
-  int mask, value ;
-
-  mask  = 1 << ((pin - node->pinBase) & 7) ;
-  value = wiringPiI2CReadReg8 (node->fd, MCP23x08_GPIO) ;
-
-  if ((value & mask) == 0)
-    return LOW ;
-  else 
-    return HIGH ;
+  return wiringPiI2CWriteReg8 (node->fd, reg, data [0]) ;
 }
 
 
@@ -139,11 +78,6 @@ int mcp23008Setup (const int pinBase, const int i2cAddress)
   node = wiringPiNewNode (pinBase, 8) ;
 
   node->fd              = fd ;
-  node->pinMode         = myPinMode ;
-  node->pullUpDnControl = myPullUpDnControl ;
-  node->digitalRead     = myDigitalRead ;
-  node->digitalWrite    = myDigitalWrite ;
-  node->data2           = wiringPiI2CReadReg8 (fd, MCP23x08_OLAT) ;
 
-  return TRUE ;
+  return mcp23xShadowSetup (node, 1, readRegs, writeRegs) ;
 }
@@ -23,143 +23,51 @@
  */
 
 #include <stdio.h>
+#include <stdint.h>
 #include <pthread.h>
 
 #include "wiringPi.h"
 #include "wiringPiI2C.h"
 #include "mcp23x0817.h"
+#include "mcp23xShadow.h"
 
 #include "mcp23017.h"
 
 
 /*
- * myPinMode:
+ * readRegs: writeRegs:
+ *	Transfer one register, or an A/B register pair as a single SMBus
+ *	word transfer.
  *********************************************************************************
  */
 
-static void myPinMode (struct wiringPiNodeStruct *node, int pin, int mode)
+static int readRegs (struct wiringPiNodeStruct *node, int reg, uint8_t *data, int len)
 {
-  int mask, old, reg ;
+  int value ;
 
-  pin -= node->pinBase ;
-
-  if (pin < 8)		// Bank A
-    reg  = MCP23x17_IODIRA ;
-  else
+  if (len == 2)
   {
-    reg  = MCP23x17_IODIRB ;
-    pin &= 0x07 ;
+    if ((value = wiringPiI2CReadReg16 (node->fd, reg)) < 0)
+      return -1 ;
+    data [0] =  value       & 0xFF ;
+    data [1] = (value >> 8) & 0xFF ;
   }
-
-  mask = 1 << pin ;
-  old  = wiringPiI2CReadReg8 (node->fd, reg) ;
-
-  if (mode == OUTPUT)
-    old &= (~mask) ;
   else
-    old |=   mask ;
-
-  wiringPiI2CWriteReg8 (node->fd, reg, old) ;
-}
-
-
-/*
- * myPullUpDnControl:
- *********************************************************************************
- */
-
-static void myPullUpDnControl (struct wiringPiNodeStruct *node, int pin, int mode)
-{
-  int mask, old, reg ;
-
-  pin -= node->pinBase ;
-
-  if (pin < 8)		// Bank A
-    reg  = MCP23x17_GPPUA ;
-  else
-  {
-    reg  = MCP23x17_GPPUB ;
-    pin &= 0x07 ;
-  }
-
-  mask = 1 << pin ;
-  old  = wiringPiI2CReadReg8 (node->fd, reg) ;
-
-  if (mode == PUD_UP)
-    old |=   mask ;
-  else
-    old &= (~mask) ;
-
-  wiringPiI2CWriteReg8 (node->fd, reg, old) ;
-}
-
-
-/*
- * myDigitalWrite:
- *********************************************************************************
- */
-
-static void myDigitalWrite (struct wiringPiNodeStruct *node, int pin, int value)
-{
-  int bit, old ;
-
-  pin -= node->pinBase ;	// Pin now 0-15
-
-  bit = 1 << (pin & 7) ;
-
-  if (pin < 8)			// Bank A
   {
-    old = node->data2 ;
-
-    if (value == LOW)
-      old &= (~bit) ;
-    else
-      old |=   bit ;
-
-    wiringPiI2CWriteReg8 (node->fd, MCP23x17_GPIOA, old) ;
-    node->data2 = old ;
+    if ((value = wiringPiI2CReadReg8 (node->fd, reg)) < 0)
+      return -1 ;
+    data [0] = value ;
   }
-  else				// Bank B
-  {
-    old = node->data3 ;
-
-    if (value == LOW)
-      old &= (~bit) ;
-    else
-      old |=   bit ;
 
-    wiringPiI2CWriteReg8 (node->fd, MCP23x17_GPIOB, old) ;
-    node->data3 = old ;
-  }
+  return 0 ;
 }
 
-
-/*
- * myDigitalRead:
- *********************************************************************************
- */
-
-static int myDigitalRead (struct wiringPiNodeStruct *node, int pin)
+static int writeRegs (struct wiringPiNodeStruct *node, int reg, const uint8_t *data, int len)
 {
-  int mask, value, gpio ;
-
-  pin -= node->pinBase ;
-
-  if (pin < 8)		// Bank A
-    gpio  = MCP23x17_GPIOA ;
+  if (len == 2)
+    return wiringPiI2CWriteReg16 (node->fd, reg, data [0] | (data [1] << 8)) ;
   else
-  {
-    gpio  = MCP23x17_GPIOB ;
-    pin  &= 0x07 ;
-  }
-
-  mask  = 1 << pin ;
-  value = wiringPiI2CReadReg8 (node->fd, gpio) ;
-
-  if ((value & mask) == 0)
-    return LOW ;
-  else 
-    return HIGH ;
+    return wiringPiI2CWriteReg8  (node->fd, reg, data [0]) ;
 }
 
 
@@ -184,12 +92,6 @@ int mcp23017Setup (const int pinBase, const int i2cAddress)
   node = wiringPiNewNode (pinBase, 16) ;
 
   node->fd              = fd ;
-  node->pinMode         = myPinMode ;
-  node->pullUpDnControl = myPullUpDnControl ;
-  node->digitalRead     = myDigitalRead ;
-  node->digitalWrite    = myDigitalWrite ;
-  node->data2           = wiringPiI2CReadReg8 (fd, MCP23x17_OLATA) ;
-  node->data3           = wiringPiI2CReadReg8 (fd, MCP23x17_OLATB) ;
-
-  return TRUE ;
+
+  return mcp23xShadowSetup (node, 2, readRegs, writeRegs) ;
 }
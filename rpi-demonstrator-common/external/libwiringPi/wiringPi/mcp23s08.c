@@ -24,10 +24,12 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
 
 #include "wiringPi.h"
 #include "wiringPiSPI.h"
 #include "mcp23x0817.h"
+#include "mcp23xShadow.h"
 
 #include "mcp23s08.h"
 
@@ -52,108 +54,72 @@ static void writeByte (uint8_t spiPort, uint8_t devId, uint8_t reg, uint8_t data
   wiringPiSPIDataRW (spiPort, spiData, 3) ;
 }
 
+
 /*
- * readByte:
- *	Read a byte from a register on the MCP23s08 on the SPI bus.
+ * readRegs: writeRegs:
+ *	Transfer len consecutive registers of the MCP23s08 in one SPI
+ *	transaction.
  *********************************************************************************
  */
 
-static uint8_t readByte (uint8_t spiPort, uint8_t devId, uint8_t reg)
+static int readRegs (struct wiringPiNodeStruct *node, int reg, uint8_t *data, int len)
 {
   uint8_t spiData [4] ;
 
-  spiData [0] = CMD_READ | ((devId & 7) << 1) ;
+  spiData [0] = CMD_READ | ((node->data1 & 7) << 1) ;
   spiData [1] = reg ;
+  spiData [2] = 0 ;
+  spiData [3] = 0 ;
 
-  wiringPiSPIDataRW (spiPort, spiData, 3) ;
-
-  return spiData [2] ;
-}
-
+  if (wiringPiSPIDataRW (node->data0, spiData, len + 2) < 0)
+    return -1 ;
 
-/*
- * myPinMode:
- *********************************************************************************
- */
-
-static void myPinMode (struct wiringPiNodeStruct *node, int pin, int mode)
-{
-  int mask, old, reg ;
+  memcpy (data, &spiData [2], len) ;
 
-  reg  = MCP23x08_IODIR ;
-  mask = 1 << (pin - node->pinBase) ;
-  old  = readByte (node->data0, node->data1, reg) ;
-
-  if (mode == OUTPUT)
-    old &= (~mask) ;
-  else
-    old |=   mask ;
-
-  writeByte (node->data0, node->data1, reg, old) ;
+  return 0 ;
 }
 
-
-/*
- * myPullUpDnControl:
- *********************************************************************************
- */
-
-static void myPullUpDnControl (struct wiringPiNodeStruct *node, int pin, int mode)
+static int writeRegs (struct wiringPiNodeStruct *node, int reg, const uint8_t *data, int len)
 {
-  int mask, old, reg ;
-
-  reg  = MCP23x08_GPPU ;
-  mask = 1 << (pin - node->pinBase) ;
-
-  old  = readByte (node->data0, node->data1, reg) ;
-
-  if (mode == PUD_UP)
-    old |=   mask ;
-  else
-    old &= (~mask) ;
-
-  writeByte (node->data0, node->data1, reg, old) ;
-}
-
-
-/*
- * myDigitalWrite:
- *********************************************************************************
- */
-
-static void myDigitalWrite (struct wiringPiNodeStruct *node, int pin, int value)
-{
-  int bit, old ;
-
-  bit  = 1 << ((pin - node->pinBase) & 7) ;
+  uint8_t spiData [4] ;
 
-  old = node->data2 ;
-  if (value == LOW)
-    old &= (~bit) ;
-  else
-    old |=   bit ;
+  spiData [0] = CMD_WRITE | ((node->data1 & 7) << 1) ;
+  spiData [1] = reg ;
+  memcpy (&spiData [2], data, len) ;
 
-  writeByte (node->data0, node->data1, MCP23x08_GPIO, old) ;
-  node->data2 = old ;
+  return wiringPiSPIDataRW (node->data0, spiData, len + 2) ;
 }
 
 
 /*
- * myDigitalRead:
+ * writeRegsBatch:
+ *	Write several register sets with one batched SPI message, cycling
+ *	CS between them.
  *********************************************************************************
  */
 
-static int myDigitalRead (struct wiringPiNodeStruct *node, int pin)
+static int writeRegsBatch (struct wiringPiNodeStruct *node, int count, const int *regs, const uint8_t data [][2], int len)
 {
-  int mask, value ;
-
-  mask  = 1 << ((pin - node->pinBase) & 7) ;
-  value = readByte (node->data0, node->data1, MCP23x08_GPIO) ;
-
-  if ((value & mask) == 0)
-    return LOW ;
-  else 
-    return HIGH ;
+  uint8_t spiData [4][4] ;
+  struct wiringPiSPISegment segs [4] ;
+  int i ;
+
+  if (count > 4)
+    return -1 ;
+
+  for (i = 0 ; i < count ; ++i)
+  {
+    spiData [i][0] = CMD_WRITE | ((node->data1 & 7) << 1) ;
+    spiData [i][1] = regs [i] ;
+    memcpy (&spiData [i][2], data [i], len) ;
+
+    segs [i].data     = spiData [i] ;
+    segs [i].len      = len + 2 ;
+    segs [i].csChange = TRUE ;
+    segs [i].delayUs  = 0 ;
+  }
+
+  return wiringPiSPIDataRWBatch (node->data0, segs, count) ;
 }
 
 
@@ -178,11 +144,11 @@ int mcp23s08Setup (const int pinBase, const int spiPort, const int devId)
 
   node->data0           = spiPort ;
   node->data1           = devId ;
-  node->pinMode         = myPinMode ;
-  node->pullUpDnControl = myPullUpDnControl ;
-  node->digitalRead     = myDigitalRead ;
-  node->digitalWrite    = myDigitalWrite ;
-  node->data2           = readByte (spiPort, devId, MCP23x08_OLAT) ;
+
+  if (!mcp23xShadowSetup (node, 1, readRegs, writeRegs))
+    return FALSE ;
+
+  mcp23xShadowSetBatch (node, writeRegsBatch) ;
 
   return TRUE ;
 }
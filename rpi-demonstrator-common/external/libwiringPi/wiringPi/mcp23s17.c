@@ -24,10 +24,12 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
 
 #include "wiringPi.h"
 #include "wiringPiSPI.h"
 #include "mcp23x0817.h"
+#include "mcp23xShadow.h"
 
 #include "mcp23s17.h"
 
@@ -36,169 +38,70 @@
 
 
 /*
- * writeByte:
- *	Write a byte to a register on the MCP23s17 on the SPI bus.
+ * readRegs: writeRegs:
+ *	Transfer len consecutive registers of the MCP23s17 in one SPI
+ *	transaction.
  *********************************************************************************
  */
 
-static void writeByte (uint8_t spiPort, uint8_t devId, uint8_t reg, uint8_t data)
+static int readRegs (struct wiringPiNodeStruct *node, int reg, uint8_t *data, int len)
 {
   uint8_t spiData [4] ;
 
-  spiData [0] = CMD_WRITE | ((devId & 7) << 1) ;
+  spiData [0] = CMD_READ | ((node->data1 & 7) << 1) ;
   spiData [1] = reg ;
-  spiData [2] = data ;
+  spiData [2] = 0 ;
+  spiData [3] = 0 ;
 
-  wiringPiSPIDataRW (spiPort, spiData, 3) ;
-}
-
-/*
- * readByte:
- *	Read a byte from a register on the MCP23s17 on the SPI bus.
- *********************************************************************************
- */
-
-static uint8_t readByte (uint8_t spiPort, uint8_t devId, uint8_t reg)
-{
-  uint8_t spiData [4] ;
-
-  spiData [0] = CMD_READ | ((devId & 7) << 1) ;
-  spiData [1] = reg ;
-
-  wiringPiSPIDataRW (spiPort, spiData, 3) ;
-
-  return spiData [2] ;
-}
-
-
-/*
- * myPinMode:
- *********************************************************************************
- */
-
-static void myPinMode (struct wiringPiNodeStruct *node, int pin, int mode)
-{
-  int mask, old, reg ;
-
-  pin -= node->pinBase ;
-
-  if (pin < 8)		// Bank A
-    reg  = MCP23x17_IODIRA ;
-  else
-  {
-    reg  = MCP23x17_IODIRB ;
-    pin &= 0x07 ;
-  }
-
-  mask = 1 << pin ;
-  old  = readByte (node->data0, node->data1, reg) ;
-
-  if (mode == OUTPUT)
-    old &= (~mask) ;
-  else
-    old |=   mask ;
-
-  writeByte (node->data0, node->data1, reg, old) ;
-}
-
-
-/*
- * myPullUpDnControl:
- *********************************************************************************
- */
-
-static void myPullUpDnControl (struct wiringPiNodeStruct *node, int pin, int mode)
-{
-  int mask, old, reg ;
-
-  pin -= node->pinBase ;
-
-  if (pin < 8)		// Bank A
-    reg  = MCP23x17_GPPUA ;
-  else
-  {
-    reg  = MCP23x17_GPPUB ;
-    pin &= 0x07 ;
-  }
+  if (wiringPiSPIDataRW (node->data0, spiData, len + 2) < 0)
+    return -1 ;
 
-  mask = 1 << pin ;
-  old  = readByte (node->data0, node->data1, reg) ;
+  memcpy (data, &spiData [2], len) ;
 
-  if (mode == PUD_UP)
-    old |=   mask ;
-  else
-    old &= (~mask) ;
-
-  writeByte (node->data0, node->data1, reg, old) ;
+  return 0 ;
 }
 
-
-/*
- * myDigitalWrite:
- *********************************************************************************
- */
-
-static void myDigitalWrite (struct wiringPiNodeStruct *node, int pin, int value)
+static int writeRegs (struct wiringPiNodeStruct *node, int reg, const uint8_t *data, int len)
 {
-  int bit, old ;
-
-  pin -= node->pinBase ;	// Pin now 0-15
-
-  bit = 1 << (pin & 7) ;
-
-  if (pin < 8)			// Bank A
-  {
-    old = node->data2 ;
-
-    if (value == LOW)
-      old &= (~bit) ;
-    else
-      old |=   bit ;
-
-    writeByte (node->data0, node->data1, MCP23x17_GPIOA, old) ;
-    node->data2 = old ;
-  }
-  else				// Bank B
-  {
-    old = node->data3 ;
+  uint8_t spiData [4] ;
 
-    if (value == LOW)
-      old &= (~bit) ;
-    else
-      old |=   bit ;
+  spiData [0] = CMD_WRITE | ((node->data1 & 7) << 1) ;
+  spiData [1] = reg ;
+  memcpy (&spiData [2], data, len) ;
 
-    writeByte (node->data0, node->data1, MCP23x17_GPIOB, old) ;
-    node->data3 = old ;
-  }
+  return wiringPiSPIDataRW (node->data0, spiData, len + 2) ;
 }
 
 
 /*
- * myDigitalRead:
+ * writeRegsBatch:
+ *	Write several register sets with one batched SPI message, cycling
+ *	CS between them.
  *********************************************************************************
  */
 
-static int myDigitalRead (struct wiringPiNodeStruct *node, int pin)
+static int writeRegsBatch (struct wiringPiNodeStruct *node, int count, const int *regs, const uint8_t data [][2], int len)
 {
-  int mask, value, gpio ;
+  uint8_t spiData [4][4] ;
+  struct wiringPiSPISegment segs [4] ;
+  int i ;
 
-  pin -= node->pinBase ;
+  if (count > 4)
+    return -1 ;
 
-  if (pin < 8)		// Bank A
-    gpio  = MCP23x17_GPIOA ;
-  else
+  for (i = 0 ; i < count ; ++i)
   {
-    gpio  = MCP23x17_GPIOB ;
-    pin  &= 0x07 ;
+    spiData [i][0] = CMD_WRITE | ((node->data1 & 7) << 1) ;
+    spiData [i][1] = regs [i] ;
+    memcpy (&spiData [i][2], data [i], len) ;
+
+    segs [i].data     = spiData [i] ;
+    segs [i].len      = len + 2 ;
+    segs [i].csChange = TRUE ;
+    segs [i].delayUs  = 0 ;
   }
 
-  mask  = 1 << pin ;
-  value = readByte (node->data0, node->data1, gpio) ;
-
-  if ((value & mask) == 0)
-    return LOW ;
-  else 
-    return HIGH ;
+  return wiringPiSPIDataRWBatch (node->data0, segs, count) ;
 }
 
 
@@ -213,23 +116,23 @@ static int myDigitalRead (struct wiringPiNodeStruct *node, int pin)
 int mcp23s17Setup (const int pinBase, const int spiPort, const int devId)
 {
   struct wiringPiNodeStruct *node ;
+  static const int iocon [2] = { MCP23x17_IOCON, MCP23x17_IOCONB } ;
+  const uint8_t ioconInit [2][2] = { { IOCON_INIT | IOCON_HAEN, 0 }, { IOCON_INIT | IOCON_HAEN, 0 } } ;
 
   if (wiringPiSPISetup (spiPort, MCP_SPEED) < 0)
     return FALSE ;
 
-  writeByte (spiPort, devId, MCP23x17_IOCON,  IOCON_INIT | IOCON_HAEN) ;
-  writeByte (spiPort, devId, MCP23x17_IOCONB, IOCON_INIT | IOCON_HAEN) ;
-
   node = wiringPiNewNode (pinBase, 16) ;
 
   node->data0           = spiPort ;
   node->data1           = devId ;
-  node->pinMode         = myPinMode ;
-  node->pullUpDnControl = myPullUpDnControl ;
-  node->digitalRead     = myDigitalRead ;
-  node->digitalWrite    = myDigitalWrite ;
-  node->data2           = readByte (spiPort, devId, MCP23x17_OLATA) ;
-  node->data3           = readByte (spiPort, devId, MCP23x17_OLATB) ;
+
+  writeRegsBatch (node, 2, iocon, ioconInit, 1) ;
+
+  if (!mcp23xShadowSetup (node, 2, readRegs, writeRegs))
+    return FALSE ;
+
+  mcp23xShadowSetBatch (node, writeRegsBatch) ;
 
   return TRUE ;
 }
@@ -0,0 +1,331 @@
+/*
+ * mcp23xShadow.c:
+ *	Shadow registers and write-combining transactions for the
+ *	MCP23x08 and MCP23x17 GPIO expander drivers.
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://github.com/WiringPi/WiringPi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+/*
+ * Notes:
+ *	The IODIR, GPPU and OLAT registers are kept in memory, so pinMode,
+ *	pullUpDnControl and digitalWrite no longer need a read-modify-write
+ *	cycle on the bus. Outside a transaction every change is written out
+ *	straight away; inside one the changes are only marked dirty and the
+ *	final commit writes each dirty register set once.
+ *
+ *	On the 23x17 the chips are set up with IOCON.BANK = 0 and SEQOP set,
+ *	so the address pointer toggles between the A and B register of a
+ *	pair and both ports go out (or come in) as a single 2-byte burst.
+ *********************************************************************************
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "wiringPi.h"
+#include "mcp23x0817.h"
+
+#include "mcp23xShadow.h"
+
+#define	DIRTY_IODIR	0x01
+#define	DIRTY_GPPU	0x02
+#define	DIRTY_OLAT	0x04
+
+struct mcp23xShadow
+{
+  int             ports ;	// 1 for the 23x08, 2 for the 23x17
+  mcp23xReadRegs  readRegs ;
+  mcp23xWriteRegs writeRegs ;
+  mcp23xWriteRegsBatch writeRegsBatch ;
+
+  uint8_t regIodir, regGppu, regOlat, regGpio ;
+
+  uint8_t iodir [2] ;
+  uint8_t gppu  [2] ;
+  uint8_t olat  [2] ;
+  uint8_t gpio  [2] ;		// Inputs as sampled inside a transaction
+
+  unsigned int dirty ;
+  int          depth ;		// Transaction nesting level
+  int          sampled ;	// gpio [] is valid for this transaction
+} ;
+
+
+/*
+ * flush:
+ *	Write every dirty register set out to the chip, all in one batch
+ *	if the bus driver can do that.
+ *********************************************************************************
+ */
+
+static int flush (struct wiringPiNodeStruct *node, struct mcp23xShadow *s)
+{
+  int     regs [3] ;
+  uint8_t data [3][2] ;
+  int     count = 0 ;
+  int     ret   = 0 ;
+  int     i ;
+
+  if (s->dirty & DIRTY_IODIR)
+  {
+    regs [count] = s->regIodir ;
+    memcpy (data [count++], s->iodir, 2) ;
+  }
+  if (s->dirty & DIRTY_GPPU)
+  {
+    regs [count] = s->regGppu ;
+    memcpy (data [count++], s->gppu, 2) ;
+  }
+  if (s->dirty & DIRTY_OLAT)
+  {
+    regs [count] = s->regOlat ;
+    memcpy (data [count++], s->olat, 2) ;
+  }
+
+  s->dirty = 0 ;
+
+  if ((count > 1) && (s->writeRegsBatch != NULL))
+    return (s->writeRegsBatch (node, count, regs, (const uint8_t (*)[2])data, s->ports) < 0) ? -1 : 0 ;
+
+  for (i = 0 ; i < count ; ++i)
+    if (s->writeRegs (node, regs [i], data [i], s->ports) < 0)
+      ret = -1 ;
+
+  return ret ;
+}
+
+
+/*
+ * update:
+ *	Change one bit of a shadow register and write it out unless we're
+ *	inside a transaction.
+ *********************************************************************************
+ */
+
+static void update (struct wiringPiNodeStruct *node, uint8_t *reg, unsigned int dirty, int pin, int set)
+{
+  struct mcp23xShadow *s = (struct mcp23xShadow *)node->devData ;
+  int port, mask ;
+
+  pin -= node->pinBase ;
+  port = (pin >> 3) & 1 ;
+  mask = 1 << (pin & 7) ;
+
+  if (set)
+    reg [port] |=   mask ;
+  else
+    reg [port] &= (~mask) ;
+
+  s->dirty |= dirty ;
+
+  if (s->depth == 0)
+    flush (node, s) ;
+}
+
+
+static void myPinMode (struct wiringPiNodeStruct *node, int pin, int mode)
+{
+  struct mcp23xShadow *s = (struct mcp23xShadow *)node->devData ;
+
+  update (node, s->iodir, DIRTY_IODIR, pin, mode != OUTPUT) ;
+}
+
+static void myPullUpDnControl (struct wiringPiNodeStruct *node, int pin, int mode)
+{
+  struct mcp23xShadow *s = (struct mcp23xShadow *)node->devData ;
+
+  update (node, s->gppu, DIRTY_GPPU, pin, mode == PUD_UP) ;
+}
+
+static void myDigitalWrite (struct wiringPiNodeStruct *node, int pin, int value)
+{
+  struct mcp23xShadow *s = (struct mcp23xShadow *)node->devData ;
+
+  update (node, s->olat, DIRTY_OLAT, pin, value != LOW) ;
+}
+
+
+/*
+ * myDigitalRead:
+ *	Outside a transaction just the one port is read. Inside a transaction
+ *	all ports are sampled with the first read and later reads are served
+ *	from that sample until the commit.
+ *********************************************************************************
+ */
+
+static int myDigitalRead (struct wiringPiNodeStruct *node, int pin)
+{
+  struct mcp23xShadow *s = (struct mcp23xShadow *)node->devData ;
+  uint8_t value [2] ;
+  int port ;
+
+  pin -= node->pinBase ;
+  port = (pin >> 3) & 1 ;
+
+  if (s->depth > 0)
+  {
+    if (!s->sampled)
+    {
+      if (s->readRegs (node, s->regGpio, s->gpio, s->ports) < 0)
+        return LOW ;
+      s->sampled = TRUE ;
+    }
+    value [port] = s->gpio [port] ;
+  }
+  else if (s->readRegs (node, s->regGpio + port, &value [port], 1) < 0)
+    return LOW ;
+
+  if ((value [port] & (1 << (pin & 7))) == 0)
+    return LOW ;
+  else
+    return HIGH ;
+}
+
+
+/*
+ * myDigitalReadAll:
+ *	Sample every port in one transfer.
+ *********************************************************************************
+ */
+
+static unsigned int myDigitalReadAll (struct wiringPiNodeStruct *node)
+{
+  struct mcp23xShadow *s = (struct mcp23xShadow *)node->devData ;
+  uint8_t value [2] = { 0, 0 } ;
+
+  if ((s->depth > 0) && s->sampled)
+    memcpy (value, s->gpio, sizeof (value)) ;
+  else if (s->readRegs (node, s->regGpio, value, s->ports) < 0)
+    return 0 ;
+  else if (s->depth > 0)
+  {
+    memcpy (s->gpio, value, sizeof (value)) ;
+    s->sampled = TRUE ;
+  }
+
+  return value [0] | (value [1] << 8) ;
+}
+
+
+/*
+ * myBeginTransaction: myCommitTransaction:
+ *********************************************************************************
+ */
+
+static int myBeginTransaction (struct wiringPiNodeStruct *node)
+{
+  struct mcp23xShadow *s = (struct mcp23xShadow *)node->devData ;
+
+  if (s->depth++ == 0)
+    s->sampled = FALSE ;
+
+  return 0 ;
+}
+
+static int myCommitTransaction (struct wiringPiNodeStruct *node)
+{
+  struct mcp23xShadow *s = (struct mcp23xShadow *)node->devData ;
+
+  if (s->depth == 0)
+    return -1 ;
+
+  if (--s->depth > 0)
+    return 0 ;
+
+  s->sampled = FALSE ;
+
+  return flush (node, s) ;
+}
+
+
+/*
+ * mcp23xShadowSetBatch:
+ *	Let flush hand all dirty register sets to the bus driver at once.
+ *********************************************************************************
+ */
+
+void mcp23xShadowSetBatch (struct wiringPiNodeStruct *node, mcp23xWriteRegsBatch writeRegsBatch)
+{
+  struct mcp23xShadow *s = (struct mcp23xShadow *)node->devData ;
+
+  if (s != NULL)
+    s->writeRegsBatch = writeRegsBatch ;
+}
+
+
+/*
+ * mcp23xShadowSetup:
+ *	Load the shadow registers from the chip and hook the shadowed pin
+ *	functions into the node. The bus driver must already have set up
+ *	whatever it needs in the node (fd, data0, ...) for readRegs/writeRegs.
+ *********************************************************************************
+ */
+
+int mcp23xShadowSetup (struct wiringPiNodeStruct *node, int ports,
+                       mcp23xReadRegs readRegs, mcp23xWriteRegs writeRegs)
+{
+  struct mcp23xShadow *s ;
+
+  if ((s = (struct mcp23xShadow *)calloc (1, sizeof (struct mcp23xShadow))) == NULL)
+    return FALSE ;
+
+  s->ports     = (ports == 2) ? 2 : 1 ;
+  s->readRegs  = readRegs ;
+  s->writeRegs = writeRegs ;
+
+  if (s->ports == 2)
+  {
+    s->regIodir = MCP23x17_IODIRA ;
+    s->regGppu  = MCP23x17_GPPUA ;
+    s->regOlat  = MCP23x17_OLATA ;
+    s->regGpio  = MCP23x17_GPIOA ;
+  }
+  else
+  {
+    s->regIodir = MCP23x08_IODIR ;
+    s->regGppu  = MCP23x08_GPPU ;
+    s->regOlat  = MCP23x08_OLAT ;
+    s->regGpio  = MCP23x08_GPIO ;
+  }
+
+// Only publish the shadow once it holds the chip's registers
+
+  if ((readRegs (node, s->regIodir, s->iodir, s->ports) < 0) ||
+      (readRegs (node, s->regGppu,  s->gppu,  s->ports) < 0) ||
+      (readRegs (node, s->regOlat,  s->olat,  s->ports) < 0))
+  {
+    free (s) ;
+    return FALSE ;
+  }
+
+  node->devData = s ;
+
+  node->pinMode           = myPinMode ;
+  node->pullUpDnControl   = myPullUpDnControl ;
+  node->digitalRead       = myDigitalRead ;
+  node->digitalWrite      = myDigitalWrite ;
+  node->digitalReadAll    = myDigitalReadAll ;
+  node->beginTransaction  = myBeginTransaction ;
+  node->commitTransaction = myCommitTransaction ;
+
+  return TRUE ;
+}
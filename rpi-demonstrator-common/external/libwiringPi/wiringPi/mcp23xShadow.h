@@ -0,0 +1,49 @@
+/*
+ * mcp23xShadow.h:
+ *	Shadow registers and write-combining transactions for the
+ *	MCP23x08 and MCP23x17 GPIO expander drivers.
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://github.com/WiringPi/WiringPi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Bus access supplied by the I2C or SPI driver:
+//	Transfer len (1 or 2) consecutive A/B registers starting at reg
+//	in one bus transaction. Return < 0 on failure.
+
+typedef int (*mcp23xReadRegs)  (struct wiringPiNodeStruct *node, int reg, uint8_t *data, int len) ;
+typedef int (*mcp23xWriteRegs) (struct wiringPiNodeStruct *node, int reg, const uint8_t *data, int len) ;
+
+// Optional: write count register sets (regs [i] <- data [i][0..len-1])
+//	in one go, for buses that can batch several transactions.
+
+typedef int (*mcp23xWriteRegsBatch) (struct wiringPiNodeStruct *node, int count, const int *regs, const uint8_t data [][2], int len) ;
+
+extern int  mcp23xShadowSetup    (struct wiringPiNodeStruct *node, int ports,
+                                  mcp23xReadRegs readRegs, mcp23xWriteRegs writeRegs) ;
+extern void mcp23xShadowSetBatch (struct wiringPiNodeStruct *node, mcp23xWriteRegsBatch writeRegsBatch) ;
+
+#ifdef __cplusplus
+}
+#endif
@@ -28,28 +28,56 @@
 #include "mcp3002.h"
 
 /*
- * myAnalogRead:
- *	Return the analog value of the given pin
+ * myAnalogReadMany:
+ *	Scan both channels in one batched SPI message, deselecting the chip
+ *	between the conversions.
  *********************************************************************************
  */
 
-static int myAnalogRead (struct wiringPiNodeStruct *node, int pin)
+static int myAnalogReadMany (struct wiringPiNodeStruct *node, int pin, int count, int *values)
 {
-  unsigned char spiData [2] ;
-  unsigned char chanBits ;
+  unsigned char spiData [2][2] ;
+  struct wiringPiSPISegment segs [2] ;
   int chan = pin - node->pinBase ;
+  int i ;
+
+  for (i = 0 ; i < count ; ++i)
+  {
+    if (chan + i == 0)
+      spiData [i][0] = 0b11010000 ;
+    else
+      spiData [i][0] = 0b11110000 ;
+    spiData [i][1] = 0 ;
+
+    segs [i].data     = spiData [i] ;
+    segs [i].len      = 2 ;
+    segs [i].csChange = TRUE ;
+    segs [i].delayUs  = 0 ;
+  }
+
+  if (wiringPiSPIDataRWBatch (node->fd, segs, count) < 0)
+    return -1 ;
+
+  for (i = 0 ; i < count ; ++i)
+    values [i] = ((spiData [i][0] << 8) | (spiData [i][1] >> 1)) & 0x3FF ;
+
+  return count ;
+}
 
-  if (chan == 0)
-    chanBits = 0b11010000 ;
-  else
-    chanBits = 0b11110000 ;
 
-  spiData [0] = chanBits ;
-  spiData [1] = 0 ;
+/*
+ * myAnalogRead:
+ *	Return the analog value of the given pin
+ *********************************************************************************
+ */
+
+static int myAnalogRead (struct wiringPiNodeStruct *node, int pin)
+{
+  int value = 0 ;
 
-  wiringPiSPIDataRW (node->fd, spiData, 2) ;
+  myAnalogReadMany (node, pin, 1, &value) ;
 
-  return ((spiData [0] << 8) | (spiData [1] >> 1)) & 0x3FF ;
+  return value ;
 }
 
 
@@ -69,8 +97,9 @@ int mcp3002Setup (const int pinBase, int spiChannel)
 
   node = wiringPiNewNode (pinBase, 2) ;
 
-  node->fd         = spiChannel ;
-  node->analogRead = myAnalogRead ;
+  node->fd             = spiChannel ;
+  node->analogRead     = myAnalogRead ;
+  node->analogReadMany = myAnalogReadMany ;
 
   return TRUE ;
 }
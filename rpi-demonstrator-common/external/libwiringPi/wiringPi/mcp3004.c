@@ -30,26 +30,54 @@
 #include "mcp3004.h"
 
 /*
- * myAnalogRead:
- *	Return the analog value of the given pin
+ * myAnalogReadMany:
+ *	Scan consecutive channels in one batched SPI message, deselecting
+ *	the chip between the conversions.
  *********************************************************************************
  */
 
-static int myAnalogRead (struct wiringPiNodeStruct *node, int pin)
+static int myAnalogReadMany (struct wiringPiNodeStruct *node, int pin, int count, int *values)
 {
-  unsigned char spiData [3] ;
-  unsigned char chanBits ;
+  unsigned char spiData [8][3] ;
+  struct wiringPiSPISegment segs [8] ;
   int chan = pin - node->pinBase ;
+  int i ;
+
+  for (i = 0 ; i < count ; ++i)
+  {
+    spiData [i][0] = 1 ;		// Start bit
+    spiData [i][1] = 0b10000000 | ((chan + i) << 4) ;
+    spiData [i][2] = 0 ;
+
+    segs [i].data     = spiData [i] ;
+    segs [i].len      = 3 ;
+    segs [i].csChange = TRUE ;
+    segs [i].delayUs  = 0 ;
+  }
+
+  if (wiringPiSPIDataRWBatch (node->fd, segs, count) < 0)
+    return -1 ;
+
+  for (i = 0 ; i < count ; ++i)
+    values [i] = ((spiData [i][1] << 8) | spiData [i][2]) & 0x3FF ;
+
+  return count ;
+}
 
-  chanBits = 0b10000000 | (chan << 4) ;
 
-  spiData [0] = 1 ;		// Start bit
-  spiData [1] = chanBits ;
-  spiData [2] = 0 ;
+/*
+ * myAnalogRead:
+ *	Return the analog value of the given pin
+ *********************************************************************************
+ */
+
+static int myAnalogRead (struct wiringPiNodeStruct *node, int pin)
+{
+  int value = 0 ;
 
-  wiringPiSPIDataRW (node->fd, spiData, 3) ;
+  myAnalogReadMany (node, pin, 1, &value) ;
 
-  return ((spiData [1] << 8) | spiData [2]) & 0x3FF ;
+  return value ;
 }
 
 
@@ -69,8 +97,9 @@ int mcp3004Setup (const int pinBase, int spiChannel)
 
   node = wiringPiNewNode (pinBase, 8) ;
 
-  node->fd         = spiChannel ;
-  node->analogRead = myAnalogRead ;
+  node->fd             = spiChannel ;
+  node->analogRead     = myAnalogRead ;
+  node->analogReadMany = myAnalogReadMany ;
 
   return TRUE ;
 }
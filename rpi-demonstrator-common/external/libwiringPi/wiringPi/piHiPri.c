@@ -24,11 +24,69 @@
  ***********************************************************************
  */
 
+#include <stdio.h>
+#include <stdlib.h>
 #include <sched.h>
 #include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
 
 #include "wiringPi.h"
 
+/*
+ * Notes:
+ *	Every thread wiringPi starts registers itself here with piThreadEnter.
+ *	Unless a policy has been set for its class it just gets the fixed
+ *	piHiPri priority it always had. A policy - scheduling class, priority
+ *	and the CPUs it may run on - can be set with piThreadSetPolicy, which
+ *	also changes threads already running, or in the environment:
+ *
+ *	  WIRINGPI_THREADS="isr=fifo:80@3 softtone=rr:70@2,3 all=@1-3"
+ *
+ *	Entries are class=[policy[:priority]][@cpus], classes being isr,
+ *	softpwm, softtone, softservo, sampler, serial or all, and policies
+ *	other, fifo or rr. Later entries win. WIRINGPI_MLOCK set to anything
+ *	locks the process memory (mlockall) too.
+ *
+ *	Threads doing timed waits report how late they woke up with
+ *	piThreadWokeUp; piThreadList shows that along with the policy each
+ *	thread is really running with.
+ *********************************************************************************
+ */
+
+#define	ENV_THREADS	"WIRINGPI_THREADS"
+#define	ENV_MLOCK	"WIRINGPI_MLOCK"
+
+#define	MAX_THREADS	64
+
+struct threadEntry
+{
+  int                 used ;
+  pthread_t           thread ;
+  int                 tid ;
+  enum WPIThreadClass threadClass ;
+
+  unsigned long long  wakeUps ;		// Only written by the thread itself
+  long long int       latencySum, latencyMin, latencyMax ;
+  int                 resetRequest ;
+} ;
+
+static const char *classNames [WPI_THREAD_CLASSES] =
+{
+  "isr", "softpwm", "softtone", "softservo", "sampler", "serial"
+} ;
+
+static pthread_mutex_t threadLock = PTHREAD_MUTEX_INITIALIZER ;
+static pthread_once_t  threadOnce = PTHREAD_ONCE_INIT ;
+
+static struct WPIThreadPolicy policies   [WPI_THREAD_CLASSES] ;
+static int                    configured [WPI_THREAD_CLASSES] ;
+static struct threadEntry     threads    [MAX_THREADS] ;
+
+static __thread struct threadEntry *self = NULL ;
+
 
 /*
  * piHiPri:
@@ -49,3 +107,371 @@ int piHiPri (const int pri)
 
   return sched_setscheduler (0, SCHED_RR, &sched) ;
 }
+
+
+
+/*
+ * applyPolicy:
+ *	Set scheduling and CPU affinity of a thread. The affinity goes by
+ *	its kernel tid (0 for the caller): bionic has no pthread_*affinity_np.
+ *********************************************************************************
+ */
+
+static int applyPolicy (pthread_t thread, int tid, const struct WPIThreadPolicy *policy)
+{
+  struct sched_param sched ;
+  cpu_set_t cpus ;
+  int ret = 0 ;
+  int cpu ;
+
+  memset (&sched, 0, sizeof (sched)) ;
+  sched.sched_priority = policy->priority ;
+
+  if (sched.sched_priority > sched_get_priority_max (policy->policy))
+    sched.sched_priority = sched_get_priority_max (policy->policy) ;
+  if (sched.sched_priority < sched_get_priority_min (policy->policy))
+    sched.sched_priority = sched_get_priority_min (policy->policy) ;
+
+  if (pthread_setschedparam (thread, policy->policy, &sched) != 0)
+    ret = -1 ;
+
+  if (policy->cpuMask != 0)
+  {
+    CPU_ZERO (&cpus) ;
+    for (cpu = 0 ; cpu < 64 ; ++cpu)
+      if (policy->cpuMask & (1ULL << cpu))
+        CPU_SET (cpu, &cpus) ;
+
+    if (sched_setaffinity (tid, sizeof (cpus), &cpus) != 0)
+      ret = -1 ;
+  }
+
+  return ret ;
+}
+
+
+/*
+ * parsePolicy:
+ *	One WIRINGPI_THREADS entry without the class: [policy[:priority]][@cpus]
+ *********************************************************************************
+ */
+
+static int parsePolicy (const char *text, struct WPIThreadPolicy *policy)
+{
+  const char *at = strchr (text, '@') ;
+  char *end ;
+  long first, last ;
+
+  /**/ if (strncmp (text, "fifo", 4) == 0)  { policy->policy = SCHED_FIFO  ; text += 4 ; }
+  else if (strncmp (text, "rr", 2) == 0)    { policy->policy = SCHED_RR    ; text += 2 ; }
+  else if (strncmp (text, "other", 5) == 0) { policy->policy = SCHED_OTHER ; text += 5 ; }
+
+  if (*text == ':')
+  {
+    policy->priority = (int)strtol (text + 1, &end, 10) ;
+    text = end ;
+  }
+
+  if (text != ((at != NULL) ? at : text + strlen (text)))
+    return -1 ;
+
+  if (at == NULL)
+    return 0 ;
+
+  policy->cpuMask = 0 ;
+  for (text = at + 1 ; *text != 0 ; )
+  {
+    first = last = strtol (text, &end, 10) ;
+    if (end == text)
+      return -1 ;
+    if (*end == '-')
+    {
+      text = end + 1 ;
+      last = strtol (text, &end, 10) ;
+      if (end == text)
+        return -1 ;
+    }
+    if ((first < 0) || (last > 63) || (first > last))
+      return -1 ;
+    for ( ; first <= last ; ++first)
+      policy->cpuMask |= 1ULL << first ;
+
+    text = (*end == ',') ? end + 1 : end ;
+    if ((*end != ',') && (*end != 0))
+      return -1 ;
+  }
+
+  return 0 ;
+}
+
+
+/*
+ * threadInit:
+ *	Read the environment, once.
+ *********************************************************************************
+ */
+
+static void threadInit (void)
+{
+  char *env, *copy, *entry, *value, *save ;
+  struct WPIThreadPolicy policy ;
+  int i ;
+
+  if ((getenv (ENV_MLOCK) != NULL) && (piMemoryLock (TRUE) < 0))
+    perror ("wiringPi: " ENV_MLOCK) ;
+
+  if (((env = getenv (ENV_THREADS)) == NULL) || ((copy = strdup (env)) == NULL))
+    return ;
+
+  for (entry = strtok_r (copy, " \t;", &save) ; entry != NULL ; entry = strtok_r (NULL, " \t;", &save))
+  {
+    if ((value = strchr (entry, '=')) == NULL)
+    {
+      fprintf (stderr, "wiringPi: " ENV_THREADS ": can't understand \"%s\"\n", entry) ;
+      continue ;
+    }
+    *value++ = 0 ;
+
+    for (i = 0 ; i < WPI_THREAD_CLASSES ; ++i)
+    {
+      if ((strcmp (entry, "all") != 0) && (strcmp (entry, classNames [i]) != 0))
+        continue ;
+
+      policy = configured [i] ? policies [i] : (struct WPIThreadPolicy){ SCHED_OTHER, 0, 0 } ;
+      if (parsePolicy (value, &policy) < 0)
+      {
+        fprintf (stderr, "wiringPi: " ENV_THREADS ": can't understand \"%s\"\n", value) ;
+        break ;
+      }
+      policies   [i] = policy ;
+      configured [i] = TRUE ;
+    }
+  }
+
+  free (copy) ;
+}
+
+
+/*
+ * piThreadSetPolicy: piThreadGetPolicy:
+ *	Set the policy for a class of threads, including the ones already
+ *	running. NULL goes back to the built-in priority for threads started
+ *	from now on. Setting a realtime policy needs root (or CAP_SYS_NICE).
+ *	Get returns FALSE if the class has no policy set.
+ *********************************************************************************
+ */
+
+int piThreadSetPolicy (enum WPIThreadClass threadClass, const struct WPIThreadPolicy *policy)
+{
+  int ret = 0 ;
+  int i ;
+
+  if (((int)threadClass < 0) || (threadClass >= WPI_THREAD_CLASSES))
+    return -1 ;
+
+  if ((policy != NULL) && (policy->policy != SCHED_OTHER) && (policy->policy != SCHED_FIFO) && (policy->policy != SCHED_RR))
+    return -1 ;
+
+  pthread_once (&threadOnce, threadInit) ;
+
+  pthread_mutex_lock (&threadLock) ;
+
+  if (policy == NULL)
+    configured [threadClass] = FALSE ;
+  else
+  {
+    policies   [threadClass] = *policy ;
+    configured [threadClass] = TRUE ;
+
+    for (i = 0 ; i < MAX_THREADS ; ++i)
+      if (threads [i].used && (threads [i].threadClass == threadClass))
+        if (applyPolicy (threads [i].thread, threads [i].tid, policy) < 0)
+          ret = -1 ;
+  }
+
+  pthread_mutex_unlock (&threadLock) ;
+
+  return ret ;
+}
+
+int piThreadGetPolicy (enum WPIThreadClass threadClass, struct WPIThreadPolicy *policy)
+{
+  int ret ;
+
+  if (((int)threadClass < 0) || (threadClass >= WPI_THREAD_CLASSES))
+    return FALSE ;
+
+  pthread_once (&threadOnce, threadInit) ;
+
+  pthread_mutex_lock (&threadLock) ;
+    if ((ret = configured [threadClass]))
+      *policy = policies [threadClass] ;
+  pthread_mutex_unlock (&threadLock) ;
+
+  return ret ;
+}
+
+
+/*
+ * piMemoryLock:
+ *	Lock all current and future memory of the process, so the timing
+ *	threads don't stall on page faults. Needs root (or CAP_IPC_LOCK).
+ *********************************************************************************
+ */
+
+int piMemoryLock (int lock)
+{
+  if (lock)
+    return mlockall (MCL_CURRENT | MCL_FUTURE) ;
+  else
+    return munlockall () ;
+}
+
+
+/*
+ * piThreadEnter: piThreadExit:
+ *	Called by each thread wiringPi starts, first thing and just before
+ *	it returns. Without a policy for its class the thread gets
+ *	piHiPri (defaultPri) as before, or is left alone if that's 0.
+ *********************************************************************************
+ */
+
+int piThreadEnter (enum WPIThreadClass threadClass, int defaultPri)
+{
+  struct WPIThreadPolicy policy ;
+  int havePolicy = FALSE ;
+  int i ;
+
+  pthread_once (&threadOnce, threadInit) ;
+
+  pthread_mutex_lock (&threadLock) ;
+
+  for (i = 0 ; (i < MAX_THREADS) && threads [i].used ; ++i)
+    ;
+
+  if (i < MAX_THREADS)
+  {
+    memset (&threads [i], 0, sizeof (struct threadEntry)) ;
+    threads [i].used        = TRUE ;
+    threads [i].thread      = pthread_self () ;
+    threads [i].tid         = (int)syscall (SYS_gettid) ;
+    threads [i].threadClass = threadClass ;
+    self = &threads [i] ;
+  }
+
+  if ((threadClass >= 0) && (threadClass < WPI_THREAD_CLASSES) && configured [threadClass])
+  {
+    policy = policies [threadClass] ;
+    havePolicy  = TRUE ;
+  }
+
+  pthread_mutex_unlock (&threadLock) ;
+
+  if (havePolicy)
+    return applyPolicy (pthread_self (), 0, &policy) ;
+
+  if (defaultPri > 0)
+    return piHiPri (defaultPri) ;
+
+  return 0 ;
+}
+
+void piThreadExit (void)
+{
+  if (self == NULL)
+    return ;
+
+  pthread_mutex_lock (&threadLock) ;
+    self->used = FALSE ;
+    self = NULL ;
+  pthread_mutex_unlock (&threadLock) ;
+}
+
+
+/*
+ * piThreadWokeUp:
+ *	A thread tells us how long after its deadline it got going again.
+ *********************************************************************************
+ */
+
+void piThreadWokeUp (long long int late_ns)
+{
+  struct threadEntry *t = self ;
+
+  if (t == NULL)
+    return ;
+
+  if (__atomic_load_n (&t->resetRequest, __ATOMIC_RELAXED))
+  {
+    __atomic_store_n (&t->resetRequest, FALSE, __ATOMIC_RELAXED) ;
+    __atomic_store_n (&t->wakeUps, 0, __ATOMIC_RELAXED) ;
+  }
+
+  if (t->wakeUps == 0)
+  {
+    __atomic_store_n (&t->latencySum, 0, __ATOMIC_RELAXED) ;
+    __atomic_store_n (&t->latencyMin, late_ns, __ATOMIC_RELAXED) ;
+    __atomic_store_n (&t->latencyMax, late_ns, __ATOMIC_RELAXED) ;
+  }
+
+  if (late_ns < t->latencyMin) __atomic_store_n (&t->latencyMin, late_ns, __ATOMIC_RELAXED) ;
+  if (late_ns > t->latencyMax) __atomic_store_n (&t->latencyMax, late_ns, __ATOMIC_RELAXED) ;
+  __atomic_store_n (&t->latencySum, t->latencySum + late_ns, __ATOMIC_RELAXED) ;
+  __atomic_store_n (&t->wakeUps,    t->wakeUps + 1,          __ATOMIC_RELAXED) ;
+}
+
+
+/*
+ * piThreadList:
+ *	Fill in up to max entries, one per running wiringPi thread, with
+ *	what it's really running with and its wake-up latency so far.
+ *	reset starts the latency figures afresh. Returns the number filled.
+ *********************************************************************************
+ */
+
+int piThreadList (struct WPIThreadInfo *info, int max, int reset)
+{
+  struct sched_param sched ;
+  cpu_set_t cpus ;
+  unsigned long long wakeUps ;
+  int count = 0 ;
+  int i, cpu ;
+
+  pthread_mutex_lock (&threadLock) ;
+
+  for (i = 0 ; (i < MAX_THREADS) && (count < max) ; ++i)
+  {
+    if (!threads [i].used)
+      continue ;
+
+    memset (&info [count], 0, sizeof (struct WPIThreadInfo)) ;
+    info [count].threadClass = threads [i].threadClass ;
+    info [count].tid         = threads [i].tid ;
+
+    if (pthread_getschedparam (threads [i].thread, &info [count].policy, &sched) == 0)
+      info [count].priority = sched.sched_priority ;
+
+    if (sched_getaffinity (threads [i].tid, sizeof (cpus), &cpus) == 0)
+      for (cpu = 0 ; cpu < 64 ; ++cpu)
+        if (CPU_ISSET (cpu, &cpus))
+          info [count].cpuMask |= 1ULL << cpu ;
+
+    wakeUps = __atomic_load_n (&threads [i].wakeUps, __ATOMIC_RELAXED) ;
+    if (wakeUps > 0)
+    {
+      info [count].wakeUps       = wakeUps ;
+      info [count].latencyMin_ns = __atomic_load_n (&threads [i].latencyMin, __ATOMIC_RELAXED) ;
+      info [count].latencyMax_ns = __atomic_load_n (&threads [i].latencyMax, __ATOMIC_RELAXED) ;
+      info [count].latencyAvg_ns = __atomic_load_n (&threads [i].latencySum, __ATOMIC_RELAXED) / (long long int)wakeUps ;
+    }
+
+    if (reset)
+      __atomic_store_n (&threads [i].resetRequest, TRUE, __ATOMIC_RELAXED) ;
+
+    ++count ;
+  }
+
+  pthread_mutex_unlock (&threadLock) ;
+
+  return count ;
+}
@@ -32,16 +32,51 @@
  ***********************************************************************
  */
 
+/*
+ * Notes:
+ *	The pins live in a versioned bank in shared memory, guarded by a
+ *	sequence lock: a writer makes the sequence number odd, changes the
+ *	values and makes it even again, and readers retry if it changed under
+ *	them. Readers never block a writer and always see a consistent set of
+ *	pins - analogWrite of one pin or pseudoPinsWriteMany of several.
+ *	Writers take the bank by CAS-ing their pid into the writer word, so
+ *	any number of processes can write. A process that dies while it
+ *	holds the bank would leave everybody spinning, so whoever has waited
+ *	STALE_NS for it checks whether the writer's process is still there
+ *	and, if not, takes the bank over and makes the sequence even again.
+ *
+ *	Each pin records the sequence number of its last change, and every
+ *	write bumps a futex word, so pseudoPinsWait can sleep until one of a
+ *	set of pins changes instead of polling.
+ *
+ *	The bank is an ashmem region, or a memfd where there's no ashmem.
+ *	Other processes get at it through the fd from pseudoPinsFd, passed
+ *	on by fork, binder or a unix socket, and pseudoPinsSetupFd.
+ *********************************************************************************
+ */
+
 #define	SHARED_NAME	"wiringPiPseudoPins"
 #define	PSEUDO_PINS	64
 
+#define	BANK_MAGIC	0x50735062	// "bPsP"
+#define	BANK_LAYOUT	2
+
+#define	STALE_NS	10000000LL	// 10mS
+
 #include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <sched.h>
+#include <signal.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/mman.h>
-#include <fcntl.h>
-#include <stdint.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
 #include <fcntl.h>
 
 #include <wiringPi.h>
@@ -50,57 +85,410 @@
 
 #include <cutils/ashmem.h>
 
-static int myAnalogRead(struct wiringPiNodeStruct *node, int pin)
+struct pseudoPinBank
 {
-  int *ptr = (int *)(intptr_t)node->data0; // Cast to intptr_t to handle pointer-to-integer conversion
-  int myPin = pin - node->pinBase;
+  uint32_t magic ;
+  uint32_t layout ;
+  uint32_t seq ;				// Odd while being written
+  uint32_t changes ;				// Futex word, bumped by every write
+  uint32_t waiters ;
+  uint32_t writer ;				// pid holding the write side, or 0
+  int64_t  timeStamp_ns ;			// CLOCK_MONOTONIC of the last write
+  uint32_t changedAt [PSEUDO_PINS] ;		// seq of each pin's last change
+  int32_t  values    [PSEUDO_PINS] ;
+} ;
+
+#define	BANK(node)	((struct pseudoPinBank *)(node)->devData)
 
-  return *(ptr + myPin);
+
+static long futex (uint32_t *word, int op, uint32_t value, const struct timespec *timeout)
+{
+  return syscall (SYS_futex, word, op, value, timeout, NULL, 0) ;
 }
 
-static void myAnalogWrite(struct wiringPiNodeStruct *node, int pin, int value)
+static int64_t monoNanos (void)
 {
-  int *ptr = (int *)(intptr_t)node->data0;
-  int myPin = pin - node->pinBase;
+  struct timespec ts ;
 
-  *(ptr + myPin) = value;
+  clock_gettime (CLOCK_MONOTONIC, &ts) ;
+
+  return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec ;
 }
 
 
 /*
- * pseudoPinsSetup:
- *	Create a new wiringPi device node for the pseudoPins driver
+ * takeFromDead:
+ *	Called while waiting for the writer owner. Once every STALE_NS, if
+ *	its process has gone, try to take the bank over from it. TRUE if we
+ *	now hold the write side.
+ *********************************************************************************
+ */
+
+static int takeFromDead (struct pseudoPinBank *bank, uint32_t owner, int64_t *since)
+{
+  int64_t now = monoNanos () ;
+
+  if (*since == 0)
+    *since = now ;
+  if (now - *since < STALE_NS)
+    return FALSE ;
+  *since = now ;
+
+  if ((owner == 0) || (kill ((pid_t)owner, 0) == 0) || (errno != ESRCH))
+    return FALSE ;
+
+  return __atomic_compare_exchange_n (&bank->writer, &owner, (uint32_t)getpid (),
+                                      FALSE, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED) ;
+}
+
+
+/*
+ * lockBank: unlockBank:
+ *	Take the write side and make the sequence number odd - it already
+ *	is if a dead writer left it so. Returns the odd sequence number.
+ *	unlockBank publishes the even one that follows it.
+ *********************************************************************************
+ */
+
+static uint32_t lockBank (struct pseudoPinBank *bank)
+{
+  uint32_t me = (uint32_t)getpid () ;
+  uint32_t owner, seq ;
+  int64_t since = 0 ;
+
+  for (;;)
+  {
+    owner = 0 ;
+    if (__atomic_compare_exchange_n (&bank->writer, &owner, me, FALSE, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+      break ;
+    if (takeFromDead (bank, owner, &since))
+      break ;
+    sched_yield () ;
+  }
+
+  seq = __atomic_load_n (&bank->seq, __ATOMIC_RELAXED) ;
+  if ((seq & 1) == 0)
+    __atomic_store_n (&bank->seq, ++seq, __ATOMIC_RELAXED) ;
+  __atomic_thread_fence (__ATOMIC_RELEASE) ;
+
+  return seq ;
+}
+
+static void unlockBank (struct pseudoPinBank *bank, uint32_t seq)
+{
+  __atomic_store_n (&bank->seq,    seq + 1, __ATOMIC_RELEASE) ;
+  __atomic_store_n (&bank->writer, 0,       __ATOMIC_RELEASE) ;
+}
+
+
+/*
+ * bankWrite:
+ *	Write count values starting at bank pin first as one change.
+ *********************************************************************************
+ */
+
+static void bankWrite (struct pseudoPinBank *bank, int first, int count, const int *values)
+{
+  uint32_t seq ;
+  int i ;
+
+  seq = lockBank (bank) ;
+
+  for (i = 0 ; i < count ; ++i)
+  {
+    if (__atomic_load_n (&bank->values [first + i], __ATOMIC_RELAXED) == values [i])
+      continue ;
+    __atomic_store_n (&bank->values    [first + i], values [i], __ATOMIC_RELAXED) ;
+    __atomic_store_n (&bank->changedAt [first + i], seq + 1,    __ATOMIC_RELAXED) ;
+  }
+  __atomic_store_n (&bank->timeStamp_ns, monoNanos (), __ATOMIC_RELAXED) ;
+
+  unlockBank (bank, seq) ;
+
+  __atomic_add_fetch (&bank->changes, 1, __ATOMIC_RELEASE) ;
+  if (__atomic_load_n (&bank->waiters, __ATOMIC_ACQUIRE) != 0)
+    futex (&bank->changes, FUTEX_WAKE, INT_MAX, NULL) ;
+}
+
+
+/*
+ * bankRead:
+ *	Consistent copy of count pins starting at first; returns the
+ *	sequence number it's valid for. values, changedAt and timeStamp may
+ *	be NULL.
+ *********************************************************************************
+ */
+
+static uint32_t bankRead (struct pseudoPinBank *bank, int first, int count,
+                          int *values, uint32_t *changedAt, long long int *timeStamp_ns)
+{
+  uint32_t seq ;
+  int64_t since = 0 ;
+  int i ;
+
+  for (;;)
+  {
+    while ((seq = __atomic_load_n (&bank->seq, __ATOMIC_ACQUIRE)) & 1)
+    {
+      if (takeFromDead (bank, __atomic_load_n (&bank->writer, __ATOMIC_RELAXED), &since))
+        unlockBank (bank, __atomic_load_n (&bank->seq, __ATOMIC_RELAXED) | 1) ;
+      else
+        sched_yield () ;
+    }
+
+    for (i = 0 ; i < count ; ++i)
+    {
+      if (values != NULL)
+        values [i] = __atomic_load_n (&bank->values [first + i], __ATOMIC_RELAXED) ;
+      if (changedAt != NULL)
+        changedAt [i] = __atomic_load_n (&bank->changedAt [first + i], __ATOMIC_RELAXED) ;
+    }
+    if (timeStamp_ns != NULL)
+      *timeStamp_ns = __atomic_load_n (&bank->timeStamp_ns, __ATOMIC_RELAXED) ;
+
+    __atomic_thread_fence (__ATOMIC_ACQUIRE) ;
+    if (__atomic_load_n (&bank->seq, __ATOMIC_RELAXED) == seq)
+      return seq ;
+  }
+}
+
+
+static int myAnalogRead (struct wiringPiNodeStruct *node, int pin)
+{
+  return __atomic_load_n (&BANK (node)->values [pin - node->pinBase], __ATOMIC_ACQUIRE) ;
+}
+
+static void myAnalogWrite (struct wiringPiNodeStruct *node, int pin, int value)
+{
+  bankWrite (BANK (node), pin - node->pinBase, 1, &value) ;
+}
+
+
+/*
+ * findBank:
+ *	The pseudo pin node for pin, with pin .. pin + count - 1 on it.
+ *********************************************************************************
+ */
+
+static struct wiringPiNodeStruct *findBank (int pin, int count)
+{
+  struct wiringPiNodeStruct *node ;
+
+  if ((count <= 0) || ((node = wiringPiFindNode (pin)) == NULL))
+    return NULL ;
+
+  if ((node->analogRead != myAnalogRead) || (pin + count - 1 > node->pinMax))
+    return NULL ;
+
+  return node ;
+}
+
+
+/*
+ * pseudoPinsWriteMany:
+ *	Write count consecutive pins in one go; readers see all or none of
+ *	the new values.
+ *********************************************************************************
+ */
+
+int pseudoPinsWriteMany (const int pin, const int count, const int *values)
+{
+  struct wiringPiNodeStruct *node ;
+
+  if ((node = findBank (pin, count)) == NULL)
+    return -1 ;
+
+  bankWrite (BANK (node), pin - node->pinBase, count, values) ;
+
+  return 0 ;
+}
+
+
+/*
+ * pseudoPinsSnapshot:
+ *	Consistent copy of count consecutive pins, with the time of the last
+ *	write to the bank (CLOCK_MONOTONIC nS, may be NULL). Returns the
+ *	bank's sequence number for pseudoPinsWait, or -1.
  *********************************************************************************
  */
 
+long long int pseudoPinsSnapshot (const int pin, const int count, int *values, long long int *timeStamp_ns)
+{
+  struct wiringPiNodeStruct *node ;
+
+  if ((node = findBank (pin, count)) == NULL)
+    return -1 ;
+
+  return bankRead (BANK (node), pin - node->pinBase, count, values, NULL, timeStamp_ns) ;
+}
+
 
-int pseudoPinsSetup(const int pinBase)
+/*
+ * pseudoPinsWait:
+ *	Wait until one of the pins in mask (bit 0 being pinBase) has changed
+ *	since sequence number seq, e.g. from pseudoPinsSnapshot. timeoutMs < 0
+ *	waits forever. The pins that changed go into *changed.
+ *	Returns TRUE, FALSE on timeout or -1.
+ *********************************************************************************
+ */
+
+int pseudoPinsWait (const int pinBase, const unsigned long long mask, const long long int seq, const int timeoutMs,
+                    unsigned long long *changed)
 {
-    struct wiringPiNodeStruct *node;
-    void *ptr;
+  struct wiringPiNodeStruct *node ;
+  struct pseudoPinBank *bank ;
+  uint32_t changedAt [PSEUDO_PINS] ;
+  uint32_t changes ;
+  struct timespec timeout ;
+  int64_t deadline = 0, left ;
+  int ret = FALSE ;
+  int i ;
+
+  if (((node = findBank (pinBase, 1)) == NULL) || (node->pinBase != pinBase) || (seq < 0))
+    return -1 ;
+
+  bank = BANK (node) ;
+  if (timeoutMs >= 0)
+    deadline = monoNanos () + (int64_t)timeoutMs * 1000000LL ;
+
+  __atomic_add_fetch (&bank->waiters, 1, __ATOMIC_ACQ_REL) ;
 
-    node = wiringPiNewNode(pinBase, PSEUDO_PINS);
-    if (node == NULL) {
-      fprintf(stderr, "Error creating new wiringPi node");
-      return FALSE;
+  for (;;)
+  {
+    changes = __atomic_load_n (&bank->changes, __ATOMIC_ACQUIRE) ;
+
+    (void)bankRead (bank, 0, PSEUDO_PINS, NULL, changedAt, NULL) ;
+    *changed = 0 ;
+    for (i = 0 ; i < PSEUDO_PINS ; ++i)
+      if ((mask & (1ULL << i)) && ((int32_t)(changedAt [i] - (uint32_t)seq) > 0))
+        *changed |= 1ULL << i ;
+
+    if (*changed != 0)
+    {
+      ret = TRUE ;
+      break ;
     }
 
-     node->fd = ashmem_create_region("wiringPiPseudoPins", PSEUDO_PINS * sizeof(int));
-    if (node->fd < 0) {
-        perror("Error creating ashmem region");
-        return FALSE;
+    if (timeoutMs >= 0)
+    {
+      if ((left = deadline - monoNanos ()) <= 0)
+        break ;
+      timeout.tv_sec  = left / 1000000000LL ;
+      timeout.tv_nsec = left % 1000000000LL ;
     }
 
-    ptr = mmap(NULL, PSEUDO_PINS * sizeof(int), PROT_READ | PROT_WRITE, MAP_SHARED, node->fd, 0);
-    if (ptr == MAP_FAILED) {
-      perror("Error mapping shared memory");
-      return FALSE;
+    if ((futex (&bank->changes, FUTEX_WAIT, changes, (timeoutMs >= 0) ? &timeout : NULL) < 0) &&
+        (errno != EAGAIN) && (errno != EINTR) && (errno != ETIMEDOUT))
+    {
+      ret = -1 ;
+      break ;
+    }
+  }
+
+  __atomic_sub_fetch (&bank->waiters, 1, __ATOMIC_ACQ_REL) ;
+
+  return ret ;
+}
+
+
+/*
+ * pseudoPinsFd:
+ *	The shared memory fd of the bank, to hand to another process.
+ *********************************************************************************
+ */
+
+int pseudoPinsFd (const int pinBase)
+{
+  struct wiringPiNodeStruct *node ;
+
+  if ((node = findBank (pinBase, 1)) == NULL)
+    return -1 ;
+
+  return node->fd ;
+}
+
+
+/*
+ * pseudoPinsSetupFd:
+ *	Create a new wiringPi device node on a bank another process has set
+ *	up, or a new bank if fd is < 0.
+ *********************************************************************************
+ */
+
+int pseudoPinsSetupFd (const int pinBase, int fd)
+{
+  struct wiringPiNodeStruct *node ;
+  struct pseudoPinBank *bank ;
+  struct stat st ;
+  int created = FALSE ;
+
+  if (fd < 0)
+  {
+    created = TRUE ;
+    if ((fd = ashmem_create_region (SHARED_NAME, sizeof (struct pseudoPinBank))) < 0)
+    {
+      if (((fd = syscall (SYS_memfd_create, SHARED_NAME, 0)) < 0) ||
+          (ftruncate (fd, sizeof (struct pseudoPinBank)) < 0))
+      {
+        perror ("Error creating shared memory region") ;
+        if (fd >= 0)
+          close (fd) ;
+        return FALSE ;
+      }
     }
+  }
+  else if ((fstat (fd, &st) == 0) && S_ISREG (st.st_mode) && (st.st_size < (off_t)sizeof (struct pseudoPinBank)))
+  {
+    fprintf (stderr, "pseudoPinsSetupFd: shared memory region too small\n") ;
+    return FALSE ;
+  }
+
+  bank = mmap (NULL, sizeof (struct pseudoPinBank), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) ;
+  if (bank == MAP_FAILED)
+  {
+    perror ("Error mapping shared memory") ;
+    if (created)
+      close (fd) ;
+    return FALSE ;
+  }
+
+  if (created)
+  {
+    bank->magic  = BANK_MAGIC ;
+    bank->layout = BANK_LAYOUT ;
+  }
+  else if ((bank->magic != BANK_MAGIC) || (bank->layout != BANK_LAYOUT))
+  {
+    fprintf (stderr, "pseudoPinsSetupFd: not a pseudo pin bank (or a different version)\n") ;
+    munmap (bank, sizeof (struct pseudoPinBank)) ;
+    return FALSE ;
+  }
+
+  if ((node = wiringPiNewNode (pinBase, PSEUDO_PINS)) == NULL)
+  {
+    fprintf (stderr, "Error creating new wiringPi node") ;
+    munmap (bank, sizeof (struct pseudoPinBank)) ;
+    if (created)
+      close (fd) ;
+    return FALSE ;
+  }
 
-    node->data0 = (unsigned int)(uintptr_t)ptr;
+  node->fd          = fd ;
+  node->devData     = bank ;
+  node->analogRead  = myAnalogRead ;
+  node->analogWrite = myAnalogWrite ;
+
+  return TRUE ;
+}
 
-    node->analogRead = myAnalogRead;
-    node->analogWrite = myAnalogWrite;
 
-    return TRUE;
+/*
+ * pseudoPinsSetup:
+ *	Create a new wiringPi device node for the pseudoPins driver
+ *********************************************************************************
+ */
+
+int pseudoPinsSetup (const int pinBase)
+{
+  return pseudoPinsSetupFd (pinBase, -1) ;
 }
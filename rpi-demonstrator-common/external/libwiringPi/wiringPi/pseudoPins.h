@@ -23,4 +23,11 @@
  ***********************************************************************
  */
 
-extern int pseudoPinsSetup (const int pinBase) ;
+extern int pseudoPinsSetup   (const int pinBase) ;
+extern int pseudoPinsSetupFd (const int pinBase, int fd) ;
+extern int pseudoPinsFd      (const int pinBase) ;
+
+extern int           pseudoPinsWriteMany (const int pin, const int count, const int *values) ;
+extern long long int pseudoPinsSnapshot  (const int pin, const int count, int *values, long long int *timeStamp_ns) ;
+extern int           pseudoPinsWait      (const int pinBase, const unsigned long long mask, const long long int seq, const int timeoutMs,
+                                          unsigned long long *changed) ;
@@ -22,14 +22,42 @@
  ***********************************************************************
  */
 
+/*
+ * Notes:
+ *	The sensor answers a start pulse with an 80uS low, 80uS high response
+ *	and then 40 bits, each a 50uS low followed by a high of 26-28uS for
+ *	a 0 or 70uS for a 1.
+ *	Rather than timing that with digitalRead in a busy loop, the data line
+ *	is requested from the gpio chardev with both-edge events and a
+ *	buffer big enough for the whole frame. We sleep while the kernel
+ *	timestamps the edges, then decode the bit widths after the fact.
+ *	If the chardev can't be used, it falls back to the old bit-banging.
+ *********************************************************************************
+ */
+
 #include <sys/time.h>
+#include <sys/ioctl.h>
+#include <poll.h>
 #include <stdio.h>
-#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
 #include <time.h>
+#include <linux/gpio.h>
 
 #include "wiringPi.h"
 #include "rht03.h"
 
+// Widths in nS
+
+#define	BIT_ONE_MIN	 50000	// 0 is 26-28uS, 1 is 70uS
+#define	BIT_MAX		100000
+#define	RESPONSE_MIN	 60000	// 80uS
+#define	RESPONSE_MAX	100000
+
+// How long past the frame to wait for its edges, in mS
+
+#define	EDGE_TIMEOUT	    20
+
 /*
  * maxDetectLowHighWait:
  *	Wait for a transition from low to high on the bus
@@ -165,24 +193,14 @@ static int maxDetectRead (const int pin, unsigned char buffer [4])
 
 
 /*
- * myReadRHT03:
- *	Read the Temperature & Humidity from an RHT03 sensor
+ * toValues:
+ *	Temperature & Humidity out of the 4 data bytes.
  *	Values returned are *10, so 123 is 12.3.
  *********************************************************************************
  */
 
-static int myReadRHT03 (const int pin, int *temp, int *rh)
+static int toValues (const unsigned char buffer [4], int *temp, int *rh)
 {
-  int result ;
-  unsigned char buffer [4] ;
-
-// Read ...
-  
-  result = maxDetectRead (pin, buffer) ;
-
-  if (!result)
-    return FALSE ;
-
   *rh   = (buffer [0] * 256 + buffer [1]) ;
   *temp = (buffer [2] * 256 + buffer [3]) ;
 
@@ -202,6 +220,173 @@ static int myReadRHT03 (const int pin, int *temp, int *rh)
 }
 
 
+/*
+ * rht03DecodeEdges:
+ *	Decode one frame from the line's edges. The data bits are the last
+ *	40 high pulses (rising edge followed by a falling one), and the
+ *	80uS response has to come right before them - so a lost edge
+ *	can't shift the frame by a bit.
+ *********************************************************************************
+ */
+
+int rht03DecodeEdges (const struct rht03Edge *edges, int count, int *temp, int *rh)
+{
+  long long int widths [RHT03_MAX_EDGES / 2] ;
+  unsigned char data [5] ;
+  unsigned int  checksum ;
+  int numWidths = 0 ;
+  int i, first ;
+
+  for (i = 0 ; (i + 1) < count ; ++i)
+    if (edges [i].rising && !edges [i + 1].rising && (numWidths < (RHT03_MAX_EDGES / 2)))
+      widths [numWidths++] = edges [i + 1].timeStamp_ns - edges [i].timeStamp_ns ;
+
+  if (numWidths < 41)
+    return FALSE ;
+
+  first = numWidths - 40 ;
+
+  if ((widths [first - 1] < RESPONSE_MIN) || (widths [first - 1] > RESPONSE_MAX))
+    return FALSE ;
+
+  memset (data, 0, sizeof (data)) ;
+  for (i = 0 ; i < 40 ; ++i)
+  {
+    if ((widths [first + i] <= 0) || (widths [first + i] > BIT_MAX))
+      return FALSE ;
+    data [i / 8] <<= 1 ;
+    if (widths [first + i] >= BIT_ONE_MIN)
+      data [i / 8] |= 1 ;
+  }
+
+  checksum = (data [0] + data [1] + data [2] + data [3]) & 0xFF ;
+  if (checksum != data [4])
+    return FALSE ;
+
+  return toValues (data, temp, rh) ;
+}
+
+
+/*
+ * readEdges:
+ *	Send the start pulse and collect the frame's edges from the gpio
+ *	chardev. Returns the number of edges, or -1 if the line can't be
+ *	requested that way or no edges turned up.
+ *********************************************************************************
+ */
+
+static int readEdges (const int gpio, struct rht03Edge *edges)
+{
+  struct gpio_v2_line_request req ;
+  struct gpio_v2_line_config  config ;
+  struct gpio_v2_line_values  values ;
+  struct gpio_v2_line_event   events [RHT03_MAX_EDGES] ;
+  struct pollfd pfd ;
+  int chipFd, len, count, i ;
+
+  if ((gpio < 0) || ((chipFd = wiringPiGpioDeviceGetFd ()) < 0))
+    return -1 ;
+
+// Line as open drain output, released (high)
+
+  memset (&req, 0, sizeof (req)) ;
+  req.offsets [0]       = gpio ;
+  req.num_lines         = 1 ;
+  req.event_buffer_size = RHT03_MAX_EDGES ;
+  strcpy (req.consumer, "wiringPi rht03") ;
+  req.config.flags      = GPIO_V2_LINE_FLAG_OUTPUT | GPIO_V2_LINE_FLAG_OPEN_DRAIN | GPIO_V2_LINE_FLAG_BIAS_PULL_UP ;
+  req.config.num_attrs  = 1 ;
+  req.config.attrs [0].attr.id     = GPIO_V2_LINE_ATTR_ID_OUTPUT_VALUES ;
+  req.config.attrs [0].attr.values = 1 ;
+  req.config.attrs [0].mask        = 1 ;
+
+  if ((ioctl (chipFd, GPIO_V2_GET_LINE_IOCTL, &req) < 0) || (req.fd < 0))
+    return -1 ;
+
+// Wake up the RHT03 by pulling the data line low for 10mS, then turn
+//	it into an input watching both edges. That releases the line, and
+//	the sensor answers 20-40uS later.
+
+  values.mask = 1 ;
+  values.bits = 0 ;
+  if (ioctl (req.fd, GPIO_V2_LINE_SET_VALUES_IOCTL, &values) < 0)
+  {
+    close (req.fd) ;
+    return -1 ;
+  }
+
+  delay (10) ;
+
+  memset (&config, 0, sizeof (config)) ;
+  config.flags = GPIO_V2_LINE_FLAG_INPUT | GPIO_V2_LINE_FLAG_BIAS_PULL_UP |
+                 GPIO_V2_LINE_FLAG_EDGE_RISING | GPIO_V2_LINE_FLAG_EDGE_FALLING ;
+
+  if (ioctl (req.fd, GPIO_V2_LINE_SET_CONFIG_IOCTL, &config) < 0)
+  {
+    close (req.fd) ;
+    return -1 ;
+  }
+
+// The frame takes about 5mS at most, the kernel queues all the edges.
+//	With no sensor there may be none at all, so don't block on the read.
+
+  delay (8) ;
+
+  pfd.fd     = req.fd ;
+  pfd.events = POLLIN ;
+  if (poll (&pfd, 1, EDGE_TIMEOUT) <= 0)
+  {
+    close (req.fd) ;
+    return -1 ;
+  }
+
+  len = read (req.fd, events, sizeof (events)) ;
+  close (req.fd) ;
+
+  if (len < 0)
+    return 0 ;
+
+  count = len / sizeof (events [0]) ;
+  for (i = 0 ; i < count ; ++i)
+  {
+    edges [i].timeStamp_ns = events [i].timestamp_ns ;
+    edges [i].rising       = events [i].id == GPIO_V2_LINE_EVENT_RISING_EDGE ;
+  }
+
+  return count ;
+}
+
+
+/*
+ * myReadRHT03:
+ *	Read the Temperature & Humidity from an RHT03 sensor
+ *	Values returned are *10, so 123 is 12.3.
+ *********************************************************************************
+ */
+
+static int myReadRHT03 (const int pin, int *temp, int *rh)
+{
+  struct rht03Edge edges [RHT03_MAX_EDGES] ;
+  unsigned char buffer [4] ;
+  int count, ok ;
+
+  if ((count = readEdges (wiringPiPinToGpio (pin), edges)) >= 0)
+    return rht03DecodeEdges (edges, count, temp, rh) ;
+
+// No chardev or no edges: time it ourselves. pinMode holds a line
+//	handle on the pin from then on, which would make the next
+//	readEdges fail with EBUSY, so let go of it again.
+  
+  ok = maxDetectRead (pin, buffer) ;
+  pinMode (pin, PM_OFF) ;
+
+  if (!ok)
+    return FALSE ;
+
+  return toValues (buffer, temp, rh) ;
+}
+
+
 /*
  * myAnalogRead:
  *********************************************************************************
@@ -22,4 +22,23 @@
  ***********************************************************************
  */
 
-extern int rht03Setup (const int pinBase, const int devicePin) ;
+// Edges of the data line, as timestamped by the kernel
+
+#define	RHT03_MAX_EDGES	128
+
+struct rht03Edge
+{
+  long long int timeStamp_ns ;
+  int           rising ;
+} ;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern int rht03Setup       (const int pinBase, const int devicePin) ;
+extern int rht03DecodeEdges (const struct rht03Edge *edges, int count, int *temp, int *rh) ;
+
+#ifdef __cplusplus
+}
+#endif
@@ -52,11 +52,19 @@
 
 #define	PULSE_TIME	39
 
-static volatile int marks         [MAX_PINS] ;
-static volatile int range         [MAX_PINS] ;
-static volatile pthread_t threads [MAX_PINS] ;
-static volatile int stopFlag[MAX_PINS] = {0};
-static volatile int newPin = -1 ;
+// marks and range are written by the API and read by the threads, each
+//	one a single atomic load/store. The rest only changes under pwmLock.
+//	pwmLock is never held across pinMode or pthread_join: pinMode calls
+//	softPwmStop, and a stopping pin keeps its range until its thread has
+//	gone so a new thread can't be started on it meanwhile.
+
+static int       marks    [MAX_PINS] ;
+static int       range    [MAX_PINS] ;
+static int       stopFlag [MAX_PINS] ;
+static int       stopping [MAX_PINS] ;
+static pthread_t threads  [MAX_PINS] ;
+
+static pthread_mutex_t pwmLock = PTHREAD_MUTEX_INITIALIZER ;
 
 
 /*
@@ -68,26 +76,20 @@ static volatile int newPin = -1 ;
 static void *softPwmThread (void *arg)
 {
   int pin, mark, space ;
-  struct sched_param param ;
-
-  param.sched_priority = sched_get_priority_max (SCHED_RR) ;
-  pthread_setschedparam (pthread_self (), SCHED_RR, &param) ;
+  unsigned long long start ;
 
   pin = *((int *)arg) ;
   free (arg) ;
 
-  pin    = newPin ;
-  newPin = -1 ;
-
-  piHiPri (90) ;
+  piThreadEnter (WPI_THREAD_SOFTPWM, 90) ;
 
   for (;;)
   {
-    if (stopFlag[pin])  // Check if the stop flag is set
+    if (__atomic_load_n (&stopFlag [pin], __ATOMIC_ACQUIRE))  // Check if the stop flag is set
       break;  // Exit the loop if the stop flag is set
 
-    mark  = marks [pin] ;
-    space = range [pin] - mark ;
+    mark  = __atomic_load_n (&marks [pin], __ATOMIC_RELAXED) ;
+    space = __atomic_load_n (&range [pin], __ATOMIC_RELAXED) - mark ;
 
     if (mark != 0)
       digitalWrite (pin, HIGH) ;
@@ -95,9 +97,14 @@ static void *softPwmThread (void *arg)
 
     if (space != 0)
       digitalWrite (pin, LOW) ;
+
+    start = piMicros64 () ;
     delayMicroseconds (space * PULSE_TIME) ;
+    piThreadWokeUp ((long long int)(piMicros64 () - start - space * PULSE_TIME) * 1000) ;
   }
 
+  piThreadExit () ;
+
   return NULL ;
 }
 
@@ -110,37 +117,41 @@ static void *softPwmThread (void *arg)
 
 void softPwmWrite (int pin, int value)
 {
-  if (pin < MAX_PINS)
+  int pwmRange ;
+
+  if ((pin >= 0) && (pin < MAX_PINS))
   {
+    pwmRange = __atomic_load_n (&range [pin], __ATOMIC_RELAXED) ;
+
     /**/ if (value < 0)
       value = 0 ;
-    else if (value > range [pin])
-      value = range [pin] ;
+    else if (value > pwmRange)
+      value = pwmRange ;
 
-    marks [pin] = value ;
+    __atomic_store_n (&marks [pin], value, __ATOMIC_RELAXED) ;
   }
 }
 
 
 /*
  * softPwmCreate:
- *	Create a new softPWM thread.
+ *	Create a new softPWM thread. The pin is handed to the thread as its
+ *	argument, so there's nothing to wait for.
  *********************************************************************************
  */
 
 int softPwmCreate (int pin, int initialValue, int pwmRange)
 {
   int res ;
-  pthread_t myThread ;
   int *passPin ;
 
-  if (pin >= MAX_PINS)
+  if ((pin < 0) || (pin >= MAX_PINS))
     return -1 ;
 
-  if (range [pin] != 0)	// Already running on this pin
+  if (pwmRange <= 0)
     return -1 ;
 
-  if (pwmRange <= 0)
+  if (__atomic_load_n (&range [pin], __ATOMIC_RELAXED) != 0)	// Already running on this pin
     return -1 ;
 
   passPin = malloc (sizeof (*passPin)) ;
@@ -150,21 +161,29 @@ int softPwmCreate (int pin, int initialValue, int pwmRange)
   digitalWrite (pin, LOW) ;
   pinMode      (pin, OUTPUT) ;
 
-  stopFlag[pin] = 0;
-  marks [pin] = initialValue ;
-  range [pin] = pwmRange ;
+  pthread_mutex_lock (&pwmLock) ;
+
+  if (range [pin] != 0)		// Somebody else got there first
+  {
+    pthread_mutex_unlock (&pwmLock) ;
+    free (passPin) ;
+    return -1 ;
+  }
+
+  __atomic_store_n (&stopFlag [pin], 0, __ATOMIC_RELAXED) ;
+  __atomic_store_n (&marks [pin], initialValue, __ATOMIC_RELAXED) ;
+  __atomic_store_n (&range [pin], pwmRange, __ATOMIC_RELAXED) ;
 
   *passPin = pin ;
-  newPin   = pin ;
-  res      = pthread_create (&myThread, NULL, softPwmThread, (void *)passPin) ;
+  res      = pthread_create (&threads [pin], NULL, softPwmThread, (void *)passPin) ;
 
   if (res != 0)
-    return res ;
-  
-  while (newPin != -1)
-    delay (1) ;
+  {
+    free (passPin) ;
+    __atomic_store_n (&range [pin], 0, __ATOMIC_RELAXED) ;
+  }
 
-  threads [pin] = myThread ;
+  pthread_mutex_unlock (&pwmLock) ;
 
   return res ;
 }
@@ -178,14 +197,28 @@ int softPwmCreate (int pin, int initialValue, int pwmRange)
 
 void softPwmStop (int pin)
 {
-  if (pin < MAX_PINS)
+  pthread_t thread ;
+
+  if ((pin < 0) || (pin >= MAX_PINS))
+    return ;
+
+  pthread_mutex_lock (&pwmLock) ;
+  if ((range [pin] == 0) || stopping [pin])	// Not running, or already being stopped
   {
-    if (range [pin] != 0)
-    {
-      stopFlag[pin] = 1;  // Signal the thread to stop
-      pthread_join   (threads [pin], NULL) ; // Wait for the thread to exit
-      range [pin] = 0 ; // Reset the range to indicate PWM has stopped
-      digitalWrite (pin, LOW) ; // Set the pin to LOW
-    }
+    pthread_mutex_unlock (&pwmLock) ;
+    return ;
   }
+  stopping [pin] = TRUE ;
+  thread         = threads [pin] ;
+  __atomic_store_n (&stopFlag [pin], 1, __ATOMIC_RELEASE) ;  // Signal the thread to stop
+  pthread_mutex_unlock (&pwmLock) ;
+
+  pthread_join (thread, NULL) ;		// Wait for the thread to exit
+
+  pthread_mutex_lock (&pwmLock) ;
+  __atomic_store_n (&range [pin], 0, __ATOMIC_RELAXED) ; // Reset the range to indicate PWM has stopped
+  stopping [pin] = FALSE ;
+  pthread_mutex_unlock (&pwmLock) ;
+
+  digitalWrite (pin, LOW) ; // Set the pin to LOW
 }
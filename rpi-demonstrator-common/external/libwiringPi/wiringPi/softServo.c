@@ -25,8 +25,6 @@
 
 //#include <stdio.h>
 #include <string.h>
-#include <time.h>
-#include <sys/time.h>
 #include <pthread.h>
 
 #include "wiringPi.h"
@@ -64,10 +62,68 @@
 //	If you want servo control for the Pi, then use the servoblaster kernel
 //	module.
 
+// The pulses are laid out on a timeline: all servos go high together
+//	at the start of a frame, and each distinct pulse width is one
+//	falling edge at an absolute time into the frame, clearing every
+//	servo with that width in a single masked write. The timeline is
+//	only rebuilt (sorted) when a width changes.
+
 #define	MAX_SERVOS	8
+#define	FRAME_TIME	8000	// uS
+
+struct servoEdge
+{
+  int          width ;		// uS from the start of the frame
+  unsigned int mask ;		// GPIOs to clear
+} ;
 
-static int pinMap     [MAX_SERVOS] ;	// Keep track of our pins
+static int pinMap     [MAX_SERVOS] =	// Keep track of our pins
+  { -1, -1, -1, -1, -1, -1, -1, -1 } ;
+static int gpioMap    [MAX_SERVOS] ;	// ... as native GPIO numbers
 static int pulseWidth [MAX_SERVOS] ;	// microseconds
+static int widthsChanged = TRUE ;
+
+
+/*
+ * buildTimeline:
+ *	Sort the servos' falling edges, shortest first, merging servos with
+ *	the same pulse width into one edge.
+ *********************************************************************************
+ */
+
+static int buildTimeline (struct servoEdge edges [MAX_SERVOS], unsigned int *allMask)
+{
+  int servo, width, i ;
+  int numEdges = 0 ;
+  unsigned int mask ;
+
+  *allMask = 0 ;
+
+  for (servo = 0 ; servo < MAX_SERVOS ; ++servo)
+  {
+    if (pinMap [servo] == -1)
+      continue ;
+
+    width = __atomic_load_n (&pulseWidth [servo], __ATOMIC_RELAXED) ;
+    mask  = 1u << gpioMap [servo] ;
+    *allMask |= mask ;
+
+    for (i = 0 ; (i < numEdges) && (edges [i].width < width) ; ++i)
+      ;
+
+    if ((i < numEdges) && (edges [i].width == width))
+      edges [i].mask |= mask ;
+    else
+    {
+      memmove (&edges [i + 1], &edges [i], (numEdges - i) * sizeof (struct servoEdge)) ;
+      edges [i].width = width ;
+      edges [i].mask  = mask ;
+      ++numEdges ;
+    }
+  }
+
+  return numEdges ;
+}
 
 
 /*
@@ -78,75 +134,41 @@ static int pulseWidth [MAX_SERVOS] ;	// microseconds
 
 static PI_THREAD (softServoThread)
 {
-  register int i, j, k, m, tmp ;
-  int lastDelay, pin, servo ;
+  struct servoEdge edges [MAX_SERVOS] ;
+  unsigned int allMask = 0 ;
+  unsigned long long frame, now ;
+  int numEdges = 0 ;
+  int i ;
 
-  int myDelays [MAX_SERVOS] ;
-  int myPins   [MAX_SERVOS] ;
+  piThreadEnter (WPI_THREAD_SOFTSERVO, 50) ;
 
-  struct timeval  tNow, tStart, tPeriod, tGap, tTotal ;
-  struct timespec tNs ;
-
-  tTotal.tv_sec  =    0 ;
-  tTotal.tv_usec = 8000 ;
-
-  piHiPri (50) ;
+  frame = piMicros64 () ;
 
   for (;;)
   {
-    gettimeofday (&tStart, NULL) ;
-
-    memcpy (myDelays, pulseWidth, sizeof (myDelays)) ;
-    memcpy (myPins,   pinMap,     sizeof (myPins)) ;
-
-// Sort the delays (& pins), shortest first
-
-    for (m = MAX_SERVOS / 2 ; m > 0 ; m /= 2 )
-      for (j = m ; j < MAX_SERVOS ; ++j)
-	for (i = j - m ; i >= 0 ; i -= m)
-	{
-	  k = i + m ;
-	  if (myDelays [k] >= myDelays [i])
-	    break ;
-	  else // Swap
-	  {
-	    tmp = myDelays [i] ; myDelays [i] = myDelays [k] ; myDelays [k] = tmp ;
-	    tmp = myPins   [i] ; myPins   [i] = myPins   [k] ; myPins   [k] = tmp ;
-	  }
-	}
-
-// All on
-
-    lastDelay = 0 ;
-    for (servo = 0 ; servo < MAX_SERVOS ; ++servo)
-    {
-      if ((pin = myPins [servo]) == -1)
-	continue ;
+    if (__atomic_exchange_n (&widthsChanged, FALSE, __ATOMIC_ACQ_REL))
+      numEdges = buildTimeline (edges, &allMask) ;
 
-      digitalWrite (pin, HIGH) ;
-      myDelays [servo] = myDelays [servo] - lastDelay ;
-      lastDelay += myDelays [servo] ;
-    }
+// All on, then off edge by edge
 
-// Now loop, turning them all off as required
+    digitalWriteGpioMask (allMask, 0) ;
 
-    for (servo = 0 ; servo < MAX_SERVOS ; ++servo)
+    for (i = 0 ; i < numEdges ; ++i)
     {
-      if ((pin = myPins [servo]) == -1)
-	continue ;
-
-      delayMicroseconds (myDelays [servo]) ;
-      digitalWrite (pin, LOW) ;
+      delayUntilMicros64 (frame + edges [i].width) ;
+      digitalWriteGpioMask (0, edges [i].mask) ;
     }
 
-// Wait until the end of an 8mS time-slot
+// Wait until the end of an 8mS time-slot. If we've fallen behind, start
+//	afresh rather than sending a burst of short frames.
+
+    frame += FRAME_TIME ;
+    now    = piMicros64 () ;
+    if (frame < now)
+      frame = now ;
 
-    gettimeofday (&tNow, NULL) ;
-    timersub (&tNow, &tStart, &tPeriod) ;
-    timersub (&tTotal, &tPeriod, &tGap) ;
-    tNs.tv_sec  = tGap.tv_sec ;
-    tNs.tv_nsec = tGap.tv_usec * 1000 ;
-    nanosleep (&tNs, NULL) ;
+    delayUntilMicros64 (frame) ;
+    piThreadWokeUp ((long long int)(piMicros64 () - frame) * 1000) ;
   }
 
   return NULL ;
@@ -172,40 +194,56 @@ void softServoWrite (int servoPin, int value)
 
   for (servo = 0 ; servo < MAX_SERVOS ; ++servo)
     if (pinMap [servo] == servoPin)
-      pulseWidth [servo] = value + 1000 ; // uS
+    {
+      __atomic_store_n (&pulseWidth [servo], value + 1000, __ATOMIC_RELAXED) ; // uS
+      __atomic_store_n (&widthsChanged, TRUE, __ATOMIC_RELEASE) ;
+    }
 }
 
 
 /*
  * softServoSetup:
- *	Setup the software servo system
+ *	Setup the software servo system. The pins have to be on-board,
+ *	native GPIOs 0-31.
  *********************************************************************************
  */
 
 int softServoSetup (int p0, int p1, int p2, int p3, int p4, int p5, int p6, int p7)
 {
-  int servo ;
+  int pins  [MAX_SERVOS] = { p0, p1, p2, p3, p4, p5, p6, p7 } ;
+  int gpios [MAX_SERVOS] = { 0 } ;
+  int servo, res ;
+
+  for (servo = 0 ; servo < MAX_SERVOS ; ++servo)
+  {
+    if (pins [servo] == -1)
+      continue ;
 
-  if (p0 != -1) { pinMode (p0, OUTPUT) ; digitalWrite (p0, LOW) ; }
-  if (p1 != -1) { pinMode (p1, OUTPUT) ; digitalWrite (p1, LOW) ; }
-  if (p2 != -1) { pinMode (p2, OUTPUT) ; digitalWrite (p2, LOW) ; }
-  if (p3 != -1) { pinMode (p3, OUTPUT) ; digitalWrite (p3, LOW) ; }
-  if (p4 != -1) { pinMode (p4, OUTPUT) ; digitalWrite (p4, LOW) ; }
-  if (p5 != -1) { pinMode (p5, OUTPUT) ; digitalWrite (p5, LOW) ; }
-  if (p6 != -1) { pinMode (p6, OUTPUT) ; digitalWrite (p6, LOW) ; }
-  if (p7 != -1) { pinMode (p7, OUTPUT) ; digitalWrite (p7, LOW) ; }
-
-  pinMap [0] = p0 ;
-  pinMap [1] = p1 ;
-  pinMap [2] = p2 ;
-  pinMap [3] = p3 ;
-  pinMap [4] = p4 ;
-  pinMap [5] = p5 ;
-  pinMap [6] = p6 ;
-  pinMap [7] = p7 ;
+    gpios [servo] = wiringPiPinToGpio (pins [servo]) ;
+    if (((pins [servo] & PI_GPIO_MASK) != 0) || (gpios [servo] < 0) || (gpios [servo] > 31))
+      return -1 ;
+  }
 
   for (servo = 0 ; servo < MAX_SERVOS ; ++servo)
+    if (pins [servo] != -1)
+    {
+      pinMode      (pins [servo], OUTPUT) ;
+      digitalWrite (pins [servo], LOW) ;
+    }
+
+// The thread idles until the pins are published below
+
+  if ((res = piThreadCreate (softServoThread)) != 0)
+    return res ;
+
+  for (servo = 0 ; servo < MAX_SERVOS ; ++servo)
+  {
+    gpioMap    [servo] = gpios [servo] ;
     pulseWidth [servo] = 1500 ;		// Mid point
+    pinMap     [servo] = pins  [servo] ;
+  }
+
+  __atomic_store_n (&widthsChanged, TRUE, __ATOMIC_RELEASE) ;
   
-  return piThreadCreate (softServoThread) ;
+  return 0 ;
 }
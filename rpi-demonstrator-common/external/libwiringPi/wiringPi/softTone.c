@@ -26,7 +26,17 @@
  ***********************************************************************
  */
 
+/*
+ * Notes:
+ *	One thread runs the edges of all tone pins on a single timeline of
+ *	absolute deadlines. Pins toggling at the same time are written in
+ *	one masked write. With no tone playing the thread blocks on a
+ *	condition variable, so idle pins cost no wakeups at all.
+ *********************************************************************************
+ */
+
 #include <stdio.h>
+#include <time.h>
 #include <pthread.h>
 
 #include "wiringPi.h"
@@ -36,51 +46,127 @@
 
 #define	PULSE_TIME	100
 
+// Further away than this, wait on the condition variable (so a new tone
+//	or frequency gets picked up), closer in, delayUntil for accuracy.
+
+#define	SPIN_WINDOW	1000	// uS
+
 static int freqs         [MAX_PINS] ;
-static pthread_t threads [MAX_PINS] ;
-static volatile int stopFlag[MAX_PINS] = {0}; 
-static int newPin = -1 ;
+static int active        [MAX_PINS] ;
+static int gpios         [MAX_PINS] ;	// Native GPIO numbers
+static int levels        [MAX_PINS] ;
+static int halfPeriods   [MAX_PINS] ;	// uS
+static unsigned long long nextEdge [MAX_PINS] ;	// piMicros64 () time
+
+static pthread_mutex_t toneLock = PTHREAD_MUTEX_INITIALIZER ;
+static pthread_mutex_t runLock  = PTHREAD_MUTEX_INITIALIZER ;	// Thread start/stop, taken before toneLock
+static pthread_cond_t  toneCond ;	// Set up with the thread, on CLOCK_MONOTONIC
+static pthread_t       toneThread ;
+static int numActive = 0 ;
+static int toneStop  = FALSE ;
+
+
+/*
+ * waitFor:
+ *	Block on the condition variable for howLong uS, or until a
+ *	softToneWrite/Create/Stop signals it. Called with toneLock held.
+ *********************************************************************************
+ */
+
+static void waitFor (unsigned long long howLong)
+{
+  struct timespec wakeUp ;
+
+  clock_gettime (CLOCK_MONOTONIC, &wakeUp) ;
+  wakeUp.tv_sec  += howLong / 1000000 ;
+  wakeUp.tv_nsec += (howLong % 1000000) * 1000 ;
+  if (wakeUp.tv_nsec >= 1000000000L)
+  {
+    wakeUp.tv_nsec -= 1000000000L ;
+    ++wakeUp.tv_sec ;
+  }
+
+  pthread_cond_timedwait (&toneCond, &toneLock, &wakeUp) ;
+}
 
 
 /*
  * softToneThread:
- *	Thread to do the actual PWM output
+ *	Thread to do the actual PWM output for all the pins
  *********************************************************************************
  */
 
 static PI_THREAD (softToneThread)
 {
-  int pin, freq, halfPeriod ;
-  struct sched_param param ;
+  unsigned long long deadline, now ;
+  unsigned int setMask, clrMask ;
+  int pin ;
 
-  param.sched_priority = sched_get_priority_max (SCHED_RR) ;
-  pthread_setschedparam (pthread_self (), SCHED_RR, &param) ;
+  piThreadEnter (WPI_THREAD_SOFTTONE, 50) ;
 
-  pin    = newPin ;
-  newPin = -1 ;
+  pthread_mutex_lock (&toneLock) ;
 
-  piHiPri (50) ;
-
-  for (;;)
+  while (!toneStop)
   {
-    if (stopFlag[pin])  // Check if the stop flag is set
-      break;  // Exit the loop if the stop flag is set
 
-    freq = freqs [pin] ;
-    if (freq == 0)
-      delay (1) ;
-    else
+// Find the next edge: playing pins, and stopped pins still to go low
+
+    deadline = ~0ULL ;
+    for (pin = 0 ; pin < MAX_PINS ; ++pin)
+      if (active [pin] && ((freqs [pin] != 0) || levels [pin]) && (nextEdge [pin] < deadline))
+        deadline = nextEdge [pin] ;
+
+    if (deadline == ~0ULL)
     {
-      halfPeriod = 500000 / freq ;
+      pthread_cond_wait (&toneCond, &toneLock) ;
+      continue ;
+    }
 
-      digitalWrite (pin, HIGH) ;
-      delayMicroseconds (halfPeriod) ;
+    now = piMicros64 () ;
+    if (deadline > (now + SPIN_WINDOW))
+    {
+      waitFor (deadline - now - SPIN_WINDOW) ;
+      continue ;
+    }
+
+    pthread_mutex_unlock (&toneLock) ;
+      delayUntilMicros64 (deadline) ;
+    pthread_mutex_lock (&toneLock) ;
+
+// Toggle every pin due by now, all in one go
 
-      digitalWrite (pin, LOW) ;
-      delayMicroseconds (halfPeriod) ;
+    now     = piMicros64 () ;
+    setMask = clrMask = 0 ;
+    piThreadWokeUp ((long long int)(now - deadline) * 1000) ;
+
+    for (pin = 0 ; pin < MAX_PINS ; ++pin)
+    {
+      if (!active [pin] || ((freqs [pin] == 0) && !levels [pin]) || (nextEdge [pin] > deadline))
+        continue ;
+
+      if (levels [pin] || (freqs [pin] == 0))
+      {
+        clrMask |= 1u << gpios [pin] ;
+        levels [pin] = LOW ;
+      }
+      else
+      {
+        setMask |= 1u << gpios [pin] ;
+        levels [pin] = HIGH ;
+      }
+
+      nextEdge [pin] += halfPeriods [pin] ;
+      if (nextEdge [pin] <= now)		// Fell behind, don't try to catch up
+        nextEdge [pin] = now + halfPeriods [pin] ;
     }
+
+    digitalWriteGpioMask (setMask, clrMask) ;
   }
 
+  pthread_mutex_unlock (&toneLock) ;
+
+  piThreadExit () ;
+
   return NULL ;
 }
 
@@ -100,36 +186,78 @@ void softToneWrite (int pin, int freq)
   else if (freq > 5000)	// Max 5KHz
     freq = 5000 ;
 
-  freqs [pin] = freq ;
+  pthread_mutex_lock (&toneLock) ;
+
+  if (freq != freqs [pin])
+  {
+    if ((freqs [pin] == 0) || (freq == 0))	// Starting or stopping: now
+      nextEdge [pin] = piMicros64 () ;
+
+    freqs [pin] = freq ;
+    if (freq != 0)
+      halfPeriods [pin] = 500000 / freq ;
+
+    pthread_cond_signal (&toneCond) ;
+  }
+
+  pthread_mutex_unlock (&toneLock) ;
 }
 
 
 /*
  * softToneCreate:
- *	Create a new tone thread.
+ *	Add a pin to the tone thread, starting the thread with the first one.
+ *	The pin has to be on-board, a native GPIO 0-31.
  *********************************************************************************
  */
 
 int softToneCreate (int pin)
 {
-  int res ;
-  pthread_t myThread ;
+  pthread_condattr_t attr ;
+  int gpio = wiringPiPinToGpio (pin) ;
+  int res  = 0 ;
+
+  if (((pin & PI_GPIO_MASK) != 0) || (gpio < 0) || (gpio > 31))
+    return -1 ;
 
   pinMode      (pin, OUTPUT) ;
   digitalWrite (pin, LOW) ;
 
-  if (threads [pin] != 0)
+  pthread_mutex_lock (&runLock) ;
+  pthread_mutex_lock (&toneLock) ;
+
+  if (active [pin])
+  {
+    pthread_mutex_unlock (&toneLock) ;
+    pthread_mutex_unlock (&runLock) ;
     return -1 ;
+  }
 
-  freqs [pin] = 0 ;
+  if (numActive == 0)
+  {
+    pthread_condattr_init     (&attr) ;
+    pthread_condattr_setclock (&attr, CLOCK_MONOTONIC) ;
+    pthread_cond_init         (&toneCond, &attr) ;
+    pthread_condattr_destroy  (&attr) ;
 
-  newPin = pin ;
-  res    = pthread_create (&myThread, NULL, softToneThread, NULL) ;
+    toneStop = FALSE ;
+    if ((res = pthread_create (&toneThread, NULL, softToneThread, NULL)) != 0)
+    {
+      pthread_cond_destroy (&toneCond) ;
+      pthread_mutex_unlock (&toneLock) ;
+      pthread_mutex_unlock (&runLock) ;
+      return res ;
+    }
+  }
 
-  while (newPin != -1)
-    delay (1) ;
+  freqs  [pin] = 0 ;
+  levels [pin] = LOW ;
+  gpios  [pin] = gpio ;
+  active [pin] = TRUE ;
+  ++numActive ;
 
-  threads [pin] = myThread ;
+  pthread_mutex_unlock (&toneLock) ;
+  pthread_mutex_unlock (&runLock) ;
 
   return res ;
 }
@@ -137,17 +265,45 @@ int softToneCreate (int pin)
 
 /*
  * softToneStop:
- *	Stop an existing softTone thread
+ *	Take a pin off the tone thread, stopping it after the last one.
+ *	runLock is held until the thread is joined and its condition
+ *	variable destroyed, so a softToneCreate can't start the next one
+ *	in between.
  *********************************************************************************
  */
 
 void softToneStop (int pin)
 {
-  if (threads [pin] != 0)
+  int last ;
+
+  pin &= 63 ;
+
+  pthread_mutex_lock (&runLock) ;
+  pthread_mutex_lock (&toneLock) ;
+
+  if (!active [pin])
+  {
+    pthread_mutex_unlock (&toneLock) ;
+    pthread_mutex_unlock (&runLock) ;
+    return ;
+  }
+
+  active [pin] = FALSE ;
+  freqs  [pin] = 0 ;
+  last = (--numActive == 0) ;
+  if (last)
+    toneStop = TRUE ;
+  pthread_cond_signal (&toneCond) ;
+
+  pthread_mutex_unlock (&toneLock) ;
+
+  if (last)
   {
-    stopFlag[pin] = 1;  // Signal the thread to stop
-    pthread_join   (threads [pin], NULL) ;
-    threads [pin] = 0 ;
-    digitalWrite (pin, LOW) ;
+    pthread_join (toneThread, NULL) ;
+    pthread_cond_destroy (&toneCond) ;
   }
+
+  pthread_mutex_unlock (&runLock) ;
+
+  digitalWrite (pin, LOW) ;
 }
@@ -5,6 +5,8 @@
  *	Note that the code can cope with a number of 595's
  *	daisy-chained together - up to 4 for now as we're storing
  *	the output "register" in a single unsigned int.
+ *	Several such chains can share the clock and latch pins, each
+ *	with its own data pin, and be shifted out in parallel.
  *
  *	Copyright (c) 2013 Gordon Henderson
  ***********************************************************************
@@ -29,81 +31,194 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <stdlib.h>
 
 #include "wiringPi.h"
+#include "wiringShift.h"
 
 #include "sr595.h"
 
+struct sr595Chains
+{
+  int      numChains ;
+  int      bits ;			// Pins per chain
+  int      clockPin, latchPin ;
+  int      dataPins [SR595_MAX_CHAINS] ;
+  uint32_t output   [SR595_MAX_CHAINS] ;
+  int      depth ;			// Transaction nesting level
+  int      dirty ;
+} ;
+
+
+/*
+ * flush:
+ *	Shift all chains out together, a byte per chain at a time, most
+ *	significant first, and latch them with one latch pulse.
+ *	A low -> high latch transition copies the latch to the output pins
+ *********************************************************************************
+ */
+
+static void flush (struct sr595Chains *sr)
+{
+  uint8_t vals [SR595_MAX_CHAINS] ;
+  int byte, chain ;
+
+  sr->dirty = FALSE ;
+
+  digitalWrite (sr->latchPin, LOW) ;
+
+  for (byte = (sr->bits - 1) / 8 ; byte >= 0 ; --byte)
+  {
+    for (chain = 0 ; chain < sr->numChains ; ++chain)
+      vals [chain] = (sr->output [chain] >> (byte * 8)) & 0xFF ;
+    shiftOutParallel (sr->numChains, sr->dataPins, sr->clockPin, MSBFIRST, vals) ;
+  }
+
+  digitalWrite (sr->latchPin, HIGH) ;
+}
+
 
 /*
  * myDigitalWrite:
+ *	Outside a transaction every write goes straight out, inside one
+ *	the commit does it once for all of them.
  *********************************************************************************
  */
 
 static void myDigitalWrite (struct wiringPiNodeStruct *node, int pin, int value)
 {
-  unsigned int mask ;
-  int  dataPin, clockPin, latchPin ;
-  int  bit, bits, output ;
-
-  pin     -= node->pinBase ;				// Normalise pin number
-  bits     = node->pinMax - node->pinBase + 1 ;		// ie. number of clock pulses
-  dataPin  = node->data0 ;
-  clockPin = node->data1 ;
-  latchPin = node->data2 ;
-  output   = node->data3 ;
+  struct sr595Chains *sr = (struct sr595Chains *)node->devData ;
+  int chain ;
+  uint32_t mask ;
 
-  mask = 1 << pin ;
+  pin  -= node->pinBase ;				// Normalise pin number
+  chain = pin / sr->bits ;
+  mask  = 1u << (pin % sr->bits) ;
 
   if (value == LOW)
-    output &= (~mask) ;
+    sr->output [chain] &= (~mask) ;
   else
-    output |=   mask ;
+    sr->output [chain] |=   mask ;
 
-  node->data3 = output ;
+  sr->dirty = TRUE ;
 
-// A low -> high latch transition copies the latch to the output pins
+  if (sr->depth == 0)
+    flush (sr) ;
+}
+
+
+/*
+ * myDigitalRead:
+ *	Read back what we last wrote.
+ *********************************************************************************
+ */
+
+static int myDigitalRead (struct wiringPiNodeStruct *node, int pin)
+{
+  struct sr595Chains *sr = (struct sr595Chains *)node->devData ;
 
-  digitalWrite (latchPin, LOW) ; delayMicroseconds (1) ;
-    for (bit = bits - 1 ; bit >= 0 ; --bit)
-    {
-      digitalWrite (dataPin, output & (1 << bit)) ;
+  pin -= node->pinBase ;
 
-      digitalWrite (clockPin, HIGH) ; delayMicroseconds (1) ;
-      digitalWrite (clockPin, LOW) ;  delayMicroseconds (1) ;
-    }
-  digitalWrite (latchPin, HIGH) ; delayMicroseconds (1) ;
+  return (sr->output [pin / sr->bits] >> (pin % sr->bits)) & 1 ;
 }
 
 
 /*
- * sr595Setup:
- *	Create a new instance of a 74x595 shift register GPIO expander.
+ * myBeginTransaction: myCommitTransaction:
  *********************************************************************************
  */
 
-int sr595Setup (const int pinBase, const int numPins,
-	const int dataPin, const int clockPin, const int latchPin) 
+static int myBeginTransaction (struct wiringPiNodeStruct *node)
+{
+  struct sr595Chains *sr = (struct sr595Chains *)node->devData ;
+
+  ++sr->depth ;
+
+  return 0 ;
+}
+
+static int myCommitTransaction (struct wiringPiNodeStruct *node)
+{
+  struct sr595Chains *sr = (struct sr595Chains *)node->devData ;
+
+  if (sr->depth == 0)
+    return -1 ;
+
+  if ((--sr->depth == 0) && sr->dirty)
+    flush (sr) ;
+
+  return 0 ;
+}
+
+
+/*
+ * sr595ParallelSetup:
+ *	Create a new instance of numChains chains of 74x595 shift registers
+ *	sharing the clock and latch pins. Chain n has numPins pins from
+ *	pinBase + n * numPins on and is fed from dataPins [n].
+ *	Write its pins inside wiringPiNodeBegin/wiringPiNodeCommit to update
+ *	them all with a single shift and latch.
+ *********************************************************************************
+ */
+
+int sr595ParallelSetup (const int pinBase, const int numPins, const int numChains,
+	const int *dataPins, const int clockPin, const int latchPin)
 {
   struct wiringPiNodeStruct *node ;
+  struct sr595Chains *sr ;
+  int chain ;
+
+  if ((numPins < 1) || (numPins > 32) || (numChains < 1) || (numChains > SR595_MAX_CHAINS))
+    return FALSE ;
+
+  if ((sr = (struct sr595Chains *)calloc (1, sizeof (struct sr595Chains))) == NULL)
+    return FALSE ;
 
-  node = wiringPiNewNode (pinBase, numPins) ;
+  sr->numChains = numChains ;
+  sr->bits      = numPins ;
+  sr->clockPin  = clockPin ;
+  sr->latchPin  = latchPin ;
 
-  node->data0           = dataPin ;
-  node->data1           = clockPin ;
-  node->data2           = latchPin ;
-  node->data3           = 0 ;		// Output register
-  node->digitalWrite    = myDigitalWrite ;
+  for (chain = 0 ; chain < numChains ; ++chain)
+    sr->dataPins [chain] = dataPins [chain] ;
+
+  node = wiringPiNewNode (pinBase, numPins * numChains) ;
+
+  node->data0             = dataPins [0] ;
+  node->data1             = clockPin ;
+  node->data2             = latchPin ;
+  node->devData           = sr ;
+  node->digitalWrite      = myDigitalWrite ;
+  node->digitalRead       = myDigitalRead ;
+  node->beginTransaction  = myBeginTransaction ;
+  node->commitTransaction = myCommitTransaction ;
 
 // Initialise the underlying hardware
 
-  digitalWrite (dataPin,  LOW) ;
+  for (chain = 0 ; chain < numChains ; ++chain)
+  {
+    digitalWrite (dataPins [chain], LOW) ;
+    pinMode      (dataPins [chain], OUTPUT) ;
+  }
+
   digitalWrite (clockPin, LOW) ;
   digitalWrite (latchPin, HIGH) ;
 
-  pinMode (dataPin,  OUTPUT) ;
   pinMode (clockPin, OUTPUT) ;
   pinMode (latchPin, OUTPUT) ;
 
   return TRUE ;
 }
+
+
+/*
+ * sr595Setup:
+ *	Create a new instance of a 74x595 shift register GPIO expander.
+ *********************************************************************************
+ */
+
+int sr595Setup (const int pinBase, const int numPins,
+	const int dataPin, const int clockPin, const int latchPin) 
+{
+  return sr595ParallelSetup (pinBase, numPins, 1, &dataPin, clockPin, latchPin) ;
+}
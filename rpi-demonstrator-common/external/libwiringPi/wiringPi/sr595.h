@@ -22,12 +22,16 @@
  ***********************************************************************
  */
 
+#define	SR595_MAX_CHAINS	16
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 extern int sr595Setup (const int pinBase, const int numPins,
 	const int dataPin, const int clockPin, const int latchPin) ;
+extern int sr595ParallelSetup (const int pinBase, const int numPins, const int numChains,
+	const int *dataPins, const int clockPin, const int latchPin) ;
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,815 @@
+// Fake GPIO character device: an ioctl shim emulating /dev/gpiochip* on any Linux box
+// Compile: gcc -Wall -shared -fPIC fakegpiochip.c -o libfakegpiochip.so -lpthread -ldl
+//
+// Either link it in front of the GPIO library (-lfakegpiochip -lwiringPi) to
+// use the control functions in fakegpiochip.h, or run an unmodified program
+// with LD_PRELOAD=./libfakegpiochip.so.
+//
+// open() of any /dev/gpiochipN returns the one emulated chip. ioctl() on it
+// and on the fds it hands out implements the uAPI v1 and v2 chip info, line
+// info, line handle, line event, get/set values and set config requests, so
+// wiringPi's device mode and lgpio both run on it. Event fds are sockets, the
+// events come out in the kernel's record formats and can be poll()ed and read().
+// A line that's already requested gives EBUSY, just like the kernel.
+//
+// The physical level of a line is, in that order: its own output, a level
+// driven from outside (fakeGpiochipSetInput or a script), the output of its
+// loopback partner, its pull-up. Every change of level is an edge.
+//
+// Environment:
+//   FAKE_GPIOCHIP_LINES=54            number of lines, up to 64
+//   FAKE_GPIOCHIP_LOOPBACK=19:26,...  lines wired together
+//   FAKE_GPIOCHIP_SCRIPT="..."        edges to inject, see fakegpiochip.h,
+//                                     "@file" reads the script from a file
+//   FAKE_GPIOCHIP_REVISION=c03111     board revision code wiringPi sees
+
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <linux/gpio.h>
+
+#include "fakegpiochip.h"
+
+#define MAX_LINES   64
+#define MAX_FDS     4096
+
+#define REVFILE     "/proc/device-tree/system/linux,revision"
+
+enum fdType { FD_CHIP = 1, FD_HANDLE, FD_EVENT };
+
+struct fakeFd {
+  enum fdType type;
+  int         v2;                 // Event records and flags in v2 format
+  int         lines;
+  int         offsets[MAX_LINES];
+  uint64_t    flags[MAX_LINES];   // As GPIO_V2_LINE_FLAG_*
+  int         eventFd;            // Our end of the event socket, -1 if none
+  uint32_t    seqno;
+};
+
+struct fakeLine {
+  struct fakeFd *owner;
+  int           index;            // In owner->offsets
+  int           output;
+  int           outLevel;
+  int           driven;           // Level driven from outside, -1 if none
+  int           pull;             // 1 up, 0 down, -1 none
+  int           peer;             // Loopback partner, -1 if none
+  int           level;            // Last physical level
+  uint32_t      lineSeqno;
+  char          consumer[32];
+};
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t  once = PTHREAD_ONCE_INIT;
+static struct fakeLine lines[MAX_LINES];
+static struct fakeFd  *fds[MAX_FDS];
+static int             numLines = 54;
+static unsigned int    revision = 0x00c03111;   // Pi 4B
+
+static int   (*realOpen)(const char *path, int flags, ...);
+static int   (*realOpen64)(const char *path, int flags, ...);
+static int   (*realClose)(int fd);
+static int   (*realIoctl)(int fd, unsigned long request, ...);
+static FILE *(*realFopen)(const char *path, const char *mode);
+static FILE *(*realFopen64)(const char *path, const char *mode);
+
+static pthread_t scriptThread;
+static int       scriptRunning;
+static int       scriptStarted;
+
+static void loopback(int lineA, int lineB);
+
+
+static void setup(void) {
+  const char *env;
+
+  realOpen    = dlsym(RTLD_NEXT, "open");
+  realOpen64  = dlsym(RTLD_NEXT, "open64");
+  realClose   = dlsym(RTLD_NEXT, "close");
+  realIoctl   = dlsym(RTLD_NEXT, "ioctl");
+  realFopen   = dlsym(RTLD_NEXT, "fopen");
+  realFopen64 = dlsym(RTLD_NEXT, "fopen64");
+
+  if ((env = getenv("FAKE_GPIOCHIP_LINES")) != NULL) {
+    numLines = atoi(env);
+    if (numLines < 1 || numLines > MAX_LINES)
+      numLines = MAX_LINES;
+  }
+  if ((env = getenv("FAKE_GPIOCHIP_REVISION")) != NULL)
+    revision = strtoul(env, NULL, 16);
+
+  for (int i = 0; i < MAX_LINES; ++i) {
+    lines[i].driven = -1;
+    lines[i].pull   = -1;
+    lines[i].peer   = -1;
+  }
+
+  if ((env = getenv("FAKE_GPIOCHIP_LOOPBACK")) != NULL) {
+    while (*env) {
+      char *end;
+      int a = strtol(env, &end, 10), b;
+      if (*end != ':')
+        break;
+      b = strtol(end + 1, &end, 10);
+      loopback(a, b);
+      env = end + strspn(end, ", ");
+    }
+  }
+}
+
+
+static long long nanos(clockid_t clock) {
+  struct timespec ts;
+  clock_gettime(clock, &ts);
+  return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+
+// Physical levels and edges, all called with the lock held
+
+static int physical(int line) {
+  struct fakeLine *l = &lines[line];
+
+  if (l->output)
+    return l->outLevel;
+  if (l->driven >= 0)
+    return l->driven;
+  if (l->peer >= 0 && lines[l->peer].output)
+    return lines[l->peer].outLevel;
+  return l->pull == 1;
+}
+
+
+static void edge(int line, int level) {
+  struct fakeLine *l = &lines[line];
+  struct fakeFd *f = l->owner;
+  uint64_t flags;
+  long long ts;
+  int rising;
+
+  if (f == NULL || f->type != FD_EVENT)
+    return;
+  flags  = f->flags[l->index];
+  rising = (level != 0) != ((flags & GPIO_V2_LINE_FLAG_ACTIVE_LOW) != 0);
+  if (!(flags & (rising ? GPIO_V2_LINE_FLAG_EDGE_RISING : GPIO_V2_LINE_FLAG_EDGE_FALLING)))
+    return;
+
+  ts = nanos((flags & GPIO_V2_LINE_FLAG_EVENT_CLOCK_REALTIME) ? CLOCK_REALTIME : CLOCK_MONOTONIC);
+  if (f->v2) {
+    struct gpio_v2_line_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.timestamp_ns = ts;
+    ev.id           = rising ? GPIO_V2_LINE_EVENT_RISING_EDGE : GPIO_V2_LINE_EVENT_FALLING_EDGE;
+    ev.offset       = line;
+    ev.seqno        = ++f->seqno;
+    ev.line_seqno   = ++l->lineSeqno;
+    (void)!send(f->eventFd, &ev, sizeof(ev), MSG_DONTWAIT | MSG_NOSIGNAL);   // Full: dropped like the kernel's kfifo
+  } else {
+    struct gpioevent_data ev;
+    ev.timestamp = ts;
+    ev.id        = rising ? GPIOEVENT_EVENT_RISING_EDGE : GPIOEVENT_EVENT_FALLING_EDGE;
+    (void)!send(f->eventFd, &ev, sizeof(ev), MSG_DONTWAIT | MSG_NOSIGNAL);
+  }
+}
+
+
+static void settleLine(int line) {
+  int level = physical(line);
+
+  if (level != lines[line].level) {
+    lines[line].level = level;
+    edge(line, level);
+  }
+}
+
+
+static void settle(int line) {
+  settleLine(line);
+  if (lines[line].peer >= 0)
+    settleLine(lines[line].peer);
+}
+
+
+// Apply v2 flags (and an output value) to a requested line
+
+static void configure(struct fakeFd *f, int index, uint64_t flags, int value) {
+  int line = f->offsets[index];
+  struct fakeLine *l = &lines[line];
+
+  f->flags[index] = flags;
+  /**/ if (flags & GPIO_V2_LINE_FLAG_BIAS_PULL_UP)
+    l->pull = 1;
+  else if (flags & GPIO_V2_LINE_FLAG_BIAS_PULL_DOWN)
+    l->pull = 0;
+  else if (flags & GPIO_V2_LINE_FLAG_BIAS_DISABLED)
+    l->pull = -1;
+
+  if (flags & GPIO_V2_LINE_FLAG_OUTPUT) {
+    l->output   = 1;
+    l->outLevel = (value != 0) != ((flags & GPIO_V2_LINE_FLAG_ACTIVE_LOW) != 0);
+  } else if (flags & GPIO_V2_LINE_FLAG_INPUT) {
+    l->output = 0;
+  }
+  settle(line);
+}
+
+
+static uint64_t v1Flags(uint32_t handleFlags) {
+  uint64_t flags = 0;
+
+  if (handleFlags & GPIOHANDLE_REQUEST_INPUT)       flags |= GPIO_V2_LINE_FLAG_INPUT;
+  if (handleFlags & GPIOHANDLE_REQUEST_OUTPUT)      flags |= GPIO_V2_LINE_FLAG_OUTPUT;
+  if (handleFlags & GPIOHANDLE_REQUEST_ACTIVE_LOW)  flags |= GPIO_V2_LINE_FLAG_ACTIVE_LOW;
+  if (handleFlags & GPIOHANDLE_REQUEST_OPEN_DRAIN)  flags |= GPIO_V2_LINE_FLAG_OPEN_DRAIN;
+  if (handleFlags & GPIOHANDLE_REQUEST_OPEN_SOURCE) flags |= GPIO_V2_LINE_FLAG_OPEN_SOURCE;
+  if (handleFlags & GPIOHANDLE_REQUEST_BIAS_PULL_UP)   flags |= GPIO_V2_LINE_FLAG_BIAS_PULL_UP;
+  if (handleFlags & GPIOHANDLE_REQUEST_BIAS_PULL_DOWN) flags |= GPIO_V2_LINE_FLAG_BIAS_PULL_DOWN;
+  if (handleFlags & GPIOHANDLE_REQUEST_BIAS_DISABLE)   flags |= GPIO_V2_LINE_FLAG_BIAS_DISABLED;
+  return flags;
+}
+
+
+static int value(struct fakeFd *f, int index) {
+  return physical(f->offsets[index]) != ((f->flags[index] & GPIO_V2_LINE_FLAG_ACTIVE_LOW) != 0);
+}
+
+
+// Hand out a new line handle or event fd for count lines.
+// Returns the fd for the caller or -errno.
+
+static int request(int v2, enum fdType type, int count, const uint32_t *offsets, const char *consumer) {
+  struct fakeFd *f;
+  int fd, sv[2];
+
+  if (count < 1 || count > MAX_LINES)
+    return -EINVAL;
+  for (int i = 0; i < count; ++i) {
+    if (offsets[i] >= (uint32_t)numLines)
+      return -EINVAL;
+    if (lines[offsets[i]].owner != NULL)
+      return -EBUSY;
+    for (int j = 0; j < i; ++j)
+      if (offsets[j] == offsets[i])
+        return -EINVAL;
+  }
+
+  if ((f = calloc(1, sizeof(*f))) == NULL)
+    return -ENOMEM;
+  f->type    = type;
+  f->v2      = v2;
+  f->lines   = count;
+  f->eventFd = -1;
+
+  if (type == FD_EVENT) {
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) != 0) {
+      free(f);
+      return -errno;
+    }
+    fd         = sv[0];
+    f->eventFd = sv[1];
+  } else if ((fd = eventfd(0, EFD_CLOEXEC)) < 0) {
+    free(f);
+    return -errno;
+  }
+  if (fd >= MAX_FDS) {
+    realClose(fd);
+    if (f->eventFd >= 0)
+      realClose(f->eventFd);
+    free(f);
+    return -EMFILE;
+  }
+
+  for (int i = 0; i < count; ++i) {
+    struct fakeLine *l = &lines[offsets[i]];
+    f->offsets[i] = offsets[i];
+    l->owner = f;
+    l->index = i;
+    l->level = physical(offsets[i]);
+    snprintf(l->consumer, sizeof(l->consumer), "%s", consumer);
+  }
+  fds[fd] = f;
+  return fd;
+}
+
+
+static void release(int fd) {
+  struct fakeFd *f = fds[fd];
+
+  if (f == NULL)
+    return;
+  fds[fd] = NULL;
+  if (f->type != FD_CHIP) {
+    for (int i = 0; i < f->lines; ++i) {
+      lines[f->offsets[i]].owner = NULL;
+      lines[f->offsets[i]].consumer[0] = 0;
+    }
+  }
+  if (f->eventFd >= 0)
+    realClose(f->eventFd);
+  free(f);
+}
+
+
+// The ioctls, with the lock held. Return 0 or -errno.
+
+static void lineInfoV2(int line, struct gpio_v2_line_info *info) {
+  struct fakeLine *l = &lines[line];
+
+  memset(info, 0, sizeof(*info));
+  snprintf(info->name, sizeof(info->name), "GPIO%d", line);
+  memcpy(info->consumer, l->consumer, sizeof(info->consumer));
+  info->offset = line;
+  if (l->owner != NULL)
+    info->flags = l->owner->flags[l->index] | GPIO_V2_LINE_FLAG_USED;
+  else
+    info->flags = l->output ? GPIO_V2_LINE_FLAG_OUTPUT : GPIO_V2_LINE_FLAG_INPUT;
+}
+
+
+static int chipIoctl(unsigned long request_, void *arg) {
+  switch (request_) {
+    case GPIO_GET_CHIPINFO_IOCTL: {
+      struct gpiochip_info *info = arg;
+      memset(info, 0, sizeof(*info));
+      snprintf(info->name, sizeof(info->name), "gpiochip0");
+      snprintf(info->label, sizeof(info->label), "fake-gpiochip");
+      info->lines = numLines;
+      return 0;
+    }
+
+    case GPIO_V2_GET_LINEINFO_IOCTL: {
+      struct gpio_v2_line_info *info = arg;
+      if (info->offset >= (uint32_t)numLines)
+        return -EINVAL;
+      lineInfoV2(info->offset, info);
+      return 0;
+    }
+
+    case GPIO_GET_LINEINFO_IOCTL: {
+      struct gpioline_info *info = arg;
+      struct gpio_v2_line_info info2;
+      if (info->line_offset >= (uint32_t)numLines)
+        return -EINVAL;
+      lineInfoV2(info->line_offset, &info2);
+      memset(info, 0, sizeof(*info));
+      info->line_offset = info2.offset;
+      memcpy(info->name, info2.name, sizeof(info->name));
+      memcpy(info->consumer, info2.consumer, sizeof(info->consumer));
+      if (info2.flags & GPIO_V2_LINE_FLAG_USED)       info->flags |= GPIOLINE_FLAG_KERNEL;
+      if (info2.flags & GPIO_V2_LINE_FLAG_OUTPUT)     info->flags |= GPIOLINE_FLAG_IS_OUT;
+      if (info2.flags & GPIO_V2_LINE_FLAG_ACTIVE_LOW) info->flags |= GPIOLINE_FLAG_ACTIVE_LOW;
+      return 0;
+    }
+
+    case GPIO_GET_LINEHANDLE_IOCTL: {
+      struct gpiohandle_request *rq = arg;
+      uint32_t offsets[MAX_LINES];
+      int fd;
+      if (rq->lines < 1 || rq->lines > GPIOHANDLES_MAX)
+        return -EINVAL;
+      for (uint32_t i = 0; i < rq->lines; ++i)
+        offsets[i] = rq->lineoffsets[i];
+      if ((fd = request(0, FD_HANDLE, rq->lines, offsets, rq->consumer_label)) < 0)
+        return fd;
+      for (uint32_t i = 0; i < rq->lines; ++i)
+        configure(fds[fd], i, v1Flags(rq->flags), rq->default_values[i]);
+      rq->fd = fd;
+      return 0;
+    }
+
+    case GPIO_GET_LINEEVENT_IOCTL: {
+      struct gpioevent_request *rq = arg;
+      uint32_t offset = rq->lineoffset;
+      uint64_t flags = v1Flags(rq->handleflags) | GPIO_V2_LINE_FLAG_INPUT;
+      int fd;
+      if (rq->eventflags & GPIOEVENT_REQUEST_RISING_EDGE)  flags |= GPIO_V2_LINE_FLAG_EDGE_RISING;
+      if (rq->eventflags & GPIOEVENT_REQUEST_FALLING_EDGE) flags |= GPIO_V2_LINE_FLAG_EDGE_FALLING;
+      if ((fd = request(0, FD_EVENT, 1, &offset, rq->consumer_label)) < 0)
+        return fd;
+      configure(fds[fd], 0, flags & ~GPIO_V2_LINE_FLAG_OUTPUT, 0);
+      rq->fd = fd;
+      return 0;
+    }
+
+    case GPIO_V2_GET_LINE_IOCTL: {
+      struct gpio_v2_line_request *rq = arg;
+      struct gpio_v2_line_config *cfg = &rq->config;
+      int fd;
+      if (rq->num_lines < 1 || rq->num_lines > GPIO_V2_LINES_MAX || cfg->num_attrs > GPIO_V2_LINE_NUM_ATTRS_MAX)
+        return -EINVAL;
+      if ((fd = request(1, FD_EVENT, rq->num_lines, rq->offsets, rq->consumer)) < 0)   // v2 line fds always carry the events
+        return fd;
+      for (uint32_t i = 0; i < rq->num_lines; ++i) {
+        uint64_t flags = cfg->flags;
+        int out = 0;
+        for (uint32_t a = 0; a < cfg->num_attrs; ++a) {
+          struct gpio_v2_line_config_attribute *ca = &cfg->attrs[a];
+          if (!(ca->mask & (1ULL << i)))
+            continue;
+          if (ca->attr.id == GPIO_V2_LINE_ATTR_ID_FLAGS)
+            flags = ca->attr.flags;
+          else if (ca->attr.id == GPIO_V2_LINE_ATTR_ID_OUTPUT_VALUES)
+            out = (ca->attr.values >> i) & 1;
+        }
+        configure(fds[fd], i, flags, out);
+      }
+      rq->fd = fd;
+      return 0;
+    }
+  }
+  return -ENOTTY;
+}
+
+
+static int lineIoctl(struct fakeFd *f, unsigned long request_, void *arg) {
+  switch (request_) {
+    case GPIOHANDLE_GET_LINE_VALUES_IOCTL: {
+      struct gpiohandle_data *data = arg;
+      if (f->v2)
+        return -ENOTTY;
+      for (int i = 0; i < f->lines; ++i)
+        data->values[i] = value(f, i);
+      return 0;
+    }
+
+    case GPIOHANDLE_SET_LINE_VALUES_IOCTL: {
+      struct gpiohandle_data *data = arg;
+      if (f->v2 || f->type != FD_HANDLE)
+        return -ENOTTY;
+      for (int i = 0; i < f->lines; ++i)
+        if (!(f->flags[i] & GPIO_V2_LINE_FLAG_OUTPUT))
+          return -EPERM;
+      for (int i = 0; i < f->lines; ++i)
+        configure(f, i, f->flags[i], data->values[i]);
+      return 0;
+    }
+
+    case GPIOHANDLE_SET_CONFIG_IOCTL: {
+      struct gpiohandle_config *cfg = arg;
+      if (f->v2 || f->type != FD_HANDLE)
+        return -ENOTTY;
+      for (int i = 0; i < f->lines; ++i)
+        configure(f, i, v1Flags(cfg->flags), cfg->default_values[i]);
+      return 0;
+    }
+
+    case GPIO_V2_LINE_GET_VALUES_IOCTL: {
+      struct gpio_v2_line_values *lv = arg;
+      if (!f->v2)
+        return -ENOTTY;
+      lv->bits = 0;
+      for (int i = 0; i < f->lines; ++i)
+        if ((lv->mask & (1ULL << i)) && value(f, i))
+          lv->bits |= 1ULL << i;
+      return 0;
+    }
+
+    case GPIO_V2_LINE_SET_VALUES_IOCTL: {
+      struct gpio_v2_line_values *lv = arg;
+      if (!f->v2)
+        return -ENOTTY;
+      for (int i = 0; i < f->lines; ++i)
+        if ((lv->mask & (1ULL << i)) && !(f->flags[i] & GPIO_V2_LINE_FLAG_OUTPUT))
+          return -EPERM;
+      for (int i = 0; i < f->lines; ++i)
+        if (lv->mask & (1ULL << i))
+          configure(f, i, f->flags[i], (lv->bits >> i) & 1);
+      return 0;
+    }
+
+    case GPIO_V2_LINE_SET_CONFIG_IOCTL: {
+      struct gpio_v2_line_config *cfg = arg;
+      if (!f->v2 || cfg->num_attrs > GPIO_V2_LINE_NUM_ATTRS_MAX)
+        return -EINVAL;
+      for (int i = 0; i < f->lines; ++i) {
+        uint64_t flags = cfg->flags;
+        int out = value(f, i);
+        for (uint32_t a = 0; a < cfg->num_attrs; ++a) {
+          struct gpio_v2_line_config_attribute *ca = &cfg->attrs[a];
+          if (!(ca->mask & (1ULL << i)))
+            continue;
+          if (ca->attr.id == GPIO_V2_LINE_ATTR_ID_FLAGS)
+            flags = ca->attr.flags;
+          else if (ca->attr.id == GPIO_V2_LINE_ATTR_ID_OUTPUT_VALUES)
+            out = (ca->attr.values >> i) & 1;
+        }
+        configure(f, i, flags, out);
+      }
+      return 0;
+    }
+  }
+  return -ENOTTY;
+}
+
+
+// The interposed libc functions
+
+static int isChip(const char *path) {
+  const char *p;
+
+  if (path == NULL || strncmp(path, "/dev/gpiochip", 13) != 0)
+    return 0;
+  for (p = path + 13; *p >= '0' && *p <= '9'; ++p)
+    ;
+  return p != path + 13 && *p == 0;
+}
+
+
+static int openChip(void) {
+  int fd = eventfd(0, EFD_CLOEXEC);
+  struct fakeFd *f;
+
+  if (fd < 0)
+    return -1;
+  if (fd >= MAX_FDS || (f = calloc(1, sizeof(*f))) == NULL) {
+    realClose(fd);
+    errno = EMFILE;
+    return -1;
+  }
+  f->type    = FD_CHIP;
+  f->eventFd = -1;
+  pthread_mutex_lock(&lock);
+  fds[fd] = f;
+  pthread_mutex_unlock(&lock);
+
+  const char *script = getenv("FAKE_GPIOCHIP_SCRIPT");
+  if (script != NULL && !__atomic_exchange_n(&scriptStarted, 1, __ATOMIC_ACQ_REL))
+    fakeGpiochipScript(script);   // Once per process, with the first open
+  return fd;
+}
+
+
+int open(const char *path, int flags, ...) {
+  mode_t mode = 0;
+  va_list ap;
+
+  pthread_once(&once, setup);
+  if (isChip(path))
+    return openChip();
+  va_start(ap, flags);
+  if ((flags & O_CREAT) || (flags & O_TMPFILE) == O_TMPFILE)
+    mode = va_arg(ap, mode_t);
+  va_end(ap);
+  return realOpen(path, flags, mode);
+}
+
+
+int open64(const char *path, int flags, ...) {
+  mode_t mode = 0;
+  va_list ap;
+
+  pthread_once(&once, setup);
+  if (isChip(path))
+    return openChip();
+  va_start(ap, flags);
+  if ((flags & O_CREAT) || (flags & O_TMPFILE) == O_TMPFILE)
+    mode = va_arg(ap, mode_t);
+  va_end(ap);
+  return realOpen64(path, flags, mode);
+}
+
+
+// wiringPi reads the board revision from the device tree
+
+static FILE *openRevision(void) {
+  static unsigned char text[4];
+
+  text[0] = revision >> 24;
+  text[1] = revision >> 16;
+  text[2] = revision >> 8;
+  text[3] = revision;
+  return fmemopen(text, sizeof(text), "rb");
+}
+
+
+FILE *fopen(const char *path, const char *mode) {
+  pthread_once(&once, setup);
+  if (path != NULL && strcmp(path, REVFILE) == 0)
+    return openRevision();
+  return realFopen(path, mode);
+}
+
+
+FILE *fopen64(const char *path, const char *mode) {
+  pthread_once(&once, setup);
+  if (path != NULL && strcmp(path, REVFILE) == 0)
+    return openRevision();
+  return realFopen64(path, mode);
+}
+
+
+int close(int fd) {
+  pthread_once(&once, setup);
+  if (fd >= 0 && fd < MAX_FDS && __atomic_load_n(&fds[fd], __ATOMIC_ACQUIRE) != NULL) {
+    pthread_mutex_lock(&lock);
+    release(fd);
+    pthread_mutex_unlock(&lock);
+  }
+  return realClose(fd);
+}
+
+
+int ioctl(int fd, unsigned long request_, ...) {
+  struct fakeFd *f;
+  void *arg;
+  va_list ap;
+  int ret;
+
+  pthread_once(&once, setup);
+  va_start(ap, request_);
+  arg = va_arg(ap, void *);
+  va_end(ap);
+
+  if (fd < 0 || fd >= MAX_FDS || __atomic_load_n(&fds[fd], __ATOMIC_ACQUIRE) == NULL)
+    return realIoctl(fd, request_, arg);
+
+  pthread_mutex_lock(&lock);
+  if ((f = fds[fd]) == NULL)
+    ret = -EBADF;
+  else if (f->type == FD_CHIP)
+    ret = chipIoctl(request_, arg);
+  else
+    ret = lineIoctl(f, request_, arg);
+  pthread_mutex_unlock(&lock);
+
+  if (ret < 0) {
+    errno = -ret;
+    return -1;
+  }
+  return 0;
+}
+
+
+// Control functions
+
+int fakeGpiochipSetInput(int line, int level) {
+  pthread_once(&once, setup);
+  if (line < 0 || line >= numLines)
+    return -1;
+  pthread_mutex_lock(&lock);
+  lines[line].driven = level < 0 ? -1 : (level != 0);
+  settle(line);
+  pthread_mutex_unlock(&lock);
+  return 0;
+}
+
+
+int fakeGpiochipLevel(int line) {
+  int level;
+
+  pthread_once(&once, setup);
+  if (line < 0 || line >= numLines)
+    return -1;
+  pthread_mutex_lock(&lock);
+  level = physical(line);
+  pthread_mutex_unlock(&lock);
+  return level;
+}
+
+
+int fakeGpiochipRequested(int line) {
+  int requested;
+
+  pthread_once(&once, setup);
+  if (line < 0 || line >= numLines)
+    return -1;
+  pthread_mutex_lock(&lock);
+  requested = lines[line].owner != NULL;
+  pthread_mutex_unlock(&lock);
+  return requested;
+}
+
+
+static void loopback(int lineA, int lineB) {
+  if (lineA < 0 || lineA >= MAX_LINES || lineB < 0 || lineB >= MAX_LINES || lineA == lineB)
+    return;
+  pthread_mutex_lock(&lock);
+  if (lines[lineA].peer >= 0)
+    lines[lines[lineA].peer].peer = -1;
+  if (lines[lineB].peer >= 0)
+    lines[lines[lineB].peer].peer = -1;
+  lines[lineA].peer = lineB;
+  lines[lineB].peer = lineA;
+  settle(lineA);
+  pthread_mutex_unlock(&lock);
+}
+
+
+int fakeGpiochipLoopback(int lineA, int lineB) {
+  pthread_once(&once, setup);
+  if (lineA < 0 || lineA >= numLines || lineB < 0 || lineB >= numLines || lineA == lineB)
+    return -1;
+  loopback(lineA, lineB);
+  return 0;
+}
+
+
+// Scripts: "+us" waits, "line=level" drives a line (level 0, 1 or z to let
+// go), "*n(...)" repeats, e.g. "+1000 *100(5=1 +50 5=0 +50) 5=z".
+
+static const char *runScript(const char *s, int depth) {
+  while (*s) {
+    char *end;
+
+    s += strspn(s, " \t\r\n,;");
+    if (*s == 0)
+      break;
+    if (*s == ')' && depth > 0)
+      return s + 1;
+
+    if (*s == '+') {
+      long us = strtol(s + 1, &end, 10);
+      struct timespec ts = { us / 1000000, (us % 1000000) * 1000 };
+      nanosleep(&ts, NULL);
+      s = end;
+    } else if (*s == '*') {
+      long n = strtol(s + 1, &end, 10);
+      const char *body = end + strspn(end, " ");
+      const char *after = body;
+      if (*body != '(')
+        return s + strlen(s);
+      for (long i = 0; i < n; ++i)
+        after = runScript(body + 1, depth + 1);
+      if (n <= 0) {   // Skip the body
+        int level = 0;
+        for (after = body; *after; ++after)
+          if (*after == '(')
+            ++level;
+          else if (*after == ')' && --level == 0) {
+            ++after;
+            break;
+          }
+      }
+      s = after;
+    } else if (*s == '#') {
+      s += strcspn(s, "\n");
+    } else {
+      long line = strtol(s, &end, 10);
+      if (end == s || *end != '=') {
+        fprintf(stderr, "fakegpiochip: bad script at '%.16s'\n", s);
+        return s + strlen(s);
+      }
+      fakeGpiochipSetInput(line, end[1] == 'z' ? -1 : end[1] == '1');
+      s = end + 2;
+    }
+  }
+  return s;
+}
+
+
+static void *scriptMain(void *arg) {
+  runScript(arg, 0);
+  free(arg);
+  return NULL;
+}
+
+
+int fakeGpiochipScript(const char *script) {
+  char *text;
+
+  pthread_once(&once, setup);
+  if (script[0] == '@') {
+    FILE *f = realFopen(script + 1, "r");
+    long len;
+    if (f == NULL)
+      return -1;
+    fseek(f, 0, SEEK_END);
+    len = ftell(f);
+    rewind(f);
+    if ((text = calloc(1, len + 1)) == NULL || fread(text, 1, len, f) != (size_t)len) {
+      free(text);
+      fclose(f);
+      return -1;
+    }
+    fclose(f);
+  } else if ((text = strdup(script)) == NULL) {
+    return -1;
+  }
+
+  fakeGpiochipWaitScript();
+  if (pthread_create(&scriptThread, NULL, scriptMain, text) != 0) {
+    free(text);
+    return -1;
+  }
+  __atomic_store_n(&scriptRunning, 1, __ATOMIC_RELEASE);
+  return 0;
+}
+
+
+void fakeGpiochipWaitScript(void) {
+  if (__atomic_exchange_n(&scriptRunning, 0, __ATOMIC_ACQ_REL))
+    pthread_join(scriptThread, NULL);
+}
@@ -0,0 +1,33 @@
+// Control functions of the fake GPIO character device, see fakegpiochip.c
+// Only available when the program links against libfakegpiochip.so.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Drive a line from outside: level 0 or 1, -1 lets go of it again
+int  fakeGpiochipSetInput(int line, int level);
+
+// Physical level of a line, as a scope would see it
+int  fakeGpiochipLevel(int line);
+
+// 1 if a line handle or event fd holds the line
+int  fakeGpiochipRequested(int line);
+
+// Wire two lines together, an output on one drives the other
+int  fakeGpiochipLoopback(int lineA, int lineB);
+
+// Run a script of injected edges in the background:
+//   +us         wait us microseconds
+//   line=level  drive a line, level 0, 1 or z (let go)
+//   *n( ... )   repeat n times
+//   # ...       comment up to the end of the line
+// e.g. "+1000 *100(5=1 +50 5=0 +50) 5=z". "@file" runs the script in file.
+int  fakeGpiochipScript(const char *script);
+
+// Wait for the script to finish
+void fakeGpiochipWaitScript(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,91 @@
+// WiringPi benchmark: delayMicroseconds overshoot and CPU cost (no hardware needed)
+// Compile: gcc -Wall wiringpi_bench_delay.c -o wiringpi_bench_delay -lwiringPi
+//
+// Compares the calibrated sleep-then-spin delayMicroseconds with the old
+// implementation (gettimeofday spin below 100uS, a plain nanosleep above).
+
+#include "wpi_test.h"
+
+#include <time.h>
+#include <sys/time.h>
+
+#define RUNS 200
+
+typedef void (*delayFunc)(unsigned int howLong);
+
+
+// The implementation before the calibrated delay
+static void oldDelayMicroseconds(unsigned int howLong) {
+  struct timeval tNow, tLong, tEnd;
+  struct timespec sleeper;
+
+  if (howLong == 0)
+    return;
+  if (howLong < 100) {
+    gettimeofday(&tNow, NULL);
+    tLong.tv_sec  = howLong / 1000000;
+    tLong.tv_usec = howLong % 1000000;
+    timeradd(&tNow, &tLong, &tEnd);
+    while (timercmp(&tNow, &tEnd, <))
+      gettimeofday(&tNow, NULL);
+  } else {
+    sleeper.tv_sec  = howLong / 1000000;
+    sleeper.tv_nsec = (long)(howLong % 1000000) * 1000L;
+    nanosleep(&sleeper, NULL);
+  }
+}
+
+
+static long long nanos(clockid_t clock) {
+  struct timespec ts;
+  clock_gettime(clock, &ts);
+  return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+
+static int compareLongLong(const void *a, const void *b) {
+  long long x = *(const long long *)a, y = *(const long long *)b;
+  return (x > y) - (x < y);
+}
+
+
+static void bench(const char *name, delayFunc func, unsigned int howLong) {
+  static long long overshoot[RUNS];
+  long long wall = 0, cpu0, cpu1;
+
+  cpu0 = nanos(CLOCK_THREAD_CPUTIME_ID);
+  for (int i = 0; i < RUNS; ++i) {
+    long long start = nanos(CLOCK_MONOTONIC_RAW);
+    func(howLong);
+    long long took = nanos(CLOCK_MONOTONIC_RAW) - start;
+    overshoot[i] = took - howLong * 1000LL;
+    wall += took;
+  }
+  cpu1 = nanos(CLOCK_THREAD_CPUTIME_ID);
+
+  qsort(overshoot, RUNS, sizeof(overshoot[0]), compareLongLong);
+  printf("%-4s %10u | %8.1f %8.1f %8.1f %8.1f %8.1f | %5.1f%%\n", name, howLong,
+         overshoot[0] / 1000.0, overshoot[RUNS / 2] / 1000.0, overshoot[(RUNS * 9) / 10] / 1000.0,
+         overshoot[(RUNS * 99) / 100] / 1000.0, overshoot[RUNS - 1] / 1000.0,
+         100.0 * (cpu1 - cpu0) / wall);
+}
+
+
+int main (void) {
+  static const unsigned int delays[] = { 1, 10, 50, 99, 100, 250, 1000, 5000 };
+  int major, minor;
+
+  wiringPiVersion(&major, &minor);
+  printf("Benchmark delayMicroseconds (WiringPi %d.%d)\n", major, minor);
+  printf("-------------------------------------------\n\n");
+  printf("calibrated margin: %d us\n\n", delayCalibrate());
+
+  printf("                | overshoot [us]                               | CPU\n");
+  printf("impl  delay[us] |      min   median      p90      p99      max | busy\n");
+  for (unsigned int i = 0; i < sizeof(delays) / sizeof(delays[0]); ++i) {
+    bench("old", oldDelayMicroseconds, delays[i]);
+    bench("new", delayMicroseconds, delays[i]);
+  }
+
+  return 0;
+}
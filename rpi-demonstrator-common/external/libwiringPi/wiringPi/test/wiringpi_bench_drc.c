@@ -0,0 +1,101 @@
+// WiringPi benchmark: DRC serial protocol round trips (no hardware needed)
+// Compile: gcc -Wall wiringpi_bench_drc.c -o wiringpi_bench_drc -lwiringPi
+//
+// Runs against the fake DRC device on a pseudo terminal, so this measures
+// the host side cost per request (system calls, wake ups), not the baud rate.
+// Compares the old one byte per write, one round trip per read protocol
+// handling with the pipelined drcSerial driver.
+
+#define _GNU_SOURCE
+#include "wpi_test.h"
+#include "wpi_drc_fake.h"
+#include "wiringSerial.h"
+#include "drcSerial.h"
+
+#define PINBASE 100
+#define PINS    20
+#define READS   4000
+
+static int asyncCount = 0;
+
+static void asyncDone(int pin, int value, void *userdata) {
+  (void)pin; (void)value; (void)userdata;
+  __atomic_add_fetch(&asyncCount, 1, __ATOMIC_RELAXED);
+}
+
+
+static void report(const char *name, int ops, unsigned long long us) {
+  printf("%-44s %6d ops in %8llu us -> %7.2f us/op\n", name, ops, us, (double)us / ops);
+}
+
+
+int main (void) {
+  int major, minor, fd;
+  int values[PINS];
+  unsigned long long start;
+  const char *device;
+
+  wiringPiVersion(&major, &minor);
+  printf("Benchmark DRC serial requests (WiringPi %d.%d)\n", major, minor);
+  printf("---------------------------------------------\n\n");
+
+  if ((device = fakeDrcStart()) == NULL || (fd = serialOpen(device, 115200)) < 0) {
+    FailAndExitWithErrno("fake DRC device", -1);
+  }
+
+  // The way drcSerial used to do it
+  start = piMicros64();
+  for (int i = 0; i < READS; ++i) {
+    serialPutchar(fd, 'r');
+    serialPutchar(fd, i % PINS);
+    (void)serialGetchar(fd);
+  }
+  report("old: putchar/getchar digital read", READS, piMicros64() - start);
+
+  start = piMicros64();
+  for (int i = 0; i < READS; ++i) {
+    serialPutchar(fd, '1');
+    serialPutchar(fd, i % PINS);
+  }
+  report("old: putchar digital write", READS, piMicros64() - start);
+
+  if (!drcSetupSerial(PINBASE, PINS, device, 115200)) {
+    FailAndExitWithErrno("drcSetupSerial", -1);
+  }
+  serialClose(fd);
+
+  start = piMicros64();
+  for (int i = 0; i < READS; ++i)
+    (void)digitalRead(PINBASE + i % PINS);
+  report("new: digitalRead, one at a time", READS, piMicros64() - start);
+
+  start = piMicros64();
+  for (int i = 0; i < READS; ++i)
+    digitalWrite(PINBASE + i % PINS, i & 1);
+  report("new: digitalWrite, one at a time", READS, piMicros64() - start);
+
+  start = piMicros64();
+  for (int i = 0; i < READS / PINS; ++i) {
+    wiringPiNodeBegin(PINBASE);
+    for (int pin = 0; pin < PINS; ++pin)
+      digitalWrite(PINBASE + pin, i & 1);
+    wiringPiNodeCommit(PINBASE);
+  }
+  report("new: digitalWrite, 20 per transaction", READS, piMicros64() - start);
+
+  start = piMicros64();
+  for (int i = 0; i < READS / PINS; ++i)
+    (void)drcSerialReadPins(PINBASE, PINS, values);
+  report("new: drcSerialReadPins, 20 pin snapshot", READS, piMicros64() - start);
+
+  start = piMicros64();
+  for (int i = 0; i < READS; ++i)
+    (void)drcSerialReadAsync(PINBASE + i % PINS, 0, asyncDone, NULL);
+  (void)drcSerialFlush(PINBASE);
+  report("new: drcSerialReadAsync, all in flight", READS, piMicros64() - start);
+
+  if (asyncCount != READS)
+    printf("only %d of %d async reads completed\n", asyncCount, READS);
+
+  return 0;
+}
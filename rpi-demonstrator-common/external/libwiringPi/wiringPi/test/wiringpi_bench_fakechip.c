@@ -0,0 +1,132 @@
+// WiringPi benchmark: GPIO device mode on the fake gpiochip (no hardware needed)
+// Compile: gcc -Wall wiringpi_bench_fakechip.c -o wiringpi_bench_fakechip -L. -lfakegpiochip -lwiringPi -lpthread -Wl,-rpath,'$ORIGIN'
+//
+// Toggle rate, read rate and ISR latency through the /dev/gpiochip paths,
+// with BCM19 wired to BCM26 on the fake chip. The numbers include the
+// emulator's own cost, so they're for comparing wiringPi versions and code
+// paths on the same box, not for predicting a Pi. The lgpio counterpart is
+// liblggpio/EXAMPLES/lgpio/bench_fakechip.c.
+
+#include "wpi_test.h"
+#include "fakegpiochip.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+#define OUT      19
+#define IN       26
+#define LOOPS    100000
+#define EDGES    2000
+#define THREADS  4
+
+static volatile int       edges;
+static volatile long long edgeAt;
+
+
+static long long nanos(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+
+static int compareLongLong(const void *a, const void *b) {
+  long long x = *(const long long *)a, y = *(const long long *)b;
+  return (x > y) - (x < y);
+}
+
+
+static void report(const char *name, long long count, long long ns) {
+  printf("%-40s %8lld in %8.1f ms -> %10.0f /s, %7.0f ns each\n", name, count, ns / 1e6, count * 1e9 / ns, (double)ns / count);
+}
+
+
+static void isrEdge(struct WPIWfiStatus wfiStatus, void *userdata) {
+  (void)wfiStatus; (void)userdata;
+  edgeAt = nanos();
+  __atomic_add_fetch(&edges, 1, __ATOMIC_RELEASE);
+}
+
+
+// One pin pair per thread, all on the default context
+
+static void *toggler(void *arg) {
+  int pin = (int)(long)arg;
+
+  for (int i = 0; i < LOOPS / THREADS; ++i)
+    digitalWrite(pin, i & 1);
+  return NULL;
+}
+
+
+int main (void) {
+  static long long latency[EDGES];
+  int major, minor, value = 0;
+  long long start;
+
+  wiringPiVersion(&major, &minor);
+  printf("Benchmark GPIO device mode on the fake gpiochip (WiringPi %d.%d)\n", major, minor);
+  printf("---------------------------------------------------------------\n\n");
+
+  fakeGpiochipLoopback(OUT, IN);
+  if (wiringPiSetupGpioDevice(WPI_PIN_BCM) != 0) {
+    printf("wiringPiSetupGpioDevice failed\n\n");
+    exit(EXIT_FAILURE);
+  }
+  pinMode(OUT, OUTPUT);
+  pinMode(IN, INPUT);
+
+  start = nanos();
+  for (int i = 0; i < LOOPS; ++i)
+    digitalWrite(OUT, i & 1);
+  report("digitalWrite toggle", LOOPS, nanos() - start);
+
+  start = nanos();
+  for (int i = 0; i < LOOPS; ++i)
+    value += digitalRead(IN);
+  report("digitalRead", LOOPS, nanos() - start);
+
+  start = nanos();
+  for (int i = 0; i < LOOPS; ++i)
+    value += wpiCtxDigitalRead(wpiCtxDefault(), IN);
+  report("wpiCtxDigitalRead", LOOPS, nanos() - start);
+
+  // Different pins from several threads: only the emulator's lock is shared
+
+  pthread_t threads[THREADS];
+  static const int pins[THREADS] = { 5, 6, 13, 16 };
+  for (int t = 0; t < THREADS; ++t)
+    pinMode(pins[t], OUTPUT);
+  start = nanos();
+  for (int t = 0; t < THREADS; ++t)
+    pthread_create(&threads[t], NULL, toggler, (void *)(long)pins[t]);
+  for (int t = 0; t < THREADS; ++t)
+    pthread_join(threads[t], NULL);
+  report("digitalWrite toggle, 4 threads", LOOPS, nanos() - start);
+
+  // ISR latency: from the write that makes the edge to the handler
+
+  digitalWrite(OUT, LOW);
+  if (wiringPiISR2(IN, INT_EDGE_BOTH, isrEdge, NULL) != 0) {
+    printf("wiringPiISR2 failed\n\n");
+    exit(EXIT_FAILURE);
+  }
+  start = nanos();
+  for (int i = 0; i < EDGES; ++i) {
+    long long t0 = nanos(), deadline = t0 + 1000000000LL;
+    digitalWrite(OUT, (i & 1) ? LOW : HIGH);
+    while (__atomic_load_n(&edges, __ATOMIC_ACQUIRE) <= i && nanos() < deadline)
+      sched_yield();
+    latency[i] = edgeAt - t0;
+  }
+  report("edge -> ISR round trip", EDGES, nanos() - start);
+  wiringPiISRStop(IN);
+
+  qsort(latency, EDGES, sizeof(latency[0]), compareLongLong);
+  printf("ISR latency [us]: min %.1f, median %.1f, p90 %.1f, p99 %.1f, max %.1f (%d edges seen)\n",
+         latency[0] / 1000.0, latency[EDGES / 2] / 1000.0, latency[(EDGES * 9) / 10] / 1000.0,
+         latency[(EDGES * 99) / 100] / 1000.0, latency[EDGES - 1] / 1000.0, edges);
+
+  return value < 0;
+}
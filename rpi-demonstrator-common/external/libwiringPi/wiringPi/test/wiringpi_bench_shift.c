@@ -0,0 +1,90 @@
+// WiringPi benchmark: shift register output throughput
+// Compile: gcc -Wall wiringpi_bench_shift.c -o wiringpi_bench_shift -lwiringPi
+//
+// Needs a Pi, the pins below are driven but nothing has to be connected:
+// data BCM5, BCM6, BCM13, BCM19 - clock BCM20 - latch BCM21
+
+#include "wpi_test.h"
+#include "wiringShift.h"
+#include "sr595.h"
+
+#define CHAINS     4
+#define BYTES      2000
+#define PINBASE    100
+#define PINS       16
+
+static const int dataPins[CHAINS] = { 5, 6, 13, 19 };
+static const int clockPin = 20;
+static const int latchPin = 21;
+
+
+static void report(const char *name, unsigned long long bits, unsigned long long us) {
+  printf("%-44s %10llu bits in %8llu us -> %8.2f Mbit/s\n", name, bits, us, (double)bits / us);
+}
+
+
+int main (void) {
+  int major, minor;
+  uint8_t vals[CHAINS];
+  unsigned long long start;
+
+  wiringPiVersion(&major, &minor);
+  printf("Benchmark shift register output (WiringPi %d.%d)\n", major, minor);
+  printf("-----------------------------------------------\n\n");
+
+  if (wiringPiSetupGpio() == -1) {
+    printf("wiringPiSetupGpio failed\n\n");
+    exit(EXIT_FAILURE);
+  }
+  for (int c = 0; c < CHAINS; ++c)
+    pinMode(dataPins[c], OUTPUT);
+  pinMode(clockPin, OUTPUT);
+  pinMode(latchPin, OUTPUT);
+
+  printf("shiftOut / shiftOutParallel:\n");
+  for (int chains = 1; chains <= CHAINS; chains *= 2) {
+    char name[64];
+
+    start = piMicros64();
+    for (int i = 0; i < BYTES; ++i)
+      for (int c = 0; c < chains; ++c)
+        shiftOut(dataPins[c], clockPin, MSBFIRST, i + c);
+    snprintf(name, sizeof(name), "  shiftOut, %d chain(s) one after another", chains);
+    report(name, 8ULL * BYTES * chains, piMicros64() - start);
+
+    start = piMicros64();
+    for (int i = 0; i < BYTES; ++i) {
+      for (int c = 0; c < chains; ++c)
+        vals[c] = i + c;
+      shiftOutParallel(chains, dataPins, clockPin, MSBFIRST, vals);
+    }
+    snprintf(name, sizeof(name), "  shiftOutParallel, %d chain(s)", chains);
+    report(name, 8ULL * BYTES * chains, piMicros64() - start);
+  }
+
+// sr595: updating all 64 pins (4 chains of 16). Written one by one, each
+// digitalWrite shifts and latches a whole chain; in a transaction it's one
+// shift of all chains and one latch.
+
+  printf("\nsr595, %d chains of %d pins, updating every pin:\n", CHAINS, PINS);
+  sr595ParallelSetup(PINBASE, PINS, CHAINS, dataPins, clockPin, latchPin);
+
+  start = piMicros64();
+  for (int i = 0; i < BYTES / 16; ++i)
+    for (int pin = 0; pin < PINS * CHAINS; ++pin)
+      digitalWrite(PINBASE + pin, (i + pin) & 1);
+  report("  digitalWrite per pin (pin bits)", (unsigned long long)(BYTES / 16) * PINS * CHAINS,
+         piMicros64() - start);
+
+  start = piMicros64();
+  for (int i = 0; i < BYTES / 16; ++i) {
+    wiringPiNodeBegin(PINBASE);
+    for (int pin = 0; pin < PINS * CHAINS; ++pin)
+      digitalWrite(PINBASE + pin, (i + pin) & 1);
+    wiringPiNodeCommit(PINBASE);
+  }
+  report("  batched in a transaction (pin bits)", (unsigned long long)(BYTES / 16) * PINS * CHAINS,
+         piMicros64() - start);
+
+  return 0;
+}
@@ -0,0 +1,121 @@
+// WiringPi test program: pipelined DRC serial protocol (no hardware needed)
+// Compile: gcc -Wall wiringpi_drc_test1_pty.c -o wiringpi_drc_test1_pty -lwiringPi
+//
+// Talks to a fake DRC device on a pseudo terminal and counts the write
+// system calls the library makes. Only calls that don't need one of the
+// wiringPiSetup functions are used, so it runs on any Linux box.
+
+#define _GNU_SOURCE
+#include "wpi_test.h"
+#include "wpi_drc_fake.h"
+#include "drcSerial.h"
+
+#include <sys/uio.h>
+#include <sys/syscall.h>
+
+#define PINBASE 100
+#define PINS    20
+#define PENDING 256     // drcSerial's request FIFO
+
+static int writevCalls = 0;
+
+
+// Interposed, so the library's writev calls land here
+ssize_t writev(int fd, const struct iovec *iov, int iovcnt) {
+  __atomic_add_fetch(&writevCalls, 1, __ATOMIC_RELAXED);
+  return syscall(SYS_writev, fd, iov, iovcnt);
+}
+
+
+static int asyncCount = 0;
+static int asyncErrors = 0;
+
+static void asyncDone(int pin, int value, void *userdata) {
+  int analog = *(int *)userdata;
+  int expect = analog ? fakeAnalog(pin - PINBASE) : fakeLevels[pin - PINBASE];
+  if (value != expect)
+    __atomic_add_fetch(&asyncErrors, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&asyncCount, 1, __ATOMIC_RELAXED);
+}
+
+
+int main (void) {
+  int major, minor;
+  int values[PINS];
+  unsigned int expectMask = 0;
+  static int digital = 0, analog = 1;
+  const char *device;
+
+  wiringPiVersion(&major, &minor);
+  printf("Testing pipelined DRC serial on a pty (WiringPi %d.%d)\n", major, minor);
+  printf("-----------------------------------------------------\n\n");
+
+  if ((device = fakeDrcStart()) == NULL) {
+    FailAndExitWithErrno("fakeDrcStart", -1);
+  }
+  CheckSame("drcSetupSerial", drcSetupSerial(PINBASE, PINS, device, 115200), TRUE);
+
+  printf("\nSingle reads and writes:\n");
+  digitalWrite(PINBASE + 3, HIGH);
+  CheckSame("digitalRead pin 3", digitalRead(PINBASE + 3), HIGH);
+  CheckSame("digitalRead pin 4", digitalRead(PINBASE + 4), LOW);
+  CheckSame("analogRead pin 5", analogRead(PINBASE + 5), fakeAnalog(5));
+
+  printf("\nWrites in a transaction:\n");
+  writevCalls = 0;
+  wiringPiNodeBegin(PINBASE);
+  for (int pin = 0; pin < 10; ++pin) {
+    digitalWrite(PINBASE + pin, pin & 1);
+    if (pin & 1)
+      expectMask |= 1u << pin;
+  }
+  CheckSame("nothing sent before commit", writevCalls, 0);
+  wiringPiNodeCommit(PINBASE);
+  CheckSame("10 writes in one writev", writevCalls, 1);
+
+  printf("\nBatched reads:\n");
+  writevCalls = 0;
+  CheckSame("wiringPiNodeReadAll", wiringPiNodeReadAll(PINBASE), expectMask);
+  CheckSame("20 reads in one writev", writevCalls, 1);
+  CheckSame("drcSerialReadPins", drcSerialReadPins(PINBASE + 2, 8, values), 0);
+  for (int i = 0; i < 8; ++i) {
+    char msg[32];
+    snprintf(msg, sizeof(msg), "snapshot pin %d", 2 + i);
+    CheckSame(msg, values[i], (2 + i) & 1);
+  }
+  CheckSame("drcSerialReadPins past the end", drcSerialReadPins(PINBASE + 15, 8, values), -1);
+  CheckSame("analogReadMany", analogReadMany(PINBASE + 1, 4, values), 4);
+  CheckSame("analogReadMany pin 1", values[0], fakeAnalog(1));
+  CheckSame("analogReadMany pin 4", values[3], fakeAnalog(4));
+
+  printf("\nAsync reads:\n");
+  writevCalls = 0;
+  wiringPiNodeBegin(PINBASE);
+  for (int i = 0; i < 200; ++i)
+    drcSerialReadAsync(PINBASE + i % PINS, i & 1, asyncDone, (i & 1) ? &analog : &digital);
+  wiringPiNodeCommit(PINBASE);
+  CheckSame("drcSerialFlush", drcSerialFlush(PINBASE), 0);
+  CheckSame("all callbacks ran", asyncCount, 200);
+  CheckSame("callback values", asyncErrors, 0);
+  CheckSame("200 async reads in one writev", writevCalls, 1);
+  CheckSame("async on a non DRC pin", drcSerialReadAsync(17, 0, asyncDone, &digital), -1);
+  CheckSame("sync read after async", digitalRead(PINBASE + 1), HIGH);
+
+  printf("\nDevice stops answering:\n");
+  __atomic_store_n(&fakeHold, 1, __ATOMIC_RELEASE);
+  CheckSame("analogRead times out", analogRead(PINBASE + 5), -1);
+  CheckSame("digitalRead times out", digitalRead(PINBASE + 5), -1);
+  asyncCount = 0;
+  for (int i = 0; i < PENDING - 2 - 2; ++i)
+    drcSerialReadAsync(PINBASE + i % PINS, 0, asyncDone, &digital);
+  CheckSame("analogReadMany with the FIFO full", analogReadMany(PINBASE + 1, 4, values), -1);
+  values[0] = values[1] = -2;   // Queued before the FIFO filled up, now abandoned
+  __atomic_store_n(&fakeHold, 0, __ATOMIC_RELEASE);
+  CheckSame("drcSerialFlush once it answers again", drcSerialFlush(PINBASE), 0);
+  CheckSame("abandoned reads not stored", values[0] + values[1], -4);
+  CheckSame("async reads still answered", asyncCount, PENDING - 4);
+  CheckSame("callback values", asyncErrors, 0);
+  CheckSame("replies still in step", analogRead(PINBASE + 5), fakeAnalog(5));
+
+  return UnitTestState();
+}
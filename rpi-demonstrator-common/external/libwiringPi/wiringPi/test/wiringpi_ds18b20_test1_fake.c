@@ -0,0 +1,136 @@
+// WiringPi test program: DS18B20 background sampler (no hardware needed)
+// Compile: gcc -Wall wiringpi_ds18b20_test1_fake.c -o wiringpi_ds18b20_test1_fake -lwiringPi
+//
+// Builds a fake w1 sysfs tree in /tmp - two sensors behind one bus master
+// and a third on a bus without therm_bulk_read - and points the driver at it.
+
+#include "wpi_test.h"
+#include "ds18b20.h"
+
+#include <unistd.h>
+#include <limits.h>
+#include <sys/stat.h>
+
+static char root[64];
+
+
+void writeFile(const char *dir, const char *name, const char *text) {
+  char path[PATH_MAX];
+  snprintf(path, sizeof(path), "%s/%s/%s", root, dir, name);
+  FILE *f = fopen(path, "w");
+  if (f == NULL) {
+    FailAndExitWithErrno(path, -1);
+  }
+  fputs(text, f);
+  fclose(f);
+}
+
+
+void readFile(const char *dir, const char *name, char *text, int size) {
+  char path[PATH_MAX];
+  snprintf(path, sizeof(path), "%s/%s/%s", root, dir, name);
+  text[0] = 0;
+  FILE *f = fopen(path, "r");
+  if (f != NULL) {
+    if (fgets(text, size, f) == NULL)
+      text[0] = 0;
+    fclose(f);
+  }
+  text[strcspn(text, "\n")] = 0;
+}
+
+
+void makeSensor(const char *master, const char *id, const char *slave) {
+  char path[PATH_MAX], link[PATH_MAX];
+  snprintf(path, sizeof(path), "%s/%s/28-%s", root, master, id);
+  mkdir(path, 0755);
+  snprintf(path, sizeof(path), "%s/28-%s", master, id);
+  snprintf(link, sizeof(link), "%s/28-%s", root, id);
+  if (symlink(path, link) != 0) {
+    FailAndExitWithErrno("symlink", -1);
+  }
+  snprintf(path, sizeof(path), "%s/28-%s", master, id);
+  writeFile(path, "w1_slave", slave);
+}
+
+
+void slaveText(char *text, int size, const char *crc, int milliDegrees) {
+  snprintf(text, size, "72 01 4b 46 7f ff 0e 10 57 : crc=57 %s\n72 01 4b 46 7f ff 0e 10 57 t=%d\n", crc, milliDegrees);
+}
+
+
+int main (void) {
+  int major, minor;
+  char text[256], path[PATH_MAX];
+
+  wiringPiVersion(&major, &minor);
+  printf("Testing DS18B20 sampler on a fake w1 sysfs tree (WiringPi %d.%d)\n",major, minor);
+  printf("-----------------------------------------------------------------\n\n");
+
+  snprintf(root, sizeof(root), "/tmp/wpi_w1_XXXXXX");
+  if (mkdtemp(root) == NULL) {
+    FailAndExitWithErrno("mkdtemp", -1);
+  }
+  snprintf(path, sizeof(path), "%s/w1_bus_master1", root);
+  mkdir(path, 0755);
+  snprintf(path, sizeof(path), "%s/w1_bus_master2", root);
+  mkdir(path, 0755);
+  writeFile("w1_bus_master1", "therm_bulk_read", "0\n");
+
+  slaveText(text, sizeof(text), "YES", 23125);
+  makeSensor("w1_bus_master1", "000000000001", text);
+  slaveText(text, sizeof(text), "YES", -10062);
+  makeSensor("w1_bus_master1", "000000000002", text);
+  slaveText(text, sizeof(text), "YES", 85000);
+  makeSensor("w1_bus_master2", "000000000003", text);
+
+  ds18b20SetW1Root(root);
+  CheckSame("setup sensor 1", ds18b20Setup(100, "000000000001"), TRUE);
+  CheckSame("setup sensor 2", ds18b20Setup(110, "000000000002"), TRUE);
+  CheckSame("setup sensor 3", ds18b20Setup(120, "000000000003"), TRUE);
+  CheckSame("setup missing sensor", ds18b20Setup(130, "0000000000ff"), FALSE);
+
+  printf("\nDirect reads:\n");
+  CheckSame("sensor 1 (23.125C)", analogRead(100), 231);
+  CheckSame("sensor 2 (-10.062C)", analogRead(110), -101);
+  CheckSame("sensor 3 (85.000C)", analogRead(120), 850);
+  readFile("w1_bus_master1", "therm_bulk_read", text, sizeof(text));
+  CheckSameText("no bulk trigger without sampler", text, "0");
+
+  printf("\nBackground sampler:\n");
+  CheckSame("ds18b20SamplerStart", ds18b20SamplerStart(20), 0);
+  readFile("w1_bus_master1", "therm_bulk_read", text, sizeof(text));
+  CheckSameText("bus 1 bulk conversion triggered", text, "trigger");
+  CheckSame("cached sensor 1", analogRead(100), 231);
+  CheckSame("cached sensor 3", analogRead(120), 850);
+
+  slaveText(text, sizeof(text), "YES", 21949);
+  writeFile("w1_bus_master1/28-000000000001", "w1_slave", text);
+  slaveText(text, sizeof(text), "NO", 21949);
+  writeFile("w1_bus_master1/28-000000000002", "w1_slave", text);
+  delay(200);
+  CheckSame("refreshed sensor 1", analogRead(100), 219);
+  CheckSame("sensor 2 CRC error", analogRead(110), -9997);
+
+  writeFile("w1_bus_master1/28-000000000002", "w1_slave", "72 01 4b 46 7f ff 0e 10 57 : crc=57 YES\n");
+  delay(200);
+  CheckSame("sensor 2 no t=", analogRead(110), -9996);
+
+  unsigned int start = micros();
+  for (int i = 0; i < 1000; ++i)
+    analogRead(100);
+  unsigned int duration = micros() - start;
+  printf("1000 cached reads took %u us\n", duration);
+  CheckSame("cached reads don't touch the file", duration < 10000, 1);
+
+  ds18b20SamplerStop();
+  slaveText(text, sizeof(text), "YES", 0);
+  writeFile("w1_bus_master1/28-000000000001", "w1_slave", text);
+  CheckSame("direct read after stop", analogRead(100), 0);
+
+  snprintf(text, sizeof(text), "rm -rf %s", root);
+  if (system(text) != 0)
+    printf("unable to remove %s\n", root);
+
+  return UnitTestState();
+}
@@ -0,0 +1,157 @@
+// WiringPi test program: GPIO device mode and pin contexts on the fake gpiochip (no hardware needed)
+// Compile: gcc -Wall wiringpi_fakechip_test1_device.c -o wiringpi_fakechip_test1_device -L. -lfakegpiochip -lwiringPi -Wl,-rpath,'$ORIGIN'
+//
+// BCM19 <-> BCM26 and BCM12 <-> BCM13 are wired together on the fake chip,
+// BCM5 gets its edges from a script.
+
+#include "wpi_test.h"
+#include "fakegpiochip.h"
+
+#include <pthread.h>
+
+#define OUT     19
+#define IN      26
+#define SCRIPTED 5
+
+static volatile int edges, rising, falling;
+static volatile long long lastStamp;
+
+
+static void isrCount(struct WPIWfiStatus wfiStatus, void *userdata) {
+  (void)userdata;
+  if (wfiStatus.edge == INT_EDGE_RISING)
+    ++rising;
+  else
+    ++falling;
+  lastStamp = wfiStatus.timeStamp_us;
+  ++edges;
+}
+
+
+static void isrStopSelf(struct WPIWfiStatus wfiStatus, void *userdata) {
+  ++edges;
+  wpiCtxISRStop((wpiCtx *)userdata, wfiStatus.pinBCM);
+}
+
+
+static void waitEdges(int count) {
+  for (int i = 0; i < 100 && edges < count; ++i)
+    delay(10);
+}
+
+
+// Every thread toggles its own pair on its own context
+
+struct toggler {
+  wpiCtx *ctx;
+  int out, in, errors;
+};
+
+static void *toggle(void *arg) {
+  struct toggler *t = arg;
+
+  for (int i = 0; i < 2000; ++i) {
+    wpiCtxDigitalWrite(t->ctx, t->out, i & 1);
+    if (wpiCtxDigitalRead(t->ctx, t->in) != (i & 1))
+      ++t->errors;
+  }
+  return NULL;
+}
+
+
+int main (void) {
+  int major, minor;
+
+  wiringPiVersion(&major, &minor);
+  printf("Testing GPIO device mode on the fake gpiochip (WiringPi %d.%d)\n", major, minor);
+  printf("-------------------------------------------------------------\n\n");
+
+  fakeGpiochipLoopback(OUT, IN);
+  fakeGpiochipLoopback(12, 13);
+
+  CheckSame("wiringPiSetupGpioDevice", wiringPiSetupGpioDevice(WPI_PIN_BCM), 0);
+
+  printf("\nLevels:\n");
+  pinMode(OUT, OUTPUT);
+  pinMode(IN, INPUT);
+  CheckSame("output line requested", fakeGpiochipRequested(OUT), 1);
+  digitalWrite(OUT, HIGH);
+  CheckSame("loopback high", digitalRead(IN), HIGH);
+  CheckSame("physical level high", fakeGpiochipLevel(OUT), 1);
+  digitalWrite(OUT, LOW);
+  CheckSame("loopback low", digitalRead(IN), LOW);
+
+  pinMode(OUT, INPUT);
+  pullUpDnControl(IN, PUD_UP);
+  CheckSame("pull-up", digitalRead(IN), HIGH);
+  pullUpDnControl(IN, PUD_DOWN);
+  CheckSame("pull-down", digitalRead(IN), LOW);
+  pinMode(OUT, OUTPUT);
+
+  printf("\nInterrupts:\n");
+  CheckSame("wiringPiISR2", wiringPiISR2(IN, INT_EDGE_BOTH, isrCount, NULL), 0);
+  CheckSame("second ISR on the pin refused", wiringPiISR2(IN, INT_EDGE_BOTH, isrCount, NULL), -1);
+  for (int i = 0; i < 10; ++i)
+    digitalWrite(OUT, (i & 1) ? LOW : HIGH);
+  waitEdges(10);
+  CheckSame("edges", edges, 10);
+  CheckSame("rising", rising, 5);
+  CheckSame("falling", falling, 5);
+  CheckSame("timestamp", lastStamp > 0, 1);
+  CheckSame("wiringPiISRStop", wiringPiISRStop(IN), 0);
+  CheckSame("event line released", fakeGpiochipRequested(IN), 0);
+  digitalWrite(OUT, HIGH);
+  delay(20);
+  CheckSame("no edges after stop", edges, 10);
+
+  edges = rising = falling = 0;
+  fakeGpiochipScript("+2000 *3(5=1 +500 5=0 +500)");
+  CheckSame("ISR on scripted pin", wiringPiISR2(SCRIPTED, INT_EDGE_RISING, isrCount, NULL), 0);
+  fakeGpiochipWaitScript();
+  waitEdges(3);
+  CheckSame("scripted rising edges", rising, 3);
+  CheckSame("no falling edges", falling, 0);
+  wiringPiISRStop(SCRIPTED);
+
+  printf("\nContexts:\n");
+  wpiCtx *ctx1 = wpiCtxNew();
+  wpiCtx *ctx2 = wpiCtxNew();
+  CheckSame("wpiCtxNew", ctx1 != NULL && ctx2 != NULL, 1);
+  CheckSame("default context", wpiCtxDefault() != ctx1, 1);
+
+  // The default context still holds BCM19
+  digitalWrite(OUT, LOW);
+  wpiCtxDigitalWrite(ctx1, OUT, HIGH);
+  CheckSame("busy line stays with its owner", fakeGpiochipLevel(OUT), 0);
+  pinMode(OUT, PM_OFF);
+  pinMode(IN, PM_OFF);
+  CheckSame("PM_OFF releases the line", fakeGpiochipRequested(OUT), 0);
+
+  struct toggler t1 = { ctx1, OUT, IN, 0 }, t2 = { ctx2, 12, 13, 0 };
+  pthread_t th1, th2;
+  pthread_create(&th1, NULL, toggle, &t1);
+  pthread_create(&th2, NULL, toggle, &t2);
+  pthread_join(th1, NULL);
+  pthread_join(th2, NULL);
+  CheckSame("context 1 toggles", t1.errors, 0);
+  CheckSame("context 2 toggles", t2.errors, 0);
+
+  edges = 0;
+  CheckSame("wpiCtxISR", wpiCtxISR(ctx2, 12, INT_EDGE_BOTH, isrStopSelf, ctx2), 0);
+  wpiCtxPinMode(ctx1, 13, OUTPUT);
+  wpiCtxDigitalWrite(ctx1, 13, HIGH);
+  waitEdges(1);
+  delay(50);
+  CheckSame("handler stopped itself", fakeGpiochipRequested(12), 0);
+  wpiCtxDigitalWrite(ctx1, 13, LOW);
+  delay(20);
+  CheckSame("one edge only", edges, 1);
+  CheckSame("ISR can be started again", wpiCtxISR(ctx2, 12, INT_EDGE_BOTH, isrCount, NULL), 0);
+
+  wpiCtxFree(ctx1);
+  wpiCtxFree(ctx2);
+  CheckSame("wpiCtxFree releases lines", fakeGpiochipRequested(OUT) + fakeGpiochipRequested(IN) +
+            fakeGpiochipRequested(12) + fakeGpiochipRequested(13), 0);
+
+  return UnitTestState();
+}
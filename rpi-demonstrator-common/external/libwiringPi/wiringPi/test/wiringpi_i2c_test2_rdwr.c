@@ -0,0 +1,273 @@
+// WiringPi test program: I2C combined transactions (no hardware needed)
+// Compile: gcc -Wall wiringpi_i2c_test2_rdwr.c -o wiringpi_i2c_test2_rdwr -lwiringPi
+//
+// The ioctl() below takes the place of the libc one for libwiringPi too,
+// so it acts as an in-process fake I2C adapter: a 256 byte register file
+// with an auto-incrementing pointer that counts every bus transaction.
+// open() and piGpioLayout() are replaced the same way so the bmp180,
+// htu21d and ads1115 drivers find their /dev/i2c-1 on any host.
+
+#include "wpi_test.h"
+#include "wiringPiI2C.h"
+#include "bmp180.h"
+#include "htu21d.h"
+#include "ads1115.h"
+
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+
+const int i2cAdress = 0x77;
+
+static int     fakeFd   = -1;
+static int     fakeAddr = -1;
+static uint8_t fakeRegs[256];
+static uint8_t fakePtr;
+static int     smbusTransactions;
+static int     rdwrTransactions;
+static int     rdwrMessages;
+static int     wrongAddress;
+
+
+static int fakeRdWr(struct i2c_rdwr_ioctl_data *rdwr) {
+  rdwrTransactions++;
+  for (unsigned int m = 0; m < rdwr->nmsgs; ++m) {
+    struct i2c_msg *msg = &rdwr->msgs[m];
+    rdwrMessages++;
+    if (msg->addr != fakeAddr) {
+      wrongAddress++;
+      errno = ENXIO;
+      return -1;
+    }
+    if (msg->flags & I2C_M_RD) {
+      for (int i = 0; i < msg->len; ++i)
+        msg->buf[i] = fakeRegs[fakePtr++];
+    } else if (msg->len > 0) {
+      fakePtr = msg->buf[0];
+      for (int i = 1; i < msg->len; ++i)
+        fakeRegs[fakePtr++] = msg->buf[i];
+    }
+  }
+  return rdwr->nmsgs;
+}
+
+
+static int fakeSmbus(struct i2c_smbus_ioctl_data *smbus) {
+  smbusTransactions++;
+  fakePtr = smbus->command;
+  switch (smbus->size) {
+    case I2C_SMBUS_BYTE_DATA:
+      if (smbus->read_write == I2C_SMBUS_READ)
+        smbus->data->byte = fakeRegs[fakePtr];
+      else
+        fakeRegs[fakePtr] = smbus->data->byte;
+      return 0;
+    case I2C_SMBUS_WORD_DATA:
+      if (smbus->read_write == I2C_SMBUS_READ) {
+        smbus->data->word = fakeRegs[fakePtr] | (fakeRegs[(uint8_t)(fakePtr + 1)] << 8);
+      } else {
+        fakeRegs[fakePtr] = smbus->data->word & 0xFF;
+        fakeRegs[(uint8_t)(fakePtr + 1)] = smbus->data->word >> 8;
+      }
+      return 0;
+    case I2C_SMBUS_I2C_BLOCK_DATA:
+      for (int i = 1; i <= smbus->data->block[0]; ++i) {
+        if (smbus->read_write == I2C_SMBUS_READ)
+          smbus->data->block[i] = fakeRegs[fakePtr++];
+        else
+          fakeRegs[fakePtr++] = smbus->data->block[i];
+      }
+      return 0;
+  }
+  errno = EOPNOTSUPP;
+  return -1;
+}
+
+
+int ioctl(int fd, unsigned long request, ...) {
+  va_list ap;
+  va_start(ap, request);
+  void *arg = va_arg(ap, void *);
+  va_end(ap);
+
+  if (request == I2C_SLAVE) {
+    fakeFd   = fd;
+    fakeAddr = (int)(long)arg;
+    return 0;
+  }
+  if (fd != fakeFd) {
+    return syscall(SYS_ioctl, fd, request, arg);
+  }
+  switch (request) {
+    case I2C_RDWR:  return fakeRdWr(arg);
+    case I2C_SMBUS: return fakeSmbus(arg);
+  }
+  errno = ENOTTY;
+  return -1;
+}
+
+
+int open(const char *path, int flags, ...) {
+  va_list ap;
+  va_start(ap, flags);
+  int mode = (flags & O_CREAT) ? va_arg(ap, int) : 0;
+  va_end(ap);
+
+  if (strcmp(path, "/dev/i2c-1") == 0)
+    path = "/dev/null";
+  return syscall(SYS_openat, AT_FDCWD, path, flags, mode);
+}
+
+
+int piGpioLayout(void) {
+  return 2;
+}
+
+
+void resetCounters() {
+  smbusTransactions = 0;
+  rdwrTransactions  = 0;
+  rdwrMessages      = 0;
+  wrongAddress      = 0;
+}
+
+
+int main (void) {
+  int major, minor;
+  uint8_t data[1024];
+  int ret;
+
+  wiringPiVersion(&major, &minor);
+  printf("Testing I2C combined transactions on a fake adapter (WiringPi %d.%d)\n",major, minor);
+  printf("--------------------------------------------------------------------\n\n");
+
+  for (int i = 0; i < 256; ++i)
+    fakeRegs[i] = i ^ 0x5A;
+
+  int fd = wiringPiI2CSetupInterface("/dev/null", i2cAdress);
+  if (fd < 0) {
+    FailAndExitWithErrno("wiringPiI2CSetupInterface", fd);
+  }
+  CheckSame("fake adapter address", fakeAddr, i2cAdress);
+
+  printf("\nRegister burst read vs. SMBus byte reads (BMP180 calibration block):\n");
+  resetCounters();
+  for (int reg = 0xAA; reg < 0xAA + 22; ++reg) {
+    wiringPiI2CReadReg8(fd, reg);
+  }
+  CheckSame("SMBus transactions for 22 bytes", smbusTransactions, 22);
+
+  resetCounters();
+  ret = wiringPiI2CReadRegBurst(fd, 0xAA, data, 22);
+  CheckSame("wiringPiI2CReadRegBurst result", ret, 22);
+  CheckSame("I2C_RDWR transactions for 22 bytes", rdwrTransactions, 1);
+  CheckSame("I2C_RDWR messages", rdwrMessages, 2);
+  CheckSame("SMBus transactions", smbusTransactions, 0);
+  int same = 1;
+  for (int i = 0; i < 22; ++i)
+    if (data[i] != fakeRegs[0xAA + i]) same = 0;
+  CheckSame("burst data matches registers", same, 1);
+
+  printf("\nBursts beyond the 32 byte SMBus block limit:\n");
+  resetCounters();
+  ret = wiringPiI2CReadRegBurst(fd, 0x00, data, sizeof(data));
+  CheckSame("1024 byte read result", ret, (int)sizeof(data));
+  CheckSame("1024 byte read transactions", rdwrTransactions, 1);
+  CheckSame("1024 byte read wraps register file", data[256 + 0x10], fakeRegs[0x10]);
+
+  for (int i = 0; i < 100; ++i)
+    data[i] = 0x80 + i;
+  resetCounters();
+  ret = wiringPiI2CWriteRegBurst(fd, 0x20, data, 100);
+  CheckSame("100 byte write result", ret, 100);
+  CheckSame("100 byte write transactions", rdwrTransactions, 1);
+  CheckSame("100 byte write first register", fakeRegs[0x20], 0x80);
+  CheckSame("100 byte write last register", fakeRegs[0x20 + 99], 0x80 + 99);
+
+  printf("\nMulti-message transaction (ADS1115 style config + conversion poll):\n");
+  uint8_t ptrConfig = 0x01, ptrConv = 0x00, status[2], conv[2];
+  struct wiringPiI2CMsg msgs[4] = {
+    { 0,            1, &ptrConfig },
+    { WPI_I2C_M_RD, 2, status     },
+    { 0,            1, &ptrConv   },
+    { WPI_I2C_M_RD, 2, conv       },
+  };
+  resetCounters();
+  ret = wiringPiI2CTransfer(fd, msgs, 4);
+  CheckSame("wiringPiI2CTransfer result", ret, 4);
+  CheckSame("transactions", rdwrTransactions, 1);
+  CheckSame("messages", rdwrMessages, 4);
+  CheckSame("status register", status[0], fakeRegs[1]);
+  CheckSame("conversion register", conv[1], fakeRegs[1]);
+
+  printf("\nLimits:\n");
+  resetCounters();
+  CheckSame("no messages", wiringPiI2CTransfer(fd, msgs, 0), -1);
+  CheckSame("too many messages", wiringPiI2CTransfer(fd, msgs, WPI_I2C_MSGS_MAX + 1), -1);
+  struct wiringPiI2CMsg big = { WPI_I2C_M_RD, WPI_I2C_MSG_MAX + 1, data };
+  CheckSame("oversized message", wiringPiI2CTransfer(fd, &big, 1), -1);
+  CheckSame("unknown fd", wiringPiI2CTransfer(fd + 1, msgs, 1), -1);
+  CheckSame("empty burst read", wiringPiI2CReadRegBurst(fd, 0x00, data, 0), -1);
+  CheckSame("burst read over 64k", wiringPiI2CReadRegBurst(fd, 0x00, data, 70000), -1);
+  CheckSame("burst read beyond message limit", wiringPiI2CReadRegBurst(fd, 0x00, data, WPI_I2C_MSG_MAX + 1), -1);
+  CheckSame("rejected without bus access", rdwrTransactions + smbusTransactions, 0);
+
+  printf("\nfd the address table doesn't know (>= 256):\n");
+  int highFd = dup2(fd, 300);
+  ioctl(highFd, I2C_SLAVE, i2cAdress);
+  resetCounters();
+  CheckSame("wiringPiI2CTransfer refuses it", wiringPiI2CTransfer(highFd, msgs, 4), -1);
+  ret = wiringPiI2CReadRegBurst(highFd, 0xAA, data, 40);
+  CheckSame("burst read falls back to SMBus", ret, 40);
+  CheckSame("SMBus block transactions", smbusTransactions, 2);
+  CheckSame("SMBus block data", data[39], fakeRegs[0xAA + 39]);
+  ret = wiringPiI2CTransferTo(highFd, i2cAdress, msgs, 4);
+  CheckSame("wiringPiI2CTransferTo with the address", ret, 4);
+  CheckSame("I2C_RDWR transactions", rdwrTransactions, 1);
+  close(highFd);
+  close(fd);
+
+  printf("\nbmp180 driver:\n");
+  resetCounters();
+  CheckSame("bmp180Setup", bmp180Setup(100), TRUE);
+  CheckSame("calibration in one transaction", rdwrTransactions, 1);
+  CheckSame("bus address", fakeAddr, 0x77);
+  CheckSame("no messages to another address", wrongAddress, 0);
+  resetCounters();
+  analogRead(100);
+  CheckSame("reading transactions", rdwrTransactions, 4);
+  CheckSame("start pressure conversion", fakeRegs[0xF4], 0x34);
+  CheckSame("no messages to another address", wrongAddress, 0);
+
+  printf("\nhtu21d driver:\n");
+  fakeRegs[0xE7] = 0x02;
+  fakeRegs[0xF3] = 0x66;
+  fakeRegs[0xF4] = 0x00;
+  resetCounters();
+  CheckSame("htu21dSetup", htu21dSetup(200), TRUE);
+  CheckSame("bus address", fakeAddr, 0x40);
+  CheckSame("reset and status transactions", rdwrTransactions, 2);
+  resetCounters();
+  ret = analogRead(200);
+  CheckSame("temperature (0x6600 raw, 23.6C)", ret, 236);
+  CheckSame("command and read transactions", rdwrTransactions, 2);
+  CheckSame("no messages to another address", wrongAddress, 0);
+
+  printf("\nads1115 driver:\n");
+  fakeRegs[0] = 0x12;
+  resetCounters();
+  CheckSame("ads1115Setup", ads1115Setup(300, 0x49), TRUE);
+  CheckSame("bus address", fakeAddr, 0x49);
+  resetCounters();
+  ret = analogRead(300);
+  CheckSame("conversion result", ret, (fakeRegs[0] << 8) | fakeRegs[1]);
+  CheckSame("config write and combined poll", rdwrTransactions, 2);
+  CheckSame("messages", rdwrMessages, 5);
+  CheckSame("no messages to another address", wrongAddress, 0);
+
+  return UnitTestState();
+}
@@ -0,0 +1,143 @@
+// WiringPi test program: shared pseudo pin bank between processes (no hardware needed)
+// Compile: gcc -Wall wiringpi_pseudopins_test1_fork.c -o wiringpi_pseudopins_test1_fork -lwiringPi
+//
+// A forked child attaches to the bank through its fd and writes while the
+// parent takes snapshots and waits for changes.
+
+#define _GNU_SOURCE
+#include "wpi_test.h"
+#include "pseudoPins.h"
+
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#define PINBASE  500
+#define CHILDPIN 600
+#define PINS     64
+#define WRITES   20000
+
+
+static void childWriter(int fd) {
+  int values[PINS];
+  if (!pseudoPinsSetupFd(CHILDPIN, fd))
+    _exit(1);
+  for (int v = 1; v <= WRITES; ++v) {
+    for (int i = 0; i < PINS; ++i)
+      values[i] = v;
+    pseudoPinsWriteMany(CHILDPIN, PINS, values);
+  }
+  _exit(0);
+}
+
+
+// Takes the bank's write side the way the library does (pid into the
+// writer word, sequence number odd) and dies holding it.
+
+static void childDies(int fd) {
+  uint32_t *bank = mmap(NULL, 4096, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (bank == MAP_FAILED)
+    _exit(1);
+  __atomic_store_n(&bank[5], (uint32_t)getpid(), __ATOMIC_RELAXED);	// writer
+  __atomic_add_fetch(&bank[2], 1, __ATOMIC_RELEASE);			// seq
+  _exit(0);
+}
+
+
+static void childPoke(int fd) {
+  if (!pseudoPinsSetupFd(CHILDPIN, fd))
+    _exit(1);
+  delay(50);
+  analogWrite(CHILDPIN + 5, 42);
+  _exit(0);
+}
+
+
+int main (void) {
+  int major, minor, status, fd;
+  int values[PINS];
+  long long int seq, timeStamp, lastTimeStamp = 0;
+  unsigned long long changed = 0;
+  int snapshots = 0, torn = 0, backwards = 0;
+  pid_t pid;
+
+  wiringPiVersion(&major, &minor);
+  printf("Testing pseudo pin bank shared with a child process (WiringPi %d.%d)\n", major, minor);
+  printf("-------------------------------------------------------------------\n\n");
+
+  CheckSame("pseudoPinsSetup", pseudoPinsSetup(PINBASE), TRUE);
+  fd = pseudoPinsFd(PINBASE);
+  CheckSame("pseudoPinsFd", fd >= 0, 1);
+  analogWrite(PINBASE + 3, 1234);
+  CheckSame("analogRead", analogRead(PINBASE + 3), 1234);
+  CheckSame("write past the end", pseudoPinsWriteMany(PINBASE + 60, 8, values), -1);
+
+  int junk = memfd_create("junk", 0);
+  CheckSame("foreign memory refused", ftruncate(junk, 4096) == 0 && !pseudoPinsSetupFd(700, junk), 1);
+  close(junk);
+
+  memset(values, 0, sizeof(values));
+  CheckSame("pseudoPinsWriteMany", pseudoPinsWriteMany(PINBASE, PINS, values), 0);
+
+  printf("\nSnapshots while a child writes all pins %d times:\n", WRITES);
+  if ((pid = fork()) == 0)
+    childWriter(fd);
+  do {
+    seq = pseudoPinsSnapshot(PINBASE, PINS, values, &timeStamp);
+    ++snapshots;
+    for (int i = 1; i < PINS; ++i)
+      if (values[i] != values[0]) {
+        ++torn;
+        break;
+      }
+    if (timeStamp < lastTimeStamp)
+      ++backwards;
+    lastTimeStamp = timeStamp;
+  } while (waitpid(pid, &status, WNOHANG) == 0);
+  printf("%d snapshots\n", snapshots);
+  CheckSame("writer child ok", WIFEXITED(status) && WEXITSTATUS(status) == 0, 1);
+  CheckSame("no torn snapshots", torn, 0);
+  CheckSame("timestamps don't go backwards", backwards, 0);
+  CheckSame("last write seen", analogRead(PINBASE + 63), WRITES);
+  CheckSame("sequence number even", (int)(seq & 1), 0);
+
+  printf("\nWaiting for a change:\n");
+  seq = pseudoPinsSnapshot(PINBASE, PINS, values, NULL);
+  CheckSame("no change on pin 5 yet", pseudoPinsWait(PINBASE, 1ULL << 5, seq, 0, &changed), FALSE);
+  if ((pid = fork()) == 0)
+    childPoke(fd);
+  unsigned int start = millis();
+  CheckSame("pin 6 times out", pseudoPinsWait(PINBASE, 1ULL << 6, seq, 20, &changed), FALSE);
+  CheckSame("wait for pins 5, 63", pseudoPinsWait(PINBASE, (1ULL << 5) | (1ULL << 63), seq, 2000, &changed), TRUE);
+  unsigned int took = millis() - start;
+  printf("woke up after %u ms\n", took);
+  CheckSame("blocked until the write", took >= 40 && took < 1000, 1);
+  CheckSame("changed mask", changed == (1ULL << 5), 1);
+  CheckSame("new value", analogRead(PINBASE + 5), 42);
+  waitpid(pid, &status, 0);
+  CheckSame("poke child ok", WIFEXITED(status) && WEXITSTATUS(status) == 0, 1);
+
+  printf("\nA writer dying with the bank held:\n");
+  if ((pid = fork()) == 0)
+    childDies(fd);
+  waitpid(pid, &status, 0);
+  CheckSame("dying child ok", WIFEXITED(status) && WEXITSTATUS(status) == 0, 1);
+  start = millis();
+  seq = pseudoPinsSnapshot(PINBASE, PINS, values, NULL);
+  CheckSame("reader takes the bank back", (int)(seq & 1), 0);
+  analogWrite(PINBASE + 7, 77);
+  took = millis() - start;
+  printf("recovered after %u ms\n", took);
+  CheckSame("... quickly", took < 1000, 1);
+  CheckSame("writes work again", analogRead(PINBASE + 7), 77);
+  if ((pid = fork()) == 0)
+    childDies(fd);
+  waitpid(pid, &status, 0);
+  analogWrite(PINBASE + 7, 78);
+  CheckSame("writer takes the bank back", analogRead(PINBASE + 7), 78);
+  seq = pseudoPinsSnapshot(PINBASE, PINS, values, NULL);
+  CheckSame("sequence number even again", (int)(seq & 1), 0);
+
+  return UnitTestState();
+}
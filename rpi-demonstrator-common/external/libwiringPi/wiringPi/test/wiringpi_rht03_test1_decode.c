@@ -0,0 +1,146 @@
+// WiringPi test program: RHT03/DHT22 edge decoder (no hardware needed)
+// Compile: gcc -Wall wiringpi_rht03_test1_decode.c -o wiringpi_rht03_test1_decode -lwiringPi
+//
+// The vectors are data line edges with kernel timestamps (nS) of whole
+// frames, as the gpio chardev hands them to the driver.
+
+#include "wpi_test.h"
+#include "rht03.h"
+
+// 23.4C, 45.6%RH - with the host releasing the line first
+static const struct rht03Edge frame23_4C_45_6RH [] =
+{
+  { 1843201553000LL, 1 }, { 1843201575201LL, 0 }, { 1843201657047LL, 1 }, { 1843201735967LL, 0 },
+  { 1843201790225LL, 1 }, { 1843201815443LL, 0 }, { 1843201864596LL, 1 }, { 1843201892198LL, 0 },
+  { 1843201940552LL, 1 }, { 1843201963688LL, 0 }, { 1843202019472LL, 1 }, { 1843202042393LL, 0 },
+  { 1843202094777LL, 1 }, { 1843202118675LL, 0 }, { 1843202172503LL, 1 }, { 1843202200709LL, 0 },
+  { 1843202249852LL, 1 }, { 1843202273059LL, 0 }, { 1843202327126LL, 1 }, { 1843202395397LL, 0 },
+  { 1843202448821LL, 1 }, { 1843202517317LL, 0 }, { 1843202566435LL, 1 }, { 1843202636328LL, 0 },
+  { 1843202688716LL, 1 }, { 1843202716715LL, 0 }, { 1843202768382LL, 1 }, { 1843202794691LL, 0 },
+  { 1843202846070LL, 1 }, { 1843202915748LL, 0 }, { 1843202968606LL, 1 }, { 1843202991368LL, 0 },
+  { 1843203040335LL, 1 }, { 1843203062501LL, 0 }, { 1843203116810LL, 1 }, { 1843203146508LL, 0 },
+  { 1843203201779LL, 1 }, { 1843203227079LL, 0 }, { 1843203277876LL, 1 }, { 1843203301502LL, 0 },
+  { 1843203351188LL, 1 }, { 1843203375893LL, 0 }, { 1843203427103LL, 1 }, { 1843203452092LL, 0 },
+  { 1843203504981LL, 1 }, { 1843203534805LL, 0 }, { 1843203584824LL, 1 }, { 1843203608547LL, 0 },
+  { 1843203662477LL, 1 }, { 1843203686254LL, 0 }, { 1843203737664LL, 1 }, { 1843203764455LL, 0 },
+  { 1843203817884LL, 1 }, { 1843203890368LL, 0 }, { 1843203938859LL, 1 }, { 1843204007281LL, 0 },
+  { 1843204062151LL, 1 }, { 1843204131624LL, 0 }, { 1843204182536LL, 1 }, { 1843204205639LL, 0 },
+  { 1843204255309LL, 1 }, { 1843204324518LL, 0 }, { 1843204379369LL, 1 }, { 1843204407890LL, 0 },
+  { 1843204458973LL, 1 }, { 1843204527221LL, 0 }, { 1843204575926LL, 1 }, { 1843204603947LL, 0 },
+  { 1843204656298LL, 1 }, { 1843204727891LL, 0 }, { 1843204781225LL, 1 }, { 1843204809851LL, 0 },
+  { 1843204859639LL, 1 }, { 1843204929340LL, 0 }, { 1843204983865LL, 1 }, { 1843205055407LL, 0 },
+  { 1843205109385LL, 1 }, { 1843205134395LL, 0 }, { 1843205183982LL, 1 }, { 1843205208690LL, 0 },
+  { 1843205261940LL, 1 }, { 1843205331735LL, 0 }, { 1843205383684LL, 1 }, { 1843205452023LL, 0 },
+  { 1843205502180LL, 1 },
+} ;
+
+// -5.2C, 87.3%RH - host edge not captured
+static const struct rht03Edge frameMinus5_2C_87_3RH [] =
+{
+  { 1843203628505LL, 0 }, { 1843203708908LL, 1 }, { 1843203789646LL, 0 }, { 1843203842330LL, 1 },
+  { 1843203867575LL, 0 }, { 1843203919522LL, 1 }, { 1843203946820LL, 0 }, { 1843204000151LL, 1 },
+  { 1843204029000LL, 0 }, { 1843204079591LL, 1 }, { 1843204109466LL, 0 }, { 1843204159212LL, 1 },
+  { 1843204189210LL, 0 }, { 1843204243347LL, 1 }, { 1843204266127LL, 0 }, { 1843204320597LL, 1 },
+  { 1843204391106LL, 0 }, { 1843204446449LL, 1 }, { 1843204515893LL, 0 }, { 1843204568479LL, 1 },
+  { 1843204595588LL, 0 }, { 1843204651255LL, 1 }, { 1843204723726LL, 0 }, { 1843204778593LL, 1 },
+  { 1843204852118LL, 0 }, { 1843204902535LL, 1 }, { 1843204925301LL, 0 }, { 1843204974722LL, 1 },
+  { 1843205044301LL, 0 }, { 1843205092536LL, 1 }, { 1843205122080LL, 0 }, { 1843205176583LL, 1 },
+  { 1843205203509LL, 0 }, { 1843205254578LL, 1 }, { 1843205328274LL, 0 }, { 1843205384113LL, 1 },
+  { 1843205452896LL, 0 }, { 1843205506381LL, 1 }, { 1843205531651LL, 0 }, { 1843205581984LL, 1 },
+  { 1843205611439LL, 0 }, { 1843205661942LL, 1 }, { 1843205689261LL, 0 }, { 1843205744135LL, 1 },
+  { 1843205773383LL, 0 }, { 1843205822995LL, 1 }, { 1843205845928LL, 0 }, { 1843205897653LL, 1 },
+  { 1843205921312LL, 0 }, { 1843205975870LL, 1 }, { 1843206000605LL, 0 }, { 1843206052247LL, 1 },
+  { 1843206077547LL, 0 }, { 1843206132009LL, 1 }, { 1843206154406LL, 0 }, { 1843206207007LL, 1 },
+  { 1843206280856LL, 0 }, { 1843206329822LL, 1 }, { 1843206400014LL, 0 }, { 1843206448823LL, 1 },
+  { 1843206477975LL, 0 }, { 1843206531194LL, 1 }, { 1843206600171LL, 0 }, { 1843206656041LL, 1 },
+  { 1843206679631LL, 0 }, { 1843206729278LL, 1 }, { 1843206754024LL, 0 }, { 1843206803353LL, 1 },
+  { 1843206831197LL, 0 }, { 1843206886193LL, 1 }, { 1843206909437LL, 0 }, { 1843206961333LL, 1 },
+  { 1843207029807LL, 0 }, { 1843207081887LL, 1 }, { 1843207108897LL, 0 }, { 1843207163355LL, 1 },
+  { 1843207189549LL, 0 }, { 1843207239826LL, 1 }, { 1843207268874LL, 0 }, { 1843207319924LL, 1 },
+  { 1843207346943LL, 0 }, { 1843207398959LL, 1 }, { 1843207426170LL, 0 }, { 1843207479008LL, 1 },
+} ;
+
+// 23.4C, 45.6%RH with bit 9 misread as a 0
+static const struct rht03Edge frameBadChecksum [] =
+{
+  { 1843205649000LL, 1 }, { 1843205671623LL, 0 }, { 1843205750540LL, 1 }, { 1843205832516LL, 0 },
+  { 1843205881645LL, 1 }, { 1843205910176LL, 0 }, { 1843205964116LL, 1 }, { 1843205991082LL, 0 },
+  { 1843206044758LL, 1 }, { 1843206070834LL, 0 }, { 1843206126806LL, 1 }, { 1843206155598LL, 0 },
+  { 1843206209885LL, 1 }, { 1843206232086LL, 0 }, { 1843206282172LL, 1 }, { 1843206308184LL, 0 },
+  { 1843206362454LL, 1 }, { 1843206390857LL, 0 }, { 1843206442706LL, 1 }, { 1843206513562LL, 0 },
+  { 1843206563507LL, 1 }, { 1843206631598LL, 0 }, { 1843206680390LL, 1 }, { 1843206706463LL, 0 },
+  { 1843206759236LL, 1 }, { 1843206783550LL, 0 }, { 1843206835202LL, 1 }, { 1843206858644LL, 0 },
+  { 1843206907013LL, 1 }, { 1843206976095LL, 0 }, { 1843207025117LL, 1 }, { 1843207051763LL, 0 },
+  { 1843207106850LL, 1 }, { 1843207133878LL, 0 }, { 1843207182287LL, 1 }, { 1843207211851LL, 0 },
+  { 1843207264880LL, 1 }, { 1843207294145LL, 0 }, { 1843207343836LL, 1 }, { 1843207372298LL, 0 },
+  { 1843207421881LL, 1 }, { 1843207451636LL, 0 }, { 1843207506359LL, 1 }, { 1843207535457LL, 0 },
+  { 1843207585904LL, 1 }, { 1843207613550LL, 0 }, { 1843207663055LL, 1 }, { 1843207689597LL, 0 },
+  { 1843207741323LL, 1 }, { 1843207767898LL, 0 }, { 1843207821590LL, 1 }, { 1843207847795LL, 0 },
+  { 1843207900090LL, 1 }, { 1843207973903LL, 0 }, { 1843208028945LL, 1 }, { 1843208101069LL, 0 },
+  { 1843208152357LL, 1 }, { 1843208222216LL, 0 }, { 1843208274508LL, 1 }, { 1843208298102LL, 0 },
+  { 1843208351976LL, 1 }, { 1843208425010LL, 0 }, { 1843208476790LL, 1 }, { 1843208501317LL, 0 },
+  { 1843208555190LL, 1 }, { 1843208627014LL, 0 }, { 1843208677684LL, 1 }, { 1843208700778LL, 0 },
+  { 1843208751821LL, 1 }, { 1843208820832LL, 0 }, { 1843208873113LL, 1 }, { 1843208901528LL, 0 },
+  { 1843208952369LL, 1 }, { 1843209021938LL, 0 }, { 1843209077661LL, 1 }, { 1843209148058LL, 0 },
+  { 1843209201711LL, 1 }, { 1843209226818LL, 0 }, { 1843209279567LL, 1 }, { 1843209307896LL, 0 },
+  { 1843209357257LL, 1 }, { 1843209425601LL, 0 }, { 1843209480589LL, 1 }, { 1843209554061LL, 0 },
+  { 1843209603034LL, 1 },
+} ;
+
+// 23.4C, 45.6%RH with two edges lost in the middle
+static const struct rht03Edge frameLostEdges [] =
+{
+  { 1843207697000LL, 1 }, { 1843207731003LL, 0 }, { 1843207812483LL, 1 }, { 1843207892184LL, 0 },
+  { 1843207941336LL, 1 }, { 1843207965347LL, 0 }, { 1843208016465LL, 1 }, { 1843208045694LL, 0 },
+  { 1843208096210LL, 1 }, { 1843208119887LL, 0 }, { 1843208171372LL, 1 }, { 1843208200665LL, 0 },
+  { 1843208254490LL, 1 }, { 1843208279004LL, 0 }, { 1843208331440LL, 1 }, { 1843208358251LL, 0 },
+  { 1843208408239LL, 1 }, { 1843208437770LL, 0 }, { 1843208492150LL, 1 }, { 1843208562357LL, 0 },
+  { 1843208616379LL, 1 }, { 1843208684688LL, 0 }, { 1843208732958LL, 1 }, { 1843208804826LL, 0 },
+  { 1843208857861LL, 1 }, { 1843208886642LL, 0 }, { 1843208941977LL, 1 }, { 1843208966222LL, 0 },
+  { 1843209016342LL, 1 }, { 1843209088736LL, 0 }, { 1843209138392LL, 1 }, { 1843209163954LL, 0 },
+  { 1843209218621LL, 1 }, { 1843209246372LL, 0 }, { 1843209297352LL, 1 }, { 1843209321076LL, 0 },
+  { 1843209372363LL, 1 }, { 1843209394636LL, 0 }, { 1843209449334LL, 1 }, { 1843209474967LL, 0 },
+  { 1843209603531LL, 1 }, { 1843209627497LL, 0 }, { 1843209677253LL, 1 }, { 1843209701890LL, 0 },
+  { 1843209752721LL, 1 }, { 1843209777154LL, 0 }, { 1843209830870LL, 1 }, { 1843209860729LL, 0 },
+  { 1843209911745LL, 1 }, { 1843209934665LL, 0 }, { 1843209988981LL, 1 }, { 1843210058750LL, 0 },
+  { 1843210107290LL, 1 }, { 1843210177330LL, 0 }, { 1843210232578LL, 1 }, { 1843210305697LL, 0 },
+  { 1843210359378LL, 1 }, { 1843210385306LL, 0 }, { 1843210440582LL, 1 }, { 1843210512676LL, 0 },
+  { 1843210564378LL, 1 }, { 1843210594040LL, 0 }, { 1843210647382LL, 1 }, { 1843210717654LL, 0 },
+  { 1843210771046LL, 1 }, { 1843210794533LL, 0 }, { 1843210845955LL, 1 }, { 1843210914231LL, 0 },
+  { 1843210962788LL, 1 }, { 1843210988740LL, 0 }, { 1843211038001LL, 1 }, { 1843211108435LL, 0 },
+  { 1843211163055LL, 1 }, { 1843211234936LL, 0 }, { 1843211289750LL, 1 }, { 1843211311795LL, 0 },
+  { 1843211359796LL, 1 }, { 1843211384067LL, 0 }, { 1843211435177LL, 1 }, { 1843211505409LL, 0 },
+  { 1843211559615LL, 1 }, { 1843211629943LL, 0 }, { 1843211680404LL, 1 },
+} ;
+
+#define EDGES(X) X, (int)(sizeof(X) / sizeof(X[0]))
+
+
+int main (void) {
+  int major, minor;
+  int temp, rh;
+
+  wiringPiVersion(&major, &minor);
+  printf("Testing RHT03 edge decoder with recorded frames (WiringPi %d.%d)\n",major, minor);
+  printf("----------------------------------------------------------------\n\n");
+
+  temp = rh = -1;
+  CheckSame("frame 1 decodes", rht03DecodeEdges(EDGES(frame23_4C_45_6RH), &temp, &rh), TRUE);
+  CheckSame("frame 1 temperature", temp, 234);
+  CheckSame("frame 1 humidity", rh, 456);
+
+  temp = rh = -1;
+  CheckSame("frame 2 decodes", rht03DecodeEdges(EDGES(frameMinus5_2C_87_3RH), &temp, &rh), TRUE);
+  CheckSame("frame 2 temperature", temp, -52);
+  CheckSame("frame 2 humidity", rh, 873);
+
+  CheckSame("bad checksum rejected", rht03DecodeEdges(EDGES(frameBadChecksum), &temp, &rh), FALSE);
+  CheckSame("lost edges rejected", rht03DecodeEdges(EDGES(frameLostEdges), &temp, &rh), FALSE);
+
+  int count = sizeof(frame23_4C_45_6RH) / sizeof(frame23_4C_45_6RH[0]);
+  CheckSame("truncated frame rejected", rht03DecodeEdges(frame23_4C_45_6RH, count - 2, &temp, &rh), FALSE);
+  CheckSame("frame without the end edge", rht03DecodeEdges(frame23_4C_45_6RH, count - 1, &temp, &rh), TRUE);
+  CheckSame("no edges", rht03DecodeEdges(frame23_4C_45_6RH, 0, &temp, &rh), FALSE);
+
+  return UnitTestState();
+}
@@ -0,0 +1,102 @@
+// WiringPi test program: background analog sampler (no hardware needed)
+// Compile: gcc -Wall wiringpi_sampler_test1_node.c -o wiringpi_sampler_test1_node -lwiringPi
+//
+// Samples a fake extension node whose analogRead blocks for 2ms like a
+// bus transfer would and returns pin * 1000 + number of reads of that pin.
+// Like the real drivers it mustn't be entered twice at once.
+
+#include "wpi_test.h"
+#include "analogSampler.h"
+
+#include <pthread.h>
+
+#define PINBASE 200
+
+static pthread_t mainThread;
+static int reads[4];
+static int mainThreadReads = 0;
+static int inDriver = 0;
+static int overlaps = 0;
+
+
+static int slowAnalogRead(struct wiringPiNodeStruct *node, int pin) {
+  (void)node;
+  if (__atomic_add_fetch(&inDriver, 1, __ATOMIC_RELAXED) > 1)
+    __atomic_add_fetch(&overlaps, 1, __ATOMIC_RELAXED);
+  delay(2);
+  __atomic_sub_fetch(&inDriver, 1, __ATOMIC_RELAXED);
+  if (pthread_equal(pthread_self(), mainThread))
+    ++mainThreadReads;
+  return pin * 1000 + __atomic_add_fetch(&reads[pin - PINBASE], 1, __ATOMIC_RELAXED);
+}
+
+
+int main (void) {
+  int major, minor;
+  struct analogSample samples[32];
+  struct analogStats stats;
+  struct wiringPiNodeStruct *node;
+
+  wiringPiVersion(&major, &minor);
+  printf("Testing background analog sampler on a fake node (WiringPi %d.%d)\n", major, minor);
+  printf("---------------------------------------------------------------\n\n");
+
+  mainThread = pthread_self();
+  node = wiringPiNewNode(PINBASE, 4);
+  node->analogRead = slowAnalogRead;
+
+  CheckSame("uncached read", analogRead(PINBASE), PINBASE * 1000 + 1);
+  CheckSame("on-board pin refused", analogSamplerAdd(5, 10, 16), -1);
+  CheckSame("pin without node refused", analogSamplerAdd(300, 10, 16), -1);
+  CheckSame("add pin 0 at 10ms", analogSamplerAdd(PINBASE, 10, 16), 0);
+  CheckSame("add pin 1 at 50ms", analogSamplerAdd(PINBASE + 1, 50, 4), 0);
+  delay(300);
+
+  printf("\nCached reads:\n");
+  mainThreadReads = 0;
+  unsigned int start = micros();
+  int last = 0;
+  for (int i = 0; i < 1000; ++i)
+    last = analogRead(PINBASE);
+  unsigned int duration = micros() - start;
+  printf("1000 cached reads took %u us\n", duration);
+  CheckSame("no bus reads from the caller", mainThreadReads, 0);
+  CheckSame("cached value is a sample of pin 0", last / 1000, PINBASE);
+  CheckSame("pin 2 isn't sampled, read directly", analogRead(PINBASE + 2), (PINBASE + 2) * 1000 + 1);
+  CheckSame("... from the caller", mainThreadReads, 1);
+  for (int i = 0; i < 50; ++i)
+    analogRead(PINBASE + 3);
+  CheckSame("driver never entered twice at once", overlaps, 0);
+
+  printf("\nHistory:\n");
+  CheckSame("pin 0 history full", analogSamplerHistory(PINBASE, samples, 32), 16);
+  long long span = samples[15].timeStamp_us - samples[0].timeStamp_us;
+  printf("15 periods took %lld us\n", span);
+  CheckSame("pin 0 sampled about every 10ms", span > 15 * 8000 && span < 15 * 20000, 1);
+  CheckSame("oldest first", samples[15].value - samples[0].value, 15);
+  CheckSame("pin 1 history full", analogSamplerHistory(PINBASE + 1, samples, 32), 4);
+  CheckSame("pin 1 fewer reads", reads[1] < reads[0] / 3, 1);
+  CheckSame("history of unsampled pin", analogSamplerHistory(PINBASE + 3, samples, 32), -1);
+
+  printf("\nStats:\n");
+  CheckSame("stats over last 4", analogSamplerStats(PINBASE, 4, &stats), 4);
+  CheckSame("max - min", stats.max - stats.min, 3);
+  CheckSame("average * 2", (int)(stats.average * 2), stats.min * 2 + 3);
+  CheckSame("stats over all", analogSamplerStats(PINBASE, 0, &stats), 16);
+
+  printf("\nRemove and stop:\n");
+  CheckSame("remove pin 0", analogSamplerRemove(PINBASE), 0);
+  CheckSame("remove pin 0 again", analogSamplerRemove(PINBASE), -1);
+  mainThreadReads = 0;
+  analogRead(PINBASE);
+  CheckSame("pin 0 read directly again", mainThreadReads, 1);
+  analogRead(PINBASE + 1);
+  CheckSame("pin 1 still cached", mainThreadReads, 1);
+  analogSamplerStop();
+  CheckSame("driver back in the node", node->analogRead == slowAnalogRead, 1);
+  int before = reads[1];
+  delay(120);
+  CheckSame("no sampling after stop", reads[1], before);
+
+  return UnitTestState();
+}
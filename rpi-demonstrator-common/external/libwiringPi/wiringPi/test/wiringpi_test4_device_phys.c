@@ -26,6 +26,9 @@ int main (void) {
 		GPIOIN = 18;  //BCM 24
 	}
 	
+	CheckSame("wiringPiPinToGpio", wiringPiPinToGpio(GPIO), piBoard40Pin() ? 19 : 23);
+	CheckSame("wiringPiPinToGpio off the table", wiringPiPinToGpio(64), -1);
+
 	pinMode(GPIOIN, INPUT);
 	pinMode(GPIO, OUTPUT);
 
@@ -0,0 +1,100 @@
+// WiringPi test program: threading policy and wake-up latency (no hardware needed)
+// Compile: gcc -Wall wiringpi_thread_test1_policy.c -o wiringpi_thread_test1_policy -lwiringPi
+//
+// Uses the background analog sampler on a fake node as the wiringPi thread.
+// Only SCHED_OTHER is set, so it runs without root.
+
+#define _GNU_SOURCE
+#include "wpi_test.h"
+#include "analogSampler.h"
+
+#include <sched.h>
+
+#define PINBASE 200
+
+
+static int fakeAnalogRead(struct wiringPiNodeStruct *node, int pin) {
+  (void)node;
+  return pin;
+}
+
+
+static int samplerThread(struct WPIThreadInfo *info) {
+  struct WPIThreadInfo all[8];
+  int count = piThreadList(all, 8, FALSE);
+  for (int i = 0; i < count; ++i)
+    if (all[i].threadClass == WPI_THREAD_SAMPLER) {
+      *info = all[i];
+      return 1;
+    }
+  return 0;
+}
+
+
+int main (void) {
+  int major, minor, first = -1, cpus = 0;
+  unsigned long long allowed = 0;
+  cpu_set_t set;
+  char env[64];
+  struct wiringPiNodeStruct *node;
+  struct WPIThreadInfo info;
+  struct WPIThreadPolicy policy;
+
+  wiringPiVersion(&major, &minor);
+  printf("Testing threading policy (WiringPi %d.%d)\n", major, minor);
+  printf("-----------------------------------------\n\n");
+
+  sched_getaffinity(0, sizeof(set), &set);
+  for (int cpu = 0; cpu < 64; ++cpu)
+    if (CPU_ISSET(cpu, &set)) {
+      allowed |= 1ULL << cpu;
+      ++cpus;
+      if (first < 0)
+        first = cpu;
+    }
+  snprintf(env, sizeof(env), "isr=fifo:80 sampler=other@%d", first);
+  setenv("WIRINGPI_THREADS", env, 1);
+  printf("%s=%s\n\n", "WIRINGPI_THREADS", env);
+
+  node = wiringPiNewNode(PINBASE, 2);
+  node->analogRead = fakeAnalogRead;
+  CheckSame("sampler started", analogSamplerAdd(PINBASE, 5, 8), 0);
+  delay(100);
+
+  printf("\nPolicy from the environment:\n");
+  CheckSame("isr policy set", piThreadGetPolicy(WPI_THREAD_ISR, &policy), TRUE);
+  CheckSame("isr is fifo", policy.policy, SCHED_FIFO);
+  CheckSame("isr priority", policy.priority, 80);
+  CheckSame("softpwm policy not set", piThreadGetPolicy(WPI_THREAD_SOFTPWM, &policy), FALSE);
+  CheckSame("sampler thread listed", samplerThread(&info), 1);
+  CheckSame("sampler thread has a tid", info.tid > 0, 1);
+  CheckSame("sampler runs on one CPU", info.cpuMask == (1ULL << first), 1);
+  CheckSame("sampler policy", info.policy, SCHED_OTHER);
+  printf("%llu wake-ups, latency min %lld avg %lld max %lld ns\n", info.wakeUps,
+         info.latencyMin_ns, info.latencyAvg_ns, info.latencyMax_ns);
+  CheckSame("wake-ups measured", info.wakeUps > 5, 1);
+  CheckSame("latency plausible", info.latencyMin_ns >= 0 && info.latencyMin_ns <= info.latencyAvg_ns &&
+            info.latencyAvg_ns <= info.latencyMax_ns, 1);
+
+  printf("\nChanging a running thread:\n");
+  policy.policy   = SCHED_OTHER;
+  policy.priority = 0;
+  policy.cpuMask  = allowed;
+  CheckSame("piThreadSetPolicy", piThreadSetPolicy(WPI_THREAD_SAMPLER, &policy), 0);
+  samplerThread(&info);
+  CheckSame("sampler on all CPUs again", info.cpuMask == allowed, 1);
+  policy.policy = 12345;
+  CheckSame("bad policy refused", piThreadSetPolicy(WPI_THREAD_SAMPLER, &policy), -1);
+  CheckSame("bad class refused", piThreadSetPolicy(WPI_THREAD_CLASSES, NULL), -1);
+
+  struct WPIThreadInfo all[8];
+  piThreadList(all, 8, TRUE);
+  delay(12);
+  samplerThread(&info);
+  CheckSame("latency figures reset", info.wakeUps < 5, 1);
+
+  analogSamplerStop();
+  CheckSame("no threads after stop", piThreadList(all, 8, FALSE), 0);
+
+  return UnitTestState();
+}
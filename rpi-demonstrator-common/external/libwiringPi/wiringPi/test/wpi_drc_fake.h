@@ -0,0 +1,82 @@
+// Fake DRC serial device on a pseudo terminal, for the drcSerial host tests
+//
+// The device side runs in a thread on the pty master and speaks the DRC
+// protocol: 'o'/'p'/'i' pin, '0'/'1' pin, 'v' pin value, 'r' pin -> '0'/'1',
+// 'a' pin -> high byte, low byte, '@' -> '@'.
+// Analog pin n reads as fakeAnalog(n). While fakeHold is set the device
+// sits on what it has read, as if it had stopped answering.
+// Define _GNU_SOURCE before the first include, for posix_openpt and ptsname.
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#define FAKE_DRC_PINS 32
+
+static int fakeMaster = -1;
+static int fakeLevels[FAKE_DRC_PINS];
+static int fakePwm[FAKE_DRC_PINS];
+static pthread_t fakeThread;
+static int fakeHold = 0;
+
+static int fakeAnalog(int pin) {
+  return 0x100 * pin + 7 * pin + 3;
+}
+
+
+static void *fakeDevice(void *arg) {
+  unsigned char in[256], out[512];
+  unsigned char command = 0, pin = 0;
+  int state = 0;
+  (void)arg;
+
+  for (;;) {
+    int len = read(fakeMaster, in, sizeof(in));
+    int n = 0;
+    if (len <= 0)
+      break;
+    while (__atomic_load_n(&fakeHold, __ATOMIC_ACQUIRE))
+      usleep(1000);
+
+    for (int i = 0; i < len; ++i) {
+      unsigned char c = in[i];
+      if (state == 0) {
+        if (c == '@') {
+          out[n++] = '@';
+        } else {
+          command = c;
+          state = 1;
+        }
+      } else if (state == 1) {
+        pin = c % FAKE_DRC_PINS;
+        state = 0;
+        switch (command) {
+          case '0': fakeLevels[pin] = 0; break;
+          case '1': fakeLevels[pin] = 1; break;
+          case 'r': out[n++] = fakeLevels[pin] ? '1' : '0'; break;
+          case 'a': out[n++] = fakeAnalog(pin) >> 8; out[n++] = fakeAnalog(pin) & 0xFF; break;
+          case 'v': state = 2; break;
+          default: break;
+        }
+      } else {
+        fakePwm[pin] = c;
+        state = 0;
+      }
+    }
+    if (n > 0 && write(fakeMaster, out, n) != n)
+      break;
+  }
+  return NULL;
+}
+
+
+// Returns the slave device name to open, or NULL
+static const char *fakeDrcStart(void) {
+  if ((fakeMaster = posix_openpt(O_RDWR | O_NOCTTY)) < 0)
+    return NULL;
+  if (grantpt(fakeMaster) != 0 || unlockpt(fakeMaster) != 0)
+    return NULL;
+  if (pthread_create(&fakeThread, NULL, fakeDevice, NULL) != 0)
+    return NULL;
+  return ptsname(fakeMaster);
+}
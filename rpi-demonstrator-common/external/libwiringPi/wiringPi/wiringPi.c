@@ -427,8 +427,6 @@ static uint64_t epochMilli, epochMicro ;
 // Misc
 
 static int wiringPiMode = WPI_MODE_UNINITIALISED ;
-static volatile int    pinPass = -1 ;
-static pthread_mutex_t pinMutex ;
 
 static int RaspberryPiModel  = -1;
 static int RaspberryPiLayout = -1;
@@ -442,36 +440,42 @@ int wiringPiReturnCodes = FALSE ;
 
 int wiringPiTryGpioMem  = FALSE ;
 
-static unsigned int lineFlags [64] =
-{
-  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-} ;
-
-static int lineFds [64] =
-{
-  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+// Pin state: the /dev/gpiochip line handles and ISR threads of a context,
+//	indexed by BCM GPIO number. See wpiCtxNew.
+
+#define	ISR_IDLE	0
+#define	ISR_RUNNING	1
+#define	ISR_STOPPING	2
+
+#define	ISR_STOP_JOIN	1	// Stopped by another thread, which joins it
+#define	ISR_STOP_SELF	2	// Stopped from its own handler, cleans up itself
+
+struct wpiPinState
+{
+  pthread_mutex_t lock ;
+  pthread_cond_t  idle ;		// Broadcast when isrState drops to ISR_IDLE
+  int             gpio ;
+  int             lineFd ;
+  unsigned int    lineFlags ;
+  int             isrFd ;
+  int             isrState ;
+  int             isrStop ;		// Polled by the ISR thread without the lock
+  int             isrMode ;
+  pthread_t       isrThread ;
+  void          (*isrFunction)  (void) ;
+  void          (*isrFunction2) (struct WPIWfiStatus wfiStatus, void *userdata) ;
+  void           *isrUserData ;
 } ;
 
-static int isrFds [64] =
+struct wpiCtx
 {
-  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  pthread_mutex_t    chipLock ;
+  int                chipFd ;
+  struct wpiPinState pins [64] ;
 } ;
 
-// ISR Data
-static int chipFd = -1;
-static void (*isrFunctions [64])(void) ;
-static pthread_t isrThreads[64];
-static int isrMode[64];
-static volatile int isrStopFlags[64] = {0};
+static struct wpiCtx  defaultCtx ;
+static pthread_once_t defaultCtxOnce = PTHREAD_ONCE_INIT ;
 
 // Doing it the Arduino way with lookup tables...
 //	Yes, it's probably more innefficient than all the bit-twidling, but it
@@ -1241,6 +1245,31 @@ int physPinToGpio (int physPin)
 }
 
 
+/*
+ * wiringPiPinToGpio:
+ *	Translate an on-board pin in the numbering mode wiringPi was set up
+ *	with to native GPIO pin number - e.g. to request the line from the
+ *	gpio chardev. -1 if the pin is off the end of the table.
+ *	Provided for external support.
+ *********************************************************************************
+ */
+
+int wiringPiPinToGpio (int pin)
+{
+  switch (wiringPiMode)
+  {
+    case WPI_MODE_PINS:
+    case WPI_MODE_GPIO_DEVICE_WPI:
+      return ((pin < 0) || (pin > 63)) ? -1 : pinToGpio [pin] ;
+    case WPI_MODE_PHYS:
+    case WPI_MODE_GPIO_DEVICE_PHYS:
+      return ((pin < 0) || (pin > 63)) ? -1 : physToGpio [pin] ;
+    default:
+      return pin ;
+  }
+}
+
+
 /*
  * setPadDrive:
  *	Set the PAD driver value
@@ -1607,6 +1636,32 @@ static         void digitalWriteDummy        (UNU struct wiringPiNodeStruct *nod
 static         void pwmWriteDummy            (UNU struct wiringPiNodeStruct *node, UNU int pin, UNU int value) { return ; }
 static          int analogReadDummy          (UNU struct wiringPiNodeStruct *node, UNU int pin)            { return 0 ; }
 static         void analogWriteDummy         (UNU struct wiringPiNodeStruct *node, UNU int pin, UNU int value) { return ; }
+static          int beginTransactionDummy    (UNU struct wiringPiNodeStruct *node)                             { return 0 ; }
+static          int commitTransactionDummy   (UNU struct wiringPiNodeStruct *node)                             { return 0 ; }
+
+// Nodes without bulk reads get them assembled pin by pin
+
+static int analogReadManyDummy (struct wiringPiNodeStruct *node, int pin, int count, int *values)
+{
+  int i ;
+
+  for (i = 0 ; i < count ; ++i)
+    values [i] = node->analogRead (node, pin + i) ;
+
+  return count ;
+}
+
+static unsigned int digitalReadAllDummy (struct wiringPiNodeStruct *node)
+{
+  unsigned int value = 0 ;
+  int pin ;
+
+  for (pin = node->pinBase ; (pin <= node->pinMax) && (pin - node->pinBase < 32) ; ++pin)
+    if (node->digitalRead (node, pin) != LOW)
+      value |= 1u << (pin - node->pinBase) ;
+
+  return value ;
+}
 
 struct wiringPiNodeStruct *wiringPiNewNode (int pinBase, int numPins)
 {
@@ -1639,6 +1694,10 @@ struct wiringPiNodeStruct *wiringPiNewNode (int pinBase, int numPins)
   node->pwmWrite         = pwmWriteDummy ;
   node->analogRead       = analogReadDummy ;
   node->analogWrite      = analogWriteDummy ;
+  node->beginTransaction = beginTransactionDummy ;
+  node->commitTransaction= commitTransactionDummy ;
+  node->digitalReadAll   = digitalReadAllDummy ;
+  node->analogReadMany   = analogReadManyDummy ;
   node->next             = wiringPiNodes ;
   wiringPiNodes          = node ;
 
@@ -1665,60 +1724,158 @@ void pinEnableED01Pi (int pin)
 const char DEV_GPIO_PI[] ="/dev/gpiochip0";
 const char DEV_GPIO_PI5[]="/dev/gpiochip4";
 
-int wiringPiGpioDeviceGetFd() {
-  if (chipFd<0) {
+
+/*
+ * Pin contexts:
+ *	All the /dev/gpiochip state - line handles, event lines and the ISR
+ *	threads - is owned by a wpiCtx. Every pin has its own lock, so threads
+ *	working on different pins never wait for each other, and the chip fd
+ *	has one of its own. The classic API works on a default context which
+ *	is set up on first use.
+ *	Inside a context pins are always BCM GPIO numbers, the classic API
+ *	translates once on the way in.
+ *	The memory mapped registers are one set of hardware, so everything
+ *	going through them stays global.
+ *********************************************************************************
+ */
+
+static void ctxInit (struct wpiCtx *ctx)
+{
+  int i ;
+
+  pthread_mutex_init (&ctx->chipLock, NULL) ;
+  ctx->chipFd = -1 ;
+
+  for (i = 0 ; i < 64 ; ++i)
+  {
+    struct wpiPinState *p = &ctx->pins [i] ;
+
+    memset (p, 0, sizeof (*p)) ;
+    pthread_mutex_init (&p->lock, NULL) ;
+    pthread_cond_init  (&p->idle, NULL) ;
+    p->gpio     = i ;
+    p->lineFd   = -1 ;
+    p->isrFd    = -1 ;
+    p->isrState = ISR_IDLE ;
+  }
+}
+
+static void defaultCtxInit (void)
+{
+  ctxInit (&defaultCtx) ;
+}
+
+wpiCtx *wpiCtxDefault (void)
+{
+  pthread_once (&defaultCtxOnce, defaultCtxInit) ;
+  return &defaultCtx ;
+}
+
+wpiCtx *wpiCtxNew (void)
+{
+  wpiCtx *ctx ;
+
+  if ((ctx = (wpiCtx *)malloc (sizeof (wpiCtx))) == NULL)
+    return NULL ;
+
+  ctxInit (ctx) ;
+  return ctx ;
+}
+
+static struct wpiPinState *ctxPin (wpiCtx *ctx, int gpio)
+{
+  if ((ctx == NULL) || (gpio < 0) || (gpio > 63))
+    return NULL ;
+
+  return &ctx->pins [gpio] ;
+}
+
+
+/*
+ * ctxChipFd:
+ *	Open the gpiochip on first use. Once open the fd never changes for
+ *	the life of the context, so the lock is only needed to open it.
+ *********************************************************************************
+ */
+
+static int ctxChipFd (wpiCtx *ctx)
+{
+  int fd ;
+
+  if ((fd = __atomic_load_n (&ctx->chipFd, __ATOMIC_ACQUIRE)) >= 0)
+    return fd ;
+
+  pthread_mutex_lock (&ctx->chipLock) ;
+  if ((fd = ctx->chipFd) < 0) {
     piBoard();
     const char* gpiochip = PI_MODEL_5 == RaspberryPiModel ? DEV_GPIO_PI5 : DEV_GPIO_PI;
-    chipFd = open(gpiochip, O_RDWR);
-    if (chipFd < 0) {
-      fprintf(stderr, "wiringPi: ERROR: %s open ret=%d\n", gpiochip, chipFd);
+    fd = open(gpiochip, O_RDWR);
+    if (fd < 0) {
+      fprintf(stderr, "wiringPi: ERROR: %s open ret=%d\n", gpiochip, fd);
     } else if (wiringPiDebug) {
-      printf ("wiringPi: Open chip %s succeded, fd=%d\n", gpiochip, chipFd) ;
+      printf ("wiringPi: Open chip %s succeded, fd=%d\n", gpiochip, fd) ;
     }
+    __atomic_store_n (&ctx->chipFd, fd, __ATOMIC_RELEASE) ;
   }
-  return chipFd;
+  pthread_mutex_unlock (&ctx->chipLock) ;
+
+  return fd ;
+}
+
+int wiringPiGpioDeviceGetFd() {
+  return ctxChipFd (wpiCtxDefault ()) ;
 }
 
-void releaseLine(int pin) {
+
+/*
+ * releaseLine: requestLine:
+ *	Line handles of a pin. Called with the pin's lock held.
+ *********************************************************************************
+ */
+
+static void releaseLine (struct wpiPinState *p) {
 
   if (wiringPiDebug)
-    printf ("releaseLine: pin:%d\n", pin) ;
-  lineFlags[pin] = 0;
-  close(lineFds[pin]);
-  lineFds[pin] = -1;
+    printf ("releaseLine: pin:%d\n", p->gpio) ;
+  p->lineFlags = 0;
+  if (p->lineFd >= 0)
+    close(p->lineFd);
+  p->lineFd = -1;
 }
 
-int requestLine(int pin, unsigned int lineRequestFlags) {
+static int requestLine (wpiCtx *ctx, struct wpiPinState *p, unsigned int lineRequestFlags) {
   struct gpiohandle_request rq;
+  int chipFd;
 
-   if (lineFds[pin]>=0) {
-    if (lineRequestFlags == lineFlags[pin]) {
+   if (p->lineFd>=0) {
+    if (lineRequestFlags == p->lineFlags) {
       //already requested
-      return lineFds[pin];
+      return p->lineFd;
     } else {
       //different request -> rerequest
-      releaseLine(pin);
+      releaseLine(p);
     }
   }
 
   //requested line
-  if (wiringPiGpioDeviceGetFd()<0) {
+  if ((chipFd = ctxChipFd(ctx))<0) {
     return -1;  // error
   }
-  rq.lineoffsets[0] = pin;
+  memset(&rq, 0, sizeof(rq));
+  rq.lineoffsets[0] = p->gpio;
   rq.lines = 1;
   rq.flags = lineRequestFlags;
   int ret = ioctl(chipFd, GPIO_GET_LINEHANDLE_IOCTL, &rq);
   if (ret || rq.fd<0) {
-    ReportDeviceError("get line handle", pin, "RequestLine", ret);
+    ReportDeviceError("get line handle", p->gpio, "RequestLine", ret);
     return -1;  // error
   }
 
-  lineFlags[pin] = lineRequestFlags;
-  lineFds[pin] = rq.fd;
+  p->lineFlags = lineRequestFlags;
+  p->lineFd = rq.fd;
   if (wiringPiDebug)
-    printf ("requestLine succeeded: pin:%d, flags: %u, fd :%d\n", pin, lineRequestFlags, lineFds[pin]) ;
-  return lineFds[pin];
+    printf ("requestLine succeeded: pin:%d, flags: %u, fd :%d\n", p->gpio, lineRequestFlags, p->lineFd) ;
+  return p->lineFd;
 }
 
 /*
@@ -1810,10 +1967,10 @@ void rp1_set_pad(int pin, int slewfast, int schmitt, int pulldown, int pullup, i
   pads[1+pin] = (slewfast != 0) | ((schmitt != 0) << 1) | ((pulldown != 0) << 2) | ((pullup != 0) << 3) | ((drive & 0x3) << 4) | ((inputenable != 0) << 6) | ((outputdisable != 0) << 7);
 }
 
-void pinModeFlagsDevice (int pin, int mode, unsigned int flags) {
+static void linePinMode (wpiCtx *ctx, struct wpiPinState *p, int mode, unsigned int flags) {
   unsigned int lflag = flags;
   if (wiringPiDebug)
-      printf ("pinModeFlagsDevice: pin:%d mode:%d, flags: %u\n", pin, mode, flags) ;
+      printf ("pinModeFlagsDevice: pin:%d mode:%d, flags: %u\n", p->gpio, mode, flags) ;
 
   lflag &= ~(GPIOHANDLE_REQUEST_INPUT | GPIOHANDLE_REQUEST_OUTPUT);
   switch(mode) {
@@ -1827,16 +1984,37 @@ void pinModeFlagsDevice (int pin, int mode, unsigned int flags) {
       lflag |= GPIOHANDLE_REQUEST_OUTPUT;
       break;
     case PM_OFF:
-      pinModeFlagsDevice(pin, INPUT, 0);
-      releaseLine(pin);
+      requestLine(ctx, p, GPIOHANDLE_REQUEST_INPUT);
+      releaseLine(p);
       return;
   }
 
-  requestLine(pin, lflag);
+  requestLine(ctx, p, lflag);
+}
+
+void wpiCtxPinMode (wpiCtx *ctx, int gpio, int mode) {
+  struct wpiPinState *p = ctxPin(ctx, gpio);
+
+  if (p == NULL)
+    return;
+  pthread_mutex_lock(&p->lock);
+  linePinMode(ctx, p, mode, p->lineFlags);
+  pthread_mutex_unlock(&p->lock);
+}
+
+void pinModeFlagsDevice (int pin, int mode, unsigned int flags) {
+  wpiCtx *ctx = wpiCtxDefault();
+  struct wpiPinState *p = ctxPin(ctx, pin);
+
+  if (p == NULL)
+    return;
+  pthread_mutex_lock(&p->lock);
+  linePinMode(ctx, p, mode, flags);
+  pthread_mutex_unlock(&p->lock);
 }
 
 void pinModeDevice (int pin, int mode) {
-  pinModeFlagsDevice(pin, mode, lineFlags[pin]);
+  wpiCtxPinMode(wpiCtxDefault(), pin, mode);
 }
 
 void pinMode (int pin, int mode)
@@ -1988,26 +2166,37 @@ void pinMode (int pin, int mode)
  *	Control the internal pull-up/down resistors on a GPIO pin.
  *********************************************************************************
  */
-void pullUpDnControlDevice (int pin, int pud) {
-  unsigned int flag = lineFlags[pin];
+void wpiCtxPullUpDnControl (wpiCtx *ctx, int gpio, int pud) {
+  struct wpiPinState *p = ctxPin(ctx, gpio);
+  unsigned int flag;
   unsigned int biasflags = GPIOHANDLE_REQUEST_BIAS_DISABLE | GPIOHANDLE_REQUEST_BIAS_PULL_UP | GPIOHANDLE_REQUEST_BIAS_PULL_DOWN;
 
-  flag &= ~biasflags;
+  if (p == NULL)
+    return;
+  pthread_mutex_lock(&p->lock);
+  flag = p->lineFlags & ~biasflags;
   switch (pud){
     case PUD_OFF:  flag |= GPIOHANDLE_REQUEST_BIAS_DISABLE;   break;
     case PUD_UP:   flag |= GPIOHANDLE_REQUEST_BIAS_PULL_UP;   break;
     case PUD_DOWN: flag |= GPIOHANDLE_REQUEST_BIAS_PULL_DOWN; break;
-    default: return ; /* An illegal value */
+    default:  /* An illegal value */
+      pthread_mutex_unlock(&p->lock);
+      return ;
   }
 
   // reset input/output
-  if (lineFlags[pin] & GPIOHANDLE_REQUEST_OUTPUT) {
-    pinModeFlagsDevice (pin, OUTPUT, flag);
-  } else if(lineFlags[pin] & GPIOHANDLE_REQUEST_INPUT) {
-    pinModeFlagsDevice (pin, INPUT, flag);
+  if (p->lineFlags & GPIOHANDLE_REQUEST_OUTPUT) {
+    linePinMode (ctx, p, OUTPUT, flag);
+  } else if(p->lineFlags & GPIOHANDLE_REQUEST_INPUT) {
+    linePinMode (ctx, p, INPUT, flag);
   } else {
-    lineFlags[pin] = flag; // only store for later
+    p->lineFlags = flag; // only store for later
   }
+  pthread_mutex_unlock(&p->lock);
+}
+
+void pullUpDnControlDevice (int pin, int pud) {
+  wpiCtxPullUpDnControl(wpiCtxDefault(), pin, pud);
 }
 
 
@@ -2096,22 +2285,34 @@ void pullUpDnControl (int pin, int pud)
  *********************************************************************************
  */
 
-int digitalReadDevice (int pin) {   // INPUT and OUTPUT should work
+int wpiCtxDigitalRead (wpiCtx *ctx, int gpio) {   // INPUT and OUTPUT should work
+  struct wpiPinState *p = ctxPin(ctx, gpio);
+  struct gpiohandle_data data;
+  int ret;
 
-   if (lineFds[pin]<0) {
+  if (p == NULL)
+    return LOW;
+  pthread_mutex_lock(&p->lock);
+  if (p->lineFd<0) {
     // line not requested - auto request on first read as input
-    pinModeDevice(pin, INPUT);
+    linePinMode(ctx, p, INPUT, p->lineFlags);
   }
-  if (lineFds[pin]>=0) {
-    struct gpiohandle_data data;
-    int ret = ioctl(lineFds[pin], GPIOHANDLE_GET_LINE_VALUES_IOCTL, &data);
-    if (ret) {
-      ReportDeviceError("get line values", pin, "digitalRead", ret);
-      return LOW;  // error
-    }
-    return data.values[0];
+  if (p->lineFd<0) {
+    pthread_mutex_unlock(&p->lock);
+    return LOW;  // error , need to request line before
+  }
+  ret = ioctl(p->lineFd, GPIOHANDLE_GET_LINE_VALUES_IOCTL, &data);
+  if (ret) {
+    ReportDeviceError("get line values", gpio, "digitalRead", ret);
+    pthread_mutex_unlock(&p->lock);
+    return LOW;  // error
   }
-  return LOW;  // error , need to request line before
+  pthread_mutex_unlock(&p->lock);
+  return data.values[0];
+}
+
+int digitalReadDevice (int pin) {
+  return wpiCtxDigitalRead(wpiCtxDefault(), pin);
 }
 
 
@@ -2190,29 +2391,36 @@ unsigned int digitalRead8 (int pin)
  *********************************************************************************
  */
 
-void digitalWriteDevice (int pin, int value) {
+void wpiCtxDigitalWrite (wpiCtx *ctx, int gpio, int value) {
+  struct wpiPinState *p = ctxPin(ctx, gpio);
 
   if (wiringPiDebug)
-    printf ("digitalWriteDevice: ioctl pin:%d value: %d\n", pin, value) ;
+    printf ("digitalWriteDevice: ioctl pin:%d value: %d\n", gpio, value) ;
 
-  if (lineFds[pin]<0) {
+  if (p == NULL)
+    return;
+  pthread_mutex_lock(&p->lock);
+  if (p->lineFd<0) {
     // line not requested - auto request on first write as output
-    pinModeDevice(pin, OUTPUT);
+    linePinMode(ctx, p, OUTPUT, p->lineFlags);
   }
-  if (lineFds[pin]>=0 && (lineFlags[pin] & GPIOHANDLE_REQUEST_OUTPUT)>0) {
+  if (p->lineFd>=0 && (p->lineFlags & GPIOHANDLE_REQUEST_OUTPUT)>0) {
     struct gpiohandle_data data;
     data.values[0] = value;
     if (wiringPiDebug)
-      printf ("digitalWriteDevice: ioctl pin:%d cmd: GPIOHANDLE_SET_LINE_VALUES_IOCTL, value: %d\n", pin, value) ;
-    int ret = ioctl(lineFds[pin], GPIOHANDLE_SET_LINE_VALUES_IOCTL, &data);
+      printf ("digitalWriteDevice: ioctl pin:%d cmd: GPIOHANDLE_SET_LINE_VALUES_IOCTL, value: %d\n", gpio, value) ;
+    int ret = ioctl(p->lineFd, GPIOHANDLE_SET_LINE_VALUES_IOCTL, &data);
     if (ret) {
-      ReportDeviceError("set line values", pin, "digitalWrite", ret);
-      return;  // error
+      ReportDeviceError("set line values", gpio, "digitalWrite", ret);
     }
   } else {
-    fprintf(stderr, "digitalWrite: no output (%d)\n", lineFlags[pin]);
+    fprintf(stderr, "digitalWrite: no output (%d)\n", p->lineFlags);
   }
-  return; // error
+  pthread_mutex_unlock(&p->lock);
+}
+
+void digitalWriteDevice (int pin, int value) {
+  wpiCtxDigitalWrite(wpiCtxDefault(), pin, value);
 }
 
 void digitalWrite (int pin, int value)
@@ -2267,6 +2475,52 @@ void digitalWrite (int pin, int value)
 }
 
 
+/*
+ * digitalWriteGpioMask:
+ *	Set and clear several on-board pins at once - the bits are native
+ *	GPIO (BCM) numbers 0-31. Memory mapped it's one clear and one set
+ *	register write, so all pins in a mask change together.
+ *********************************************************************************
+ */
+
+void digitalWriteGpioMask (unsigned int setMask, unsigned int clrMask)
+{
+  int pin ;
+
+  switch(wiringPiMode) {
+    case WPI_MODE_PINS:
+    case WPI_MODE_PHYS:
+    case WPI_MODE_GPIO:
+      break;
+    case WPI_MODE_GPIO_DEVICE_BCM:
+    case WPI_MODE_GPIO_DEVICE_WPI:
+    case WPI_MODE_GPIO_DEVICE_PHYS:
+      for (pin = 0 ; pin < 32 ; ++pin) {
+        if (clrMask & (1u << pin))
+          digitalWriteDevice(pin, LOW);
+        else if (setMask & (1u << pin))
+          digitalWriteDevice(pin, HIGH);
+      }
+      return;
+    default: //WPI_MODE_GPIO_SYS
+      fprintf(stderr, "digitalWriteGpioMask: invalid mode\n");
+      return;
+  }
+
+  if (PI_MODEL_5 == RaspberryPiModel) {
+    if (clrMask)
+      rio[RP1_RIO_OUT + RP1_CLR_OFFSET] = clrMask;
+    if (setMask)
+      rio[RP1_RIO_OUT + RP1_SET_OFFSET] = setMask;
+  } else {
+    if (clrMask)
+      *(gpio + gpioToGPCLR [0]) = clrMask ;
+    if (setMask)
+      *(gpio + gpioToGPSET [0]) = setMask ;
+  }
+}
+
+
 /*
  * digitalWrite8:
  *	Set an output 8-bit byte on the device from the given pin number
@@ -2359,6 +2613,29 @@ int analogRead (int pin)
 }
 
 
+/*
+ * analogReadMany:
+ *	Read count consecutive analog pins starting at pinBase into values.
+ *	All pins have to be on the same node; nodes which can (e.g. the
+ *	MCP300x ADCs) sample them in one batched bus transfer.
+ *	Returns the number of values read or -1.
+ *********************************************************************************
+ */
+
+int analogReadMany (int pinBase, int count, int *values)
+{
+  struct wiringPiNodeStruct *node ;
+
+  if ((count <= 0) || ((node = wiringPiFindNode (pinBase)) == NULL))
+    return -1 ;
+
+  if (pinBase + count - 1 > node->pinMax)
+    count = node->pinMax - pinBase + 1 ;
+
+  return node->analogReadMany (node, pinBase, count, values) ;
+}
+
+
 /*
  * analogWrite:
  *	Write the analog value to the given Pin.
@@ -2378,6 +2655,56 @@ void analogWrite (int pin, int value)
 }
 
 
+/*
+ * wiringPiNodeBegin: wiringPiNodeCommit:
+ *	Bracket a group of pinMode/pullUpDnControl/digitalWrite calls on
+ *	an extension node. Nodes that support it (e.g. the MCP23x08/17
+ *	expanders) collect the changes in shadow registers and write them
+ *	out in as few bus transfers as possible on the final commit.
+ *	Transactions nest; nodes without support act immediately.
+ *********************************************************************************
+ */
+
+int wiringPiNodeBegin (int pin)
+{
+  struct wiringPiNodeStruct *node ;
+
+  if ((node = wiringPiFindNode (pin)) == NULL)
+    return -1 ;
+
+  return node->beginTransaction (node) ;
+}
+
+int wiringPiNodeCommit (int pin)
+{
+  struct wiringPiNodeStruct *node ;
+
+  if ((node = wiringPiFindNode (pin)) == NULL)
+    return -1 ;
+
+  return node->commitTransaction (node) ;
+}
+
+
+/*
+ * wiringPiNodeReadAll:
+ *	Read every pin of the node holding the given pin as a bit mask,
+ *	bit 0 being the node's pinBase. Expanders sample all ports in a
+ *	single bus transfer.
+ *********************************************************************************
+ */
+
+unsigned int wiringPiNodeReadAll (int pin)
+{
+  struct wiringPiNodeStruct *node ;
+
+  if ((node = wiringPiFindNode (pin)) == NULL)
+    return 0 ;
+
+  return node->digitalReadAll (node) ;
+}
+
+
 /*
  * pwmToneWrite:
  *	Pi Specific.
@@ -2522,19 +2849,14 @@ unsigned int digitalReadByte2 (void)
  *********************************************************************************
  */
 
-int waitForInterrupt (int pin, int mS)
+static int waitForInterruptEvent (int fd, int gpio, int mS, struct gpioevent_data *evdataOut)
 {
-  int fd, ret;
+  int ret;
   struct pollfd polls ;
   struct gpioevent_data evdata;
   //struct gpio_v2_line_request req2;
 
-  if (wiringPiMode == WPI_MODE_PINS)
-    pin = pinToGpio [pin] ;
-  else if (wiringPiMode == WPI_MODE_PHYS)
-    pin = physToGpio [pin] ;
-
-  if ((fd = isrFds [pin]) == -1)
+  if (fd == -1)
     return -2 ;
 
   // Setup poll structure
@@ -2544,20 +2866,22 @@ int waitForInterrupt (int pin, int mS)
 
   // Wait for it ...
   ret = poll(&polls, 1, mS);
-  if (ret <= 0) {
+  if (ret < 0) {
     fprintf(stderr, "wiringPi: ERROR: poll returned=%d\n", ret);
-  } else {
+  } else if (ret > 0) {
     //if (polls.revents & POLLIN)
     if (wiringPiDebug) {
-      printf ("wiringPi: IRQ line %d received %d, fd=%d\n", pin, ret, isrFds[pin]) ;
+      printf ("wiringPi: IRQ line %d received %d, fd=%d\n", gpio, ret, fd) ;
     }
     /* read event data */
-    int readret = read(isrFds [pin], &evdata, sizeof(evdata));
+    int readret = read(fd, &evdata, sizeof(evdata));
     if (readret == sizeof(evdata)) {
       if (wiringPiDebug) {
         printf ("wiringPi: IRQ data id: %d, timestamp: %lld\n", evdata.id, evdata.timestamp) ;
       }
       ret = evdata.id;
+      if (evdataOut)
+        *evdataOut = evdata;
     } else {
       ret = 0;
     }
@@ -2565,24 +2889,45 @@ int waitForInterrupt (int pin, int mS)
   return ret;
 }
 
-int waitForInterruptInit (int pin, int mode)
+int wpiCtxWaitForInterrupt (wpiCtx *ctx, int gpio, int mS)
 {
-  const char* strmode = "";
+  struct wpiPinState *p = ctxPin (ctx, gpio) ;
+  int fd ;
 
-  if (wiringPiMode == WPI_MODE_PINS) {
-    pin = pinToGpio [pin] ;
-  } else if (wiringPiMode == WPI_MODE_PHYS) {
-    pin = physToGpio [pin] ;
-  }
+  if (p == NULL)
+    return -2 ;
 
-  /* open gpio */
-  sleep(1);
-  if (wiringPiGpioDeviceGetFd()<0) {
+  pthread_mutex_lock (&p->lock) ;
+  fd = p->isrFd ;
+  pthread_mutex_unlock (&p->lock) ;
+
+  return waitForInterruptEvent (fd, gpio, mS, NULL) ;
+}
+
+int waitForInterrupt (int pin, int mS)
+{
+  return wpiCtxWaitForInterrupt (wpiCtxDefault (), wiringPiPinToGpio (pin), mS) ;
+}
+
+
+/*
+ * requestEvent:
+ *	Get the event line of a pin. Called with the pin's lock held.
+ *********************************************************************************
+ */
+
+static int requestEvent (wpiCtx *ctx, struct wpiPinState *p, int mode)
+{
+  const char* strmode = "";
+  int chipFd ;
+
+  if ((chipFd = ctxChipFd (ctx))<0) {
     return -1;
   }
 
   struct gpioevent_request req;
-  req.lineoffset = pin;
+  memset(&req, 0, sizeof(req));
+  req.lineoffset = p->gpio;
   req.handleflags = GPIOHANDLE_REQUEST_INPUT;
   switch(mode) {
     default:
@@ -2606,62 +2951,145 @@ int waitForInterruptInit (int pin, int mode)
   }
   strncpy(req.consumer_label, "wiringpi_gpio_irq", sizeof(req.consumer_label) - 1);
 
+  // A line handle of our own would keep the kernel from handing out the event line
+  if (p->lineFd >= 0)
+    releaseLine(p);
+  if (p->isrFd >= 0) {
+    close(p->isrFd);
+    p->isrFd = -1;
+  }
+
   //later implement GPIO_V2_GET_LINE_IOCTL req2
   int ret = ioctl(chipFd, GPIO_GET_LINEEVENT_IOCTL, &req);
   if (ret) {
-    ReportDeviceError("get line event", pin , strmode, ret);
+    ReportDeviceError("get line event", p->gpio , strmode, ret);
     return -1;
   }
   if (wiringPiDebug) {
-    printf ("wiringPi: GPIO get line %d , mode %s succeded, fd=%d\n", pin, strmode, req.fd) ;
+    printf ("wiringPi: GPIO get line %d , mode %s succeded, fd=%d\n", p->gpio, strmode, req.fd) ;
   }
 
   /* set event fd nonbloack read */
   int fd_line = req.fd;
-  isrFds [pin] = fd_line;
   int flags = fcntl(fd_line, F_GETFL);
   flags |= O_NONBLOCK;
   ret = fcntl(fd_line, F_SETFL, flags);
   if (ret) {
     fprintf(stderr, "wiringPi: ERROR: fcntl set nonblock return=%d\n", ret);
+    close(fd_line);
     return -1;
   }
+  p->isrFd   = fd_line;
+  p->isrMode = mode;
 
   return 0;
 }
 
+int wpiCtxWaitForInterruptInit (wpiCtx *ctx, int gpio, int mode)
+{
+  struct wpiPinState *p = ctxPin (ctx, gpio) ;
+  int ret = -1 ;
 
-int waitForInterruptClose (int pin) {
-  if (isrFds[pin]>0) {
+  if (p == NULL)
+    return -1 ;
+
+  pthread_mutex_lock (&p->lock) ;
+  if (p->isrState == ISR_IDLE)	// Not under a running ISR thread's feet
+    ret = requestEvent (ctx, p, mode) ;
+  pthread_mutex_unlock (&p->lock) ;
+
+  return ret ;
+}
+
+int waitForInterruptInit (int pin, int mode)
+{
+  return wpiCtxWaitForInterruptInit (wpiCtxDefault (), wiringPiPinToGpio (pin), mode) ;
+}
+
+
+/*
+ * isrCleanup:
+ *	Return a pin to idle once its ISR thread is gone. Called with the
+ *	pin's lock held.
+ *********************************************************************************
+ */
+
+static void isrCleanup (struct wpiPinState *p)
+{
+  if (p->isrFd >= 0)
+    close (p->isrFd) ;
+  p->isrFd        = -1 ;
+  p->isrFunction  = NULL ;
+  p->isrFunction2 = NULL ;
+  p->isrUserData  = NULL ;
+  __atomic_store_n (&p->isrStop, 0, __ATOMIC_RELEASE) ;
+  p->isrState     = ISR_IDLE ;
+  pthread_cond_broadcast (&p->idle) ;
+}
+
+
+/*
+ * wpiCtxISRStop:
+ *	Stop the ISR thread of a pin and close its event line. Waits until
+ *	the thread is gone, unless called from the pin's own handler - then
+ *	the thread finishes the job itself once the handler returns.
+ *********************************************************************************
+ */
+
+int wpiCtxISRStop (wpiCtx *ctx, int gpio)
+{
+  struct wpiPinState *p = ctxPin (ctx, gpio) ;
+  pthread_t thread ;
+
+  if (p == NULL)
+    return -1 ;
+
+  pthread_mutex_lock (&p->lock) ;
+
+  if ((p->isrState != ISR_IDLE) && pthread_equal (p->isrThread, pthread_self ()))
+  {
+    __atomic_store_n (&p->isrStop, ISR_STOP_SELF, __ATOMIC_RELEASE) ;
+    p->isrState = ISR_STOPPING ;
+    pthread_mutex_unlock (&p->lock) ;
+    return 0 ;
+  }
+
+  while (p->isrState == ISR_STOPPING)
+    pthread_cond_wait (&p->idle, &p->lock) ;
+
+  if (p->isrState == ISR_IDLE)		// Maybe just waitForInterruptInit
+  {
+    isrCleanup (p) ;
+    pthread_mutex_unlock (&p->lock) ;
+    return 0 ;
+  }
+
+  if (wiringPiDebug) {
+    printf ("wiringPi: waitForInterruptClose close thread 0x%lX\n", (unsigned long)p->isrThread) ;
+  }
+  __atomic_store_n (&p->isrStop, ISR_STOP_JOIN, __ATOMIC_RELEASE) ;
+  p->isrState = ISR_STOPPING ;
+  thread      = p->isrThread ;
+  pthread_mutex_unlock (&p->lock) ;
+
+  if (pthread_join (thread, NULL) != 0) {
     if (wiringPiDebug) {
-      printf ("wiringPi: waitForInterruptClose close thread 0x%lX\n", (unsigned long)isrThreads[pin]) ;
-    }
-    // Set stop flag
-    isrStopFlags[pin] = 1;
-    if (pthread_join(isrThreads[pin], NULL) == 0) {
-      if (wiringPiDebug) {
-        printf ("wiringPi: waitForInterruptClose thread canceled successfuly\n") ;
-      }
-    } else {
-     if (wiringPiDebug) {
-        fprintf (stderr, "wiringPi: waitForInterruptClose could not cancel thread\n");
-      }
+      fprintf (stderr, "wiringPi: waitForInterruptClose could not cancel thread\n");
     }
-    close(isrFds [pin]);
   }
-  isrFds [pin] = -1;
-  isrFunctions [pin] = NULL;
 
-  /* -not closing so far - other isr may be using it - only close if no other is using - will code later
-  if (chipFd>0) {
-    close(chipFd);
-  }
-  chipFd = -1;
-  */
+  pthread_mutex_lock (&p->lock) ;
+  isrCleanup (p) ;
+  pthread_mutex_unlock (&p->lock) ;
+
   if (wiringPiDebug) {
     printf ("wiringPi: waitForInterruptClose finished\n") ;
   }
-  return 0;
+  return 0 ;
+}
+
+int waitForInterruptClose (int pin) {
+  return wpiCtxISRStop (wpiCtxDefault (), wiringPiPinToGpio (pin)) ;
 }
 
 
@@ -2673,27 +3101,42 @@ int wiringPiISRStop (int pin) {
  * interruptHandler:
  *	This is a thread and gets started to wait for the interrupt we're
  *	hoping to catch. It will call the user-function when the interrupt
- *	fires.
+ *	fires. It gets its pin state handed over as the argument and runs
+ *	until it's told to stop or its event line fails.
  *********************************************************************************
  */
 
-static void *interruptHandler (UNU void *arg)
+static void *interruptHandler (void *arg)
 {
-  int pin ;
+  struct wpiPinState *p = (struct wpiPinState *)arg ;
+  struct gpioevent_data evdata ;
+  struct WPIWfiStatus wfiStatus ;
+  struct timespec now ;
+  long long int late ;
+
+  (void)piThreadEnter (WPI_THREAD_ISR, 55) ;	// Only effective if we run as root
 
-  (void)piHiPri (55) ;	// Only effective if we run as root
+  wfiStatus.pinBCM = p->gpio ;
 
-  pin   = pinPass ;
-  pinPass = -1 ;
+  // Wake up now and then to see if wpiCtxISRStop wants us gone
 
-  for (;;) {
-    int ret = waitForInterrupt(pin, -1);
+  while (__atomic_load_n (&p->isrStop, __ATOMIC_ACQUIRE) == 0) {
+    int ret = waitForInterruptEvent(p->isrFd, p->gpio, 100, &evdata);
     if ( ret> 0) {
+      clock_gettime (CLOCK_MONOTONIC, &now) ;
+      late = (long long int)now.tv_sec * 1000000000LL + now.tv_nsec - (long long int)evdata.timestamp ;
+      if ((late >= 0) && (late < 1000000000LL))	// Kernels before 5.7 stamp events with CLOCK_REALTIME
+        piThreadWokeUp (late) ;
       if (wiringPiDebug) {
         printf ("wiringPi: call function\n") ;
       }
-      if(isrFunctions [pin]) {
-        isrFunctions [pin] () ;
+      if(p->isrFunction) {
+        p->isrFunction () ;
+      } else if (p->isrFunction2) {
+        wfiStatus.statusOK     = 1 ;
+        wfiStatus.edge         = (evdata.id == GPIOEVENT_EVENT_RISING_EDGE) ? INT_EDGE_RISING : INT_EDGE_FALLING ;
+        wfiStatus.timeStamp_us = evdata.timestamp / 1000 ;
+        p->isrFunction2 (wfiStatus, p->isrUserData) ;
       }
       // wait again - in the past forever - now can be stopped by  waitForInterruptClose
     } else if( ret< 0) {
@@ -2701,10 +3144,19 @@ static void *interruptHandler (UNU void *arg)
     }
   }
 
-  waitForInterruptClose (pin);
+  // Nobody is going to join us unless wpiCtxISRStop asked us to go
+
+  pthread_mutex_lock (&p->lock) ;
+  if (p->isrStop != ISR_STOP_JOIN) {
+    pthread_detach (pthread_self ()) ;
+    isrCleanup (p) ;
+  }
+  pthread_mutex_unlock (&p->lock) ;
+
   if (wiringPiDebug) {
     printf ("wiringPi: interruptHandler finished\n") ;
   }
+  piThreadExit () ;
   return NULL ;
 }
 
@@ -2717,60 +3169,138 @@ static void *interruptHandler (UNU void *arg)
  *********************************************************************************
  */
 
-int wiringPiISR (int pin, int mode, void (*function)(void))
+static int isrStart (wpiCtx *ctx, int gpio, int mode, void (*function)(void),
+                     void (*function2)(struct WPIWfiStatus wfiStatus, void *userdata), void *userdata)
 {
-  const int maxpin = GetMaxPin();
+  struct wpiPinState *p = ctxPin (ctx, gpio) ;
 
-  if (pin < 0 || pin > maxpin)
-    return wiringPiFailure (WPI_FATAL, "wiringPiISR: pin must be 0-%d (%d)\n", maxpin, pin) ;
-  if (wiringPiMode == WPI_MODE_UNINITIALISED)
-    return wiringPiFailure (WPI_FATAL, "wiringPiISR: wiringPi has not been initialised. Unable to continue.\n") ;
-  if (wiringPiDebug) {
-    printf ("wiringPi: wiringPiISR pin %d, mode %d\n", pin, mode) ;
+  if (p == NULL)
+    return -1 ;
+
+  pthread_mutex_lock (&p->lock) ;
+
+  if ((p->isrState != ISR_IDLE) && pthread_equal (p->isrThread, pthread_self ()))
+  {
+    pthread_mutex_unlock (&p->lock) ;
+    return -1 ;
   }
-  if (isrFunctions [pin]) {
+
+  while (p->isrState == ISR_STOPPING)
+    pthread_cond_wait (&p->idle, &p->lock) ;
+
+  if (p->isrState == ISR_RUNNING) {
+    pthread_mutex_unlock (&p->lock) ;
     printf ("wiringPi: ISR function alread active, ignoring \n") ;
+    return -1 ;
   }
 
-  isrFunctions [pin] = function ;
-  isrMode[pin] = mode;
-  if(waitForInterruptInit (pin, mode)<0) {
+  if (requestEvent (ctx, p, mode) < 0) {
+    pthread_mutex_unlock (&p->lock) ;
     if (wiringPiDebug) {
       fprintf (stderr, "wiringPi: waitForInterruptInit failed\n") ;
     }
-  };
-
-  if (wiringPiDebug) {
-    printf ("wiringPi: mutex in\n") ;
+    return -1 ;
   }
-  pthread_mutex_lock (&pinMutex) ;
-    pinPass = pin ;
-    if (wiringPiDebug) {
-      printf("wiringPi: pthread_create before 0x%lX\n", (unsigned long)isrThreads[pin]);
-    }
-    if (pthread_create (&isrThreads[pin], NULL, interruptHandler, NULL)==0) {
-      if (wiringPiDebug) {
-        printf("wiringPi: pthread_create successed, 0x%lX\n", (unsigned long)isrThreads[pin]);
-      }
-      while (pinPass != -1)
-        delay (1) ;
-    } else {
-      if (wiringPiDebug) {
-        printf("wiringPi: pthread_create failed\n");
-      }
-    }
 
+  p->isrFunction  = function ;
+  p->isrFunction2 = function2 ;
+  p->isrUserData  = userdata ;
+  p->isrState     = ISR_RUNNING ;
+  __atomic_store_n (&p->isrStop, 0, __ATOMIC_RELEASE) ;
+
+  if (pthread_create (&p->isrThread, NULL, interruptHandler, p) != 0) {
     if (wiringPiDebug) {
-      printf ("wiringPi: mutex out\n") ;
+      printf("wiringPi: pthread_create failed\n");
     }
-  pthread_mutex_unlock (&pinMutex) ;
+    isrCleanup (p) ;
+    pthread_mutex_unlock (&p->lock) ;
+    return -1 ;
+  }
+  if (wiringPiDebug) {
+    printf("wiringPi: pthread_create successed, 0x%lX\n", (unsigned long)p->isrThread);
+  }
+  pthread_mutex_unlock (&p->lock) ;
+
+  return 0 ;
+}
+
+int wpiCtxISR (wpiCtx *ctx, int gpio, int mode, void (*function)(struct WPIWfiStatus wfiStatus, void *userdata), void *userdata)
+{
+  return isrStart (ctx, gpio, mode, NULL, function, userdata) ;
+}
 
+static int isrCheck (int pin, int mode)
+{
+  const int maxpin = GetMaxPin();
+
+  if (pin < 0 || pin > maxpin)
+    return wiringPiFailure (WPI_FATAL, "wiringPiISR: pin must be 0-%d (%d)\n", maxpin, pin) ;
+  if (wiringPiMode == WPI_MODE_UNINITIALISED)
+    return wiringPiFailure (WPI_FATAL, "wiringPiISR: wiringPi has not been initialised. Unable to continue.\n") ;
   if (wiringPiDebug) {
-    printf ("wiringPi: wiringPiISR finished\n") ;
+    printf ("wiringPi: wiringPiISR pin %d, mode %d\n", pin, mode) ;
   }
   return 0 ;
 }
 
+int wiringPiISR (int pin, int mode, void (*function)(void))
+{
+  if (isrCheck (pin, mode) < 0)
+    return -1 ;
+
+  return isrStart (wpiCtxDefault (), wiringPiPinToGpio (pin), mode, function, NULL, NULL) ;
+}
+
+
+/*
+ * wiringPiISR2:
+ *	As wiringPiISR, but the function also gets the edge, the kernel's
+ *	timestamp of it and a user pointer - so one handler can serve
+ *	several pins or device instances.
+ *********************************************************************************
+ */
+
+int wiringPiISR2 (int pin, int mode, void (*function)(struct WPIWfiStatus wfiStatus, void *userdata), void *userdata)
+{
+  if (isrCheck (pin, mode) < 0)
+    return -1 ;
+
+  return isrStart (wpiCtxDefault (), wiringPiPinToGpio (pin), mode, NULL, function, userdata) ;
+}
+
+
+/*
+ * wpiCtxFree:
+ *	Stop the ISR threads of a context, release its lines and close the
+ *	chip. The default context can't be freed.
+ *********************************************************************************
+ */
+
+void wpiCtxFree (wpiCtx *ctx)
+{
+  int i ;
+
+  if ((ctx == NULL) || (ctx == &defaultCtx))
+    return ;
+
+  for (i = 0 ; i < 64 ; ++i)
+  {
+    struct wpiPinState *p = &ctx->pins [i] ;
+
+    wpiCtxISRStop (ctx, i) ;
+    pthread_mutex_lock (&p->lock) ;
+    releaseLine (p) ;
+    pthread_mutex_unlock (&p->lock) ;
+    pthread_cond_destroy  (&p->idle) ;
+    pthread_mutex_destroy (&p->lock) ;
+  }
+
+  if (ctx->chipFd >= 0)
+    close (ctx->chipFd) ;
+  pthread_mutex_destroy (&ctx->chipLock) ;
+  free (ctx) ;
+}
+
 
 /*
  * initialiseEpoch:
@@ -2821,46 +3351,141 @@ void delay (unsigned int howLong)
  *	obeying the standards (may take longer), it's not always what we
  *	want!
  *
- *	So what I'll do now is if the delay is less than 100uS we'll do it
- *	in a hard loop, watching a built-in counter on the ARM chip. This is
- *	somewhat sub-optimal in that it uses 100% CPU, something not an issue
- *	in a microcontroller, but under a multi-tasking, multi-user OS, it's
- *	wastefull, however we've no real choice )-:
- *
- *      Plan B: It seems all might not be well with that plan, so changing it
- *      to use gettimeofday () and poll on that instead...
+ *	So we work to an absolute deadline: sleep on CLOCK_MONOTONIC until
+ *	a margin before it, then spin on CLOCK_MONOTONIC_RAW for the rest.
+ *	The margin is the nanosleep overshoot measured by delayCalibrate
+ *	when wiringPi is set up, so short delays spin (as they always did)
+ *	and long ones only spin for their last few tens of microseconds.
+ *	Neither clock steps with NTP, unlike the gettimeofday () we used to
+ *	poll on.
  *********************************************************************************
  */
 
-void delayMicrosecondsHard (unsigned int howLong)
+#define	DELAY_CALIBRATE_RUNS	25
+#define	DELAY_MARGIN_MIN	  5000L		// nS
+#define	DELAY_MARGIN_MAX	500000L
+
+static long delayMarginNs = 80000L ;		// Until calibrated
+
+static uint64_t rawNanos (void)
 {
-  struct timeval tNow, tLong, tEnd ;
+  struct timespec ts ;
 
-  gettimeofday (&tNow, NULL) ;
-  tLong.tv_sec  = howLong / 1000000 ;
-  tLong.tv_usec = howLong % 1000000 ;
-  timeradd (&tNow, &tLong, &tEnd) ;
+  clock_gettime (CLOCK_MONOTONIC_RAW, &ts) ;
+  return (uint64_t)ts.tv_sec * (uint64_t)1000000000 + (uint64_t)ts.tv_nsec ;
+}
 
-  while (timercmp (&tNow, &tEnd, <))
-    gettimeofday (&tNow, NULL) ;
+static void addNanos (struct timespec *ts, int64_t nanos)
+{
+  ts->tv_sec  += nanos / 1000000000LL ;
+  ts->tv_nsec += nanos % 1000000000LL ;
+  if (ts->tv_nsec >= 1000000000L)
+  {
+    ts->tv_nsec -= 1000000000L ;
+    ++ts->tv_sec ;
+  }
 }
 
-void delayMicroseconds (unsigned int howLong)
+static void delayUntilNanos (uint64_t deadline)
 {
-  struct timespec sleeper ;
-  unsigned int uSecs = howLong % 1000000 ;
-  unsigned int wSecs = howLong / 1000000 ;
+  struct timespec wakeUp ;
+  uint64_t now = rawNanos () ;
+  int64_t  sleepFor ;
 
-  /**/ if (howLong ==   0)
+  if (now >= deadline)
     return ;
-  else if (howLong  < 100)
-    delayMicrosecondsHard (howLong) ;
-  else
+
+  sleepFor = (int64_t)(deadline - now) - delayMarginNs ;
+  if (sleepFor > 0)
   {
-    sleeper.tv_sec  = wSecs ;
-    sleeper.tv_nsec = (long)(uSecs * 1000L) ;
-    nanosleep (&sleeper, NULL) ;
+    clock_gettime (CLOCK_MONOTONIC, &wakeUp) ;
+    addNanos (&wakeUp, sleepFor) ;
+    while (clock_nanosleep (CLOCK_MONOTONIC, TIMER_ABSTIME, &wakeUp, NULL) == EINTR)
+      ;
   }
+
+  while (rawNanos () < deadline)
+    ;
+}
+
+static int compareLong (const void *a, const void *b)
+{
+  long x = *(const long *)a ;
+  long y = *(const long *)b ;
+
+  return (x > y) - (x < y) ;
+}
+
+
+/*
+ * delayCalibrate:
+ *	Measure how late a 100uS sleep wakes up and use the 90th percentile
+ *	as the margin to spin for. Returns the margin in uS.
+ *********************************************************************************
+ */
+
+int delayCalibrate (void)
+{
+  struct timespec wakeUp, now ;
+  long overshoot [DELAY_CALIBRATE_RUNS] ;
+  long margin ;
+  int  i ;
+
+  for (i = 0 ; i < DELAY_CALIBRATE_RUNS ; ++i)
+  {
+    clock_gettime (CLOCK_MONOTONIC, &wakeUp) ;
+    addNanos (&wakeUp, 100000) ;
+    while (clock_nanosleep (CLOCK_MONOTONIC, TIMER_ABSTIME, &wakeUp, NULL) == EINTR)
+      ;
+    clock_gettime (CLOCK_MONOTONIC, &now) ;
+    overshoot [i] = (now.tv_sec - wakeUp.tv_sec) * 1000000000L + (now.tv_nsec - wakeUp.tv_nsec) ;
+  }
+
+  qsort (overshoot, DELAY_CALIBRATE_RUNS, sizeof (long), compareLong) ;
+  margin = overshoot [(DELAY_CALIBRATE_RUNS * 9) / 10] ;
+
+  /**/ if (margin < DELAY_MARGIN_MIN)
+    margin = DELAY_MARGIN_MIN ;
+  else if (margin > DELAY_MARGIN_MAX)
+    margin = DELAY_MARGIN_MAX ;
+
+  delayMarginNs = margin ;
+
+  if (wiringPiDebug)
+    printf ("wiringPi: delay margin %ld nS\n", margin) ;
+
+  return (int)(margin / 1000) ;
+}
+
+
+void delayMicrosecondsHard (unsigned int howLong)
+{
+  uint64_t deadline = rawNanos () + (uint64_t)howLong * 1000 ;
+
+  while (rawNanos () < deadline)
+    ;
+}
+
+void delayMicroseconds (unsigned int howLong)
+{
+  if (howLong == 0)
+    return ;
+
+  delayUntilNanos (rawNanos () + (uint64_t)howLong * 1000) ;
+}
+
+
+/*
+ * delayUntilMicros64:
+ *	Wait until piMicros64 () reaches deadline. For periodic work keep
+ *	adding the period to the deadline, so it doesn't drift by the time
+ *	the work itself takes.
+ *********************************************************************************
+ */
+
+void delayUntilMicros64 (unsigned long long deadline)
+{
+  delayUntilNanos ((deadline + epochMicro) * 1000) ;
 }
 
 
@@ -3212,6 +3837,7 @@ int wiringPiSetup (void)
   }
 
   initialiseEpoch () ;
+  delayCalibrate () ;
 
   return 0 ;
 }
@@ -3298,6 +3924,7 @@ int wiringPiSetupGpioDevice (enum WPIPinType pinType) {
   }
 
   initialiseEpoch () ;
+  delayCalibrate () ;
 
   switch (pinType) {
     case WPI_PIN_BCM:
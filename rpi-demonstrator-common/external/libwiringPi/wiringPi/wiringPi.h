@@ -142,6 +142,16 @@ extern const int   piMemorySize    [ 8] ;
 
 #define	PI_THREAD(X)	void *X (UNU void *dummy)
 
+// Interrupt status handed to wiringPiISR2 functions
+
+struct WPIWfiStatus
+{
+  int           statusOK ;	// 1: edge seen, the fields below are valid
+  unsigned int  pinBCM ;	// GPIO as BCM pin
+  int           edge ;		// INT_EDGE_FALLING or INT_EDGE_RISING
+  long long int timeStamp_us ;	// Kernel timestamp of the edge
+} ;
+
 // Failure modes
 
 #define	WPI_FATAL	(1==1)
@@ -176,6 +186,12 @@ struct wiringPiNodeStruct
            void   (*pwmWrite)         (struct wiringPiNodeStruct *node, int pin, int value) ;
            int    (*analogRead)       (struct wiringPiNodeStruct *node, int pin) ;
            void   (*analogWrite)      (struct wiringPiNodeStruct *node, int pin, int value) ;
+           int    (*beginTransaction) (struct wiringPiNodeStruct *node) ;
+           int    (*commitTransaction)(struct wiringPiNodeStruct *node) ;
+  unsigned int    (*digitalReadAll)   (struct wiringPiNodeStruct *node) ;
+           int    (*analogReadMany)   (struct wiringPiNodeStruct *node, int pin, int count, int *values) ;
+
+  void   *devData ;	// Node specific, for drivers needing more than data0-3
 
   struct wiringPiNodeStruct *next ;
 } ;
@@ -257,8 +273,15 @@ extern unsigned int  digitalRead8        (int pin) ;
 extern          void digitalWrite8       (int pin, int value) ;
 extern          void pwmWrite            (int pin, int value) ;
 extern          int  analogRead          (int pin) ;
+extern          int  analogReadMany      (int pinBase, int count, int *values) ;
 extern          void analogWrite         (int pin, int value) ;
 
+// Extension node transactions
+
+extern          int  wiringPiNodeBegin   (int pin) ;
+extern          int  wiringPiNodeCommit  (int pin) ;
+extern unsigned int  wiringPiNodeReadAll (int pin) ;
+
 // PiFace specifics
 //	(Deprecated)
 
@@ -273,6 +296,7 @@ extern          void piBoardId           (int *model, int *rev, int *mem, int *m
 extern          int  piBoard40Pin        (void) ;                   // Interface V3.7
 extern          int  wpiPinToGpio        (int wpiPin) ;
 extern          int  physPinToGpio       (int physPin) ;
+extern          int  wiringPiPinToGpio   (int pin) ;
 extern          void setPadDrive         (int group, int value) ;
 extern          void setPadDrivePin      (int pin, int value);     // Interface V3.0
 extern          int  getAlt              (int pin) ;
@@ -285,6 +309,7 @@ extern unsigned int  digitalReadByte     (void) ;
 extern unsigned int  digitalReadByte2    (void) ;
 extern          void digitalWriteByte    (int value) ;
 extern          void digitalWriteByte2   (int value) ;
+extern          void digitalWriteGpioMask (unsigned int setMask, unsigned int clrMask) ;
 
 // Interrupts
 //	(Also Pi hardware specific)
@@ -292,8 +317,28 @@ extern          void digitalWriteByte2   (int value) ;
 extern int  waitForInterrupt    (int pin, int mS) ;
 extern int  wiringPiISR         (int pin, int mode, void (*function)(void)) ;
 extern int  wiringPiISRStop     (int pin) ;  //V3.2
+extern int  wiringPiISR2        (int pin, int mode, void (*function)(struct WPIWfiStatus wfiStatus, void *userdata), void *userdata) ;
 extern int  waitForInterruptClose(int pin) ; //V3.2
 
+// Pin contexts
+//	Own the /dev/gpiochip line handles and ISR threads, with a lock per pin
+//	so they can be used from any thread. Pins are BCM GPIO numbers, no
+//	wiringPiSetup needed. The functions above use wpiCtxDefault ().
+
+typedef struct wpiCtx wpiCtx ;
+
+extern wpiCtx *wpiCtxNew                  (void) ;
+extern void    wpiCtxFree                 (wpiCtx *ctx) ;
+extern wpiCtx *wpiCtxDefault              (void) ;
+extern void    wpiCtxPinMode              (wpiCtx *ctx, int gpio, int mode) ;
+extern void    wpiCtxPullUpDnControl      (wpiCtx *ctx, int gpio, int pud) ;
+extern int     wpiCtxDigitalRead          (wpiCtx *ctx, int gpio) ;
+extern void    wpiCtxDigitalWrite         (wpiCtx *ctx, int gpio, int value) ;
+extern int     wpiCtxISR                  (wpiCtx *ctx, int gpio, int mode, void (*function)(struct WPIWfiStatus wfiStatus, void *userdata), void *userdata) ;
+extern int     wpiCtxISRStop              (wpiCtx *ctx, int gpio) ;
+extern int     wpiCtxWaitForInterruptInit (wpiCtx *ctx, int gpio, int mode) ;
+extern int     wpiCtxWaitForInterrupt     (wpiCtx *ctx, int gpio, int mS) ;
+
 // Threads
 
 extern int  piThreadCreate      (void *(*fn)(void *)) ;
@@ -304,6 +349,45 @@ extern void piUnlock            (int key) ;
 
 extern int piHiPri (const int pri) ;
 
+// Threading policy for the threads wiringPi starts itself
+
+enum WPIThreadClass {
+  WPI_THREAD_ISR,		// wiringPiISR/wiringPiISR2 handlers
+  WPI_THREAD_SOFTPWM,
+  WPI_THREAD_SOFTTONE,
+  WPI_THREAD_SOFTSERVO,
+  WPI_THREAD_SAMPLER,		// ds18b20 and analog background samplers
+  WPI_THREAD_SERIAL,		// Buffered serial receive
+  WPI_THREAD_CLASSES
+};
+
+struct WPIThreadPolicy {
+  int                policy ;	// SCHED_OTHER, SCHED_FIFO or SCHED_RR
+  int                priority ;
+  unsigned long long cpuMask ;	// CPUs 0-63 it may run on, 0: any
+};
+
+struct WPIThreadInfo {
+  enum WPIThreadClass threadClass ;
+  int                 tid ;
+  int                 policy ;
+  int                 priority ;
+  unsigned long long  cpuMask ;
+  unsigned long long  wakeUps ;	// Timed waits measured
+  long long int       latencyMin_ns, latencyAvg_ns, latencyMax_ns ;
+};
+
+extern int  piThreadSetPolicy (enum WPIThreadClass threadClass, const struct WPIThreadPolicy *policy) ;
+extern int  piThreadGetPolicy (enum WPIThreadClass threadClass, struct WPIThreadPolicy *policy) ;
+extern int  piThreadList      (struct WPIThreadInfo *info, int max, int reset) ;
+extern int  piMemoryLock      (int lock) ;
+
+// Used by the threads themselves
+
+extern int  piThreadEnter     (enum WPIThreadClass threadClass, int defaultPri) ;
+extern void piThreadExit      (void) ;
+extern void piThreadWokeUp    (long long int late_ns) ;
+
 // Extras from arduino land
 
 extern void         delay             (unsigned int howLong) ;
@@ -312,6 +396,8 @@ extern unsigned int millis            (void) ;
 extern unsigned int micros            (void) ;
 
 extern unsigned long long piMicros64(void);   // Interface V3.7
+extern void         delayUntilMicros64 (unsigned long long deadline) ;
+extern int          delayCalibrate     (void) ;
 
 #ifdef __cplusplus
 }
@@ -60,8 +60,11 @@
 // I2C definitions
 
 #define I2C_SLAVE	0x0703
+#define I2C_RDWR	0x0707	/* Combined R/W transfer (one STOP only) */
 #define I2C_SMBUS	0x0720	/* SMBus-level access */
 
+#define I2C_M_RD	0x0001	/* read data, from slave to master */
+
 #define I2C_SMBUS_READ	1
 #define I2C_SMBUS_WRITE	0
 
@@ -110,6 +113,36 @@ static inline int i2c_smbus_access (int fd, char rw, uint8_t command, int size,
   return ioctl (fd, I2C_SMBUS, &args) ;
 }
 
+// Combined transactions: I2C_RDWR
+
+struct i2c_msg
+{
+  uint16_t addr ;
+  uint16_t flags ;
+  uint16_t len ;
+  uint8_t *buf ;
+} ;
+
+struct i2c_rdwr_ioctl_data
+{
+  struct i2c_msg *msgs ;
+  uint32_t nmsgs ;
+} ;
+
+// I2C_RDWR messages carry the target address, so remember the one
+//	each fd was set up for (stored +1, 0 is unknown). The table only
+//	covers the fd-only calls for fds wiringPiI2CSetup* opened: it knows
+//	nothing of fds past I2C_MAX_FDS or of an fd closed and reused.
+//	Drivers pass the address themselves with the ...To calls.
+
+#define	I2C_MAX_FDS	256
+
+static int i2cAddrs [I2C_MAX_FDS] ;
+
+// Small register writes are assembled on the stack
+
+#define	I2C_STACK_BUF	64
+
 
 /*
  * wiringPiI2CRead:
@@ -226,6 +259,214 @@ int wiringPiI2CRawWrite (int fd, const uint8_t *values, uint8_t size)
   return(write(fd, values, size));
 }
 
+/*
+ * i2cAddr:
+ *	The address an fd was set up for, or -1 if it isn't known.
+ *********************************************************************************
+ */
+
+static int i2cAddr (int fd)
+{
+  if ((fd < 0) || (fd >= I2C_MAX_FDS) || (i2cAddrs [fd] == 0))
+    return -1 ;
+
+  return i2cAddrs [fd] - 1 ;
+}
+
+
+/*
+ * wiringPiI2CTransferTo: wiringPiI2CTransfer:
+ *	Run up to WPI_I2C_MSGS_MAX messages as one combined I2C transaction:
+ *	a repeated start between the messages and a single stop at the end,
+ *	all with one ioctl. Each message may be up to WPI_I2C_MSG_MAX bytes.
+ *	Returns the number of messages transferred or < 0 on failure.
+ *********************************************************************************
+ */
+
+int wiringPiI2CTransferTo (int fd, int devId, struct wiringPiI2CMsg *msgs, int count)
+{
+  struct i2c_msg kmsgs [WPI_I2C_MSGS_MAX] ;
+  struct i2c_rdwr_ioctl_data args ;
+  int i ;
+
+  if (fd < 0)
+  {
+    errno = EBADF ;
+    return -1 ;
+  }
+
+  if ((devId < 0) || (devId > 0x7F) || (count <= 0) || (count > WPI_I2C_MSGS_MAX))
+  {
+    errno = EINVAL ;
+    return -1 ;
+  }
+
+  for (i = 0 ; i < count ; ++i)
+  {
+    if (msgs [i].len > WPI_I2C_MSG_MAX)
+    {
+      errno = EINVAL ;
+      return -1 ;
+    }
+    kmsgs [i].addr  = devId ;
+    kmsgs [i].flags = (msgs [i].flags & WPI_I2C_M_RD) ? I2C_M_RD : 0 ;
+    kmsgs [i].len   = msgs [i].len ;
+    kmsgs [i].buf   = msgs [i].buf ;
+  }
+
+  args.msgs  = kmsgs ;
+  args.nmsgs = count ;
+
+  return ioctl (fd, I2C_RDWR, &args) ;
+}
+
+int wiringPiI2CTransfer (int fd, struct wiringPiI2CMsg *msgs, int count)
+{
+  int devId = i2cAddr (fd) ;
+
+  if (devId < 0)
+  {
+    errno = EBADF ;
+    return -1 ;
+  }
+
+  return wiringPiI2CTransferTo (fd, devId, msgs, count) ;
+}
+
+
+/*
+ * wiringPiI2CReadRegBurstTo: wiringPiI2CReadRegBurst:
+ *	Write the register address then read size bytes after a repeated
+ *	start - the usual way of reading a run of auto-incrementing
+ *	registers, in one transaction and without the SMBus 32 byte limit.
+ *	Without a known address the fd-only call reads SMBus blocks instead.
+ *********************************************************************************
+ */
+
+int wiringPiI2CReadRegBurstTo (int fd, int devId, int reg, uint8_t *values, int size)
+{
+  uint8_t regAddr = reg ;
+  struct wiringPiI2CMsg msgs [2] ;
+
+  if ((size <= 0) || (size > WPI_I2C_MSG_MAX))
+  {
+    errno = EINVAL ;
+    return -1 ;
+  }
+
+  msgs [0].flags = 0 ;
+  msgs [0].len   = 1 ;
+  msgs [0].buf   = &regAddr ;
+  msgs [1].flags = WPI_I2C_M_RD ;
+  msgs [1].len   = size ;
+  msgs [1].buf   = values ;
+
+  if (wiringPiI2CTransferTo (fd, devId, msgs, 2) < 0)
+    return -1 ;
+
+  return size ;
+}
+
+int wiringPiI2CReadRegBurst (int fd, int reg, uint8_t *values, int size)
+{
+  union i2c_smbus_data data ;
+  int devId = i2cAddr (fd) ;
+  int done, chunk ;
+
+  if (devId >= 0)
+    return wiringPiI2CReadRegBurstTo (fd, devId, reg, values, size) ;
+
+  if ((size <= 0) || (size > WPI_I2C_MSG_MAX))
+  {
+    errno = EINVAL ;
+    return -1 ;
+  }
+
+  for (done = 0 ; done < size ; done += chunk)
+  {
+    chunk = size - done ;
+    if (chunk > I2C_SMBUS_BLOCK_MAX)
+      chunk = I2C_SMBUS_BLOCK_MAX ;
+
+    data.block [0] = chunk ;
+    if (i2c_smbus_access (fd, I2C_SMBUS_READ, reg + done, I2C_SMBUS_I2C_BLOCK_DATA, &data) < 0)
+      return -1 ;
+    memcpy (&values [done], &data.block [1], chunk) ;
+  }
+
+  return size ;
+}
+
+
+/*
+ * wiringPiI2CWriteRegBurstTo: wiringPiI2CWriteRegBurst:
+ *	Write the register address followed by size bytes in one message.
+ *	Without a known address the fd-only call writes SMBus blocks instead.
+ *********************************************************************************
+ */
+
+int wiringPiI2CWriteRegBurstTo (int fd, int devId, int reg, const uint8_t *values, int size)
+{
+  uint8_t  stackBuf [I2C_STACK_BUF + 1] ;
+  uint8_t *buf = stackBuf ;
+  struct wiringPiI2CMsg msg ;
+  int ret ;
+
+  if ((size < 0) || (size >= WPI_I2C_MSG_MAX))
+  {
+    errno = EINVAL ;
+    return -1 ;
+  }
+
+  if ((size > I2C_STACK_BUF) && ((buf = malloc (size + 1)) == NULL))
+    return -1 ;
+
+  buf [0] = reg ;
+  memcpy (&buf [1], values, size) ;
+
+  msg.flags = 0 ;
+  msg.len   = size + 1 ;
+  msg.buf   = buf ;
+
+  ret = wiringPiI2CTransferTo (fd, devId, &msg, 1) ;
+
+  if (buf != stackBuf)
+    free (buf) ;
+
+  return (ret < 0) ? -1 : size ;
+}
+
+int wiringPiI2CWriteRegBurst (int fd, int reg, const uint8_t *values, int size)
+{
+  union i2c_smbus_data data ;
+  int devId = i2cAddr (fd) ;
+  int done, chunk ;
+
+  if (devId >= 0)
+    return wiringPiI2CWriteRegBurstTo (fd, devId, reg, values, size) ;
+
+  if ((size < 0) || (size >= WPI_I2C_MSG_MAX))
+  {
+    errno = EINVAL ;
+    return -1 ;
+  }
+
+  for (done = 0 ; done < size ; done += chunk)
+  {
+    chunk = size - done ;
+    if (chunk > I2C_SMBUS_BLOCK_MAX)
+      chunk = I2C_SMBUS_BLOCK_MAX ;
+
+    data.block [0] = chunk ;
+    memcpy (&data.block [1], &values [done], chunk) ;
+    if (i2c_smbus_access (fd, I2C_SMBUS_WRITE, reg + done, I2C_SMBUS_I2C_BLOCK_DATA, &data) < 0)
+      return -1 ;
+  }
+
+  return size ;
+}
+
+
 /*
  * wiringPiI2CSetupInterface:
  *	Undocumented access to set the interface explicitly - might be used
@@ -243,6 +484,9 @@ int wiringPiI2CSetupInterface (const char *device, int devId)
   if (ioctl (fd, I2C_SLAVE, devId) < 0)
     return wiringPiFailure (WPI_ALMOST, "Unable to select I2C device: %s\n", strerror (errno)) ;
 
+  if (fd < I2C_MAX_FDS)
+    i2cAddrs [fd] = devId + 1 ;
+
   return fd ;
 }
 
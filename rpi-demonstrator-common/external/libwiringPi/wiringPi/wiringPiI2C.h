@@ -24,6 +24,19 @@
 
 #include <stdint.h>
 
+// Combined transactions
+
+#define	WPI_I2C_M_RD		0x0001	// Message reads from the device
+#define	WPI_I2C_MSG_MAX		8192	// Bytes per message (kernel limit)
+#define	WPI_I2C_MSGS_MAX	42	// Messages per transaction (kernel limit)
+
+struct wiringPiI2CMsg
+{
+  uint16_t  flags ;
+  uint16_t  len ;
+  uint8_t  *buf ;
+} ;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -40,6 +53,16 @@ extern int wiringPiI2CWriteReg16     (int fd, int reg, int data) ;
 extern int wiringPiI2CWriteBlockData (int fd, int reg, const uint8_t *values, uint8_t size);  //Interface 3.3
 extern int wiringPiI2CRawWrite       (int fd, const uint8_t *values, uint8_t size);           //Interface 3.3
 
+extern int wiringPiI2CTransfer       (int fd, struct wiringPiI2CMsg *msgs, int count) ;
+extern int wiringPiI2CReadRegBurst   (int fd, int reg, uint8_t *values, int size) ;
+extern int wiringPiI2CWriteRegBurst  (int fd, int reg, const uint8_t *values, int size) ;
+
+// As above, to the device at devId rather than the one the fd was set up for
+
+extern int wiringPiI2CTransferTo       (int fd, int devId, struct wiringPiI2CMsg *msgs, int count) ;
+extern int wiringPiI2CReadRegBurstTo   (int fd, int devId, int reg, uint8_t *values, int size) ;
+extern int wiringPiI2CWriteRegBurstTo  (int fd, int devId, int reg, const uint8_t *values, int size) ;
+
 extern int wiringPiI2CSetupInterface (const char *device, int devId) ;
 extern int wiringPiI2CSetup          (const int devId) ;
 
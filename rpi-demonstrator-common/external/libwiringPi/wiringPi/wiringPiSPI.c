@@ -144,6 +144,65 @@ int wiringPiSPIDataRW (int channel, unsigned char *data, int len) {
   return wiringPiSPIxDataRW(0, channel, data, len);
 }
 
+
+/*
+ * wiringPiSPIxDataRWBatch:
+ *	Run a list of full-duplex segments as one SPI message, i.e. a single
+ *	ioctl. Each segment can deselect CS after it (csChange) and/or delay
+ *	before the next one starts, so e.g. a whole ADC channel scan with a
+ *	CS cycle per conversion is one system call. CS is always released
+ *	at the end of the batch.
+ *********************************************************************************
+ */
+
+#define	SPI_BATCH_STACK	16
+
+int wiringPiSPIxDataRWBatch (const int number, const int channel, struct wiringPiSPISegment *segs, const int count)
+{
+  struct spi_ioc_transfer  stackSpi [SPI_BATCH_STACK] ;
+  struct spi_ioc_transfer *spi = stackSpi ;
+  int i ;
+
+  RETURN_ON_LIMIT_FAIL
+  if (-1==spiFds[number][channel]) {
+    fprintf (stderr, "wiringPiSPI: Invalid SPI number/channel (need wiringPiSPIxSetupMode before read/write)");
+    return -EBADF;
+  }
+  if (count<=0 || count>WPI_SPI_MAX_SEGMENTS) {
+    fprintf (stderr, "wiringPiSPI: Invalid segment count (%d, valid range 1-%d)", count, WPI_SPI_MAX_SEGMENTS);
+    return -EINVAL;
+  }
+
+  if (count > SPI_BATCH_STACK) {
+    if ((spi = calloc (count, sizeof (struct spi_ioc_transfer))) == NULL)
+      return -ENOMEM;
+  } else {
+    memset (spi, 0, count * sizeof (struct spi_ioc_transfer)) ;
+  }
+
+  for (i = 0 ; i < count ; ++i)
+  {
+    spi [i].tx_buf        = (unsigned long)segs [i].data ;
+    spi [i].rx_buf        = (unsigned long)segs [i].data ;
+    spi [i].len           = segs [i].len ;
+    spi [i].delay_usecs   = segs [i].delayUs ;
+    spi [i].speed_hz      = spiSpeeds [number][channel] ;
+    spi [i].bits_per_word = spiBPW ;
+    spi [i].cs_change     = (segs [i].csChange && (i < count - 1)) ? 1 : 0 ;	// On the last one it would keep CS active
+  }
+
+  ret = ioctl (spiFds[number][channel], SPI_IOC_MESSAGE(count), spi) ;
+
+  if (spi != stackSpi)
+    free (spi) ;
+
+  return ret ;
+}
+
+int wiringPiSPIDataRWBatch (const int channel, struct wiringPiSPISegment *segs, const int count) {
+  return wiringPiSPIxDataRWBatch(0, channel, segs, count);
+}
+
 /*
  * wiringPiSPISetupMode:
  *	Open the SPI device, and set it up, with the mode, etc.
@@ -22,6 +22,18 @@
  ***********************************************************************
  */
 
+// Batched transfers: one segment per spi_ioc_transfer, all in one ioctl
+
+#define	WPI_SPI_MAX_SEGMENTS	511	// SPI_IOC_MESSAGE size field limit
+
+struct wiringPiSPISegment
+{
+  unsigned char *data ;		// Written out and read back into
+  int            len ;
+  int            csChange ;	// Deselect CS between this segment and the next
+  int            delayUs ;	// Delay after this segment
+} ;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -41,6 +53,9 @@ int wiringPiSPIxSetupMode (const int number, const int channel, const int speed,
 int wiringPiSPIxSetup     (const int number, const int channel, const int speed) ;
 int wiringPiSPIxClose     (const int number, const int channel);
 
+int wiringPiSPIDataRWBatch  (const int channel, struct wiringPiSPISegment *segs, const int count) ;
+int wiringPiSPIxDataRWBatch (const int number, const int channel, struct wiringPiSPISegment *segs, const int count) ;
+
 #ifdef __cplusplus
 }
 #endif
@@ -28,10 +28,17 @@
 #include <termios.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
 #include <sys/ioctl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 
+#include "wiringPi.h"
 #include "wiringSerial.h"
 
 /*
@@ -230,3 +237,410 @@ int serialGetchar (const int fd)
 
   return ((int)x) & 0xFF ;
 }
+
+
+/*
+ *********************************************************************************
+ * Buffered transport
+ *	Writes are collected in a transmit ring and go out with one writev ()
+ *	per serialBufFlush. A thread waits in epoll for the port to become
+ *	readable and reads whatever has arrived into a receive ring, so
+ *	request/response protocols can keep several requests in flight.
+ *********************************************************************************
+ */
+
+#define	SERIAL_BUF_SIZE	4096
+
+struct serialBuf
+{
+  int fd ;
+  int epollFd ;
+  int wakeFd ;				// eventfd to stop the receive thread
+  pthread_t rxThread ;
+
+  pthread_mutex_t txLock ;
+  uint8_t      tx [SERIAL_BUF_SIZE] ;
+  unsigned int txHead, txLen ;
+
+  pthread_mutex_t rxLock ;
+  pthread_cond_t  rxData ;		// Something arrived
+  pthread_cond_t  rxSpace ;		// Something was taken out
+  uint8_t      rx [SERIAL_BUF_SIZE] ;
+  unsigned int rxHead, rxLen ;
+  int          stop ;
+  int          error ;
+
+  serialBufReceiver receiver ;
+  void             *userdata ;
+} ;
+
+
+/*
+ * serialBufRxThread:
+ *	Fill the receive ring from the port and tell whoever is interested.
+ *********************************************************************************
+ */
+
+static void *serialBufRxThread (void *arg)
+{
+  struct serialBuf  *sb = (struct serialBuf *)arg ;
+  struct epoll_event events [2] ;
+  unsigned int tail, space ;
+  ssize_t len ;
+  int n, i, readable ;
+
+  piThreadEnter (WPI_THREAD_SERIAL, 0) ;
+
+  for (;;)
+  {
+    n = epoll_wait (sb->epollFd, events, 2, -1) ;
+    if ((n < 0) && (errno == EINTR))
+      continue ;
+
+    readable = 0 ;
+    for (i = 0 ; i < n ; ++i)
+      if (events [i].data.fd == sb->fd)
+        readable = 1 ;
+
+    pthread_mutex_lock (&sb->rxLock) ;
+
+    if ((n < 0) || sb->stop)
+    {
+      pthread_mutex_unlock (&sb->rxLock) ;
+      break ;
+    }
+
+    while ((sb->rxLen == SERIAL_BUF_SIZE) && !sb->stop)	// Full, wait for a reader
+      pthread_cond_wait (&sb->rxSpace, &sb->rxLock) ;
+
+    if (readable && !sb->stop)
+    {
+      tail  = (sb->rxHead + sb->rxLen) % SERIAL_BUF_SIZE ;
+      space = SERIAL_BUF_SIZE - sb->rxLen ;
+      if (space > (SERIAL_BUF_SIZE - tail))
+        space = SERIAL_BUF_SIZE - tail ;
+
+      len = read (sb->fd, &sb->rx [tail], space) ;
+      if (len > 0)
+      {
+        sb->rxLen += len ;
+        pthread_cond_broadcast (&sb->rxData) ;
+      }
+      else if ((len == 0) || ((errno != EAGAIN) && (errno != EINTR)))
+      {
+        sb->error = 1 ;		// Port gone away
+        pthread_cond_broadcast (&sb->rxData) ;
+        pthread_mutex_unlock (&sb->rxLock) ;
+        break ;
+      }
+    }
+
+    pthread_mutex_unlock (&sb->rxLock) ;
+
+    if (readable && (sb->receiver != NULL))
+      sb->receiver (sb, sb->userdata) ;
+  }
+
+  piThreadExit () ;
+
+  return NULL ;
+}
+
+
+/*
+ * serialBufOpen:
+ *	Put a buffered transport on top of a port opened with serialOpen.
+ *	serialBufClose doesn't close the port.
+ *********************************************************************************
+ */
+
+struct serialBuf *serialBufOpen (const int fd)
+{
+  struct serialBuf  *sb ;
+  struct epoll_event ev ;
+
+  if ((sb = (struct serialBuf *)calloc (1, sizeof (struct serialBuf))) == NULL)
+    return NULL ;
+
+  sb->fd      = fd ;
+  sb->epollFd = epoll_create1 (EPOLL_CLOEXEC) ;
+  sb->wakeFd  = eventfd (0, EFD_CLOEXEC | EFD_NONBLOCK) ;
+
+  if ((sb->epollFd < 0) || (sb->wakeFd < 0))
+    goto fail ;
+
+  memset (&ev, 0, sizeof (ev)) ;
+  ev.events  = EPOLLIN ;
+  ev.data.fd = fd ;
+  if (epoll_ctl (sb->epollFd, EPOLL_CTL_ADD, fd, &ev) < 0)
+    goto fail ;
+
+  ev.data.fd = sb->wakeFd ;
+  if (epoll_ctl (sb->epollFd, EPOLL_CTL_ADD, sb->wakeFd, &ev) < 0)
+    goto fail ;
+
+  pthread_mutex_init (&sb->txLock, NULL) ;
+  pthread_mutex_init (&sb->rxLock, NULL) ;
+  pthread_cond_init  (&sb->rxData,  NULL) ;
+  pthread_cond_init  (&sb->rxSpace, NULL) ;
+
+  if (pthread_create (&sb->rxThread, NULL, serialBufRxThread, sb) != 0)
+  {
+    pthread_cond_destroy  (&sb->rxSpace) ;
+    pthread_cond_destroy  (&sb->rxData) ;
+    pthread_mutex_destroy (&sb->rxLock) ;
+    pthread_mutex_destroy (&sb->txLock) ;
+    goto fail ;
+  }
+
+  return sb ;
+
+fail:
+  if (sb->epollFd >= 0) close (sb->epollFd) ;
+  if (sb->wakeFd  >= 0) close (sb->wakeFd) ;
+  free (sb) ;
+  return NULL ;
+}
+
+
+/*
+ * serialBufClose:
+ *	Stop the receive thread and free the transport. Anything still in
+ *	the transmit ring is sent first.
+ *********************************************************************************
+ */
+
+void serialBufClose (struct serialBuf *sb)
+{
+  uint64_t one = 1 ;
+
+  if (sb == NULL)
+    return ;
+
+  serialBufFlush (sb) ;
+
+  pthread_mutex_lock (&sb->rxLock) ;
+    sb->stop = 1 ;
+    pthread_cond_broadcast (&sb->rxSpace) ;
+    pthread_cond_broadcast (&sb->rxData) ;
+  pthread_mutex_unlock (&sb->rxLock) ;
+
+  if (write (sb->wakeFd, &one, sizeof (one)) < 0)
+    perror ("serialBufClose: eventfd") ;
+
+  pthread_join (sb->rxThread, NULL) ;
+
+  close (sb->epollFd) ;
+  close (sb->wakeFd) ;
+  pthread_cond_destroy  (&sb->rxSpace) ;
+  pthread_cond_destroy  (&sb->rxData) ;
+  pthread_mutex_destroy (&sb->rxLock) ;
+  pthread_mutex_destroy (&sb->txLock) ;
+  free (sb) ;
+}
+
+
+/*
+ * serialBufSetReceiver:
+ *	Have the receive thread call receiver each time data has arrived,
+ *	e.g. to take complete replies out with serialBufGet (.., 0).
+ *********************************************************************************
+ */
+
+void serialBufSetReceiver (struct serialBuf *sb, serialBufReceiver receiver, void *userdata)
+{
+  pthread_mutex_lock (&sb->rxLock) ;
+    sb->userdata = userdata ;
+    sb->receiver = receiver ;
+  pthread_mutex_unlock (&sb->rxLock) ;
+}
+
+
+/*
+ * flushLocked:
+ *	Write out the transmit ring - it can wrap, so that's up to two
+ *	buffers in one writev (). Called with txLock held.
+ *********************************************************************************
+ */
+
+static int flushLocked (struct serialBuf *sb)
+{
+  struct iovec iov [2] ;
+  unsigned int first ;
+  ssize_t len ;
+  int total = 0 ;
+
+  while (sb->txLen > 0)
+  {
+    first = SERIAL_BUF_SIZE - sb->txHead ;
+    if (first > sb->txLen)
+      first = sb->txLen ;
+
+    iov [0].iov_base = &sb->tx [sb->txHead] ;
+    iov [0].iov_len  = first ;
+    iov [1].iov_base = sb->tx ;
+    iov [1].iov_len  = sb->txLen - first ;
+
+    len = writev (sb->fd, iov, (iov [1].iov_len > 0) ? 2 : 1) ;
+    if (len < 0)
+    {
+      if (errno == EINTR)
+        continue ;
+      if (errno == EAGAIN)
+      {
+        usleep (100) ;
+        continue ;
+      }
+      return -1 ;
+    }
+
+    sb->txHead  = (sb->txHead + len) % SERIAL_BUF_SIZE ;
+    sb->txLen  -= len ;
+    total      += len ;
+  }
+
+  sb->txHead = 0 ;
+
+  return total ;
+}
+
+
+/*
+ * serialBufPut:
+ *	Queue data for sending. Nothing is written until serialBufFlush,
+ *	or the transmit ring fills up.
+ *********************************************************************************
+ */
+
+int serialBufPut (struct serialBuf *sb, const void *data, const int len)
+{
+  const uint8_t *p = (const uint8_t *)data ;
+  unsigned int tail, chunk ;
+  int left = len ;
+
+  pthread_mutex_lock (&sb->txLock) ;
+
+  while (left > 0)
+  {
+    if ((sb->txLen == SERIAL_BUF_SIZE) && (flushLocked (sb) < 0))
+    {
+      pthread_mutex_unlock (&sb->txLock) ;
+      return -1 ;
+    }
+
+    tail  = (sb->txHead + sb->txLen) % SERIAL_BUF_SIZE ;
+    chunk = SERIAL_BUF_SIZE - sb->txLen ;
+    if (chunk > (SERIAL_BUF_SIZE - tail))
+      chunk = SERIAL_BUF_SIZE - tail ;
+    if (chunk > (unsigned int)left)
+      chunk = left ;
+
+    memcpy (&sb->tx [tail], p, chunk) ;
+    sb->txLen += chunk ;
+    p         += chunk ;
+    left      -= chunk ;
+  }
+
+  pthread_mutex_unlock (&sb->txLock) ;
+
+  return len ;
+}
+
+
+/*
+ * serialBufFlush:
+ *	Send everything queued with one writev (). Returns the number of
+ *	bytes written, or -1.
+ *********************************************************************************
+ */
+
+int serialBufFlush (struct serialBuf *sb)
+{
+  int ret ;
+
+  pthread_mutex_lock (&sb->txLock) ;
+    ret = flushLocked (sb) ;
+  pthread_mutex_unlock (&sb->txLock) ;
+
+  return ret ;
+}
+
+
+/*
+ * serialBufAvail:
+ *	Number of received bytes waiting in the ring.
+ *********************************************************************************
+ */
+
+int serialBufAvail (struct serialBuf *sb)
+{
+  int len ;
+
+  pthread_mutex_lock (&sb->rxLock) ;
+    len = sb->rxLen ;
+  pthread_mutex_unlock (&sb->rxLock) ;
+
+  return len ;
+}
+
+
+/*
+ * serialBufGet:
+ *	Take up to len received bytes out of the ring. If there are none,
+ *	wait up to timeoutMs for some (0: don't wait, -1: forever).
+ *	Returns the number of bytes, 0 on timeout or -1 if the port failed.
+ *********************************************************************************
+ */
+
+int serialBufGet (struct serialBuf *sb, void *data, const int len, const int timeoutMs)
+{
+  uint8_t *p = (uint8_t *)data ;
+  struct timespec deadline ;
+  unsigned int chunk ;
+  int got = 0 ;
+
+  if (timeoutMs > 0)
+  {
+    clock_gettime (CLOCK_REALTIME, &deadline) ;
+    deadline.tv_sec  += timeoutMs / 1000 ;
+    deadline.tv_nsec += (timeoutMs % 1000) * 1000000L ;
+    if (deadline.tv_nsec >= 1000000000L)
+    {
+      deadline.tv_nsec -= 1000000000L ;
+      ++deadline.tv_sec ;
+    }
+  }
+
+  pthread_mutex_lock (&sb->rxLock) ;
+
+  while ((sb->rxLen == 0) && !sb->error && !sb->stop && (timeoutMs != 0))
+  {
+    if (timeoutMs < 0)
+      pthread_cond_wait (&sb->rxData, &sb->rxLock) ;
+    else if (pthread_cond_timedwait (&sb->rxData, &sb->rxLock, &deadline) != 0)
+      break ;
+  }
+
+  while ((got < len) && (sb->rxLen > 0))
+  {
+    chunk = SERIAL_BUF_SIZE - sb->rxHead ;
+    if (chunk > sb->rxLen)
+      chunk = sb->rxLen ;
+    if (chunk > (unsigned int)(len - got))
+      chunk = len - got ;
+
+    memcpy (p + got, &sb->rx [sb->rxHead], chunk) ;
+    sb->rxHead  = (sb->rxHead + chunk) % SERIAL_BUF_SIZE ;
+    sb->rxLen  -= chunk ;
+    got        += chunk ;
+  }
+
+  if (got > 0)
+    pthread_cond_signal (&sb->rxSpace) ;
+  else if (sb->error)
+    got = -1 ;
+
+  pthread_mutex_unlock (&sb->rxLock) ;
+
+  return got ;
+}
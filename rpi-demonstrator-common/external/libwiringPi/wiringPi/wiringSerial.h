@@ -33,6 +33,20 @@ extern void  serialPrintf    (const int fd, const char *message, ...) ;
 extern int   serialDataAvail (const int fd) ;
 extern int   serialGetchar   (const int fd) ;
 
+// Buffered transport
+
+struct serialBuf ;
+
+typedef void (*serialBufReceiver) (struct serialBuf *sb, void *userdata) ;
+
+extern struct serialBuf *serialBufOpen (const int fd) ;
+extern void  serialBufClose       (struct serialBuf *sb) ;
+extern void  serialBufSetReceiver (struct serialBuf *sb, serialBufReceiver receiver, void *userdata) ;
+extern int   serialBufPut         (struct serialBuf *sb, const void *data, const int len) ;
+extern int   serialBufFlush       (struct serialBuf *sb) ;
+extern int   serialBufAvail       (struct serialBuf *sb) ;
+extern int   serialBufGet         (struct serialBuf *sb, void *data, const int len, const int timeoutMs) ;
+
 #ifdef __cplusplus
 }
 #endif
@@ -81,3 +81,69 @@ void shiftOut (uint8_t dPin, uint8_t cPin, uint8_t order, uint8_t val)
       digitalWrite (cPin, LOW) ;
     }
 }
+
+
+/*
+ * shiftOutParallel:
+ *	Shift one byte into each of several chains which share the clock
+ *	pin but each have their own data pin: vals [n] goes out on dPins [n].
+ *	With on-board pins (native GPIOs 0-31) each clock cycle is two
+ *	masked writes for all the chains together, which also means no
+ *	more than 32 chains.
+ *********************************************************************************
+ */
+
+static int gpioMask (int pin, unsigned int *mask)
+{
+  int gpio ;
+
+  if ((pin & PI_GPIO_MASK) != 0)
+    return FALSE ;
+
+  gpio = wiringPiPinToGpio (pin) ;
+  if ((gpio < 0) || (gpio > 31))
+    return FALSE ;
+
+  *mask = 1u << gpio ;
+  return TRUE ;
+}
+
+void shiftOutParallel (int numChains, const int *dPins, int cPin, uint8_t order, const uint8_t *vals)
+{
+  unsigned int dMasks [32] ;
+  unsigned int cMask, setMask, clrMask ;
+  int8_t i, bit ;
+  int    chain ;
+
+  for (chain = 0 ; (chain < numChains) && (chain < 32) ; ++chain)
+    if (!gpioMask (dPins [chain], &dMasks [chain]))
+      break ;
+
+  if ((chain < numChains) || !gpioMask (cPin, &cMask))
+  {
+    for (chain = 0 ; chain < numChains ; ++chain)	// One after another then
+      shiftOut (dPins [chain], cPin, order, vals [chain]) ;
+    return ;
+  }
+
+// Data lines change with the clock going low, the 595s take them on
+//	the rising edge
+
+  for (i = 0 ; i < 8 ; ++i)
+  {
+    bit = (order == MSBFIRST) ? (7 - i) : i ;
+
+    setMask = 0 ;
+    clrMask = cMask ;
+    for (chain = 0 ; chain < numChains ; ++chain)
+      if (vals [chain] & (1 << bit))
+        setMask |= dMasks [chain] ;
+      else
+        clrMask |= dMasks [chain] ;
+
+    digitalWriteGpioMask (setMask, clrMask) ;
+    digitalWriteGpioMask (cMask, 0) ;
+  }
+
+  digitalWriteGpioMask (0, cMask) ;
+}
@@ -35,6 +35,7 @@ extern "C" {
 
 extern uint8_t shiftIn      (uint8_t dPin, uint8_t cPin, uint8_t order) ;
 extern void    shiftOut     (uint8_t dPin, uint8_t cPin, uint8_t order, uint8_t val) ;
+extern void    shiftOutParallel (int numChains, const int *dPins, int cPin, uint8_t order, const uint8_t *vals) ;
 
 #ifdef __cplusplus
 }